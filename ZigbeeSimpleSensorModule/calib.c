@@ -0,0 +1,59 @@
+/*
+    calib.c - definitions relating to fixed-point conversion of sensor readings (in ADC counts)
+    into engineering units
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+
+    Each conversion is a multiply and a shift, or a table lookup with linear interpolation; there
+    is no floating-point arithmetic and no division.
+*/
+
+#include "calib.h"
+#include "therm_table.h"
+#include <avr/pgmspace.h>
+
+
+// Number of bits in a reading below the thermistor table index
+#define THERM_FRAC_BITS         (SENSOR_READING_BITS - THERM_TABLE_BITS)
+
+
+// calib_vbatt_mv() - convert the battery voltage reading <counts> into millivolts.
+//
+uint16_t calib_vbatt_mv(const uint16_t counts)
+{
+    return ((uint32_t) counts * (CALIB_VREF_MV * CALIB_VBATT_DIV)) >> SENSOR_READING_BITS;
+}
+
+
+// calib_light_lux() - convert the light level reading <counts> into lux.  The light sensor's
+// output is assumed to be proportional to illuminance.
+//
+uint16_t calib_light_lux(const uint16_t counts)
+{
+    return ((uint32_t) counts * CALIB_LIGHT_FULL_SCALE) >> SENSOR_READING_BITS;
+}
+
+
+// calib_temp_centi() - convert the thermistor reading <counts> into a temperature, in units of
+// 0.01 degC, by linear interpolation between the entries in therm_table[] on either side of it.
+//
+int16_t calib_temp_centi(const uint16_t counts)
+{
+    const uint8_t index = counts >> THERM_FRAC_BITS;
+    const uint16_t frac = counts & ((1 << THERM_FRAC_BITS) - 1);
+    const int16_t lo = pgm_read_word(therm_table + index),
+                  hi = pgm_read_word(therm_table + index + 1);
+
+    return lo + (((int32_t) (hi - lo) * frac) >> THERM_FRAC_BITS);
+}
+
+
+// calib_convert() - convert the set of readings in <readings> into engineering units, and write
+// the results to <values>.
+//
+void calib_convert(const SensorReadings_t * const readings, SensorValues_t * const values)
+{
+    values->vbatt = calib_vbatt_mv(readings->vbatt);
+    values->light = calib_light_lux(readings->light);
+    values->temp = calib_temp_centi(readings->temp);
+}
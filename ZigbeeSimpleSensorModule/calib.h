@@ -0,0 +1,33 @@
+#ifndef CALIB_H_INC
+#define CALIB_H_INC
+/*
+    calib.h - declarations relating to fixed-point conversion of sensor readings (in ADC counts)
+    into engineering units
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include <stdint.h>
+#include "sensors.h"
+
+
+// Calibration constants.  These must match the components fitted to the board, and may be
+// overridden from the build settings.  The thermistor curve is held in therm_table.h, which is
+// generated by tools/gen_therm_table.py.
+#ifndef CALIB_VREF_MV
+#define CALIB_VREF_MV           (2500)  // ADC reference voltage, in mV
+#endif
+#ifndef CALIB_VBATT_DIV
+#define CALIB_VBATT_DIV         (2)     // Battery voltage divider ratio, i.e. Vbatt / Vadc
+#endif
+#ifndef CALIB_LIGHT_FULL_SCALE
+#define CALIB_LIGHT_FULL_SCALE  (2000)  // Light level at a full-scale ADC reading, in lux
+#endif
+
+
+uint16_t calib_vbatt_mv(const uint16_t counts);
+uint16_t calib_light_lux(const uint16_t counts);
+int16_t calib_temp_centi(const uint16_t counts);
+void calib_convert(const SensorReadings_t * const readings, SensorValues_t * const values);
+
+#endif
@@ -0,0 +1,203 @@
+/*
+    config.c - definitions relating to runtime configuration of the sampling and reporting
+    parameters, which may be changed over the air and are persisted in EEPROM
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "config.h"
+#include "lib/debug.h"
+#include "sched.h"
+#include "sensors.h"
+#include "xbee/xbee.h"
+#include <avr/eeprom.h>
+#include <stddef.h>
+#include <util/crc16.h>
+
+#define DEBUG_LOG_FILE_ID       (4)     // Identifies debug log records from this file
+
+
+// ConfigRecord_t - configuration record, as saved in EEPROM
+//
+typedef struct ConfigRecord
+{
+    uint8_t         version;                // CONFIG_RECORD_VERSION
+    uint8_t         reading_bits;           // SENSOR_READING_BITS, which scales the deadbands
+    SchedConfig_t   sched;                  // Scheduler configuration
+    uint8_t         filter_shift[SensorChannel_end];    // Sensor filter window length shifts
+    uint8_t         crc;                    // CRC-8 of the preceding fields
+} ConfigRecord_t;
+
+static ConfigRecord_t EEMEM ee_config;
+
+
+// config_crc() - return the CRC-8 of the fields which precede the <crc> field in <rec>.
+//
+static uint8_t config_crc(const ConfigRecord_t * const rec)
+{
+    const uint8_t *p = (const uint8_t *) rec;
+    uint8_t i, crc = 0;
+
+    for(i = 0; i < offsetof(ConfigRecord_t, crc); ++i)
+        crc = _crc8_ccitt_update(crc, *p++);
+
+    return crc;
+}
+
+
+// config_apply() - validate the scheduler configuration <sched> and the sensor filter window
+// length shifts <filter_shift>; if all are valid, put them into effect.  Returns non-zero on
+// success.  Nothing is changed on failure.
+//
+static uint8_t config_apply(const SchedConfig_t * const sched, const uint8_t * const filter_shift)
+{
+    uint8_t ch;
+
+    if(!sched_config_valid(sched))
+        return 0;
+
+    for(ch = 0; ch < SensorChannel_end; ++ch)
+        if(!sensor_filter_shift_valid(ch, filter_shift[ch]))
+            return 0;
+
+    for(ch = 0; ch < SensorChannel_end; ++ch)
+        sensor_set_filter_shift(ch, filter_shift[ch]);
+
+    sched_set_config(sched);
+    return 1;
+}
+
+
+// config_save() - save the current configuration in EEPROM.  Only bytes which have changed are
+// written.
+//
+static void config_save()
+{
+    ConfigRecord_t rec;
+    uint8_t ch;
+
+    rec.version = CONFIG_RECORD_VERSION;
+    rec.reading_bits = SENSOR_READING_BITS;
+    rec.sched = *sched_get_config();
+    for(ch = 0; ch < SensorChannel_end; ++ch)
+        rec.filter_shift[ch] = sensor_get_filter_shift(ch);
+    rec.crc = config_crc(&rec);
+
+    eeprom_update_block(&rec, &ee_config, sizeof(rec));
+}
+
+
+// config_parse() - apply the <len> bytes of parameter settings at <p> (see config.h) to the
+// scheduler configuration <sched> and the sensor filter window length shifts <filter_shift>.
+// Returns zero if a setting is truncated, or carries an unrecognised parameter ID or an
+// out-of-range value.
+//
+static uint8_t config_parse(const uint8_t *p, uint8_t len, SchedConfig_t * const sched,
+                            uint8_t * const filter_shift)
+{
+    for(; len >= CONFIG_CMD_SETTING_LEN; p += CONFIG_CMD_SETTING_LEN, len -= CONFIG_CMD_SETTING_LEN)
+    {
+        const uint16_t val = p[1] | (p[2] << 8);
+
+        switch((ConfigParam_t) p[0])
+        {
+            case ConfigParamDeadbandVBatt:
+                sched->deadband.vbatt = val;
+                break;
+
+            case ConfigParamDeadbandLight:
+                sched->deadband.light = val;
+                break;
+
+            case ConfigParamDeadbandTemp:
+                sched->deadband.temp = val;
+                break;
+
+            case ConfigParamMinInterval:
+                sched->min_interval = val;
+                break;
+
+            case ConfigParamHeartbeat:
+                sched->heartbeat = val;
+                break;
+
+            case ConfigParamStableWakes:
+                if(val > 0xff)
+                    return 0;
+                sched->stable_wakes = val;
+                break;
+
+            case ConfigParamMaxPeriodShift:
+                if(val > 0xff)
+                    return 0;
+                sched->max_period_shift = val;
+                break;
+
+            case ConfigParamFilterShiftVBatt:
+            case ConfigParamFilterShiftLight:
+            case ConfigParamFilterShiftTemp:
+                if(val > 0xff)
+                    return 0;
+                filter_shift[p[0] - ConfigParamFilterShiftVBatt] = val;
+                break;
+
+            default:
+                return 0;                   // Unrecognised parameter
+        }
+    }
+
+    return !len;
+}
+
+
+// config_handle_rx_packet() - handler for Zigbee receive-packet frames.  If the frame was sent by
+// the network coordinator and carries a configuration command, the command is applied and the new
+// configuration is saved.  Other frames are ignored.
+//
+static void config_handle_rx_packet(const XBeePacketBuf_t * const pkt)
+{
+    const XBeeRXPacketView_t * const rx = xbee_view_rx_packet(pkt);
+    uint8_t filter_shift[SensorChannel_end];
+    SchedConfig_t sched;
+    uint8_t len, ch;
+
+    if(!rx || (xbee_get_u64_be(rx->src_addr) != XBEE_ADDR_COORDINATOR))
+        return;
+
+    len = xbee_view_data_len(pkt, XBeeRXPacketView_t);
+    if(!len || (rx->data[0] != CONFIG_CMD_MARKER))
+        return;
+
+    sched = *sched_get_config();
+    for(ch = 0; ch < SensorChannel_end; ++ch)
+        filter_shift[ch] = sensor_get_filter_shift(ch);
+
+    if(!config_parse(rx->data + 1, len - 1, &sched, filter_shift) ||
+       !config_apply(&sched, filter_shift))
+    {
+        debug_log("E: config cmd rejected\n");
+        return;
+    }
+
+    config_save();
+    debug_log("I: config updated\n");
+}
+
+
+// config_init() - restore the configuration saved in EEPROM, if it is present and valid, and
+// register the handler which receives configuration commands.  Must be called after xbee_init().
+//
+void config_init()
+{
+    ConfigRecord_t rec;
+
+    eeprom_read_block(&rec, &ee_config, sizeof(rec));
+
+    // A record saved by firmware built with a different oversampling ratio holds deadbands of the
+    // wrong scale, and is ignored
+    if((rec.version == CONFIG_RECORD_VERSION) && (rec.reading_bits == SENSOR_READING_BITS) &&
+       (rec.crc == config_crc(&rec)) && config_apply(&rec.sched, rec.filter_shift))
+        debug_log("I: config restored\n");
+
+    xbee_set_rx_handler(XBeeFrameZigbeeReceivePacket, config_handle_rx_packet);
+}
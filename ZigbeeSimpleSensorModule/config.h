@@ -0,0 +1,51 @@
+#ifndef CONFIG_H_INC
+#define CONFIG_H_INC
+/*
+    config.h - declarations relating to runtime configuration of the sampling and reporting
+    parameters, which may be changed over the air and are persisted in EEPROM
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+
+    Configuration command format, carried in the data field of a Zigbee receive-packet frame sent
+    by the network coordinator.  Multi-byte values are little-endian.
+
+        offset  size    field
+        0       1       command marker, CONFIG_CMD_MARKER
+        1       3 * N   parameter settings, each comprising:
+                            1   parameter ID (a value from ConfigParam_t)
+                            2   parameter value
+
+    A command is applied only if every parameter ID in it is recognised and the resulting
+    configuration is valid.  The new configuration is then saved in EEPROM, and restored at boot.
+    Commands are buffered by the node's parent while the XBee sleeps, and are therefore received
+    only when the node wakes to transmit a report.
+*/
+
+#include <stdint.h>
+
+
+#define CONFIG_CMD_MARKER       (0xc1)  // First byte of a configuration command
+#define CONFIG_CMD_SETTING_LEN  (3)     // Length of one parameter setting in a command, in bytes
+#define CONFIG_RECORD_VERSION   (3)     // Version number of the configuration record in EEPROM
+
+
+// ConfigParam_t - IDs of the parameters which may be set by a configuration command
+//
+typedef enum ConfigParam
+{
+    ConfigParamDeadbandVBatt    = 0x01,     // } Deadbands, in reading counts - i.e. ADC counts
+    ConfigParamDeadbandLight    = 0x02,     // } at SENSOR_READING_BITS resolution.  The
+    ConfigParamDeadbandTemp     = 0x03,     // } coordinator must scale them to match.
+    ConfigParamMinInterval      = 0x04,     // Minimum time between reports, in seconds
+    ConfigParamHeartbeat        = 0x05,     // Maximum time between reports, in seconds
+    ConfigParamStableWakes      = 0x06,     // Stable wakes before the wake period is doubled
+    ConfigParamMaxPeriodShift   = 0x07,     // Longest wake period = 8s << this value
+    ConfigParamFilterShiftVBatt = 0x08,     // } Sensor EMA time constant = 1 << this value, for
+    ConfigParamFilterShiftLight = 0x09,     // } each channel.  Only EMA filters' windows may be
+    ConfigParamFilterShiftTemp  = 0x0a      // } changed.
+} ConfigParam_t;
+
+
+void config_init();
+
+#endif
@@ -5,6 +5,36 @@
 */
 
 #include "adc.h"
+#include "wait.h"
+#include <avr/interrupt.h>
+#include <stddef.h>
+
+
+// State of the interrupt-driven channel scan
+static volatile struct ADCScan
+{
+    const ADCChannel_t *channels;   // Channels to convert, in order
+    uint16_t *results;              // Destination for the results
+    uint8_t count;                  // Number of channels to convert
+    uint8_t index;                  // Index of the channel currently being converted
+    uint8_t busy;                   // Non-zero while a scan is in progress
+} adc_scan;
+
+static uint32_t adc_clk_freq_max;   // Max ADC clock frequency, or 0 if the prescaler is fixed
+
+
+static void adc_scan_service();
+static uint8_t adc_scan_pending(void * const arg);
+static void adc_scan_poll();
+static void adc_update_prescaler();
+
+
+// ISR(ADC0_RESRDY_vect) - ISR which handles result-ready interrupts while a scan is in progress.
+//
+ISR(ADC0_RESRDY_vect)
+{
+    adc_scan_service();
+}
 
 
 // adc_set_vref() - specify the source of the voltage reference for the ADC module.  Also specify
@@ -32,6 +62,50 @@ void adc_set_prescaler(const ADCPrescaleDiv_t div)
 }
 
 
+// adc_set_clk_freq_max() - set the ADC clock prescaler to the smallest division ratio which gives
+// an ADC clock frequency no greater than <freq> Hz, and maintain this relationship whenever the
+// peripheral clock frequency changes (see adc_clk_changed()).  Conversion timings expressed in
+// ADC clock cycles (e.g. the init delay) therefore remain approximately constant in real time.
+//
+void adc_set_clk_freq_max(const uint32_t freq)
+{
+    adc_clk_freq_max = freq;
+    adc_update_prescaler();
+}
+
+
+// adc_clk_changed() - clock governor hook which waits for any scan in progress to complete before
+// the peripheral clock frequency changes, and re-derives the ADC clock prescaler afterwards.
+//
+void adc_clk_changed(const ClkGovEvent_t event)
+{
+    if(event == ClkGovEventPreChange)
+        adc_scan_wait();
+    else
+        adc_update_prescaler();
+}
+
+
+// adc_update_prescaler() - if a maximum ADC clock frequency has been set, select the smallest
+// prescaler division ratio which satisfies it at the current peripheral clock frequency.
+//
+static void adc_update_prescaler()
+{
+    const uint32_t pclk_freq = pclk_get_freq();
+    uint8_t i;
+
+    if(!adc_clk_freq_max || !pclk_freq)
+        return;
+
+    // The ADCPrescaleDiv_t values are consecutive, starting at ADCPrescaleDiv2
+    for(i = 0; (i < ADCPrescaleDiv256 - ADCPrescaleDiv2) &&
+               ((pclk_freq >> (i + 1)) > adc_clk_freq_max); ++i)
+        ;
+
+    adc_set_prescaler(ADCPrescaleDiv2 + i);
+}
+
+
 // adc_set_initdelay() - set the delay, expressed as a number of ADC clock cycles, following ADC
 // startup (or reference change) before the first conversion can occur.
 //
@@ -41,6 +115,16 @@ void adc_set_initdelay(const ADCInitDelay_t delay)
 }
 
 
+// adc_set_accumulation() - set the number of conversions which the ADC accumulates into each
+// result.  The result register holds the sum of the conversions; with a 10-bit ADC, the sum of up
+// to 64 conversions fits in 16 bits.
+//
+void adc_set_accumulation(const ADCSampleNum_t num)
+{
+    ADC0_CTRLB = (ADC0_CTRLB & ~ADC_SAMPNUM_gm) | num;
+}
+
+
 // adc_configure_input() - prepare the specified pin to act as an ADC input by disabling its
 // digital input buffer and making it an input.
 //
@@ -95,6 +179,22 @@ uint16_t adc_convert_channel(const ADCChannel_t channel)
 }
 
 
+// adc_convert_channel_accumulated() - connect the channel specified by <channel> to the ADC
+// input, and perform <num> back-to-back conversions, accumulated in hardware.  Return the sum of
+// the conversions.  Accumulation is switched off again before returning.
+//
+uint16_t adc_convert_channel_accumulated(const ADCChannel_t channel, const ADCSampleNum_t num)
+{
+    uint16_t ret;
+
+    adc_set_accumulation(num);
+    ret = adc_convert_channel(channel);
+    adc_set_accumulation(ADCSampleNum1);
+
+    return ret;
+}
+
+
 // adc_channel_from_gpio() - given GPIO pin <pin>, return the ADC channel associated with the pin.
 // If the pin does not represent an ADC channel, return ADCChannelGND.
 //
@@ -121,3 +221,104 @@ ADCChannel_t adc_channel_from_gpio(const GPIOPin_t pin)
 
     return ADCChannelGND;       // <pin> does not specify an ADC input pin
 }
+
+
+// adc_connect_event() - route the event generator <generator> to the ADC's event input, via
+// asynchronous event channel 0.  Used in conjunction with a scan started with ADCTriggerEvent.
+//
+void adc_connect_event(const ADCEventGen_t generator)
+{
+    EVSYS_ASYNCCH0 = generator;
+    EVSYS_ASYNCUSER1 = EVSYS_ASYNCUSER1_ASYNCCH0_gc;    // ASYNCUSER1 is the ADC0 event input
+}
+
+
+// adc_scan_service() - store the result of the conversion just completed, and start the next one.
+// Once every channel has been converted, the scan is complete: the result-ready interrupt is
+// disabled and the scan engine goes idle.  Called from the ADC ISR, or directly by adc_scan_wait()
+// when the ISR cannot run.
+//
+static void adc_scan_service()
+{
+    adc_scan.results[adc_scan.index] = ADC0_RES;        // Reading RES clears the RESRDY flag
+    ADC0_EVCTRL &= ~ADC_STARTEI_bm;                     // Later conversions are started here
+
+    if(++adc_scan.index < adc_scan.count)
+    {
+        adc_set_channel(adc_scan.channels[adc_scan.index]);
+        ADC0_COMMAND |= ADC_STCONV_bm;
+    }
+    else
+    {
+        ADC0_INTCTRL &= ~ADC_RESRDY_bm;
+        adc_scan.busy = 0;
+    }
+}
+
+
+// adc_scan_start() - start an interrupt-driven scan which converts each of the <count> channels in
+// <channels[]>, in order, writing the results to the corresponding elements of <results[]>.  Each
+// conversion is started from the ADC ISR as soon as the previous one completes.  If <trigger> is
+// ADCTriggerEvent, the first conversion is started by an event at the ADC's event input (see
+// adc_connect_event()); otherwise it is started immediately.  Any accumulation configured using
+// adc_set_accumulation() applies to every conversion.  The ADC must be enabled.  The function
+// returns immediately; use adc_scan_busy() or adc_scan_wait() to detect completion.
+//
+void adc_scan_start(const ADCChannel_t * const channels, uint16_t * const results,
+                    const uint8_t count, const ADCTrigger_t trigger)
+{
+    if(!count)
+        return;
+
+    adc_scan.channels = channels;
+    adc_scan.results = results;
+    adc_scan.count = count;
+    adc_scan.index = 0;
+    adc_scan.busy = 1;
+
+    adc_set_channel(channels[0]);
+    ADC0_INTFLAGS = ADC_RESRDY_bm;                      // Discard any stale result
+    ADC0_INTCTRL |= ADC_RESRDY_bm;
+
+    if(trigger == ADCTriggerEvent)
+        ADC0_EVCTRL |= ADC_STARTEI_bm;                  // First conversion starts on an event
+    else
+        ADC0_COMMAND |= ADC_STCONV_bm;
+}
+
+
+// adc_scan_busy() - return non-zero if a scan is in progress.
+//
+uint8_t adc_scan_busy()
+{
+    return adc_scan.busy;
+}
+
+
+// adc_scan_wait() - wait for the current scan to complete.  If interrupts are enabled, the core
+// sleeps in idle mode between ADC interrupts.  If the caller has disabled interrupts, or is itself
+// running in an ISR (in which case the ADC interrupt cannot preempt it), the scan is instead
+// serviced by polling the result-ready flag.  The sleep mode in force on entry is restored before
+// returning.
+//
+void adc_scan_wait()
+{
+    wait_idle(adc_scan_pending, NULL, adc_scan_poll);
+}
+
+
+// adc_scan_pending() - wait_idle() callback which returns non-zero while a scan is in progress.
+//
+static uint8_t adc_scan_pending(void * const arg)
+{
+    return adc_scan.busy;
+}
+
+
+// adc_scan_poll() - wait_idle() callback which services the scan if a result is ready.
+//
+static void adc_scan_poll()
+{
+    if(ADC0_INTFLAGS & ADC_RESRDY_bm)
+        adc_scan_service();
+}
@@ -8,6 +8,7 @@
 
 #include <stdint.h>
 #include <avr/io.h>
+#include "clk.h"
 #include "gpio.h"
 
 
@@ -50,6 +51,21 @@ typedef enum ADCInitDelay
 } ADCInitDelay_t;
 
 
+// ADCSampleNum_t - enumeration of possible numbers of conversions accumulated, in hardware, into a
+// single result.
+//
+typedef enum ADCSampleNum
+{
+    ADCSampleNum1       = ADC_SAMPNUM_ACC1_gc,      // 1 result (no accumulation)
+    ADCSampleNum2       = ADC_SAMPNUM_ACC2_gc,      // 2 results accumulated
+    ADCSampleNum4       = ADC_SAMPNUM_ACC4_gc,      // 4 results accumulated
+    ADCSampleNum8       = ADC_SAMPNUM_ACC8_gc,      // 8 results accumulated
+    ADCSampleNum16      = ADC_SAMPNUM_ACC16_gc,     // 16 results accumulated
+    ADCSampleNum32      = ADC_SAMPNUM_ACC32_gc,     // 32 results accumulated
+    ADCSampleNum64      = ADC_SAMPNUM_ACC64_gc      // 64 results accumulated
+} ADCSampleNum_t;
+
+
 // ADCChannel_t- enumeration of possible ADC input channel values.
 //
 typedef enum ADCChannel
@@ -73,14 +89,42 @@ typedef enum ADCChannel
 } ADCChannel_t;
 
 
+// ADCTrigger_t - enumeration of ways in which the first conversion of a scan may be started.
+//
+typedef enum ADCTrigger
+{
+    ADCTriggerSoftware  = 0,        // Start the scan immediately
+    ADCTriggerEvent     = 1         // Start the scan on an event at the ADC's event input
+} ADCTrigger_t;
+
+
+// ADCEventGen_t - enumeration of event generators which may be routed to the ADC's event input, via
+// asynchronous event channel 0, to start a conversion.
+//
+typedef enum ADCEventGen
+{
+    ADCEventRTCOverflow = EVSYS_ASYNCCH0_RTC_OVF_gc,    // RTC counter overflow
+    ADCEventRTCCompare  = EVSYS_ASYNCCH0_RTC_CMP_gc     // RTC counter compare match
+} ADCEventGen_t;
+
+
 void adc_set_vref(const ADCRef_t ref, const uint8_t reduce_sample_cap);
 void adc_set_prescaler(const ADCPrescaleDiv_t div);
+void adc_set_clk_freq_max(const uint32_t freq);
+void adc_clk_changed(const ClkGovEvent_t event);
 void adc_set_initdelay(const ADCInitDelay_t delay);
+void adc_set_accumulation(const ADCSampleNum_t num);
 void adc_enable(const uint8_t enable);
 void adc_set_channel(const ADCChannel_t channel);
 uint16_t adc_convert();
 uint16_t adc_convert_channel(const ADCChannel_t channel);
+uint16_t adc_convert_channel_accumulated(const ADCChannel_t channel, const ADCSampleNum_t num);
 void adc_configure_input(const GPIOPin_t pin);
+void adc_connect_event(const ADCEventGen_t generator);
+void adc_scan_start(const ADCChannel_t * const channels, uint16_t * const results,
+                    const uint8_t count, const ADCTrigger_t trigger);
+uint8_t adc_scan_busy();
+void adc_scan_wait();
 ADCChannel_t adc_channel_from_gpio(const GPIOPin_t pin);
 
 #endif
@@ -5,9 +5,22 @@
  */
 
 #include "clk.h"
+#include <avr/interrupt.h>
 #include <avr/pgmspace.h>
 
 
+#define CLK_SAFE_FREQ_ANY_VDD       (5000000UL)     // Max frequency which is safe at any voltage
+
+
+// ClkSafeFreq_t - an entry in the table of safe operating frequencies
+//
+typedef struct ClkSafeFreq
+{
+    uint16_t    vdd_mv_min;     // Minimum supply voltage, in mV
+    uint32_t    freq_max;       // Max CPU/peripheral clock frequency at that voltage, in Hz
+} ClkSafeFreq_t;
+
+
 // Map of peripheral clock (PCLK) divisor values, as stored in bits 1:4 of MCLKCTRLB, to actual
 // divisor values.
 static const uint8_t pclk_divisor_to_uint_map[16] PROGMEM =
@@ -16,6 +29,29 @@ static const uint8_t pclk_divisor_to_uint_map[16] PROGMEM =
     6, 10, 12, 24, 48, PCLK_DIVISOR_RESERVED, PCLK_DIVISOR_RESERVED, PCLK_DIVISOR_RESERVED
 };
 
+// Supported PCLK divisor values, in increasing order
+static const uint8_t pclk_divisors[] PROGMEM = {2, 4, 6, 8, 10, 12, 16, 24, 32, 48, 64};
+
+// Max frequency at which the uC may safely run at a given supply voltage (see the "speed grades"
+// in the datasheet), in decreasing order of voltage.  The supply is taken directly from the
+// battery.  The final entry applies to any voltage, including an unknown one.
+static const ClkSafeFreq_t clk_safe_freq[] PROGMEM =
+{
+    {4500, 20000000UL},
+    {2700, 10000000UL},
+    {0,     CLK_SAFE_FREQ_ANY_VDD}
+};
+
+// State of the clock governor
+static ClkGovHook_t clk_gov_hooks[CLK_GOV_HOOKS_MAX];
+static ClkSpeed_t clk_gov_speed = ClkSpeedFast;     // Requested speed
+static uint32_t clk_gov_freq_cap = CLK_SAFE_FREQ_ANY_VDD;  // Max safe freq at the battery voltage
+static uint32_t clk_gov_freq_floor;                 // Min frequency needed by the peripherals
+
+
+static uint8_t clk_gov_select_divisor();
+static void clk_gov_apply();
+
 
 // clk_get_freq() - get the frequency of the uC main clock, i.e. the input to the master prescaler.
 // Returns the value in Hz as a uint32_t, or 0 if the frequency cannot be determined.
@@ -96,6 +132,7 @@ uint8_t pclk_set_divisor_val(const uint8_t val)
         case 16:    divisor = CLKCTRL_PDIV_16X_gc;      break;
         case 24:    divisor = CLKCTRL_PDIV_24X_gc;      break;
         case 32:    divisor = CLKCTRL_PDIV_32X_gc;      break;
+        case 48:    divisor = CLKCTRL_PDIV_48X_gc;      break;
         case 64:    divisor = CLKCTRL_PDIV_64X_gc;      break;
         default:    divisor = PCLK_DIVISOR_RESERVED;    break;
     }
@@ -128,3 +165,136 @@ uint32_t pclk_get_freq()
 
     return (divisor_val == PCLK_DIVISOR_RESERVED) ? 0 : clk_get_freq() / divisor_val;
 }
+
+
+// clk_gov_add_hook() - register <hook> to be called before and after each change made by the
+// clock governor to the peripheral clock frequency.  Returns non-zero on success, or zero if the
+// hook table is full.
+//
+uint8_t clk_gov_add_hook(const ClkGovHook_t hook)
+{
+    uint8_t i;
+
+    for(i = 0; i < CLK_GOV_HOOKS_MAX; ++i)
+    {
+        if(!clk_gov_hooks[i])
+        {
+            clk_gov_hooks[i] = hook;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+// clk_gov_set_speed() - switch the peripheral clock (which also clocks the CPU) to the frequency
+// appropriate to <speed>.  Must not be called from an ISR.
+//
+void clk_gov_set_speed(const ClkSpeed_t speed)
+{
+    clk_gov_speed = speed;
+    clk_gov_apply();
+}
+
+
+// clk_gov_set_vbatt() - inform the clock governor that the battery voltage is <vbatt_mv> mV (or
+// CLK_GOV_VBATT_UNKNOWN), and so set the maximum safe frequency.  Until this is called, the
+// frequency is limited to that which is safe at any voltage.  If the current frequency is unsafe
+// at this voltage, it is reduced immediately.  The maximum is raised only once the voltage exceeds
+// the minimum of a faster speed grade by CLK_GOV_VBATT_HYST_MV, so that a voltage hovering near a
+// threshold does not switch the clock on every wake.  Must not be called from an ISR.
+//
+void clk_gov_set_vbatt(const uint16_t vbatt_mv)
+{
+    const ClkSafeFreq_t *entry = clk_safe_freq;
+    uint32_t freq_max;
+
+    while(vbatt_mv < pgm_read_word(&entry->vdd_mv_min))
+        ++entry;
+
+    // The last entry is never faster than the current maximum, so this loop terminates
+    while((pgm_read_dword(&entry->freq_max) > clk_gov_freq_cap) &&
+          (vbatt_mv < pgm_read_word(&entry->vdd_mv_min) + CLK_GOV_VBATT_HYST_MV))
+        ++entry;
+
+    freq_max = pgm_read_dword(&entry->freq_max);
+    if(freq_max == clk_gov_freq_cap)
+        return;                             // Nothing to do; the usual case
+
+    clk_gov_freq_cap = freq_max;
+    clk_gov_apply();
+}
+
+
+// clk_gov_set_freq_floor() - set the minimum peripheral clock frequency needed by the enabled
+// peripherals (e.g. to reach a particular baud rate), in Hz.  The floor is not honoured if doing
+// so would exceed the safe frequency for the battery voltage.
+//
+void clk_gov_set_freq_floor(const uint32_t freq)
+{
+    clk_gov_freq_floor = freq;
+    clk_gov_apply();
+}
+
+
+// clk_gov_select_divisor() - return the peripheral clock divisor which best satisfies the
+// governor's constraints.  The frequency never exceeds the safe frequency for the battery voltage;
+// within that limit, the fastest frequency which does not exceed the target for the requested
+// speed is chosen, unless it is below the floor, in which case the slowest frequency which meets
+// the floor is chosen.  Returns zero if the main clock frequency is unknown.
+//
+static uint8_t clk_gov_select_divisor()
+{
+    const uint32_t clk_freq = clk_get_freq();
+    const uint32_t target = (clk_gov_speed == ClkSpeedFast) ? clk_gov_freq_cap : CLK_GOV_SLOW_FREQ;
+    uint8_t i, best = 0;
+
+    if(!clk_freq)
+        return 0;
+
+    for(i = 0; i < sizeof(pclk_divisors); ++i)
+    {
+        const uint8_t div = pgm_read_byte(pclk_divisors + i);
+        const uint32_t freq = clk_freq / div;
+
+        if(freq > clk_gov_freq_cap)
+            continue;                       // Unsafe at this voltage
+
+        if(best && (freq < clk_gov_freq_floor))
+            break;                          // Too slow for the peripherals in use
+
+        best = div;
+        if(freq <= target)
+            break;
+    }
+
+    // If even the largest divisor gives an unsafe frequency (which requires a very fast main
+    // clock), use it anyway
+    return best ? best : pgm_read_byte(pclk_divisors + sizeof(pclk_divisors) - 1);
+}
+
+
+// clk_gov_apply() - if the peripheral clock divisor chosen by clk_gov_select_divisor() differs
+// from the current one, call each hook with ClkGovEventPreChange, change the divisor, then call
+// each hook with ClkGovEventPostChange.
+//
+static void clk_gov_apply()
+{
+    const uint8_t div = clk_gov_select_divisor();
+    uint8_t i, sreg;
+
+    if(!div || (div == pclk_get_divisor_val()))
+        return;
+
+    for(i = 0; (i < CLK_GOV_HOOKS_MAX) && clk_gov_hooks[i]; ++i)
+        clk_gov_hooks[i](ClkGovEventPreChange);
+
+    sreg = SREG;
+    cli();
+    pclk_set_divisor_val(div);
+    SREG = sreg;
+
+    for(i = 0; (i < CLK_GOV_HOOKS_MAX) && clk_gov_hooks[i]; ++i)
+        clk_gov_hooks[i](ClkGovEventPostChange);
+}
@@ -12,6 +12,36 @@
 
 #define PCLK_DIVISOR_RESERVED       ((CLKCTRL_PDIV_t) 0xff)
 
+#define CLK_GOV_HOOKS_MAX           (6)             // Max number of registered clock-change hooks
+#define CLK_GOV_SLOW_FREQ           (1000000UL)     // Target PCLK frequency in ClkSpeedSlow, in Hz
+#define CLK_GOV_VBATT_UNKNOWN       (0)             // Battery voltage value meaning "not measured"
+#define CLK_GOV_VBATT_HYST_MV       (100)           // Hysteresis of speed-grade increases, in mV
+
+
+// ClkSpeed_t - speeds which may be requested from the clock governor
+//
+typedef enum ClkSpeed
+{
+    ClkSpeedSlow,               // Waiting, sampling: run at (or near) CLK_GOV_SLOW_FREQ
+    ClkSpeedFast                // SPI bursts, computation: run as fast as is safe
+} ClkSpeed_t;
+
+
+// ClkGovEvent_t - events passed to clock-change hooks
+//
+typedef enum ClkGovEvent
+{
+    ClkGovEventPreChange,       // PCLK is about to change: complete or suspend peripheral activity
+    ClkGovEventPostChange       // PCLK has changed: re-derive clock-dependent settings
+} ClkGovEvent_t;
+
+
+// ClkGovHook_t - function called by the clock governor before and after each change to the
+// peripheral clock frequency.
+//
+typedef void (*ClkGovHook_t)(const ClkGovEvent_t event);
+
+
 #define pclk_is_enabled()           (CLKCTRL_MCLKCTRLB & CLKCTRL_PEN_bm)
 
 uint32_t clk_get_freq();
@@ -21,5 +51,9 @@ uint8_t pclk_get_divisor_val();
 void pclk_enable();
 void pclk_disable();
 uint32_t pclk_get_freq();
+uint8_t clk_gov_add_hook(const ClkGovHook_t hook);
+void clk_gov_set_speed(const ClkSpeed_t speed);
+void clk_gov_set_vbatt(const uint16_t vbatt_mv);
+void clk_gov_set_freq_floor(const uint32_t freq);
 
 #endif
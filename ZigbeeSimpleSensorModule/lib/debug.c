@@ -6,14 +6,21 @@
 
 #include "debug.h"
 
-#ifdef DEBUG
+#ifdef DEBUG_LOG
 
+#include <avr/interrupt.h>
 #include <stdarg.h>
-#include <stdio.h>
 #include "types.h"
 
+#if (DEBUG_BAUD_RATE * BAUDREG_VAL_MIN) / 4 > CLK_GOV_SLOW_FREQ
+#error "DEBUG_BAUD_RATE is too high for USART0 to run at CLK_GOV_SLOW_FREQ"
+#endif
+
+
+static uint8_t *log_put_u16(uint8_t *p, const uint16_t val);
+
 
-static char debug_buf[DEBUG_BUF_LEN];
+static uint8_t log_dropped;                 // Number of records discarded (saturating)
 
 
 // debug_init() - initialise debugging via USART0.
@@ -24,26 +31,65 @@ void debug_init()
     usart0_configure_io(PinsetDefault);
     usart0_set_baud_rate(DEBUG_BAUD_RATE);
     usart0_enable(USART_ENABLE_RX | USART_ENABLE_TX);
+    clk_gov_add_hook(usart0_clk_changed);           // Keep the baud rate correct as PCLK changes
+    clk_gov_set_freq_floor(USART_PCLK_FREQ_MIN(DEBUG_BAUD_RATE));
     usart0_puts_p(PSTR("\n\nDebug mode\n"));
     usart0_flush_tx();
 }
 
 
-// debug_printf() - a variant of printf() that writes to the debug channel (usually USART0).  Note
-// that the length of the temporary buffer used by this function is specified by DEBUG_BUF_LEN, and
-// is likely to be quite small.
+// log_put_u16() - write the 16-bit value <val> to <p>, LSB first.  Returns a pointer to the byte
+// following the value.
+//
+static uint8_t *log_put_u16(uint8_t *p, const uint16_t val)
+{
+    *p++ = val & 0xff;
+    *p++ = val >> 8;
+
+    return p;
+}
+
+
+// debug_log_record() - append to the USART0 transmit buffer a log record with ID <id>, holding the
+// <nargs> 16-bit values which follow.  Normally called through the debug_log() macro.  The record
+// is transmitted under interrupt control; the function does not wait.  If the record does not fit
+// in the buffer, it is discarded and counted; a DEBUG_LOG_ID_DROPPED record giving the count is
+// logged ahead of the next record for which there is room.
 //
-void debug_printf(char *fmt, ...)
+void debug_log_record(const uint16_t id, const uint8_t nargs, ...)
 {
+    uint8_t rec[DEBUG_LOG_RECORD_LEN(DEBUG_LOG_ARGS_MAX)], *p = rec;
+    const uint8_t sreg = SREG;
     va_list ap;
-    va_start(ap, fmt);
+    uint8_t i;
 
-    vsnprintf(debug_buf, DEBUG_BUF_LEN, fmt, ap);
-    debug_putstr(debug_buf);
+    *p++ = DEBUG_LOG_MARKER | nargs;
+    p = log_put_u16(p, id);
 
+    va_start(ap, nargs);
+    for(i = 0; i < nargs; ++i)
+        p = log_put_u16(p, va_arg(ap, unsigned int));
     va_end(ap);
+
+    cli();
+    if(log_dropped)
+    {
+        uint8_t dropped[DEBUG_LOG_RECORD_LEN(1)] = {DEBUG_LOG_MARKER | 1};
+
+        log_put_u16(log_put_u16(dropped + 1, DEBUG_LOG_ID_DROPPED), log_dropped);
+        if(usart0_write(dropped, sizeof(dropped)))
+            log_dropped = 0;
+    }
+
+    if(!usart0_write(rec, p - rec) && (log_dropped < 0xff))
+        ++log_dropped;
+    SREG = sreg;
 }
 
+#endif  // DEBUG_LOG
+
+
+#ifdef DEBUG
 
 // debug_put_reg8_p() - write <msg> (a string which must be located in the program memory space) to
 // the debug channel, then write the string " = 0x" followed by the value of <regval> as a hex
@@ -57,4 +103,4 @@ void debug_put_reg8_p(const char *msg, const uint8_t regval)
     debug_putchar('\n');
 };
 
-#endif
+#endif  // DEBUG
@@ -3,6 +3,24 @@
 /*
     debug.h - various debugging macros and declarations
 
+    Debug messages are logged by debug_log() as compact binary records, rather than as formatted
+    text.  A record holds only an ID identifying the call site and the raw values of its arguments;
+    the format string is not compiled into the firmware.  Records are appended to the USART0
+    transmit buffer and sent under interrupt control, so logging does not stall the caller.  The
+    host-side decoder (tools/log_decode.py) builds a table of format strings from the project's
+    sources and expands each record into text.
+
+    Each source file which calls debug_log() must define DEBUG_LOG_FILE_ID, a small integer which
+    is unique within the project.
+
+    The log is compiled in if either DEBUG or DEBUG_LOG is defined; DEBUG_LOG alone enables only
+    the log, e.g. for field-diagnostic builds.  The remaining text-output macros require DEBUG.
+
+    Record format: a marker byte, DEBUG_LOG_MARKER | <number of args>, then the 16-bit record ID
+    (file ID << DEBUG_LOG_LINE_BITS | line number), then each argument as a 16-bit value; all
+    values are LSB first.  Marker bytes never occur in ASCII text, so records may be interleaved
+    with text written by the other macros.
+
     Stuart Wallace <stuartw@atom.net>, August 2018.
 */
 
@@ -10,20 +28,64 @@
 #include <avr/pgmspace.h>
 
 
-#ifdef DEBUG
+#if defined(DEBUG) && !defined(DEBUG_LOG)
+#define DEBUG_LOG
+#endif
+
+#define DEBUG_LOG_MARKER        (0xf0)      // Record marker byte; low nibble holds the arg count
+#define DEBUG_LOG_ARGS_MAX      (6)         // Max number of arguments to debug_log()
+#define DEBUG_LOG_LINE_BITS     (12)        // Number of record ID bits holding the line number
+#define DEBUG_LOG_ID_DROPPED    (0x0000)    // ID of record giving the number of records dropped
+
+// Macro giving the length of a log record carrying <nargs> arguments
+#define DEBUG_LOG_RECORD_LEN(nargs)     (3 + 2 * (nargs))
 
-#define DEBUG_BAUD_RATE         (230400)
-#define DEBUG_BUF_LEN           (64)
+// Macros which expand to the number of arguments (0 - DEBUG_LOG_ARGS_MAX) passed to them
+#define DEBUG_LOG_NARGS(...)    DEBUG_LOG_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define DEBUG_LOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, n, ...)    n
+
+
+#ifdef DEBUG_LOG
+
+// Debug baud rate.  This is low enough for USART0 to run at CLK_GOV_SLOW_FREQ, so that the clock
+// governor's frequency floor (see debug_init()) does not prevent ClkSpeedSlow from taking effect
+// in debug builds.
+#define DEBUG_BAUD_RATE         (38400)
+
+// debug_log() - macro which logs a record identifying the call site, and holding the values of
+// the arguments following <fmt>.  <fmt> is a printf()-style format string, used only by the
+// host-side decoder.  Each argument is passed as a 16-bit integer; a 32-bit value is passed as
+// two arguments, low word first, and formatted with the "l" length modifier.  Records are
+// discarded if the USART0 transmit buffer is full; the number discarded is logged once there is
+// room.  May be called from an ISR.
+//
+#define debug_log(fmt, ...)                                                                 \
+            debug_log_record(((uint16_t) DEBUG_LOG_FILE_ID << DEBUG_LOG_LINE_BITS)           \
+                                | (__LINE__ & ((1 << DEBUG_LOG_LINE_BITS) - 1)),            \
+                             DEBUG_LOG_NARGS(__VA_ARGS__), ##__VA_ARGS__)
+
+#define debug_flush()           usart0_flush_tx()
+
+void debug_init();
+void debug_log_record(const uint16_t id, const uint8_t nargs, ...);
+
+#else
+
+#define debug_init()
+#define debug_log(fmt, ...)
+#define debug_flush()
+
+#endif  // DEBUG_LOG
+
+
+#ifdef DEBUG
 
 #define debug_putstr(str)       usart0_puts(str)
 #define debug_putstr_p(str)     usart0_puts_p(PSTR(str))
 #define debug_putchar(ch)       usart0_tx(ch)
 #define debug_puthex_byte(b)    usart0_puthex_byte(b)
 #define debug_puthex_word(w)    usart0_puthex_word(w)
-#define debug_flush()           usart0_flush_tx()
 
-void debug_init();
-void debug_printf(char *fmt, ...);
 void debug_put_reg8_p(const char *msg, const uint8_t regval);
 
 #else
@@ -32,12 +94,9 @@ void debug_put_reg8_p(const char *msg, const uint8_t regval);
 #define debug_putchar(ch)
 #define debug_puthex_byte(b)
 #define debug_puthex_word(w)
-#define debug_flush()
 
-#define debug_init()
-#define debug_printf(fmt, ...)
 #define debug_put_reg8_p(msg, regval)
 
-#endif  // _DEBUG
+#endif  // DEBUG
 
 #endif
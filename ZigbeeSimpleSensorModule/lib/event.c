@@ -0,0 +1,70 @@
+/*
+    event.c - definitions relating to the event queue, through which interrupt handlers pass work
+    to the main loop.  Interrupt handlers should do no more than acknowledge their interrupt and
+    post an event; the main loop retrieves events and handles them with interrupts enabled.
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "event.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+
+static volatile struct EventQueue
+{
+    uint8_t     events[EVENT_QUEUE_LEN];    // Queued events
+    uint8_t     head;                       // Index of the next event to be retrieved
+    uint8_t     count;                      // Number of queued events
+} queue;
+
+
+// event_post() - append <event> to the event queue.  May be called from an ISR or from the main
+// loop.  Returns non-zero on success, or zero if the queue is full (in which case the event is
+// discarded).
+//
+uint8_t event_post(const Event_t event)
+{
+    const uint8_t sreg = SREG;
+    uint8_t ret = 0;
+
+    cli();
+    if(queue.count < EVENT_QUEUE_LEN)
+    {
+        queue.events[(queue.head + queue.count++) & (EVENT_QUEUE_LEN - 1)] = event;
+        ret = 1;
+    }
+    SREG = sreg;
+
+    return ret;
+}
+
+
+// event_get() - remove and return the oldest event from the event queue, or return EventNone if
+// the queue is empty.
+//
+Event_t event_get()
+{
+    const uint8_t sreg = SREG;
+    Event_t event = EventNone;
+
+    cli();
+    if(queue.count)
+    {
+        event = (Event_t) queue.events[queue.head];
+        queue.head = (queue.head + 1) & (EVENT_QUEUE_LEN - 1);
+        --queue.count;
+    }
+    SREG = sreg;
+
+    return event;
+}
+
+
+// event_pending() - return non-zero if the event queue is not empty.  To avoid missing an event
+// posted between this call and entry to sleep mode, call this with interrupts disabled.
+//
+uint8_t event_pending()
+{
+    return queue.count;
+}
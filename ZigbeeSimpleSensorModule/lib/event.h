@@ -0,0 +1,29 @@
+#ifndef LIB_EVENT_H_INC
+#define LIB_EVENT_H_INC
+/*
+    event.h - declarations relating to the event queue, through which interrupt handlers pass work
+    to the main loop
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include <stdint.h>
+
+
+#define EVENT_QUEUE_LEN     (8)     // Max # queued events; must be a power of two
+
+
+// Event_t - enumeration of events which may be posted to the event queue.
+//
+typedef enum Event
+{
+    EventNone = 0,          // No event (returned by event_get() when the queue is empty)
+    EventPeriodic           // Periodic interrupt timer (PIT) tick
+} Event_t;
+
+
+uint8_t event_post(const Event_t event);
+Event_t event_get();
+uint8_t event_pending();
+
+#endif
@@ -5,7 +5,27 @@
 */
 
 #include "gpio.h"
+#include "rtc.h"
+#include "wait.h"
+#include <avr/interrupt.h>
 #include <avr/pgmspace.h>
+#include <stddef.h>
+
+
+// GPIOLevelWait_t - state of a wait for a pin to reach a given level; see gpio_wait_level_timeout()
+//
+typedef struct GPIOLevelWait
+{
+    volatile uint8_t *  reg;                // Input register of the pin's port
+    uint8_t             mask;               // Bit corresponding to the pin
+    uint8_t             want;               // Value of the bit which ends the wait
+    uint16_t            start;              // RTC count at the start of the wait
+    uint16_t            ticks;              // Length of the wait, in RTC ticks
+    uint8_t             timed_out;          // Set if the wait timed out
+} GPIOLevelWait_t;
+
+
+static uint8_t gpio_level_pending(void * const arg);
 
 
 // Array of GPIO-manipulation registers
@@ -21,6 +41,27 @@ static volatile uint8_t * const reg_map[] PROGMEM =
 };
 
 
+// ISR(PORTx_PORT_vect) - ISRs which acknowledge pin-change interrupts.  These are used only to
+// wake the core from sleep; see gpio_wait_level_timeout().
+//
+ISR(PORTA_PORT_vect)
+{
+    PORTA_INTFLAGS = PORTA_INTFLAGS;
+}
+
+ISR(PORTB_PORT_vect)
+{
+    PORTB_INTFLAGS = PORTB_INTFLAGS;
+}
+
+#if defined(WITH_ATTINY816)
+ISR(PORTC_PORT_vect)
+{
+    PORTC_INTFLAGS = PORTC_INTFLAGS;
+}
+#endif // WITH_ATTINY816
+
+
 // register_address() - get the address of the GPIO register corresponding to the action and port
 // combination specified by <action> and <pin>.
 //
@@ -72,6 +113,69 @@ void gpio_wait_low(const GPIOPin_t pin)
 }
 
 
+// gpio_wait_level_timeout() - wait until the specified pin reads as logic 1 (if <level> is
+// non-zero) or logic 0 (if <level> equals zero), or until <ticks> RTC counter ticks have elapsed.
+// The RTC counter must be running.  Returns non-zero if the pin reached the requested level, or
+// zero if the wait timed out.
+//
+// If interrupts are enabled, the core sleeps in idle mode during the wait: a pin-change interrupt
+// on <pin>, or an RTC compare-match interrupt at the deadline, wakes it.  If the caller has
+// disabled interrupts, or is itself running in an ISR, the pin and the RTC counter are instead
+// polled.  The pin's input/sense configuration and the sleep mode in force on entry are restored
+// before returning.
+//
+uint8_t gpio_wait_level_timeout(const GPIOPin_t pin, const uint8_t level, const uint16_t ticks)
+{
+    const uint8_t can_sleep = wait_can_sleep();
+    const GPIOSense_t sense = gpio_get_sense(pin);
+    GPIOLevelWait_t w;
+
+    w.reg = register_address(pin, GPIOActionRead);
+    w.mask = 1 << pin.pin;
+    w.want = level ? w.mask : 0;
+    w.start = rtc_get_count();
+    w.ticks = ticks;
+    w.timed_out = 0;
+
+    if(can_sleep)
+    {
+        gpio_set_sense(pin, GPIOSenseBothEdges);    // Wake on any change at the pin
+        rtc_set_compare(w.start + ticks);           // Wake at the deadline
+        rtc_cmp_irq_enable(1);
+    }
+
+    wait_idle(gpio_level_pending, &w, NULL);        // The pin and the RTC need no servicing
+
+    if(can_sleep)
+    {
+        rtc_cmp_irq_enable(0);
+        gpio_set_sense(pin, sense);
+    }
+
+    return !w.timed_out;
+}
+
+
+// gpio_level_pending() - wait_idle() callback which returns non-zero until the pin described by
+// the GPIOLevelWait_t <arg> reaches the required level, or the wait times out.
+//
+static uint8_t gpio_level_pending(void * const arg)
+{
+    GPIOLevelWait_t * const w = arg;
+
+    if((*w->reg & w->mask) == w->want)
+        return 0;
+
+    if((uint16_t) (rtc_get_count() - w->start) >= w->ticks)
+    {
+        w->timed_out = 1;
+        return 0;
+    }
+
+    return 1;
+}
+
+
 // gpio_get_sense() - get the input/sense configuration for a pin.
 //
 GPIOSense_t gpio_get_sense(const GPIOPin_t pin)
@@ -88,12 +88,109 @@ typedef enum GPIOSense
 void gpio_action_write(const GPIOPin_t pin, const GPIOAction_t action);
 uint8_t gpio_action_read(const GPIOPin_t pin, const GPIOAction_t action);
 
-#define gpio_make_output(pin)   gpio_action_write(pin, GPIOActionDirSet)
-#define gpio_make_input(pin)    gpio_action_write(pin, GPIOActionDirClr)
-#define gpio_set(pin)           gpio_action_write(pin, GPIOActionOutSet)
-#define gpio_clear(pin)         gpio_action_write(pin, GPIOActionOutClr)
-#define gpio_read(pin)          gpio_action_read(pin, GPIOActionRead)
-#define gpio_get_dir(pin)       gpio_action_read(pin, GPIOActionDirGet)
+
+// Offsets of the registers within each virtual port (VPORTx) register block.  The VPORT blocks
+// live in the bottom 32 bytes of the I/O space, where single-bit instructions can reach them.
+#define GPIO_VPORT_DIR          (0)
+#define GPIO_VPORT_OUT          (1)
+#define GPIO_VPORT_IN           (2)
+
+// Macro yielding the I/O-space address of the VPORT register at <offset> in the block belonging to
+// <port>
+#define GPIO_VPORT_IO_ADDR(port, offset)    (_SFR_IO_ADDR(VPORTA_DIR) + ((port) * 4) + (offset))
+
+// Macro yielding the VPORT register at <offset> in the block belonging to <port>
+#define GPIO_VPORT_REG(port, offset) \
+    (*(volatile uint8_t *) ((uintptr_t) &VPORTA_DIR + ((port) * 4) + (offset)))
+
+// Macros which emit a single SBI or CBI instruction, setting or clearing bit <bit> of the VPORT
+// register at <offset> in the block belonging to <port>.  These instructions are atomic, unlike
+// a read-modify-write sequence, which an ISR touching the same register could interrupt.  The "I"
+// constraints require every argument to be a compile-time constant; anything else fails to
+// compile.
+#if defined(__AVR__)
+#define GPIO_VPORT_SBI(port, offset, bit) \
+    __asm__ __volatile__ ("sbi %0, %1" : : "I" (GPIO_VPORT_IO_ADDR(port, offset)), "I" (bit))
+#define GPIO_VPORT_CBI(port, offset, bit) \
+    __asm__ __volatile__ ("cbi %0, %1" : : "I" (GPIO_VPORT_IO_ADDR(port, offset)), "I" (bit))
+#else
+// Host builds (see host/Makefile) have no SBI/CBI, so the macros instead write the pin's bit to
+// the port's DIRSET/OUTSET or DIRCLR/OUTCLR strobe register: a single, equally atomic, write.
+#define GPIO_VPORT_STROBE(port, offset, clr) \
+    (*(&PORTA_DIRSET + ((port) * (&PORTB_DIR - &PORTA_DIR)) + \
+       ((offset) * (&PORTA_OUTSET - &PORTA_DIRSET)) + ((clr) * (&PORTA_DIRCLR - &PORTA_DIRSET))))
+#define GPIO_VPORT_SBI(port, offset, bit)   (GPIO_VPORT_STROBE(port, offset, 0) = 1 << (bit))
+#define GPIO_VPORT_CBI(port, offset, bit)   (GPIO_VPORT_STROBE(port, offset, 1) = 1 << (bit))
+#endif
+
+// Macro which evaluates to non-zero if <pin> is known at compile time
+#define GPIO_PIN_CONST(pin) \
+    (__builtin_constant_p((pin).port) && __builtin_constant_p((pin).pin))
+
+
+// gpio_vport_write() - perform the write action <action> on <pin>.  If <pin> is a compile-time
+// constant (e.g. one of the PIN_* definitions in platform.h), and optimisation is enabled, the
+// action compiles to a single SBI/CBI instruction on the relevant VPORT register; otherwise the
+// run-time, table-driven gpio_action_write() is called, which writes to the port's DIRSET,
+// DIRCLR, OUTSET or OUTCLR register.  Either way, the write is atomic.
+//
+static inline __attribute__((always_inline))
+void gpio_vport_write(const GPIOPin_t pin, const GPIOAction_t action)
+{
+    if(GPIO_PIN_CONST(pin))
+    {
+        switch(action)
+        {
+            case GPIOActionDirSet:
+                GPIO_VPORT_SBI(pin.port, GPIO_VPORT_DIR, pin.pin);
+                return;
+
+            case GPIOActionDirClr:
+                GPIO_VPORT_CBI(pin.port, GPIO_VPORT_DIR, pin.pin);
+                return;
+
+            case GPIOActionOutSet:
+                GPIO_VPORT_SBI(pin.port, GPIO_VPORT_OUT, pin.pin);
+                return;
+
+            case GPIOActionOutClr:
+                GPIO_VPORT_CBI(pin.port, GPIO_VPORT_OUT, pin.pin);
+                return;
+
+            default:
+                break;
+        }
+    }
+
+    gpio_action_write(pin, action);
+}
+
+
+// gpio_vport_read() - perform the read action <action> on <pin>, returning the bit corresponding
+// to the pin.  As with gpio_vport_write(), constant pins compile to a VPORT access (which becomes
+// a single SBIS/SBIC instruction when the result is tested), and other pins fall back to
+// gpio_action_read().
+//
+static inline __attribute__((always_inline))
+uint8_t gpio_vport_read(const GPIOPin_t pin, const GPIOAction_t action)
+{
+    if(GPIO_PIN_CONST(pin))
+    {
+        if(action == GPIOActionRead)
+            return GPIO_VPORT_REG(pin.port, GPIO_VPORT_IN) & (1 << pin.pin);
+        else if(action == GPIOActionDirGet)
+            return GPIO_VPORT_REG(pin.port, GPIO_VPORT_DIR) & (1 << pin.pin);
+    }
+
+    return gpio_action_read(pin, action);
+}
+
+#define gpio_make_output(pin)   gpio_vport_write(pin, GPIOActionDirSet)
+#define gpio_make_input(pin)    gpio_vport_write(pin, GPIOActionDirClr)
+#define gpio_set(pin)           gpio_vport_write(pin, GPIOActionOutSet)
+#define gpio_clear(pin)         gpio_vport_write(pin, GPIOActionOutClr)
+#define gpio_read(pin)          gpio_vport_read(pin, GPIOActionRead)
+#define gpio_get_dir(pin)       gpio_vport_read(pin, GPIOActionDirGet)
 
 
 // gpio_port() - return the GPIOPort_t containing the specified GPIOPin_t in <pin>.
@@ -123,6 +220,7 @@ inline uint8_t gpio_pin_bit(const GPIOPin_t pin)
 
 void gpio_wait_high(const GPIOPin_t pin);
 void gpio_wait_low(const GPIOPin_t pin);
+uint8_t gpio_wait_level_timeout(const GPIOPin_t pin, const uint8_t level, const uint16_t ticks);
 GPIOSense_t gpio_get_sense(const GPIOPin_t pin);
 void gpio_set_sense(const GPIOPin_t pin, const GPIOSense_t sense);
 void gpio_set_level(const GPIOPin_t pin, const uint8_t level);
@@ -0,0 +1,229 @@
+/*
+    profile.c - definitions relating to the active-time profiler
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "profile.h"
+
+#ifdef PROFILE
+
+#include "clk.h"
+#include "debug.h"
+#include "rtc.h"
+
+#define DEBUG_LOG_FILE_ID       (6)     // Identifies debug log records from this file
+
+#define PROFILE_FRAC_BITS       (12)    // Fractional bits in <profile_us_per_count>
+
+// Macro converting a number of RTC ticks into microseconds (1000000 / 1024 = 15625 / 16)
+#define PROFILE_RTC_TICKS_TO_US(ticks)  (((uint32_t) (ticks) * 15625) / 16)
+
+// Slack allowed between the TCB0 and RTC durations of a phase before TCB0 is assumed to have
+// stopped or wrapped: one RTC tick for the RTC's resolution, and one for margin, in us
+#define PROFILE_RTC_SLACK_US    (2 * PROFILE_RTC_TICKS_TO_US(1))
+
+#if RTC_TICKS_PER_S != 1024
+#error "PROFILE_RTC_TICKS_TO_US() assumes an RTC count rate of 1024Hz"
+#endif
+
+// Length of the log records written for each phase by profile_poll()
+#define PROFILE_DUMP_LEN        (DEBUG_LOG_RECORD_LEN(4) + DEBUG_LOG_RECORD_LEN(5))
+
+
+static void profile_set_scale();
+static void profile_clear(ProfileStats_t * const s);
+static uint32_t profile_now();
+static void profile_clk_changed(const ClkGovEvent_t event);
+
+
+static ProfileStats_t profile_table[ProfilePhase_end];
+static uint32_t profile_phase_start[ProfilePhase_end];     // Start time of each phase, in us
+static uint16_t profile_phase_start_rtc[ProfilePhase_end]; // RTC count at the start of each phase
+
+static uint32_t profile_clock_us;           // Time counted by profile_now(), in us
+static uint16_t profile_clock_frac;         // Fractional us not yet added to <profile_clock_us>
+static uint16_t profile_clock_cnt;          // TCB0 count at the last call to profile_now()
+static uint16_t profile_us_per_count;       // Duration of one TCB0 count, in us (fixed-point)
+static uint8_t profile_dump_next = ProfilePhase_end;   // Next phase to be logged by profile_poll()
+
+
+// profile_init() - initialise the profiler: start TCB0 counting PCLK cycles, and register a
+// clock-change hook which keeps the conversion of counts into microseconds correct.  Also resets
+// the statistics.
+//
+void profile_init()
+{
+    TCB0_CCMP = 0xffff;                     // Count through the full 16-bit range
+    TCB0_CTRLB = TCB_CNTMODE_INT_gc;        // Periodic mode; the interrupt is not enabled
+    TCB0_CTRLA = TCB_CLKSEL_CLKDIV1_gc | TCB_ENABLE_bm;
+
+    profile_set_scale();
+    clk_gov_add_hook(profile_clk_changed);
+    profile_reset();
+}
+
+
+// profile_set_scale() - calculate the duration of one TCB0 count at the current PCLK frequency.
+//
+static void profile_set_scale()
+{
+    const uint32_t pclk_freq = pclk_get_freq();
+
+    if(pclk_freq)
+        profile_us_per_count = ((1000000UL << PROFILE_FRAC_BITS) + pclk_freq / 2) / pclk_freq;
+}
+
+
+// profile_now() - return the time, in microseconds, counted by TCB0 since the profiler was
+// initialised.  Must be called at least once every 65536 PCLK cycles while a phase is being timed
+// for the result to be exact; otherwise the RTC duration is used (see profile_end()).
+//
+static uint32_t profile_now()
+{
+    const uint16_t cnt = TCB0_CNT;          // Only the profiler reads TCB0
+    uint32_t acc;
+
+    acc = (uint32_t) (uint16_t) (cnt - profile_clock_cnt) * profile_us_per_count
+          + profile_clock_frac;
+    profile_clock_cnt = cnt;
+    profile_clock_us += acc >> PROFILE_FRAC_BITS;
+    profile_clock_frac = acc & ((1 << PROFILE_FRAC_BITS) - 1);
+
+    return profile_clock_us;
+}
+
+
+// profile_clk_changed() - clock-governor hook.  Before PCLK changes, the counts accumulated at the
+// old frequency are converted into microseconds; afterwards, the duration of a count is
+// recalculated.
+//
+static void profile_clk_changed(const ClkGovEvent_t event)
+{
+    if(event == ClkGovEventPreChange)
+        profile_now();
+    else
+    {
+        profile_set_scale();
+        profile_clock_cnt = TCB0_CNT;       // Discard the few counts taken during the change
+    }
+}
+
+
+// profile_clear() - discard the statistics in <s>.
+//
+static void profile_clear(ProfileStats_t * const s)
+{
+    s->min = 0xffffffffUL;
+    s->max = 0;
+    s->total = 0;
+    s->count = 0;
+}
+
+
+// profile_reset() - discard all accumulated statistics.
+//
+void profile_reset()
+{
+    uint8_t i;
+
+    for(i = 0; i < ProfilePhase_end; ++i)
+        profile_clear(profile_table + i);
+}
+
+
+// profile_start() - begin timing the ProfilePhaseCycle phase, at the beginning of a wake cycle.
+//
+void profile_start()
+{
+    profile_begin(ProfilePhaseCycle);
+}
+
+
+// profile_stop() - finish timing the ProfilePhaseCycle phase, at the end of a wake cycle.
+//
+void profile_stop()
+{
+    profile_end(ProfilePhaseCycle);
+}
+
+
+// profile_begin() - record the start time of phase <phase>.
+//
+void profile_begin(const ProfilePhase_t phase)
+{
+    profile_phase_start[phase] = profile_now();
+    profile_phase_start_rtc[phase] = rtc_get_count();
+}
+
+
+// profile_end() - calculate the duration of phase <phase>, which must have been started by a call
+// to profile_begin(), and accumulate it in the statistics table.  Once a phase's counter is
+// saturated, further durations for the phase are ignored until profile_reset() is called.
+//
+void profile_end(const ProfilePhase_t phase)
+{
+    const uint32_t rtc_us = PROFILE_RTC_TICKS_TO_US(rtc_get_count() -
+                                                    profile_phase_start_rtc[phase]);
+    ProfileStats_t * const s = profile_table + phase;
+    uint32_t us = profile_now() - profile_phase_start[phase];
+
+    if(rtc_us > us + PROFILE_RTC_SLACK_US)
+        us = rtc_us;                        // TCB0 stopped during sleep, or wrapped
+
+    if(s->count == 0xffff)
+        return;
+
+    if(us < s->min)
+        s->min = us;
+    if(us > s->max)
+        s->max = us;
+
+    s->total += us;
+    ++s->count;
+}
+
+
+// profile_stats() - return a pointer to the statistics accumulated for phase <phase>, e.g. so that
+// they may be copied into an XBee frame.
+//
+const ProfileStats_t *profile_stats(const ProfilePhase_t phase)
+{
+    return profile_table + phase;
+}
+
+
+// profile_dump() - begin logging the accumulated statistics.  The records are written by
+// profile_poll() as space becomes available in the USART0 transmit buffer; the records for all
+// phases would not fit in the buffer together, and the CPU should not wait for it to drain.
+//
+void profile_dump()
+{
+    profile_dump_next = 0;
+    profile_poll();
+}
+
+
+// profile_poll() - if a dump is in progress, log the statistics of as many phases as fit in the
+// USART0 transmit buffer: two records per phase, giving the phase number, count, and mean, min and
+// max durations in us.  The statistics for each phase are reset once logged, so that each dump
+// covers the interval since the previous one.  Called from the main loop.
+//
+void profile_poll()
+{
+    for(; (profile_dump_next < ProfilePhase_end) && (usart0_tx_space() >= PROFILE_DUMP_LEN);
+        ++profile_dump_next)
+    {
+        ProfileStats_t * const s = profile_table + profile_dump_next;
+        const uint32_t mean = s->count ? s->total / s->count : 0;
+
+        debug_log("P%u: n=%u mean=%lu us\n", profile_dump_next, s->count, (uint16_t) mean,
+                  (uint16_t) (mean >> 16));
+        debug_log("P%u: min=%lu max=%lu us\n", profile_dump_next, (uint16_t) s->min,
+                  (uint16_t) (s->min >> 16), (uint16_t) s->max, (uint16_t) (s->max >> 16));
+
+        profile_clear(s);
+    }
+}
+
+#endif  // PROFILE
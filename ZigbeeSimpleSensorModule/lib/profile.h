@@ -0,0 +1,74 @@
+#ifndef LIB_PROFILE_H_INC
+#define LIB_PROFILE_H_INC
+/*
+    profile.h - declarations relating to the active-time profiler
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+
+    The profiler is compiled in only if the PROFILE symbol is defined.  It timestamps phases of the
+    wake cycle and accumulates min/max/mean durations for each phase, in microseconds.  Phases are
+    timed by TCB0, which counts PCLK cycles; the counts are converted to microseconds at the PCLK
+    frequency in effect, which is re-read whenever the clock governor (see clk.h) changes it.  TCB0
+    stops in power-down sleep, and its count wraps every 65536 PCLK cycles (at least 6.5ms), so
+    each phase is also timed by the RTC counter (1/1024 s resolution); if the RTC shows that a
+    phase lasted longer than TCB0 does, the RTC duration is used instead.
+
+    The statistics are logged by profile_dump() through the debug log.  The records are written
+    only as space becomes available in the USART0 transmit buffer, by profile_poll(), which must be
+    called from the main loop; the buffer drains under interrupt control while the CPU sleeps.
+*/
+
+#include <stdint.h>
+
+
+// ProfilePhase_t - enumeration of the phases of a wake cycle which are timed by the profiler.
+//
+typedef enum ProfilePhase
+{
+    ProfilePhaseCycle       = 0,    // Entire wake cycle
+    ProfilePhaseSensors     = 1,    // Reading sensors
+    ProfilePhaseXBeeWake    = 2,    // Waiting for the XBee module to wake up
+    ProfilePhaseSPI         = 3,    // SPI traffic with the XBee module
+    ProfilePhaseDebug       = 4,    // Writing debug output
+    ProfilePhase_end                // Placeholder value
+} ProfilePhase_t;
+
+
+// ProfileStats_t - accumulated statistics for one phase.
+//
+typedef struct ProfileStats
+{
+    uint32_t    min;                // Shortest duration seen, in us
+    uint32_t    max;                // Longest duration seen, in us
+    uint32_t    total;              // Sum of all durations, in us
+    uint16_t    count;              // Number of durations accumulated
+} ProfileStats_t;
+
+
+#ifdef PROFILE
+
+void profile_init();
+void profile_reset();
+void profile_start();
+void profile_stop();
+void profile_begin(const ProfilePhase_t phase);
+void profile_end(const ProfilePhase_t phase);
+const ProfileStats_t *profile_stats(const ProfilePhase_t phase);
+void profile_dump();
+void profile_poll();
+
+#else
+
+#define profile_init()
+#define profile_reset()
+#define profile_start()
+#define profile_stop()
+#define profile_begin(phase)
+#define profile_end(phase)
+#define profile_stats(phase)    ((const ProfileStats_t *) 0)
+#define profile_dump()
+#define profile_poll()
+
+#endif  // PROFILE
+
+#endif
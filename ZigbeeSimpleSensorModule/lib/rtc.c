@@ -5,6 +5,19 @@
 */
 
 #include "rtc.h"
+#include <avr/interrupt.h>
+
+
+// rtc_ctrla_sync_wait() - Macro which can be used to wait until the uC has finished synchronising
+// the CTRLA register.  This must be done before any update to CTRLA.
+//
+#define rtc_ctrla_sync_wait()                   \
+    do                                          \
+    {                                           \
+        while(RTC_STATUS & RTC_CTRLABUSY_bm)    \
+            ;                                   \
+    } while(0)
+
 
 // rtc_pitctrla_sync_wait() - Macro which can be used to wait until the uC has finished
 // synchronising the PITCTRLA register.  This must be done before any update to PITCTRLA.
@@ -30,6 +43,7 @@ void rtc_set_clock(const RTCClkSel_t clock)
 //
 void rtc_set_prescaler(const RTCPrescaler_t prescaler)
 {
+    rtc_ctrla_sync_wait();
     RTC_CTRLA = (RTC_CTRLA & ~RTC_PRESCALER_gm) | prescaler;
 }
 
@@ -39,6 +53,7 @@ void rtc_set_prescaler(const RTCPrescaler_t prescaler)
 //
 void rtc_enable(const uint8_t enable)
 {
+    rtc_ctrla_sync_wait();
     if(enable)
         RTC_CTRLA |= RTC_RTCEN_bm;
     else
@@ -46,6 +61,15 @@ void rtc_enable(const uint8_t enable)
 }
 
 
+// ISR(RTC_CNT_vect) - ISR which acknowledges RTC compare-match interrupts.  These are used only to
+// wake the core from sleep when a timeout expires; see rtc_set_compare().
+//
+ISR(RTC_CNT_vect)
+{
+    RTC_INTFLAGS = RTC_CMP_bm;
+}
+
+
 // rtc_pit_enable() enable (if <enable> is non-zero) or disable (if <enable> equals zero) the real-
 // time counter (RTC)'s periodic interrupt timer (PIT).
 //
@@ -88,3 +112,37 @@ void rtc_pit_irq_acknowledge()
 {
     RTC_PITINTFLAGS = 1;    // Clear periodic interrupt flag
 }
+
+
+// rtc_get_count() - return the current value of the real-time counter (RTC).
+//
+uint16_t rtc_get_count()
+{
+    return RTC_CNT;
+}
+
+
+// rtc_set_compare() - set the RTC compare register to <cmp>.  If the compare interrupt is enabled,
+// an interrupt will occur when the counter reaches this value.
+//
+void rtc_set_compare(const uint16_t cmp)
+{
+    while(RTC_STATUS & RTC_CMPBUSY_bm)
+        ;
+
+    RTC_CMP = cmp;
+}
+
+
+// rtc_cmp_irq_enable() - enable (if <enable> is non-zero) or disable (if <enable> equals zero) the
+// RTC compare-match interrupt.  Any pending compare-match interrupt flag is cleared.
+//
+void rtc_cmp_irq_enable(const uint8_t enable)
+{
+    RTC_INTFLAGS = RTC_CMP_bm;
+
+    if(enable)
+        RTC_INTCTRL |= RTC_CMP_bm;
+    else
+        RTC_INTCTRL &= ~RTC_CMP_bm;
+}
@@ -9,6 +9,15 @@
 #include <avr/io.h>
 
 
+#define RTC_TICKS_PER_S         (1024)  // RTC count rate with RTCClkInt1K and RTCPrescalerDiv1
+
+
+// RTC_MS_TO_TICKS() - convert a duration in milliseconds to a number of RTC counter ticks,
+// assuming that the RTC is clocked at 1.024kHz (RTCClkInt1K, RTCPrescalerDiv1).
+//
+#define RTC_MS_TO_TICKS(ms)     ((uint16_t) (((uint32_t) (ms) * RTC_TICKS_PER_S) / 1000UL))
+
+
 // RTCPrescaler_t - enumeration of possible values of the RTC clock prescaler.
 //
 typedef enum RTCPrescaler
@@ -73,5 +82,8 @@ void rtc_pit_enable(const uint8_t enable);
 void rtc_pit_irq_enable(const uint8_t enable);
 void rtc_pit_irq_acknowledge();
 void rtc_pit_set_period(const RTCPITPeriod_t period);
+uint16_t rtc_get_count();
+void rtc_set_compare(const uint16_t cmp);
+void rtc_cmp_irq_enable(const uint8_t enable);
 
 #endif
\ No newline at end of file
@@ -7,10 +7,51 @@
 #include "spi.h"
 #include "gpio.h"
 #include "../platform.h"
+#include <avr/interrupt.h>
+#include "wait.h"
+#include <avr/pgmspace.h>
+#include <stddef.h>
+
+
+#define SPI_XFER_DEPTH          (2)     // Max bytes in flight: one in the shift reg, one buffered
 
 
 static GPIOPin_t SPI_nSS;
 
+// State of the interrupt-driven transfer engine
+static volatile struct SPIXfer
+{
+    SPIXferTxFn_t   tx_fn;      // Callback supplying bytes to transmit
+    SPIXferRxFn_t   rx_fn;      // Callback consuming received bytes
+    uint8_t         tx_len;     // Number of bytes which <tx_fn> has still to supply
+    uint8_t         in_flight;  // Number of bytes written to SPI0_DATA but not yet received
+    SPIXferNeed_t   rx_need;    // Number of further bytes required by <rx_fn>
+    uint8_t         busy;       // Non-zero while a transfer is in progress
+} spi0_xfer;
+
+static uint32_t spi0_clk_freq_max;  // Max SPI clock frequency, or 0 if the prescaler is fixed
+
+// SPI clock prescaler settings, in increasing order of division ratio
+static const uint8_t spi0_clk_divs[] PROGMEM = {SPIClkDiv4, SPIClkDiv16, SPIClkDiv64,
+                                                SPIClkDiv128};
+static const uint8_t spi0_clk_div_vals[] PROGMEM = {4, 16, 64, 128};
+
+
+static void spi0_xfer_fill();
+static void spi0_xfer_service();
+static uint8_t spi0_xfer_pending(void * const arg);
+static void spi0_xfer_poll();
+static void spi0_update_prescaler();
+
+
+// ISR(SPI0_INT_vect) - ISR which handles receive-complete interrupts from the SPI peripheral while
+// an interrupt-driven transfer is in progress.
+//
+ISR(SPI0_INT_vect)
+{
+    spi0_xfer_service();
+}
+
 
 // spi0_configure_master() - configure the SPI0 peripheral as a master, and set its clock divider
 // according to the value in <div>.  This function unconditionally sets certain options in the SPI
@@ -40,6 +81,50 @@ void spi0_configure_master(const Pinset_t pinset, const SPIClkDiv_t div)
 }
 
 
+// spi0_set_clk_freq_max() - set the SPI clock prescaler to the smallest division ratio which gives
+// an SPI clock frequency no greater than <freq> Hz, and maintain this relationship whenever the
+// peripheral clock frequency changes (see spi0_clk_changed()).  If no ratio is large enough, the
+// largest is used.  spi0_configure_master() must have been called first.
+//
+void spi0_set_clk_freq_max(const uint32_t freq)
+{
+    spi0_clk_freq_max = freq;
+    spi0_update_prescaler();
+}
+
+
+// spi0_clk_changed() - clock governor hook which waits for any interrupt-driven transfer in
+// progress to complete before the peripheral clock frequency changes, and re-derives the SPI clock
+// prescaler afterwards.
+//
+void spi0_clk_changed(const ClkGovEvent_t event)
+{
+    if(event == ClkGovEventPreChange)
+        spi0_xfer_wait();
+    else
+        spi0_update_prescaler();
+}
+
+
+// spi0_update_prescaler() - if a maximum SPI clock frequency has been set, select the smallest
+// prescaler division ratio which satisfies it at the current peripheral clock frequency.
+//
+static void spi0_update_prescaler()
+{
+    const uint32_t pclk_freq = pclk_get_freq();
+    uint8_t i;
+
+    if(!spi0_clk_freq_max || !pclk_freq)
+        return;
+
+    for(i = 0; (i < sizeof(spi0_clk_div_vals) - 1) &&
+               (pclk_freq / pgm_read_byte(spi0_clk_div_vals + i) > spi0_clk_freq_max); ++i)
+        ;
+
+    SPI0_CTRLA = (SPI0_CTRLA & ~SPI_PRESC_gm) | pgm_read_byte(spi0_clk_divs + i);
+}
+
+
 // spi0_port_activate() - activate (if <activate> is non-zero) or deactivate (if <activate> equals
 // zero) the SPI port.  Activation entails configuring as outputs the pins associated with SPI
 // output signals.  Deactivation entails configuring all SPI pins as inputs.  In both cases,
@@ -106,8 +191,124 @@ void spi0_enable(const uint8_t enable)
 //
 void spi0_slave_select(const uint8_t select)
 {
-    if(select)
-        gpio_clear(SPI_nSS);
+    // Test the pin-set here, rather than using SPI_nSS, so that each branch refers to a constant
+    // pin and compiles to a single VPORT bit operation.
+    if(PORTMUX_CTRLB & PORTMUX_SPI0_ALTERNATE_gc)
+    {
+        if(select)
+            gpio_clear(PIN_SPI_nSS_ALT);
+        else
+            gpio_set(PIN_SPI_nSS_ALT);
+    }
     else
-        gpio_set(SPI_nSS);
+    {
+        if(select)
+            gpio_clear(PIN_SPI_nSS_DEFAULT);
+        else
+            gpio_set(PIN_SPI_nSS_DEFAULT);
+    }
+}
+
+
+// spi0_xfer_fill() - keep the SPI transmit path topped up.  Up to SPI_XFER_DEPTH bytes are kept in
+// flight, so that the shift register never idles between bytes, but no byte is queued unless the
+// transmitter still has data to send or the receiver has asked for it.  Once nothing remains in
+// flight, the transfer is complete: the receive interrupt is disabled and the engine goes idle.
+//
+static void spi0_xfer_fill()
+{
+    uint8_t need = spi0_xfer.in_flight + spi0_xfer.tx_len;
+
+    if(spi0_xfer.rx_need > need)
+        need = spi0_xfer.rx_need;
+
+    while((spi0_xfer.in_flight < SPI_XFER_DEPTH) && (spi0_xfer.in_flight < need))
+    {
+        SPI0_DATA = spi0_xfer.tx_fn();
+        if(spi0_xfer.tx_len)
+            --spi0_xfer.tx_len;
+        ++spi0_xfer.in_flight;
+    }
+
+    if(!spi0_xfer.in_flight)
+    {
+        SPI0_INTCTRL &= ~SPI_RXCIE_bm;
+        spi0_xfer.busy = 0;
+    }
+}
+
+
+// spi0_xfer_service() - collect one received byte, pass it to the receive callback, and queue
+// further bytes for transmission as required.  Called from the SPI ISR, or directly by
+// spi0_xfer_wait() when the ISR cannot run.
+//
+static void spi0_xfer_service()
+{
+    const uint8_t data = SPI0_DATA;
+
+    --spi0_xfer.in_flight;
+    spi0_xfer.rx_need = spi0_xfer.rx_fn(data);
+    spi0_xfer_fill();
+}
+
+
+// spi0_xfer_start() - start an interrupt-driven transfer.  <tx_len> bytes will be obtained from
+// <tx_fn> and transmitted; every byte received, including those received after <tx_len> bytes
+// have been sent, is passed to <rx_fn>.  The transfer continues until all <tx_len> bytes have
+// been sent and <rx_fn> returns SPIXferDone.  At least one byte is always exchanged.  The SPI
+// peripheral must be enabled, and the slave selected, by the caller.  The function returns
+// immediately; use spi0_xfer_busy() or spi0_xfer_wait() to detect completion.
+//
+void spi0_xfer_start(const SPIXferTxFn_t tx_fn, const SPIXferRxFn_t rx_fn, const uint8_t tx_len)
+{
+    while(SPI0_INTFLAGS & SPI_RXCIF_bm)
+        (void) SPI0_DATA;                       // Discard stale data in the receive buffer
+
+    spi0_xfer.tx_fn = tx_fn;
+    spi0_xfer.rx_fn = rx_fn;
+    spi0_xfer.tx_len = tx_len;
+    spi0_xfer.in_flight = 0;
+    spi0_xfer.rx_need = SPIXferNext;            // Always clock at least one byte
+    spi0_xfer.busy = 1;
+
+    spi0_xfer_fill();
+    SPI0_INTCTRL |= SPI_RXCIE_bm;
+}
+
+
+// spi0_xfer_busy() - return non-zero if an interrupt-driven transfer is in progress.
+//
+uint8_t spi0_xfer_busy()
+{
+    return spi0_xfer.busy;
+}
+
+
+// spi0_xfer_wait() - wait for the current interrupt-driven transfer to complete.  If interrupts
+// are enabled, the core sleeps in idle mode between SPI interrupts.  If the caller has disabled
+// interrupts, or is itself running in an ISR (in which case the SPI interrupt cannot preempt it),
+// the transfer is instead serviced by polling the receive-complete flag.  The sleep mode in force
+// on entry is restored before returning.
+//
+void spi0_xfer_wait()
+{
+    wait_idle(spi0_xfer_pending, NULL, spi0_xfer_poll);
+}
+
+
+// spi0_xfer_pending() - wait_idle() callback which returns non-zero while a transfer is in
+// progress.
+//
+static uint8_t spi0_xfer_pending(void * const arg)
+{
+    return spi0_xfer.busy;
+}
+
+
+// spi0_xfer_poll() - wait_idle() callback which services the transfer if a byte has been received.
+//
+static void spi0_xfer_poll()
+{
+    if(SPI0_INTFLAGS & SPI_RXCIF_bm)
+        spi0_xfer_service();
 }
@@ -7,6 +7,7 @@
 */
 
 #include <avr/io.h>
+#include "clk.h"
 #include "types.h"
 
 
@@ -21,6 +22,31 @@ typedef enum SPIClkDiv
 } SPIClkDiv_t;
 
 
+// SPIXferNeed_t - values returned by an SPIXferRxFn_t callback to tell the interrupt-driven
+// transfer engine how many further bytes the receiver requires.  Only the distinction between
+// "none", "exactly one" and "two or more" matters: the engine uses it to decide whether it is safe
+// to queue a byte ahead in the SPI transmit buffer without clocking in data nobody has asked for.
+//
+typedef enum SPIXferNeed
+{
+    SPIXferDone     = 0,        // Receiver needs no more data
+    SPIXferNext     = 1,        // Receiver needs exactly one more byte, then will re-evaluate
+    SPIXferStream   = 2         // Receiver needs at least two more bytes
+} SPIXferNeed_t;
+
+
+// SPIXferTxFn_t - callback used by the interrupt-driven transfer engine to obtain the next byte to
+// be transmitted.  Called from the SPI ISR.
+//
+typedef uint8_t (*SPIXferTxFn_t)();
+
+
+// SPIXferRxFn_t - callback used by the interrupt-driven transfer engine to hand over each received
+// byte.  Returns a value from the SPIXferNeed_t enumeration.  Called from the SPI ISR.
+//
+typedef SPIXferNeed_t (*SPIXferRxFn_t)(const uint8_t data);
+
+
 // spi0_flush_tx() - wait for SPI transmission to complete by busy-waiting on the TXCIF bit in the
 // SPI INTFLAGS register.  After the bit becomes 1, transmission is complete; at this point a 1 is
 // written to the register in order to clear it.
@@ -66,8 +92,13 @@ typedef enum SPIClkDiv
 
 
 void spi0_configure_master(const Pinset_t pinset, const SPIClkDiv_t div);
+void spi0_set_clk_freq_max(const uint32_t freq);
+void spi0_clk_changed(const ClkGovEvent_t event);
 void spi0_port_activate(const uint8_t activate);
 void spi0_enable(const uint8_t enable);
 void spi0_slave_select(const uint8_t select);
+void spi0_xfer_start(const SPIXferTxFn_t tx_fn, const SPIXferRxFn_t rx_fn, const uint8_t tx_len);
+uint8_t spi0_xfer_busy();
+void spi0_xfer_wait();
 
 #endif
@@ -8,7 +8,9 @@
 #include "clk.h"
 #include "debug.h"
 #include <avr/interrupt.h>
+#include "wait.h"
 #include <avr/io.h>
+#include <stddef.h>
 
 
 #define TWI_CMD_WRITE           (0)     // Bit value indicating that the master is writing
@@ -26,19 +28,33 @@ typedef enum TWIBusState
     TWIBusStateBusy     = 3         // The bus is busy
 } TWIBusState_t;
 
-static volatile struct TWICommand
+// State of the transaction engine.  Transactions are held in a singly-linked list; the head of
+// the list is the transaction currently on the bus.
+static volatile struct TWIEngine
 {
-    uint8_t write;              // 0 = read, 1 = write
-    uint8_t dev_addr;           // TWI device address
-    uint8_t reg_addr;           // TWI device register address
-    uint8_t data;               // Data to be written, or data received from the device
+    TWITxn_t *head;             // Transaction in progress, or NULL if the engine is idle
+    TWITxn_t *tail;             // Last transaction in the queue
+    uint8_t index;              // Index of the next byte to be written or read
     TWICmdState_t state;        // Current state of the FSM
-} twi_command;
+} twi;
+
+static TWISpeed_t twi_speed;            // Bus speed last set by twi_set_clock(), or zero
+
+// Transaction used to implement the single-register command functions
+static TWITxn_t twi_command;
+static uint8_t twi_command_buf[2];      // [0] = register address, [1] = data written or read
 
 
 static TWIBusState_t twi_bus_status();
-static uint8_t twi_cmd_start(const uint8_t dev_addr, const uint8_t reg_addr, const uint8_t data,
-                             const uint8_t is_write);
+static void twi_txn_next();
+static void twi_txn_complete(const TWICmdStatus_t status);
+static void twi_service();
+static uint8_t twi_txn_pending(void * const arg);
+static uint8_t twi_engine_pending(void * const arg);
+static void twi_poll();
+static void twi_stop();
+static TWICmdStatus_t twi_cmd_start(const uint8_t dev_addr, const uint8_t reg_addr,
+                                    const uint8_t data, const uint8_t is_write);
 static TWICmdStatus_t twi_sync_cmd(const uint8_t dev_addr, const uint8_t reg_addr,
                                    uint8_t * const data, const uint8_t is_write);
 
@@ -48,75 +64,242 @@ static TWICmdStatus_t twi_sync_cmd(const uint8_t dev_addr, const uint8_t reg_add
 //
 ISR(TWI0_TWIM_vect)
 {
-    if(TWI0_MSTATUS & TWI_WIF_bm)
+    twi_service();
+}
+
+
+// twi_stop() - issue a STOP condition (preceded by a NACK, if a read is in progress) and return
+// the bus to the idle state.
+//
+static void twi_stop()
+{
+    TWI0_MCTRLB = (TWI0_MCTRLB & ~TWI_MCMD_gm) | TWI_MCMD_STOP_gc | TWI_ACKACT_bm;
+    TWI0_MSTATUS = (TWI0_MSTATUS & ~TWI_BUSSTATE_gm) | TWI_BUSSTATE_IDLE_gc;
+}
+
+
+// twi_service() - advance the transaction engine in response to a master write or read interrupt
+// flag.  Called from the ISR, or from twi_txn_wait() when the ISR cannot run.
+//
+static void twi_service()
+{
+    TWITxn_t * const txn = twi.head;
+    const uint8_t status = TWI0_MSTATUS;
+
+    if(!txn)
     {
-        if(TWI0_MSTATUS & TWI_RXACK_bm)
-        {
-            twi_command.state = TWICmdStateNack;            // NACK or no acknowledgment received
+        TWI0_MSTATUS = TWI_WIF_bm | TWI_RIF_bm;         // Spurious interrupt; clear the flags
+        return;
+    }
 
-            // Issue a STOP to end the transaction
-            TWI0_MCTRLB = (TWI0_MCTRLB & ~(TWI_MCMD_gm | TWI_ACKACT_bm)) | TWI_MCMD_STOP_gc;
-            return;
+    if(status & (TWI_ARBLOST_bm | TWI_BUSERR_bm))
+    {
+        TWI0_MSTATUS = TWI_ARBLOST_bm | TWI_BUSERR_bm;  // Clear the error flags
+        twi_stop();
+        twi_txn_complete(TWICmdError);
+    }
+    else if(status & TWI_WIF_bm)
+    {
+        if(status & TWI_RXACK_bm)
+        {
+            twi_stop();                                 // NACK or no acknowledgment received
+            twi_txn_complete(TWICmdNack);
         }
-
-        switch(twi_command.state)
+        else
         {
-            case TWICmdDevAddr:
-                TWI0_MDATA = twi_command.reg_addr;          // Transmit register address
-                twi_command.state = TWICmdRegAddr;
-                break;
-
-            case TWICmdRegAddr:
-                if(twi_command.write)
-                {
-                    TWI0_MDATA = twi_command.data;          // Transmit data
-                    twi_command.state = TWICmdDataWrite;
-                }
-                else
-                {
-                    // Transmit device address and request a read operation
-                    TWI0_MADDR = (twi_command.dev_addr << 1) | TWI_CMD_READ;
-                    twi_command.state = TWICmdDataRead;
-                }
-                break;
-
-            case TWICmdDataRead:
-                break;      // No action - case handled by the RIF handler below
-
-            case TWICmdDataWrite:
-                // Issue a STOP command
-                TWI0_MCTRLB = (TWI0_MCTRLB & ~(TWI_MCMD_gm | TWI_ACKACT_bm)) | TWI_MCMD_STOP_gc;
-                twi_command.state = TWICmdStateIdle;
-
-                // Return the bus to the idle state
-                TWI0_MSTATUS = (TWI0_MSTATUS & ~TWI_BUSSTATE_gm) | TWI_BUSSTATE_IDLE_gc;
-                break;
-
-            default:
-                twi_command.state = TWICmdStateError;
-                break;
+            switch(twi.state)
+            {
+                case TWICmdDevAddr:
+                case TWICmdDataWrite:
+                    if(twi.index < txn->tx_len)
+                    {
+                        TWI0_MDATA = txn->tx_buf[twi.index++];  // Transmit the next byte
+                        twi.state = TWICmdDataWrite;
+                    }
+                    else if(txn->rx_len)
+                    {
+                        // Issue a repeated START, with the device address, and request a read
+                        twi.index = 0;
+                        TWI0_MADDR = (txn->dev_addr << 1) | TWI_CMD_READ;
+                        twi.state = TWICmdDevAddr2;
+                    }
+                    else
+                    {
+                        twi_stop();
+                        twi_txn_complete(TWICmdSuccess);
+                    }
+                    break;
+
+                default:
+                    twi_stop();
+                    twi_txn_complete(TWICmdError);
+                    break;
+            }
         }
     }
-
-    if(TWI0_MSTATUS & TWI_RIF_bm)
+    else if(status & TWI_RIF_bm)
     {
-        if(twi_command.state == TWICmdDataRead)
+        if((twi.state == TWICmdDevAddr2) || (twi.state == TWICmdDataRead))
+        {
+            twi.state = TWICmdDataRead;
+
+            if(twi.index + 1 < txn->rx_len)
+            {
+                // ACK the byte; in smart mode, reading MDATA then starts the next byte
+                TWI0_MCTRLB &= ~TWI_ACKACT_bm;
+                txn->rx_buf[twi.index++] = TWI0_MDATA;
+            }
+            else
+            {
+                // Issue a NACK (to tell the slave that no more data is expected) and a STOP.
+                twi_stop();
+                txn->rx_buf[twi.index] = TWI0_MDATA;
+                twi_txn_complete(TWICmdSuccess);
+            }
+        }
+        else
         {
-            // Issue a NACK (to tell the slave that no more data is expected) and a STOP.
-            TWI0_MCTRLB = (TWI0_MCTRLB & ~TWI_MCMD_gm) | TWI_MCMD_STOP_gc | TWI_ACKACT_bm;
-            twi_command.data = TWI0_MDATA;
+            twi_stop();
+            twi_txn_complete(TWICmdError);
+        }
+    }
+
+    twi_txn_next();                                     // Start the next transaction, if any
+}
 
-            // Return the bus to the idle state
-            TWI0_MSTATUS = (TWI0_MSTATUS & ~TWI_BUSSTATE_gm) | TWI_BUSSTATE_IDLE_gc;
 
-            twi_command.state = TWICmdStateIdle;
+// twi_txn_complete() - record <status> as the outcome of the transaction at the head of the
+// queue, remove it from the queue and invoke its callback.  Must be called with interrupts
+// disabled.
+//
+static void twi_txn_complete(const TWICmdStatus_t status)
+{
+    TWITxn_t * const txn = twi.head;
+
+    twi.head = txn->next;
+    if(!twi.head)
+        twi.tail = NULL;
+
+    twi.state = TWICmdStateIdle;
+    txn->status = status;
+
+    if(txn->callback)
+        txn->callback(txn);
+}
+
+
+// twi_txn_next() - start the transaction at the head of the queue, if the engine is idle.
+// Transactions which cannot be started because another master holds the bus are completed with
+// the status TWICmdBusBusy.  Must be called with interrupts disabled.
+//
+static void twi_txn_next()
+{
+    TWITxn_t *txn;
+
+    while(((txn = twi.head) != NULL) && (twi.state == TWICmdStateIdle))
+    {
+        if(twi_bus_status() == TWIBusStateBusy)
+        {
+            twi_txn_complete(TWICmdBusBusy);
+            continue;
+        }
+
+        twi.index = 0;
+        if(txn->tx_len || !txn->rx_len)
+        {
+            TWI0_MADDR = (txn->dev_addr << 1) | TWI_CMD_WRITE;
+            twi.state = TWICmdDevAddr;
         }
         else
-            twi_command.state = TWICmdStateError;
+        {
+            TWI0_MADDR = (txn->dev_addr << 1) | TWI_CMD_READ;
+            twi.state = TWICmdDevAddr2;
+        }
     }
 }
 
 
+// twi_txn_submit() - append <txn> to the transaction queue, starting it immediately if the bus is
+// free.  Returns TWICmdSuccess if the transaction was queued, or TWICmdBusy if <txn> is already
+// queued.  Completion may be detected by polling <txn->status>, through the transaction's
+// callback, or by calling twi_txn_wait().
+//
+TWICmdStatus_t twi_txn_submit(TWITxn_t * const txn)
+{
+    const uint8_t sreg = SREG;
+
+    cli();
+    if(txn->status == TWICmdBusy)
+    {
+        SREG = sreg;
+        return TWICmdBusy;
+    }
+
+    txn->status = TWICmdBusy;
+    txn->next = NULL;
+
+    if(twi.tail)
+        twi.tail->next = txn;
+    else
+        twi.head = txn;
+    twi.tail = txn;
+
+    twi_txn_next();
+    SREG = sreg;
+
+    return TWICmdSuccess;
+}
+
+
+// twi_txn_busy() - return non-zero if any transaction is queued or in progress.
+//
+uint8_t twi_txn_busy()
+{
+    return twi.head != NULL;
+}
+
+
+// twi_txn_wait() - wait for <txn> to complete, and return its status.  If interrupts are enabled,
+// the core sleeps in idle mode between TWI interrupts.  If the caller has disabled interrupts, or
+// is itself running in an ISR, the engine is instead serviced by polling the interrupt flags.  The
+// sleep mode in force on entry is restored before returning.
+//
+TWICmdStatus_t twi_txn_wait(TWITxn_t * const txn)
+{
+    wait_idle(twi_txn_pending, txn, twi_poll);
+
+    return txn->status;
+}
+
+
+// twi_txn_pending() - wait_idle() callback which returns non-zero while the transaction <arg> is
+// in progress.
+//
+static uint8_t twi_txn_pending(void * const arg)
+{
+    return ((TWITxn_t *) arg)->status == TWICmdBusy;
+}
+
+
+// twi_engine_pending() - wait_idle() callback which returns non-zero while any transaction is
+// queued or in progress.
+//
+static uint8_t twi_engine_pending(void * const arg)
+{
+    return twi_txn_busy();
+}
+
+
+// twi_poll() - wait_idle() callback which services the TWI engine if a master interrupt flag is
+// set.
+//
+static void twi_poll()
+{
+    if(TWI0_MSTATUS & (TWI_WIF_bm | TWI_RIF_bm))
+        twi_service();
+}
+
+
 // twi_configure_master() - configure the default or alternate pin-set for the TWI peripheral and
 // enable "smart mode" (automatic ACK generation).
 //
@@ -133,7 +316,7 @@ void twi_configure_master(const Pinset_t pinset)
     // Force the bus to the "idle" state
     TWI0_MSTATUS = TWI_BUSSTATE_IDLE_gc;
 
-    twi_command.state = TWICmdStateIdle;
+    twi.state = TWICmdStateIdle;
 }
 
 
@@ -164,7 +347,20 @@ uint8_t twi_master_enable(const uint8_t enable)
 //
 TWICmdState_t twi_cmd_get_state()
 {
-    return twi_command.state;
+    switch(twi_command.status)
+    {
+        case TWICmdSuccess:
+            return TWICmdStateIdle;
+
+        case TWICmdBusy:
+            return (twi.head == &twi_command) ? twi.state : TWICmdStateQueued;
+
+        case TWICmdNack:
+            return TWICmdStateNack;
+
+        default:
+            return TWICmdStateError;
+    }
 }
 
 
@@ -174,11 +370,7 @@ TWICmdState_t twi_cmd_get_state()
 //
 uint8_t twi_cmd_state_busy()
 {
-    const TWICmdState_t state = twi_cmd_get_state();
-
-    return ((state != TWICmdStateIdle) &&
-            (state != TWICmdStateNack) &&
-            (state != TWICmdStateError));
+    return twi_command.status == TWICmdBusy;
 }
 
 
@@ -189,7 +381,7 @@ uint8_t twi_cmd_state_busy()
 //
 uint8_t twi_cmd_get_data()
 {
-    return twi_command.data;
+    return twi_command_buf[1];
 }
 
 
@@ -198,41 +390,36 @@ uint8_t twi_cmd_get_data()
 //
 void twi_cmd_reset_state()
 {
-    twi_command.state = TWICmdStateIdle;
+    if(twi_command.status != TWICmdBusy)
+        twi_command.status = TWICmdSuccess;
 }
 
 
-// twi_cmd_start() - helper function for twi_(read|write)_register().  Initiates an asynchronous
+// twi_cmd_start() - helper function for twi_(read|write)_register().  Queues an asynchronous
 // read (if <is_write> equals zero) or write (if <is_write> is non-zero) command specifying the
 // device with address <dev_addr> containing the register identified by <reg_addr>.  The <data>
-// argument contains data to be written in a write command, and is ignore for read commands.
-// Returns a value from the TWICmdStatus_t enumeration to indicate the outcome of command
-// initiation.
+// argument contains data to be written in a write command, and is ignored for read commands.  A
+// read is performed as a single transaction: the register address is written, then the data is
+// read following a repeated START.  Returns a value from the TWICmdStatus_t enumeration to
+// indicate the outcome of command initiation.
 //
 static TWICmdStatus_t twi_cmd_start(const uint8_t dev_addr, const uint8_t reg_addr,
                                     const uint8_t data, const uint8_t is_write)
 {
-    if(twi_command.state != TWICmdStateIdle)
+    if(twi_command.status == TWICmdBusy)
         return TWICmdBusy;
 
-    if(twi_bus_status() != TWIBusStateIdle)
-        return TWICmdBusBusy;
+    twi_command_buf[0] = reg_addr;
+    twi_command_buf[1] = data;
 
     twi_command.dev_addr = dev_addr;
-    twi_command.reg_addr = reg_addr;
-
-    if(is_write)
-    {
-        twi_command.write = 1;
-        twi_command.data = data;
-    }
-    else
-        twi_command.write = 0;
+    twi_command.tx_buf = twi_command_buf;
+    twi_command.tx_len = is_write ? 2 : 1;
+    twi_command.rx_buf = twi_command_buf + 1;
+    twi_command.rx_len = is_write ? 0 : 1;
+    twi_command.callback = NULL;
 
-    TWI0_MADDR = (twi_command.dev_addr << 1) | TWI_CMD_WRITE;
-    twi_command.state = TWICmdDevAddr;
-
-    return TWICmdSuccess;
+    return twi_txn_submit(&twi_command);
 }
 
 
@@ -243,49 +430,28 @@ static TWICmdStatus_t twi_cmd_start(const uint8_t dev_addr, const uint8_t reg_ad
 static TWICmdStatus_t twi_sync_cmd(const uint8_t dev_addr, const uint8_t reg_addr,
                                    uint8_t * const data, const uint8_t is_write)
 {
-    TWICmdStatus_t status;
-
-    while(twi_cmd_state_busy())
-        ;                           // Wait for any pending commands to complete
-
-    while(twi_bus_status() != TWIBusStateIdle)
-        ;                           // Wait for the TWI bus to become idle
-
-    status = is_write ? twi_register_write(dev_addr, reg_addr, *data) :
-                        twi_register_read(dev_addr, reg_addr);
-    if(status != TWICmdSuccess)
-        return status;
-
-    while(twi_cmd_state_busy())
-        ;                           // Wait for the command to complete
-
-    status = twi_cmd_get_state();
-
-    switch(status)
+    uint8_t buf[2];
+    TWITxn_t txn =
     {
-        case TWICmdSuccess:
-            if(!is_write)
-                *data = twi_cmd_get_data();
-            break;
-
-        case TWICmdStateNack:
-        case TWICmdStateError:
-            // If the slave device didn't acknowledge us, or the command failed for any other
-            // reason, reset the state of the command object so that another command can be
-            // initiated.
-            twi_cmd_reset_state();
-            break;
+        .dev_addr = dev_addr,
+        .tx_buf = buf,
+        .tx_len = is_write ? 2 : 1,
+        .rx_buf = data,
+        .rx_len = is_write ? 0 : 1,
+        .callback = NULL,
+        .status = TWICmdSuccess
+    };
 
-        default:
-            // Do nothing
-            break;
-    }
+    buf[0] = reg_addr;
+    buf[1] = *data;
+
+    twi_txn_submit(&txn);
 
-    return status;
+    return twi_txn_wait(&txn);
 }
 
 
-// twi_register_read() - initiate an asynchronous read of the register with address <reg_addr> in
+// twi_register_read() - queue an asynchronous read of the register with address <reg_addr> in
 // the device with address <dev_addr>.  Returns a value from the TWICmdStatus_t enumeration to
 // indicate the outcome of command initiation.
 //
@@ -295,7 +461,7 @@ TWICmdStatus_t twi_register_read(const uint8_t dev_addr, const uint8_t reg_addr)
 }
 
 
-// twi_register_write() - initiate an asynchronous write of the register with address <reg_addr> in
+// twi_register_write() - queue an asynchronous write of the register with address <reg_addr> in
 // the device with address <dev_addr>.  Returns a value from the TWICmdStatus_t enumeration to
 // indicate the outcome of command initiation.
 //
@@ -334,7 +500,8 @@ TWICmdStatus_t twi_sync_register_write(const uint8_t dev_addr, const uint8_t reg
 // will disable the TWI master while the clock rate is changed.  The master will always be left in
 // the same enabled/disabled state as it was before the function was called.  To guarantee this
 // behaviour, any interrupts which may change the enabled/disabled state of the TWI peripheral must
-// be disabled around calls to this function.
+// be disabled around calls to this function.  The first call registers twi_clk_changed() with the
+// clock governor, so that the rate is maintained as the peripheral clock frequency changes.
 //
 uint8_t twi_set_clock(const TWISpeed_t speed)
 {
@@ -342,6 +509,10 @@ uint8_t twi_set_clock(const TWISpeed_t speed)
     uint16_t baud_val;
     uint8_t was_enabled;
 
+    if(!twi_speed)
+        clk_gov_add_hook(twi_clk_changed);
+    twi_speed = speed;
+
     pclk_freq = pclk_get_freq();
     if(!pclk_freq)
         return 0;
@@ -354,8 +525,12 @@ uint8_t twi_set_clock(const TWISpeed_t speed)
         bus_freq = 100e3;
 
     // Calculate value for the MBAUD register.  Add 1 to the value to account for integer rounding;
-    // this is cheesy, but ensures that the specified baud rates are not exceeded.
-    baud_val = 1 + (((pclk_freq / bus_freq) - 10) / 2);
+    // this is cheesy, but ensures that the specified baud rates are not exceeded.  If the
+    // peripheral clock is too slow to reach the bus rate, use the fastest rate available.
+    if(pclk_freq / bus_freq > 10)
+        baud_val = 1 + (((pclk_freq / bus_freq) - 10) / 2);
+    else
+        baud_val = 0;
 
     TWI0_MBAUD = baud_val;
     twi_master_enable(was_enabled);
@@ -364,6 +539,25 @@ uint8_t twi_set_clock(const TWISpeed_t speed)
 }
 
 
+// twi_clk_changed() - clock governor hook which waits for any queued transactions to complete
+// before the peripheral clock frequency changes, and re-derives the MBAUD value for the bus speed
+// last set by twi_set_clock() afterwards.
+//
+void twi_clk_changed(const ClkGovEvent_t event)
+{
+    if(event == ClkGovEventPreChange)
+        wait_idle(twi_engine_pending, NULL, twi_poll);
+    else
+    {
+        const uint8_t sreg = SREG;
+
+        cli();
+        twi_set_clock(twi_speed);
+        SREG = sreg;
+    }
+}
+
+
 // twi_bus_status() - obtain the status of the TWI bus and return it in the form of a TWIBusState_t
 // enum.
 //
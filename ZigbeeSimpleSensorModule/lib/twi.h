@@ -6,6 +6,7 @@
     Stuart Wallace <stuartw@atom.net>, September 2018.
 */
 
+#include "clk.h"
 #include "types.h"
 #include <stdint.h>
 
@@ -19,16 +20,16 @@ typedef enum TWISpeed
 } TWISpeed_t;
 
 
-// TWICmdState_t - state machine for TWI read/write register commands.
+// TWICmdState_t - state machine for TWI transactions.
 //
 typedef enum TWICmdState
 {
     TWICmdStateIdle = 0,    // Command state is idle
     TWICmdStateNack,        // NACK from slave
     TWICmdStateError,       // Unexpected interrupt or other error condition
-    TWICmdDevAddr,          // Waiting for device address to be sent
-    TWICmdRegAddr,          // Waiting for register address to be sent
-    TWICmdDevAddr2,         // Waiting for device address to be sent (second half of read command)
+    TWICmdStateQueued,      // Command is queued behind another transaction
+    TWICmdDevAddr,          // Waiting for device address to be sent (write phase)
+    TWICmdDevAddr2,         // Waiting for device address to be sent (read phase)
     TWICmdDataWrite,        // Waiting for data to be sent
     TWICmdDataRead          // Waiting for data to be received
 } TWICmdState_t;
@@ -40,7 +41,8 @@ typedef enum TWICmdState
 typedef enum TWICmdStatus
 {
     TWICmdSuccess = 0,      // Command successfully initiated
-    TWICmdBusy,             // Command could not be initiated because another command is running
+    TWICmdBusy,             // Command could not be initiated because another command is running,
+                            // or (as a transaction status) the transaction is still in progress
     TWICmdBusBusy,          // Command could not be initiated because the TWI bus is busy
     TWICmdNack,             // No acknowledgment from slave device
     TWICmdTimeout,          // Command timed out
@@ -48,9 +50,39 @@ typedef enum TWICmdStatus
 } TWICmdStatus_t;
 
 
+typedef struct TWITxn TWITxn_t;
+
+
+// TWITxnCallback_t - function called, from the TWI ISR, when a transaction completes.  The
+// transaction's <status> member indicates the outcome.  Callbacks should be brief; typically they
+// post an event for the main loop.
+//
+typedef void (*TWITxnCallback_t)(TWITxn_t * const txn);
+
+
+// TWITxn_t - a TWI transaction.  <tx_len> bytes from <tx_buf> are written to the device with
+// address <dev_addr>; then, if <rx_len> is non-zero, <rx_len> bytes are read from the device into
+// <rx_buf>, following a repeated START if anything was written.  If both lengths are zero, only
+// the device address is sent, which is useful for probing the bus.  Transactions are owned by the
+// caller, and must remain in scope, untouched, until <status> is no longer TWICmdBusy.
+//
+struct TWITxn
+{
+    uint8_t                 dev_addr;       // TWI device address
+    const uint8_t *         tx_buf;         // Data to be written
+    uint8_t                 tx_len;         // Number of bytes to be written
+    uint8_t *               rx_buf;         // Buffer for data read from the device
+    uint8_t                 rx_len;         // Number of bytes to be read
+    TWITxnCallback_t        callback;       // Completion callback, or NULL
+    volatile TWICmdStatus_t status;         // TWICmdBusy until the transaction completes
+    TWITxn_t * volatile     next;           // Next transaction in the queue (internal use)
+};
+
+
 void twi_configure_master(const Pinset_t pinset);
 uint8_t twi_master_enable(const uint8_t enable);
 uint8_t twi_set_clock(const TWISpeed_t speed);
+void twi_clk_changed(const ClkGovEvent_t event);
 TWICmdState_t twi_cmd_get_state();
 uint8_t twi_cmd_state_busy();
 uint8_t twi_cmd_get_data();
@@ -62,6 +94,9 @@ TWICmdStatus_t twi_sync_register_read(const uint8_t dev_addr, const uint8_t reg_
                                       uint8_t * const data);
 TWICmdStatus_t twi_sync_register_write(const uint8_t dev_addr, const uint8_t reg_addr,
                                        uint8_t data);
+TWICmdStatus_t twi_txn_submit(TWITxn_t * const txn);
+uint8_t twi_txn_busy();
+TWICmdStatus_t twi_txn_wait(TWITxn_t * const txn);
 // TODO: reset_nack
 // TODO: reset_err
 
@@ -7,6 +7,8 @@
 #include "usart.h"
 #include "clk.h"
 #include "gpio.h"
+#include <avr/interrupt.h>
+#include "wait.h"
 #include <avr/pgmspace.h>
 
 
@@ -14,6 +16,49 @@
 static const uint8_t hex_map[16] PROGMEM = {'0', '1', '2', '3', '4', '5', '6', '7',
                                             '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
 
+// Transmit and receive ring buffers, drained and filled by the USART0 ISRs
+static volatile struct USARTBuf
+{
+    uint8_t     tx_buf[USART_TX_BUF_LEN];
+    uint8_t     tx_head;                // Index of the oldest byte in <tx_buf>
+    uint8_t     tx_count;               // Number of bytes in <tx_buf>
+    uint8_t     tx_started;             // Non-zero if a byte has been written to TXDATAL
+    uint8_t     rx_buf[USART_RX_BUF_LEN];
+    uint8_t     rx_head;                // Index of the oldest byte in <rx_buf>
+    uint8_t     rx_count;               // Number of bytes in <rx_buf>
+} usart0_buf;
+
+static uint32_t usart0_baud;            // Baud rate last requested from usart0_set_baud_rate()
+
+
+static void usart0_tx_put(const uint8_t data);
+static void usart0_tx_service();
+static void usart0_tx_wait(const uint8_t space);
+static uint8_t usart0_tx_full(void * const arg);
+static void usart0_tx_poll();
+
+
+// ISR(USART0_DRE_vect) - ISR which handles data-register-empty interrupts from USART0 by writing
+// the next byte from the transmit ring buffer.  The interrupt is enabled only while the buffer is
+// not empty.
+//
+ISR(USART0_DRE_vect)
+{
+    usart0_tx_service();
+}
+
+
+// ISR(USART0_RXC_vect) - ISR which handles receive-complete interrupts from USART0 by appending the
+// received byte to the receive ring buffer.  If the buffer is full, the byte is discarded.
+//
+ISR(USART0_RXC_vect)
+{
+    const uint8_t data = USART0_RXDATAL;
+
+    if(usart0_buf.rx_count < USART_RX_BUF_LEN)
+        usart0_buf.rx_buf[(usart0_buf.rx_head + usart0_buf.rx_count++) % USART_RX_BUF_LEN] = data;
+}
+
 
 // usart0_configure_io() - configure the IO pins for the USART module.  The <pinset> argument
 // specifies whether to use the default (if <pinset> == USART0_PINSET_DEFAULT) or alternative (if
@@ -59,22 +104,43 @@ uint8_t usart0_configure_port(const uint32_t baud, const uint8_t bpw, const USAR
 
 // usart0_enable() - selectively enable or disable the USART0 receiver and transmitter based on the
 // value of the <enable> argument.  <enable> is a bitmap of USART_ENABLE_RX and USART_ENABLE_TX.
+// The receive-complete interrupt is enabled along with the receiver.  If the transmitter is
+// disabled, any data awaiting transmission is discarded.
 //
 void usart0_enable(const uint8_t enable)
 {
+    const uint8_t sreg = SREG;
+
+    cli();
+    if(!(enable & USART_ENABLE_TX))
+    {
+        USART0_CTRLA &= ~USART_DREIE_bm;
+        usart0_buf.tx_count = 0;
+        usart0_buf.tx_started = 0;
+    }
+
+    if(enable & USART_ENABLE_RX)
+        USART0_CTRLA |= USART_RXCIE_bm;
+    else
+        USART0_CTRLA &= ~USART_RXCIE_bm;
+
     USART0_CTRLB = (USART0_CTRLB & ~(USART_RXEN_bm | USART_TXEN_bm)) | enable;
+    SREG = sreg;
 }
 
 
 // usart0_set_baud_rate() - attempt to set the USART0 baud rate to the value specified by <baud>.
 // Return non-zero on success, or zero if the specified baud rate is out of range or the peripheral
-// clock frequency cannot be determined.
+// clock frequency cannot be determined.  The baud rate is re-applied by usart0_clk_changed()
+// whenever the peripheral clock frequency changes.
 //
 uint8_t usart0_set_baud_rate(const uint32_t baud)
 {
     const uint32_t pclk_freq = pclk_get_freq();
     uint16_t baudreg_val;
 
+    usart0_baud = baud;
+
     if(!pclk_freq || !baud)
         return 0;
 
@@ -116,6 +182,19 @@ uint32_t usart0_get_baud_rate()
 }
 
 
+// usart0_clk_changed() - clock governor hook which waits for all buffered data to be transmitted
+// before the peripheral clock frequency changes, and re-derives the BAUD register value
+// afterwards.  A byte received while the frequency changes may be corrupted.
+//
+void usart0_clk_changed(const ClkGovEvent_t event)
+{
+    if(event == ClkGovEventPreChange)
+        usart0_flush_tx();
+    else if(usart0_baud)
+        usart0_set_baud_rate(usart0_baud);
+}
+
+
 // usart0_puthex_byte() - write the byte value in <data> to USART0 as a two-character hex string.
 //
 void usart0_puthex_byte(const uint8_t data)
@@ -153,3 +232,159 @@ void usart0_puts_p(const char *str)
         usart0_tx(c);
 }
 
+
+
+// usart0_tx_put() - append <data> to the transmit ring buffer, and enable the data-register-empty
+// interrupt so that it will be transmitted.  The caller must ensure that there is room in the
+// buffer, and that interrupts are disabled.
+//
+static void usart0_tx_put(const uint8_t data)
+{
+    usart0_buf.tx_buf[(usart0_buf.tx_head + usart0_buf.tx_count++) % USART_TX_BUF_LEN] = data;
+    USART0_CTRLA |= USART_DREIE_bm;
+}
+
+
+// usart0_tx_service() - if the transmit ring buffer is not empty, write its oldest byte to the
+// USART0 transmit data register.  Once the buffer is empty, the data-register-empty interrupt is
+// disabled.  Must be called with interrupts disabled, and only when the data register is empty.
+//
+static void usart0_tx_service()
+{
+    if(usart0_buf.tx_count)
+    {
+        USART0_STATUS = USART_TXCIF_bm;     // Clear the transmit-complete flag
+        USART0_TXDATAL = usart0_buf.tx_buf[usart0_buf.tx_head];
+        usart0_buf.tx_head = (usart0_buf.tx_head + 1) % USART_TX_BUF_LEN;
+        --usart0_buf.tx_count;
+        usart0_buf.tx_started = 1;
+    }
+
+    if(!usart0_buf.tx_count)
+        USART0_CTRLA &= ~USART_DREIE_bm;
+}
+
+
+// usart0_tx_wait() - wait until there are at least <space> free bytes in the transmit ring buffer.
+// If interrupts are enabled, the core sleeps in idle mode between USART interrupts.  If the caller
+// has disabled interrupts, or is itself running in an ISR, the buffer is instead drained by polling
+// the data-register-empty flag.  The sleep mode in force on entry is restored before returning.
+//
+static void usart0_tx_wait(const uint8_t space)
+{
+    uint8_t need = space;
+
+    wait_idle(usart0_tx_full, &need, usart0_tx_poll);
+}
+
+
+// usart0_tx_full() - wait_idle() callback which returns non-zero while there are fewer than
+// *<arg> free bytes in the transmit ring buffer.
+//
+static uint8_t usart0_tx_full(void * const arg)
+{
+    return USART_TX_BUF_LEN - usart0_buf.tx_count < *(const uint8_t *) arg;
+}
+
+
+// usart0_tx_poll() - wait_idle() callback which transmits the next buffered byte if the transmit
+// data register is empty.
+//
+static void usart0_tx_poll()
+{
+    if(USART0_STATUS & USART_DREIF_bm)
+        usart0_tx_service();
+}
+
+
+// usart0_tx() - append <data> to the transmit ring buffer, waiting for room if the buffer is full.
+// The function returns once the byte has been buffered; it is transmitted under interrupt control.
+//
+void usart0_tx(const uint8_t data)
+{
+    const uint8_t sreg = SREG;
+
+    cli();
+    while(usart0_buf.tx_count == USART_TX_BUF_LEN)
+    {
+        SREG = sreg;                        // An ISR may fill the buffer again before cli()
+        usart0_tx_wait(1);
+        cli();
+    }
+
+    usart0_tx_put(data);
+    SREG = sreg;
+}
+
+
+// usart0_write() - append the <len> bytes at <data> to the transmit ring buffer, without waiting.
+// Either all of the bytes or none of them are buffered.  Returns non-zero if the bytes were
+// buffered, or zero if there was not enough room.  May be called from an ISR.
+//
+uint8_t usart0_write(const uint8_t * const data, const uint8_t len)
+{
+    const uint8_t sreg = SREG;
+    uint8_t i, ret = 0;
+
+    cli();
+    if(USART_TX_BUF_LEN - usart0_buf.tx_count >= len)
+    {
+        for(i = 0; i < len; ++i)
+            usart0_tx_put(data[i]);
+        ret = 1;
+    }
+    SREG = sreg;
+
+    return ret;
+}
+
+
+// usart0_tx_busy() - return non-zero if data is awaiting transmission, or is being transmitted.
+// The USART must not be stopped (e.g. by entering power-down sleep mode) while this is the case.
+//
+uint8_t usart0_tx_busy()
+{
+    return usart0_buf.tx_count || (usart0_buf.tx_started && !(USART0_STATUS & USART_TXCIF_bm));
+}
+
+
+// usart0_tx_space() - return the number of bytes free in the transmit ring buffer.
+//
+uint8_t usart0_tx_space()
+{
+    return USART_TX_BUF_LEN - usart0_buf.tx_count;
+}
+
+
+// usart0_flush_tx() - wait until all buffered data has been transmitted, including the final
+// byte's stop bit(s).
+//
+void usart0_flush_tx()
+{
+    usart0_tx_wait(USART_TX_BUF_LEN);
+
+    while(usart0_tx_busy())
+        ;
+}
+
+
+// usart0_rx() - if the receive ring buffer is not empty, remove its oldest byte, write it to
+// <data> and return non-zero; otherwise return zero.
+//
+uint8_t usart0_rx(uint8_t * const data)
+{
+    const uint8_t sreg = SREG;
+    uint8_t ret = 0;
+
+    cli();
+    if(usart0_buf.rx_count)
+    {
+        *data = usart0_buf.rx_buf[usart0_buf.rx_head];
+        usart0_buf.rx_head = (usart0_buf.rx_head + 1) % USART_RX_BUF_LEN;
+        --usart0_buf.rx_count;
+        ret = 1;
+    }
+    SREG = sreg;
+
+    return ret;
+}
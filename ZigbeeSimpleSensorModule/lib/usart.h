@@ -7,6 +7,7 @@
 */
 
 #include <avr/io.h>
+#include "clk.h"
 #include "types.h"
 
 
@@ -14,6 +15,13 @@
 #define BPW_MIN                 (5)                 // Minimum allowable bits-per-word
 #define BPW_MAX                 (8)                 // Maximum allowable bits-per-word
 
+#define USART_TX_BUF_LEN        (64)                // Length of the transmit ring buffer
+#define USART_RX_BUF_LEN        (16)                // Length of the receive ring buffer
+
+// Macro giving the minimum peripheral clock frequency at which USART0 can run at <baud> (in the
+// normal, 16-samples-per-bit mode)
+#define USART_PCLK_FREQ_MIN(baud)   (((uint32_t) (baud) * BAUDREG_VAL_MIN) / 4)
+
 
 // USARTParity_t - parity modes
 //
@@ -31,38 +39,6 @@ typedef enum USARTParity
 #define USART_ENABLE_TX         USART_TXEN_bm       // Transmitter-enable flag
 
 
-// usart0_flush_dre() - macro to busy-wait until the USART0 transmit data register is empty.
-//
-#define usart0_flush_dre()                                  \
-            do                                              \
-            {                                               \
-                while(!(USART0_STATUS & USART_DREIF_bm))    \
-                    ;                                       \
-            } while(0)
-
-
-// usart0_flush_tx() - macro to busy-wait until all data has been flushed (i.e. sent) from the
-// USART0 transmit buffer.
-//
-#define usart0_flush_tx()                                   \
-            do                                              \
-            {                                               \
-                while(!(USART0_STATUS & USART_TXCIF_bm))    \
-                    ;                                       \
-            } while(0)
-
-
-// usart0_tx(data) - wait for the USART0 transmit data register to become empty, then coerce the
-// value in <data> to a uint_fast8_t and transmit it over USART0.
-//
-#define usart0_tx(data)                                     \
-            do                                              \
-            {                                               \
-                usart0_flush_dre();                         \
-                USART0_TXDATAL = (uint_fast8_t) data;       \
-            } while (0)
-
-
 void usart0_configure_io(const Pinset_t pinset);
 uint8_t usart0_configure_port(const uint32_t baud, const uint8_t bpw, const USARTParity_t parity);
 void usart0_enable(const uint8_t enable);
@@ -70,7 +46,14 @@ void usart0_puthex_byte(const uint8_t data);
 void usart0_puthex_word(const uint16_t data);
 void usart0_puts(const char *str);
 void usart0_puts_p(const char *str);
+void usart0_tx(const uint8_t data);
+uint8_t usart0_write(const uint8_t * const data, const uint8_t len);
+uint8_t usart0_tx_busy();
+uint8_t usart0_tx_space();
+void usart0_flush_tx();
+uint8_t usart0_rx(uint8_t * const data);
 uint8_t usart0_set_baud_rate(const uint32_t baud);
 uint32_t usart0_get_baud_rate();
+void usart0_clk_changed(const ClkGovEvent_t event);
 
 #endif
@@ -0,0 +1,46 @@
+/*
+    wait.c - definitions relating to waiting for interrupt-driven peripheral activity to complete
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "wait.h"
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+
+// wait_idle() - wait until <busy>(<arg>) returns zero.  If interrupts are enabled, the core sleeps
+// in idle mode, in which the peripherals keep running, until an interrupt ends the wait.  If the
+// caller has disabled interrupts, or is itself running in an ISR (in which case the peripheral's
+// interrupt cannot preempt it), <poll> is instead called repeatedly to service the peripheral; it
+// may be NULL if <busy> needs no servicing.  The sleep mode in force on entry is restored before
+// returning.
+//
+void wait_idle(const WaitBusy_t busy, void * const arg, const WaitPoll_t poll)
+{
+    uint8_t slpctrl;
+
+    if(!wait_can_sleep())
+    {
+        while(busy(arg))
+            if(poll)
+                poll();
+        return;
+    }
+
+    slpctrl = SLPCTRL_CTRLA;
+    set_sleep_mode(SLEEP_MODE_IDLE);
+
+    cli();
+    while(busy(arg))
+    {
+        sleep_enable();
+        sei();                                  // The instruction after SEI always executes, so
+        sleep_cpu();                            // an interrupt can't slip in before we sleep
+        sleep_disable();
+        cli();
+    }
+    sei();
+
+    SLPCTRL_CTRLA = slpctrl;
+}
@@ -0,0 +1,33 @@
+#ifndef LIB_WAIT_H_INC
+#define LIB_WAIT_H_INC
+/*
+    wait.h - declarations relating to waiting for interrupt-driven peripheral activity to complete
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include <stdint.h>
+#include <avr/io.h>
+
+
+// WaitBusy_t - function called by wait_idle() to test whether the wait should continue.  <arg> is
+// the argument passed to wait_idle().  Returns non-zero while the activity is in progress.  May be
+// called with interrupts disabled.
+//
+typedef uint8_t (*WaitBusy_t)(void * const arg);
+
+// WaitPoll_t - function called by wait_idle() when interrupts cannot be taken.  Checks the
+// peripheral's interrupt flag, and does the work of its ISR if the flag is set.
+//
+typedef void (*WaitPoll_t)();
+
+
+// wait_can_sleep() - macro which evaluates to non-zero if the core may sleep while waiting for an
+// interrupt: i.e. if interrupts are enabled and the caller is not itself running in an ISR.
+//
+#define wait_can_sleep()    ((SREG & CPU_I_bm) && !(CPUINT_STATUS & CPUINT_LVL0EX_bm))
+
+
+void wait_idle(const WaitBusy_t busy, void * const arg, const WaitPoll_t poll);
+
+#endif
@@ -9,37 +9,93 @@
 #include <avr/io.h>
 #include <avr/sleep.h>
 #include <avr/interrupt.h>
+#include "lib/adc.h"
 #include "lib/clk.h"
 #include "lib/debug.h"
+#include "lib/event.h"
 #include "lib/gpio.h"
+#include "lib/profile.h"
 #include "lib/rtc.h"
 #include "lib/spi.h"
+#include "lib/twi.h"
+#include "lib/usart.h"
+#include "config.h"
+#include "report.h"
+#include "sched.h"
 #include "sensors.h"
 #include "xbee/xbee.h"
 
+#define DEBUG_LOG_FILE_ID       (1)     // Identifies debug log records from this file
 
-void handle_periodic_irq()
+
+// elapsed_time() - return the time since boot, in seconds, measured by the RTC counter.  The
+// counter runs at RTC_TICKS_PER_S and wraps every 64 seconds, so this must be called more often
+// than that; the wake period is at most 32 seconds.  The counter is used, rather than the wake
+// period, because the first PIT interrupt after a change of period may occur at any point within
+// the new period.  The sub-second remainder is carried over to the next call.
+//
+static uint16_t elapsed_time()
 {
-    static uint8_t counter = 0;
+    static uint16_t now = 0;                        // Seconds since boot
+    static uint16_t last_count = 0;                 // RTC count at the previous call
+    static uint16_t ticks = 0;                      // Ticks not yet counted in <now>
+    const uint16_t count = rtc_get_count();
+
+    ticks += count - last_count;
+    last_count = count;
+
+    now += ticks / RTC_TICKS_PER_S;
+    ticks %= RTC_TICKS_PER_S;
+
+    return now;
+}
+
+
+void handle_periodic_event()
+{
+    uint16_t now;
+    uint8_t report;
+
+    profile_start();                                // Start timing the wake cycle
 
     gpio_set(PIN_LED);
-    ++counter;
+    now = elapsed_time();                           // Time elapsed since boot
 
+    profile_begin(ProfilePhaseSensors);
     sensor_read();
+    profile_end(ProfilePhaseSensors);
 
-    if(!(counter & 0x07))
-    {
-        xbee_set_power_state(XBeePowerStateWake);   // Signal the XBee module to awaken
-        xbee_wait_power_state(XBeePowerStateWake);  // Wait for the XBee module to wake up
+    report = report_add_sample(now);                // Buffer the readings; report if now full
+    if(sched_tick(now))                             // Decide whether to report; adjust wake period
+        report = 1;
+    if(report_deferred(now))
+        report = 0;                                 // Backing off after a failed report
 
-        spi0_port_activate(1);                      // Activate SPI port pins
-        spi0_enable(1);                             // Enable SPI interface
+    if(report)
+    {
+        XBeeTxnStatus_t wake;
 
-        // Transmit data
-        spi0_slave_select(1);
-        // ... transmit all the datas ...
+        profile_begin(ProfilePhaseXBeeWake);
+        xbee_set_power_state(XBeePowerStateWake);   // Signal the XBee module to awaken
+        wake = xbee_wait_power_state(XBeePowerStateWake);   // Wait for the XBee module to wake up
+        profile_end(ProfilePhaseXBeeWake);
+
+        if(wake != XBEE_TXRX_TIMEOUT)               // Skip the transmission if the XBee is hung
+        {
+            profile_begin(ProfilePhaseSPI);
+            clk_gov_set_speed(ClkSpeedFast);        // Run fast for the SPI traffic
+            spi0_port_activate(1);                  // Activate SPI port pins
+            spi0_enable(1);                         // Enable SPI interface
+
+            if(report_send(now) & XBEE_TX_SUCCESS)  // Transmit all buffered samples
+                sched_reported(now);
+            xbee_poll();                            // Handle any frames sent by the XBee
+            clk_gov_set_speed(ClkSpeedSlow);
+            profile_end(ProfilePhaseSPI);
+        }
+        else
+            debug_log("E: XBee wake timeout\n");
 
-        spi0_slave_select(0);                       // De-select the SPI slave
         xbee_set_power_state(XBeePowerStateSleep);  // Ask the XBee module to go to sleep
     }
 
@@ -47,16 +103,35 @@ void handle_periodic_irq()
     spi0_port_activate(0);                          // Deactivate the port
 
     gpio_clear(PIN_LED);
+
+    profile_stop();                                 // Stop timing the wake cycle
+
+    if(report)
+        profile_dump();                             // Report timings on each radio cycle
+}
+
+
+// select_sleep_mode() - return the deepest sleep mode which is safe given the peripheral activity
+// currently in progress.  The SPI, TWI, ADC and USART peripherals are not clocked in power-down
+// mode, so idle mode must be used while an interrupt-driven SPI transfer, TWI transaction or ADC
+// scan is running, or while debug output is draining from the USART0 transmit buffer.
+//
+static uint8_t select_sleep_mode()
+{
+    if(spi0_xfer_busy() || twi_txn_busy() || adc_scan_busy() || usart0_tx_busy())
+        return SLEEP_MODE_IDLE;
+
+    return SLEEP_MODE_PWR_DOWN;
 }
 
 
 // ISR for interrupts from the periodic interrupt timer (PIT).  These interrupts are received every
-// 8 seconds.
+// 8-32 seconds, as determined by the reporting scheduler.  The work is done in the main loop.
 //
 ISR(RTC_PIT_vect)
 {
-    handle_periodic_irq();
     rtc_pit_irq_acknowledge();
+    event_post(EventPeriodic);
 }
 
 
@@ -66,11 +141,14 @@ int main(void)
 {
     cli();
 
-    pclk_set_divisor_val(2);                        // Set peripheral clock = main clock / 2
+    clk_gov_set_speed(ClkSpeedFast);                // Set peripheral clock divisor (see clk.c)
     pclk_enable();                                  // Enable peripheral clock
 
-    // Configure, activate and enable the SPI port
-    spi0_configure_master(SPIPinsetAlternate, SPIClkDiv4);
+    // Configure, activate and enable the SPI port.  The SPI clock prescaler is re-derived by the
+    // clock governor whenever the peripheral clock changes.
+    spi0_configure_master(PinsetAlternative, SPIClkDiv4);
+    spi0_set_clk_freq_max(XBEE_SPI_CLK_FREQ_MAX);
+    clk_gov_add_hook(spi0_clk_changed);
     spi0_port_activate(1);
     spi0_enable(1);
 
@@ -78,26 +156,66 @@ int main(void)
     gpio_make_output(PIN_LED);                      // Make the LED control pin an output
     gpio_clear(PIN_LED);                            // Switch off the LED
 
-    debug_init();                                   // Init debugging (NOP in release mode)
+    profile_init();                                 // Init profiler (NOP unless profiling)
 
     // Configure RTC and periodic interrupt timer (PIT)
     rtc_set_clock(RTCClkInt1K);                     // Select 1kHz ULP osc output as RTC clock
+    rtc_set_prescaler(RTCPrescalerDiv1);            // Count at 1.024kHz; used for timeouts
+    rtc_enable(1);                                  // Start the RTC counter
 
-    rtc_pit_set_period(RTCPITPeriod8192);           // Set PIT IRQ period to 8192 RTC cycles
+    sched_init();                                   // Set initial PIT IRQ period (8s)
     rtc_pit_enable(1);                              // Enable periodic interrupt timer
     rtc_pit_irq_enable(1);                          // Enable periodic interrupt timer interrupts
 
     // Configure and initialise external hardware
-    sensor_init();                                  // Initialise sensors
+    sensor_init();                                  // Initialise sensors; measure the battery
+
+    // Init debugging (NOP in release mode).  This follows sensor_init(), as the clock frequency
+    // is limited, possibly below that needed by the debug baud rate, until the battery voltage
+    // is known.
+    debug_init();
+
     xbee_init();                                    // Initialise the XBee module interface
-    xbee_configure();                               // Set initial configuration in the XBee module
+    config_init();                                  // Restore saved runtime configuration
+    if(!xbee_configure())                           // Set initial configuration in the XBee module
+        debug_log("E: XBee config failed\n");
     xbee_set_power_state(XBeePowerStateSleep);      // Put the XBee module to sleep
 
     debug_flush();                                  // Flush early debug messages, if any
+    clk_gov_set_speed(ClkSpeedSlow);                // Run slowly except during SPI bursts
 
-    set_sleep_mode(SLEEP_MODE_PWR_DOWN);            // Set the lowest-power sleep mode
     sei();                                          // Enable interrupts
 
     while(1)
-        sleep_mode();                               // Await PIT wake-up interrupts
+    {
+        Event_t event;
+
+        while((event = event_get()) != EventNone)  // Handle all pending events
+        {
+            switch(event)
+            {
+                case EventPeriodic:
+                    handle_periodic_event();
+                    break;
+
+                default:
+                    break;
+            }
+        }
+
+        profile_poll();                             // Continue logging profiler statistics
+
+        // Sleep until the next interrupt.  Interrupts are disabled while the queue is checked, so
+        // that an event posted immediately before sleep_cpu() will still wake the CPU.
+        cli();
+        if(!event_pending())
+        {
+            set_sleep_mode(select_sleep_mode());
+            sleep_enable();
+            sei();
+            sleep_cpu();
+            sleep_disable();
+        }
+        sei();
+    }
 }
@@ -0,0 +1,247 @@
+/*
+    report.c - definitions relating to buffering of sensor samples and their transmission in
+    batched report frames
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "report.h"
+#include "lib/debug.h"
+#include <stddef.h>
+
+#define DEBUG_LOG_FILE_ID       (3)     // Identifies debug log records from this file
+
+
+// Ring buffer of samples awaiting transmission
+static SensorSample_t ring[REPORT_RING_LEN];
+static uint8_t ring_head;                   // Index of the oldest sample
+static uint8_t ring_count;                  // Number of samples in the buffer
+
+// Length of the first fragment of a streamed report frame: transmit-request header and report
+// header.  Later fragments each hold one encoded sample.
+#define REPORT_FIRST_CHUNK_LEN  (1 + XBEE_TXRQ_HDR_LEN + REPORT_HDR_LEN)
+
+#if REPORT_SAMPLE_LEN_MAX > REPORT_FIRST_CHUNK_LEN
+#error "The fragment buffer is too small to hold an encoded sample"
+#endif
+
+// State of the report frame being streamed to the XBee module by report_stream_byte()
+static struct ReportStream
+{
+    uint8_t             chunk[REPORT_FIRST_CHUNK_LEN + 1];  // Fragment of frame data (+1: reserve)
+    uint8_t             len;                // Length of the fragment in <chunk>
+    uint8_t             pos;                // Index of the next byte in <chunk> to be transmitted
+    uint8_t             next;               // Index of the next sample, counting from <ring_head>
+    SensorSample_t      prev;               // Sample preceding the next sample
+} stream;
+
+static uint8_t backoff_exp;                 // Consecutive failed reports (capped)
+static uint16_t retry_time;                 // Time before which no report should be attempted
+
+
+// report_add_sample() - append the current sensor readings to the sample buffer, stamped with
+// <timestamp>.  Returns non-zero if the buffer is now full, in which case a report should be sent
+// at once: the buffer holds fewer samples than are taken between heartbeat reports.  If the buffer
+// is already full (e.g. because reports are failing), the oldest sample is discarded to make room.
+//
+uint8_t report_add_sample(const uint16_t timestamp)
+{
+    SensorSample_t *s;
+
+    if(ring_count == REPORT_RING_LEN)
+    {
+        ring_head = (ring_head + 1) % REPORT_RING_LEN;      // Drop the oldest sample
+        --ring_count;
+        debug_log("W: report buffer full; sample dropped\n");
+    }
+
+    s = ring + ((ring_head + ring_count) % REPORT_RING_LEN);
+    s->timestamp = timestamp;
+    sensor_get_values(&s->values);
+
+    return ++ring_count == REPORT_RING_LEN;
+}
+
+
+// report_pending() - return the number of samples awaiting transmission.
+//
+uint8_t report_pending()
+{
+    return ring_count;
+}
+
+
+// report_deferred() - return non-zero if, at time <now>, reporting is being held off following a
+// failed report.  The caller should not wake the XBee module in this case.
+//
+uint8_t report_deferred(const uint16_t now)
+{
+    return backoff_exp && ((int16_t) (now - retry_time) < 0);
+}
+
+
+// zigzag() - map the signed value <val> to an unsigned value whose magnitude is twice that of
+// <val>, with the sign in the LSB: 0 -> 0, -1 -> 1, 1 -> 2, -2 -> 3, etc.
+//
+static uint16_t zigzag(const int16_t val)
+{
+    return ((uint16_t) val << 1) ^ (uint16_t) (val >> 15);
+}
+
+
+// put_varint() - append <val> to the frame under construction in <b> as a varint: seven bits per
+// byte, least-significant first, with bit 7 set in every byte but the last.  If <b> is NULL,
+// nothing is appended.  Returns the length of the varint, in bytes.
+//
+static uint8_t put_varint(XBeeFrameBuilder_t * const b, uint16_t val)
+{
+    uint8_t len = 1;
+
+    for(; val > 0x7f; val >>= 7, ++len)
+        if(b)
+            xbee_frame_put_u8(b, val | 0x80);
+
+    if(b)
+        xbee_frame_put_u8(b, val);
+
+    return len;
+}
+
+
+// put_sample() - append to the frame under construction in <b> the encoded form of sample <s>,
+// relative to the preceding sample <prev> (see report.h).  If <b> is NULL, nothing is appended.
+// Returns the length of the encoded sample, in bytes.
+//
+static uint8_t put_sample(XBeeFrameBuilder_t * const b, const SensorSample_t * const s,
+                          const SensorSample_t * const prev)
+{
+    uint8_t len;
+
+    len = put_varint(b, s->timestamp - prev->timestamp);
+    len += put_varint(b, zigzag(s->values.vbatt - prev->values.vbatt));
+    len += put_varint(b, zigzag(s->values.light - prev->values.light));
+    len += put_varint(b, zigzag(s->values.temp - prev->values.temp));
+
+    return len;
+}
+
+
+// report_stream_byte() - XBee transmit producer callback which returns the next byte of the
+// report frame being streamed.  When the current fragment has been consumed, the next sample is
+// encoded into the fragment buffer.  Called from the SPI ISR.
+//
+static uint8_t report_stream_byte()
+{
+    if(stream.pos == stream.len)
+    {
+        const SensorSample_t * const s = ring + ((ring_head + stream.next++) % REPORT_RING_LEN);
+        XBeeFrameBuilder_t b;
+
+        xbee_frame_begin_data(&b, stream.chunk, sizeof(stream.chunk));
+        put_sample(&b, s, &stream.prev);
+        stream.prev = *s;
+        stream.len = b.len;
+        stream.pos = 0;
+    }
+
+    return stream.chunk[stream.pos++];
+}
+
+
+// report_send() - transmit all buffered samples to the network coordinator, delta-encoding and
+// packing as many as will fit into each Zigbee transmit-request frame.  The XBee module must be
+// awake and the SPI port enabled.  <now> is the current time, in seconds since boot.
+//
+// Each frame is streamed to the XBee module (see xbee_send_stream()): samples are encoded one at a
+// time as the frame is clocked out, so only one fragment of the frame is held in RAM.
+//
+// The delivery status of each frame is tracked.  Samples are removed from the buffer only once the
+// frame carrying them has been delivered.  An undelivered frame is retried up to
+// REPORT_TX_RETRIES times; no more than REPORT_AIRTIME_BUDGET bytes of frames are sent per call.
+// If a frame still cannot be delivered, the function stops and returns a status without the
+// XBEE_TX_SUCCESS flag, leaving the remaining samples buffered, and further reports are deferred
+// (see report_deferred()) by a delay which doubles with each consecutive failure.
+//
+XBeeTxnStatus_t report_send(const uint16_t now)
+{
+    uint8_t budget = REPORT_AIRTIME_BUDGET, retries = REPORT_TX_RETRIES;
+    XBeeTxnStatus_t ret = 0;
+
+    while(ring_count)
+    {
+        const SensorSample_t *s;
+        SensorSample_t prev;
+        XBeeFrameBuilder_t b;
+        XBeeFrameID_t frame_id;
+        uint8_t n, len, sample_len, frame_len, status;
+
+        // Count the samples whose encoded forms fit in one frame
+        prev.timestamp = ring[ring_head].timestamp;
+        prev.values.vbatt = prev.values.light = prev.values.temp = 0;
+        for(n = 0, len = REPORT_HDR_LEN; n < ring_count; ++n)
+        {
+            s = ring + ((ring_head + n) % REPORT_RING_LEN);
+            sample_len = put_sample(NULL, s, &prev);
+
+            if(len + sample_len > XBEE_TXRQ_DATA_MAX)
+                break;
+
+            len += sample_len;
+            prev = *s;
+        }
+
+        frame_len = XBEE_TXRQ_FRAME_LEN(len);
+        if(frame_len > budget)
+            break;                          // Leave the remaining samples for the next wake
+        budget -= frame_len;
+
+        // Build the first fragment of the frame: the transmit-request and report headers.  Radius
+        // 0: use the maximum number of hops.
+        frame_id = xbee_tx_track_begin();
+        xbee_frame_begin_data(&b, stream.chunk, sizeof(stream.chunk));
+        xbee_frame_put_u8(&b, XBeeFrameZigbeeTXRequest);
+        xbee_frame_put_txrq_fields(&b, frame_id, XBEE_ADDR_COORDINATOR, XBEE_NET_ADDR_UNKNOWN, 0,
+                                   0);
+        xbee_frame_put_u8(&b, REPORT_FORMAT_VERSION);
+        xbee_frame_put_u8(&b, n);
+        xbee_frame_put_u16_le(&b, ring[ring_head].timestamp);
+
+        stream.len = b.len;
+        stream.pos = 0;
+        stream.next = 0;
+        stream.prev.timestamp = ring[ring_head].timestamp;
+        stream.prev.values.vbatt = stream.prev.values.light = stream.prev.values.temp = 0;
+
+        ret = xbee_send_stream(report_stream_byte, frame_len - XBEE_FRAME_OVERHEAD);
+
+        // If no tracking slot was available, the frame was sent without requesting a status
+        // frame; assume that it was delivered.
+        status = frame_id ? xbee_tx_track_wait(frame_id) : XBeeTXDelStatusSuccess;
+
+        if(!(ret & XBEE_TX_SUCCESS) || (status != XBeeTXDelStatusSuccess))
+        {
+            debug_log("E: report send failed: %04x/%02x\n", ret, status);
+            ret &= ~XBEE_TX_SUCCESS;
+
+            if((ret & XBEE_TX_BAD_FRAME_SIZE) || !retries--)
+                break;
+
+            continue;                       // Retry the same samples
+        }
+
+        ring_head = (ring_head + n) % REPORT_RING_LEN;
+        ring_count -= n;
+        retries = REPORT_TX_RETRIES;
+    }
+
+    if(ret & XBEE_TX_SUCCESS)
+        backoff_exp = 0;
+    else if(ring_count)
+    {
+        retry_time = now + (REPORT_BACKOFF_BASE_S << backoff_exp);
+        if(backoff_exp < REPORT_BACKOFF_MAX_EXP)
+            ++backoff_exp;
+    }
+
+    return ret;
+}
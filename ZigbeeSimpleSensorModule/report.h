@@ -0,0 +1,58 @@
+#ifndef REPORT_H_INC
+#define REPORT_H_INC
+/*
+    report.h - declarations relating to buffering of sensor samples and their transmission in
+    batched report frames
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+
+    Report payload format (version REPORT_FORMAT_VERSION), carried in the data field of a Zigbee
+    transmit-request frame.  Multi-byte header values are little-endian.
+
+        offset  size    field
+        0       1       format version
+        1       1       number of samples, N
+        2       2       timestamp of the first sample, in seconds since boot
+        4       ...     N samples, oldest first, each comprising four varints:
+                            seconds elapsed since the previous sample (0 for the first)
+                            zigzag(battery voltage - previous battery voltage), mV
+                            zigzag(light level - previous light level), lux
+                            zigzag(temperature - previous temperature), 0.01 degC
+
+    Differences are taken modulo 2^16.  The "previous" readings of the first sample in each
+    payload are zero.  A varint holds an unsigned value, least-significant seven bits first, in
+    one or more bytes; bit 7 of each byte is set if another byte follows.  zigzag() maps signed
+    values to unsigned ones, so that small changes in either direction encode in one byte:
+    0 -> 0, -1 -> 1, 1 -> 2, -2 -> 3, etc.  See tools/report_decode.py for a reference decoder.
+*/
+
+#include <stdint.h>
+#include "sensors.h"
+#include "xbee/xbee.h"
+
+
+#define REPORT_FORMAT_VERSION   (3)     // Version number of the report payload format
+#define REPORT_RING_LEN         (8)     // Number of samples buffered; a report is sent when full
+#define REPORT_HDR_LEN          (4)     // Length of the report payload header, in bytes
+#define REPORT_SAMPLE_LEN_MAX   (12)    // Max length of an encoded sample, in bytes
+#define REPORT_TX_RETRIES       (1)     // Immediate retries of an undelivered frame, per wake
+#define REPORT_AIRTIME_BUDGET   (192)   // Max frame bytes transmitted per wake
+#define REPORT_BACKOFF_BASE_S   (32)    // Delay before retrying after a failed report, in seconds
+#define REPORT_BACKOFF_MAX_EXP  (4)     // Max doublings of the retry delay (i.e. 32s << 4 = 512s)
+
+// SensorSample_t - a set of sensor readings, in engineering units, together with the time at which
+// they were taken
+//
+typedef struct SensorSample
+{
+    uint16_t            timestamp;      // Seconds since boot
+    SensorValues_t      values;
+} SensorSample_t;
+
+
+uint8_t report_add_sample(const uint16_t timestamp);
+uint8_t report_pending();
+uint8_t report_deferred(const uint16_t now);
+XBeeTxnStatus_t report_send(const uint16_t now);
+
+#endif
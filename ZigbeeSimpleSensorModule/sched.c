@@ -0,0 +1,146 @@
+/*
+    sched.c - definitions relating to the reporting scheduler, which decides on each wake whether
+    a report should be transmitted, and how long to sleep before the next wake
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "sched.h"
+#include "lib/rtc.h"
+#include <avr/pgmspace.h>
+
+
+// Map of wake-period "shift" values (see SchedConfig_t) to PIT periods.  The RTC is clocked at
+// 1.024kHz, so each entry is twice the length of the previous one, starting at 8 seconds.
+static const uint8_t pit_period_map[] PROGMEM =
+{
+    RTCPITPeriod8192, RTCPITPeriod16384, RTCPITPeriod32768
+};
+
+static SchedConfig_t config =
+{
+    .deadband =
+    {
+        .vbatt = SCHED_DEADBAND_VBATT,
+        .light = SCHED_DEADBAND_LIGHT,
+        .temp = SCHED_DEADBAND_TEMP
+    },
+    .min_interval = SCHED_MIN_INTERVAL_S,
+    .heartbeat = SCHED_HEARTBEAT_S,
+    .stable_wakes = SCHED_STABLE_WAKES,
+    .max_period_shift = SCHED_MAX_PERIOD_SHIFT
+};
+
+static SensorReadings_t last_reported;      // Readings at the time of the last report
+static uint16_t last_report_time;           // Time of the last report, in seconds since boot
+static uint8_t have_reported;               // Non-zero once a report has been transmitted
+static uint8_t stable_count;                // Number of consecutive stable wakes
+static uint8_t period_shift;                // Current wake period = 8s << this value
+
+
+// set_period() - set the wake period to (8s << <shift>) and reprogram the PIT accordingly.
+//
+static void set_period(const uint8_t shift)
+{
+    period_shift = shift;
+    rtc_pit_set_period(pgm_read_byte(pit_period_map + shift));
+}
+
+
+// exceeds() - return non-zero if <a> and <b> differ by more than <deadband>.
+//
+static uint8_t exceeds(const uint16_t a, const uint16_t b, const uint16_t deadband)
+{
+    return ((a > b) ? a - b : b - a) > deadband;
+}
+
+
+// sched_init() - initialise the scheduler and set the PIT to the shortest wake period.
+//
+void sched_init()
+{
+    have_reported = 0;
+    stable_count = 0;
+    set_period(0);
+}
+
+
+// sched_get_config() - return a pointer to the scheduler configuration.
+//
+const SchedConfig_t *sched_get_config()
+{
+    return &config;
+}
+
+
+// sched_set_config() - replace the scheduler configuration with <c>, which must be valid (see
+// sched_config_valid()).  May be called at any time between wakes.  If the current wake period is
+// longer than the new maximum, it is shortened to the maximum at once.
+//
+void sched_set_config(const SchedConfig_t * const c)
+{
+    config = *c;
+
+    if(period_shift > config.max_period_shift)
+        set_period(config.max_period_shift);
+}
+
+
+// sched_config_valid() - return non-zero if the scheduler configuration in <c> is usable: i.e. if
+// the wake period may be doubled only after at least one stable wake, and no further than the
+// longest supported period, and the heartbeat interval is no shorter than the minimum interval.
+//
+uint8_t sched_config_valid(const SchedConfig_t * const c)
+{
+    return c->stable_wakes && (c->max_period_shift <= SCHED_MAX_PERIOD_SHIFT) &&
+           (c->heartbeat >= c->min_interval);
+}
+
+
+// sched_tick() - called once per wake, at time <now> (in seconds since boot), after the sensors
+// have been read.  Compares the current readings with those last reported.  If any reading has
+// moved outside its deadband, the wake period is reset to its shortest value; otherwise, once the
+// readings have been stable for <stable_wakes> consecutive wakes, the wake period is doubled, up
+// to the configured maximum.  Returns non-zero if a report should be transmitted now: i.e. if no
+// report has yet been sent, if a reading has changed and at least <min_interval> seconds have
+// passed since the last report, or if <heartbeat> seconds have passed since the last report.
+//
+uint8_t sched_tick(const uint16_t now)
+{
+    const uint16_t elapsed = now - last_report_time;
+    SensorReadings_t r;
+    uint8_t changed;
+
+    sensor_get_readings(&r);
+
+    changed = exceeds(r.vbatt, last_reported.vbatt, config.deadband.vbatt) ||
+              exceeds(r.light, last_reported.light, config.deadband.light) ||
+              exceeds(r.temp, last_reported.temp, config.deadband.temp);
+
+    if(changed)
+    {
+        stable_count = 0;
+        if(period_shift)
+            set_period(0);
+    }
+    else if(++stable_count >= config.stable_wakes)
+    {
+        stable_count = 0;
+        if((period_shift < config.max_period_shift) && (period_shift < SCHED_MAX_PERIOD_SHIFT))
+            set_period(period_shift + 1);
+    }
+
+    return !have_reported || (changed && (elapsed >= config.min_interval)) ||
+           (elapsed >= config.heartbeat);
+}
+
+
+// sched_reported() - record that a report carrying the current readings was successfully
+// transmitted at time <now>.
+//
+void sched_reported(const uint16_t now)
+{
+    sensor_get_readings(&last_reported);
+    last_report_time = now;
+    have_reported = 1;
+}
@@ -0,0 +1,45 @@
+#ifndef SCHED_H_INC
+#define SCHED_H_INC
+/*
+    sched.h - declarations relating to the reporting scheduler, which decides on each wake whether
+    a report should be transmitted, and how long to sleep before the next wake
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include <stdint.h>
+#include "sensors.h"
+
+
+// Default scheduler configuration.  Deadbands are given in 10-bit ADC counts, and scaled to the
+// resolution of the readings (see SENSOR_READING_BITS) so that they do not tighten as the
+// oversampling ratio rises.
+#define SCHED_DEADBAND_VBATT        (8 << SENSOR_OVERSAMPLE_BITS)   // Battery voltage deadband
+#define SCHED_DEADBAND_LIGHT        (16 << SENSOR_OVERSAMPLE_BITS)  // Light level deadband
+#define SCHED_DEADBAND_TEMP         (4 << SENSOR_OVERSAMPLE_BITS)   // Temperature deadband
+#define SCHED_MIN_INTERVAL_S        (32)    // Minimum time between reports, in seconds
+#define SCHED_HEARTBEAT_S           (900)   // Maximum time between reports, in seconds
+#define SCHED_STABLE_WAKES          (4)     // Stable wakes before the wake period is doubled
+#define SCHED_MAX_PERIOD_SHIFT      (2)     // Longest wake period = 8s << this value (max 2)
+
+
+// SchedConfig_t - scheduler configuration.
+//
+typedef struct SchedConfig
+{
+    SensorReadings_t    deadband;           // Change in each reading which triggers a report
+    uint16_t            min_interval;       // Minimum time between reports, in seconds
+    uint16_t            heartbeat;          // Maximum time between reports, in seconds
+    uint8_t             stable_wakes;       // Stable wakes before the wake period is doubled
+    uint8_t             max_period_shift;   // Longest wake period = 8s << this value (max 2)
+} SchedConfig_t;
+
+
+void sched_init();
+const SchedConfig_t *sched_get_config();
+void sched_set_config(const SchedConfig_t * const c);
+uint8_t sched_config_valid(const SchedConfig_t * const c);
+uint8_t sched_tick(const uint16_t now);
+void sched_reported(const uint16_t now);
+
+#endif
@@ -5,64 +5,252 @@
 */
 
 #include "sensors.h"
+#include "calib.h"
 #include "lib/adc.h"
+#include "lib/clk.h"
 #include "lib/debug.h"
 #include "lib/gpio.h"
+#include "lib/profile.h"
+#include "lib/rtc.h"
 #include "lib/vref.h"
 #include "platform.h"
-#include <util/delay.h>
+#include <util/delay_basic.h>
+
+#define DEBUG_LOG_FILE_ID       (5)     // Identifies debug log records from this file
 
 
 #define ADCVBatt                ADCChannel1         // Battery voltage input
 #define ADCTemp                 ADCChannel2         // Thermistor input
 #define ADCLight                ADCChannel3         // Light sensor input
 
+#define SENSOR_ADC_CLK_FREQ     (125000UL)          // Max ADC clock frequency, in Hz
+
+// ADC sample accumulation corresponding to SENSOR_OVERSAMPLE_BITS (see sensors.h)
+#if SENSOR_OVERSAMPLE_BITS == 1
+#define SENSOR_ADC_SAMPNUM      ADCSampleNum4
+#elif SENSOR_OVERSAMPLE_BITS == 2
+#define SENSOR_ADC_SAMPNUM      ADCSampleNum16
+#elif SENSOR_OVERSAMPLE_BITS == 3
+#define SENSOR_ADC_SAMPNUM      ADCSampleNum64
+#elif SENSOR_OVERSAMPLE_BITS != 0
+#error "SENSOR_OVERSAMPLE_BITS must be in the range 0-3"
+#endif
+
+// Sensor settling.  If SENSOR_SETTLE_ON_RTC_EVENT is non-zero, the core sleeps while the sensors
+// settle, and the ADC scan is started by an RTC compare-match event SENSOR_SETTLE_TICKS RTC ticks
+// later (i.e. after 1-2ms).  Otherwise the core busy-waits for SENSOR_SETTLE_US and then starts
+// the scan; the length of the busy-wait loop is recalculated whenever the clock governor changes
+// the peripheral clock (which also clocks the CPU) frequency.
+#ifndef SENSOR_SETTLE_ON_RTC_EVENT
+#define SENSOR_SETTLE_ON_RTC_EVENT  (0)
+#endif
+#define SENSOR_SETTLE_TICKS     (2)
+#define SENSOR_SETTLE_US        (50)
+
+
+// Channels converted by each ADC scan.  The order of this list determines the order of the results
+// returned by the scan; see SensorScanIndex_t.
+static const ADCChannel_t scan_channels[] = {ADCLight, ADCTemp, ADCVBatt};
+
+typedef enum SensorScanIndex
+{
+    SensorScanLight     = 0,
+    SensorScanTemp      = 1,
+    SensorScanVBatt     = 2,
+    SensorScan_end                  // Placeholder value
+} SensorScanIndex_t;
+
+
+// SENSOR_FILTER_HIST() - macro giving the number of past readings kept by a filter of type <type>
+// with a window of (1 << <shift>) readings
+#define SENSOR_FILTER_HIST(type, shift) \
+    (((type) == SensorFilterBoxcar) ? (1 << (shift)) : ((type) == SensorFilterMedian3) ? 2 : 1)
+
+#define SENSOR_MAX(a, b)        (((a) > (b)) ? (a) : (b))
+
+// Number of past readings kept for each channel: enough for the most demanding filter
+#define SENSOR_FILTER_HIST_LEN \
+    SENSOR_MAX(SENSOR_FILTER_HIST(SENSOR_FILTER_VBATT, SENSOR_FILTER_VBATT_SHIFT), \
+    SENSOR_MAX(SENSOR_FILTER_HIST(SENSOR_FILTER_LIGHT, SENSOR_FILTER_LIGHT_SHIFT), \
+               SENSOR_FILTER_HIST(SENSOR_FILTER_TEMP, SENSOR_FILTER_TEMP_SHIFT)))
 
-// Struct which accumulates sensor values
-typedef struct SensorReadings
+
+// SensorFilter_t - filter descriptor: the type of filter applied to a channel, and its window
+//
+typedef struct SensorFilter
 {
-    uint16_t    vbatt;
-    uint16_t    light;
-    uint16_t    temp;
-} SensorReadings_t;
+    SensorFilterType_t  type;
+    uint8_t             shift;              // Window length = 1 << shift readings
+} SensorFilter_t;
 
-static SensorReadings_t acc;
-static const uint8_t avg_len = 8;
+// Filter descriptors, by channel.  These are constant, so that the filter code for each channel is
+// resolved at compile time.
+static const SensorFilter_t filters[SensorChannel_end] =
+{
+    [SensorChannelVBatt]    = {SENSOR_FILTER_VBATT, SENSOR_FILTER_VBATT_SHIFT},
+    [SensorChannelLight]    = {SENSOR_FILTER_LIGHT, SENSOR_FILTER_LIGHT_SHIFT},
+    [SensorChannelTemp]     = {SENSOR_FILTER_TEMP, SENSOR_FILTER_TEMP_SHIFT}
+};
+
+// Filter state, by channel
+static struct SensorFilterState
+{
+    uint32_t    acc;                        // EMA: average << shift; boxcar: sum of window;
+                                            // median: current median
+    uint16_t    hist[SENSOR_FILTER_HIST_LEN];   // Boxcar: window; median: last two readings
+    uint8_t     index;                      // Boxcar: index of the oldest reading in <hist>
+    uint8_t     shift;                      // EMA: current time constant (may be changed)
+} filter_state[SensorChannel_end];
+
+#if !SENSOR_SETTLE_ON_RTC_EVENT
+static uint16_t settle_loops;               // _delay_loop_2() iterations lasting SENSOR_SETTLE_US
+#endif
+
+
+static void sensor_scan(uint16_t * const res);
+#if !SENSOR_SETTLE_ON_RTC_EVENT
+static void sensor_clk_changed(const ClkGovEvent_t event);
+#endif
+
+
+// filter_shift() - return the window length shift currently in use for <channel>.
+//
+static inline __attribute__((always_inline)) uint8_t filter_shift(const SensorChannel_t channel)
+{
+    return (filters[channel].type == SensorFilterEMA) ? filter_state[channel].shift
+                                                      : filters[channel].shift;
+}
+
+
+// filter_output() - return the current filtered value of <channel>.
+//
+static inline __attribute__((always_inline)) uint16_t filter_output(const SensorChannel_t channel)
+{
+    const uint8_t shift = filter_shift(channel);
+
+    if(filters[channel].type == SensorFilterMedian3)
+        return filter_state[channel].acc;
+
+    return (filter_state[channel].acc + ((1UL << shift) >> 1)) >> shift;
+}
+
+
+// filter_prime() - initialise the filter for <channel> as though every past reading had been
+// <reading>.
+//
+static inline __attribute__((always_inline)) void filter_prime(const SensorChannel_t channel,
+                                                               const uint16_t reading)
+{
+    struct SensorFilterState * const f = filter_state + channel;
+    uint8_t i;
+
+    for(i = 0; i < SENSOR_FILTER_HIST(filters[channel].type, filters[channel].shift); ++i)
+        f->hist[i] = reading;
+
+    f->index = 0;
+
+    if(filters[channel].type == SensorFilterMedian3)
+        f->acc = reading;
+    else
+        f->acc = (uint32_t) reading << filter_shift(channel);
+}
+
+
+// filter_update() - pass a new <reading> through the filter for <channel>.
+//
+static inline __attribute__((always_inline)) void filter_update(const SensorChannel_t channel,
+                                                                const uint16_t reading)
+{
+    struct SensorFilterState * const f = filter_state + channel;
+    uint16_t a, b;
+
+    switch(filters[channel].type)
+    {
+        case SensorFilterEMA:
+            f->acc -= (f->acc + ((1UL << f->shift) >> 1)) >> f->shift;
+            f->acc += reading;
+            break;
+
+        case SensorFilterBoxcar:
+            f->acc += reading;
+            f->acc -= f->hist[f->index];
+            f->hist[f->index] = reading;
+            f->index = (f->index + 1) & ((1 << filters[channel].shift) - 1);
+            break;
+
+        case SensorFilterMedian3:
+            a = f->hist[0];
+            b = f->hist[1];
+            f->hist[0] = b;
+            f->hist[1] = reading;
+
+            if(a > b)
+            {
+                const uint16_t t = a;
+                a = b;
+                b = t;
+            }
+            f->acc = (reading < a) ? a : (reading > b) ? b : reading;
+            break;
+    }
+}
 
 
 // sensor_init() - initialise sensor system by configuring voltage reference and ADC modules,
-// making the SENSOR_nENABLE pin an output, and performing an initial read of the sensors.
+// making the SENSOR_nENABLE pin an output, and performing an initial read of the sensors.  The
+// battery voltage is passed to the clock governor, which limits the clock frequency until it is
+// known.
 //
 void sensor_init()
 {
+    uint16_t res[SensorScan_end];
+
     // Configure voltage reference module
     vref_set(VRefADC0, VRef2V5);                    // Select 2.5V internal reference for ADCs
 
     // Configure ADC module
     adc_set_vref(ADCRefInternal, 1);                // Set ADC ref voltage and reduce sample cap
-    adc_set_prescaler(ADCPrescaleDiv64);            // Set ADC clock = main clock / 64
+    adc_set_clk_freq_max(SENSOR_ADC_CLK_FREQ);      // Set ADC clock prescaler, and re-derive it
+    clk_gov_add_hook(adc_clk_changed);              // whenever the peripheral clock changes
+#if !SENSOR_SETTLE_ON_RTC_EVENT
+    sensor_clk_changed(ClkGovEventPostChange);      // Calculate the settling delay, and
+    clk_gov_add_hook(sensor_clk_changed);           // recalculate it as the clock changes
+#endif
     adc_set_initdelay(ADCInitDelay64);              // Set ADC startup delay to 64 ADC clocks
 
     adc_configure_input(PIN_AIN_VBATT);             // }
     adc_configure_input(PIN_AIN_TEMP);              // } Configure analogue inputs as ADC input pins
     adc_configure_input(PIN_AIN_LIGHT);             // }
 
-    acc.vbatt = 0;
-    acc.light = 0;
-    acc.temp = 0;
-
     gpio_make_output(PIN_SENSOR_nENABLE);
-    sensor_read();
-
-    // Multiply the first set of readings by the length of the moving average, so that the global
-    // accumulator contains a correctly-scaled value.  This value will always be divided by
-    // <avg_len> before being used.
-    acc.vbatt *= avg_len;
-    acc.light *= avg_len;
-    acc.temp *= avg_len;
+    sensor_scan(res);
+
+    // Prime each channel's filter with the first set of readings, and set the EMA time constants
+    filter_state[SensorChannelVBatt].shift = SENSOR_FILTER_VBATT_SHIFT;
+    filter_state[SensorChannelLight].shift = SENSOR_FILTER_LIGHT_SHIFT;
+    filter_state[SensorChannelTemp].shift = SENSOR_FILTER_TEMP_SHIFT;
+
+    filter_prime(SensorChannelVBatt, res[SensorScanVBatt] >> SENSOR_OVERSAMPLE_BITS);
+    filter_prime(SensorChannelLight, res[SensorScanLight] >> SENSOR_OVERSAMPLE_BITS);
+    filter_prime(SensorChannelTemp, res[SensorScanTemp] >> SENSOR_OVERSAMPLE_BITS);
+
+    clk_gov_set_vbatt(calib_vbatt_mv(filter_output(SensorChannelVBatt)));
 }
 
 
+#if !SENSOR_SETTLE_ON_RTC_EVENT
+// sensor_clk_changed() - clock governor hook which recalculates the number of iterations of the
+// four-cycle _delay_loop_2() loop which last SENSOR_SETTLE_US at the new CPU clock frequency,
+// rounding up.
+//
+static void sensor_clk_changed(const ClkGovEvent_t event)
+{
+    if(event == ClkGovEventPostChange)
+        settle_loops = ((pclk_get_freq() / 1000) * SENSOR_SETTLE_US + 3999) / 4000;
+}
+#endif
+
+
 // sensor_activate() - activate (if <activate> is non-zero) or de-activate (if <activate> equals
 // zero) sensors by asserting or negating the SENSOR_nENABLE output pin.
 //
@@ -75,37 +263,141 @@ void sensor_activate(const uint8_t activate)
 }
 
 
-// sensor_read() - activate sensors, ADC, and the VREF module; read sensors; update the moving
-// average values in the global struct <acc>; deactivate sensors, ADC and the VREF module.
+// sensor_scan() - activate sensors, ADC, and the VREF module; read sensors into <res>, in the
+// order given by SensorScanIndex_t; deactivate sensors, ADC and the VREF module.
 //
-void sensor_read()
+static void sensor_scan(uint16_t * const res)
 {
     sensor_activate(1);                         // Enable analogue sensors
 
     vref_enable(VRefADC0, 1);                   // Enable ADC voltage reference
     adc_enable(1);                              // Enable ADC module
+#if SENSOR_OVERSAMPLE_BITS
+    adc_set_accumulation(SENSOR_ADC_SAMPNUM);   // Oversample in hardware
+#endif
 
-    _delay_us(50);                              // Wait for the sensors to stabilise
-
-    acc.light -= ((acc.light + (avg_len / 2)) / avg_len);
-    acc.light += adc_convert_channel(ADCLight);
-
-    acc.temp -= ((acc.temp + (avg_len / 2)) / avg_len);
-    acc.temp += adc_convert_channel(ADCTemp);
-
-    acc.vbatt -= ((acc.vbatt + (avg_len / 2)) / avg_len);
-    acc.vbatt += adc_convert_channel(ADCVBatt);
+#if SENSOR_SETTLE_ON_RTC_EVENT
+    // Sleep while the sensors stabilise; the RTC starts the scan
+    adc_connect_event(ADCEventRTCCompare);
+    rtc_set_compare(rtc_get_count() + SENSOR_SETTLE_TICKS);
+    adc_scan_start(scan_channels, res, SensorScan_end, ADCTriggerEvent);
+#else
+    _delay_loop_2(settle_loops);                // Wait for the sensors to stabilise
+    adc_scan_start(scan_channels, res, SensorScan_end, ADCTriggerSoftware);
+#endif
+    adc_scan_wait();                            // Sleep until all channels are converted
 
+#if SENSOR_OVERSAMPLE_BITS
+    adc_set_accumulation(ADCSampleNum1);
+#endif
     adc_enable(0);                              // Disable ADC
     vref_enable(VRefADC0, 0);                   // Disable voltage reference
 
     sensor_activate(0);                         // Disable analogue sensors
+}
+
+
+// sensor_read() - read sensors, pass the readings through each channel's filter, and update the
+// clock governor with the battery voltage.
+//
+void sensor_read()
+{
+    uint16_t res[SensorScan_end];
+
+    sensor_scan(res);
+
+    filter_update(SensorChannelVBatt, res[SensorScanVBatt] >> SENSOR_OVERSAMPLE_BITS);
+    filter_update(SensorChannelLight, res[SensorScanLight] >> SENSOR_OVERSAMPLE_BITS);
+    filter_update(SensorChannelTemp, res[SensorScanTemp] >> SENSOR_OVERSAMPLE_BITS);
+
+    // Keep the clock within the safe operating area for the battery voltage
+    clk_gov_set_vbatt(calib_vbatt_mv(filter_output(SensorChannelVBatt)));
+
+    profile_begin(ProfilePhaseDebug);
+    debug_log("vbatt=%04x temp=%04x light=%04x\n", filter_output(SensorChannelVBatt),
+              filter_output(SensorChannelTemp), filter_output(SensorChannelLight));
+    profile_end(ProfilePhaseDebug);
+}
+
+
+// sensor_get_readings() - write the current filtered value of each sensor channel to the struct
+// pointed to by <readings>.
+//
+void sensor_get_readings(SensorReadings_t * const readings)
+{
+    readings->vbatt = filter_output(SensorChannelVBatt);
+    readings->light = filter_output(SensorChannelLight);
+    readings->temp = filter_output(SensorChannelTemp);
+}
+
+
+// sensor_get_values() - write the current filtered value of each sensor channel, converted
+// into engineering units, to the struct pointed to by <values>.
+//
+void sensor_get_values(SensorValues_t * const values)
+{
+    SensorReadings_t readings;
+
+    sensor_get_readings(&readings);
+    calib_convert(&readings, values);
+}
+
+
+// sensor_get_filter_shift() - return the window length of the filter applied to <channel>,
+// expressed as a power of two.
+//
+uint8_t sensor_get_filter_shift(const SensorChannel_t channel)
+{
+    switch(channel)
+    {
+        case SensorChannelVBatt:
+            return filter_shift(SensorChannelVBatt);
+
+        case SensorChannelLight:
+            return filter_shift(SensorChannelLight);
+
+        case SensorChannelTemp:
+            return filter_shift(SensorChannelTemp);
+
+        default:
+            return 0;
+    }
+}
+
+
+// sensor_filter_shift_valid() - return non-zero if <shift> may be passed to
+// sensor_set_filter_shift() for <channel>: i.e. if it equals the current window length shift, or
+// if the channel's filter is an EMA and <shift> does not exceed SENSOR_EMA_SHIFT_MAX.  Only EMA
+// windows may be changed at runtime, as the storage for other filters is sized at compile time.
+//
+uint8_t sensor_filter_shift_valid(const SensorChannel_t channel, const uint8_t shift)
+{
+    if(channel >= SensorChannel_end)
+        return 0;
+
+    return (shift == sensor_get_filter_shift(channel)) ||
+           ((filters[channel].type == SensorFilterEMA) && (shift <= SENSOR_EMA_SHIFT_MAX));
+}
+
+
+// sensor_set_filter_shift() - set the window length of the filter applied to <channel> to
+// (1 << <shift>) readings, rescaling its accumulator so that the current output is preserved.
+// Returns non-zero on success, or zero if sensor_filter_shift_valid() rejects <shift>.
+//
+uint8_t sensor_set_filter_shift(const SensorChannel_t channel, const uint8_t shift)
+{
+    uint16_t out;
+
+    if(!sensor_filter_shift_valid(channel, shift))
+        return 0;
+
+    if(filters[channel].type == SensorFilterEMA)
+    {
+        out = (filter_state[channel].acc + ((1UL << filter_state[channel].shift) >> 1)) >>
+                filter_state[channel].shift;
+        filter_state[channel].acc = (uint32_t) out << shift;
+        filter_state[channel].shift = shift;
+    }
 
-    debug_putstr_p("vbatt=");
-    debug_puthex_word((acc.vbatt + (avg_len / 2)) / avg_len);
-    debug_putstr_p(" temp=");
-    debug_puthex_word((acc.temp + (avg_len / 2)) / avg_len);
-    debug_putstr_p(" light=");
-    debug_puthex_word((acc.light + (avg_len / 2)) / avg_len);
-    debug_putchar('\n');
+    return 1;
 }
@@ -9,8 +9,90 @@
 #include <stdint.h>
 
 
+// Hardware oversampling.  If SENSOR_OVERSAMPLE_BITS is non-zero, each reading is the sum of
+// 4^SENSOR_OVERSAMPLE_BITS conversions accumulated by the ADC, decimated to give that many extra
+// bits of resolution.  Readings are then (10 + SENSOR_OVERSAMPLE_BITS)-bit values.  The maximum
+// is 3 (64 conversions); 0 selects a single conversion per reading.  May be overridden from the
+// build settings.
+#ifndef SENSOR_OVERSAMPLE_BITS
+#define SENSOR_OVERSAMPLE_BITS  (0)
+#endif
+
+#define SENSOR_READING_BITS     (10 + SENSOR_OVERSAMPLE_BITS)   // Resolution of each reading
+
+#define SENSOR_EMA_SHIFT_MAX    (8)     // Max EMA time constant = 1 << this value readings
+
+
+// SensorChannel_t - enumeration of sensor channels
+//
+typedef enum SensorChannel
+{
+    SensorChannelVBatt,
+    SensorChannelLight,
+    SensorChannelTemp,
+    SensorChannel_end                       // Placeholder value
+} SensorChannel_t;
+
+
+// SensorFilterType_t - enumeration of the filters which may be applied to a sensor channel
+//
+typedef enum SensorFilterType
+{
+    SensorFilterEMA,                        // Exponential moving average; factor 1 / (1 << shift)
+    SensorFilterBoxcar,                     // Mean of the last (1 << shift) readings
+    SensorFilterMedian3                     // Median of the last three readings; rejects spikes
+} SensorFilterType_t;
+
+
+// Filter applied to each channel, and its window length expressed as a power of two (ignored by
+// SensorFilterMedian3).  Each may be overridden independently from the build settings.
+#ifndef SENSOR_FILTER_VBATT
+#define SENSOR_FILTER_VBATT         SensorFilterEMA
+#endif
+#ifndef SENSOR_FILTER_VBATT_SHIFT
+#define SENSOR_FILTER_VBATT_SHIFT   (2)
+#endif
+#ifndef SENSOR_FILTER_LIGHT
+#define SENSOR_FILTER_LIGHT         SensorFilterEMA
+#endif
+#ifndef SENSOR_FILTER_LIGHT_SHIFT
+#define SENSOR_FILTER_LIGHT_SHIFT   (4)
+#endif
+#ifndef SENSOR_FILTER_TEMP
+#define SENSOR_FILTER_TEMP          SensorFilterEMA
+#endif
+#ifndef SENSOR_FILTER_TEMP_SHIFT
+#define SENSOR_FILTER_TEMP_SHIFT    (3)
+#endif
+
+
+// SensorReadings_t - a set of readings, one per sensor channel, expressed in ADC counts
+//
+typedef struct SensorReadings
+{
+    uint16_t    vbatt;
+    uint16_t    light;
+    uint16_t    temp;
+} SensorReadings_t;
+
+
+// SensorValues_t - a set of readings, one per sensor channel, expressed in engineering units
+//
+typedef struct SensorValues
+{
+    uint16_t    vbatt;                  // Battery voltage, in mV
+    uint16_t    light;                  // Light level, in lux
+    int16_t     temp;                   // Temperature, in units of 0.01 degC
+} SensorValues_t;
+
+
 void sensor_init();
 void sensor_activate(const uint8_t activate);
 void sensor_read();
+void sensor_get_readings(SensorReadings_t * const readings);
+void sensor_get_values(SensorValues_t * const values);
+uint8_t sensor_get_filter_shift(const SensorChannel_t channel);
+uint8_t sensor_filter_shift_valid(const SensorChannel_t channel, const uint8_t shift);
+uint8_t sensor_set_filter_shift(const SensorChannel_t channel, const uint8_t shift);
 
 #endif
@@ -0,0 +1,27 @@
+#ifndef THERM_TABLE_H_INC
+#define THERM_TABLE_H_INC
+/*
+    therm_table.h - thermistor calibration table.  Generated by tools/gen_therm_table.py;
+    do not edit.
+
+    Thermistor: R0=10000 ohm at 25 degC, Beta=3950 K
+    Divider: 10000 ohm to 3V supply; ADC reference 2.5V
+*/
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+
+#define THERM_TABLE_BITS        (5)     // Table has (1 << THERM_TABLE_BITS) + 1 entries
+
+// Temperature, in units of 0.01 degC, at ADC readings of 0, 1/32, 2/32 ... full scale
+static const int16_t therm_table[] PROGMEM =
+{
+     12500,  12500,  10861,   9326,   8281,   7489,   6849,   6309,
+      5841,   5425,   5050,   4706,   4387,   4088,   3805,   3536,
+      3277,   3027,   2784,   2547,   2314,   2083,   1853,   1624,
+      1393,   1160,    922,    678,    426,    163,   -114,   -409,
+      -730
+};
+
+#endif
@@ -7,14 +7,31 @@
 #include "xbee.h"
 #include "../lib/debug.h"
 #include "../lib/gpio.h"
+#include "../lib/rtc.h"
 #include "../lib/spi.h"
 #include "../platform.h"
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <stddef.h>
+#include <util/crc16.h>
 #include <util/delay.h>
 
+#define DEBUG_LOG_FILE_ID       (2)     // Identifies debug log records from this file
 
-XBeeTxnStatus_t xbee_send_at_command(const XBeeATCmd_t command, const uint8_t param_len);
+
+XBeeTxnStatus_t xbee_send_at_command(const XBeeFrameID_t frame_id, const XBeeATCmd_t command,
+                                     const uint8_t * const param, const uint8_t param_len);
+XBeeTxnStatus_t xbee_receive_packet_no_wait();
 XBeeTxnStatus_t xbee_receive_packet();
-XBeeTxnStatus_t xbee_do_at_command(const XBeeATCmd_t command, const uint8_t param_len);
+static uint8_t xbee_frame_responses(const uint8_t * const frame, const uint8_t frame_len);
+static void xbee_rx_dispatch_one();
+static const XBeeRxStreamHandler_t *xbee_rx_stream_find(const XBeeFrameType_t type);
+static XBeeTxnStatus_t xbee_rx_wait(const XBeeFrameType_t type);
+static void xbee_handle_tx_status(const XBeePacketBuf_t * const pkt);
+static uint8_t xbee_at_batch_query(XBeeATBatch_t * const batch, const XBeeATCmd_t command);
+static XBeeTxnStatus_t xbee_at_batch_transmit(XBeeATBatch_t * const batch);
+static uint8_t xbee_at_batch_match(const XBeePacketBuf_t * const pkt);
+static uint8_t xbee_sentinel_ok();
 
 
 // XBeeCmdState_t - enumeration to express the state machine used for command
@@ -32,10 +49,84 @@ typedef enum XBeeCmdState
 } XBeeCmdState_t;
 
 
+// State of the SPI transaction in progress.  This is shared between xbee_spi_transaction() and the
+// transmit/receive state machines, which run in the SPI ISR.
+//
+static volatile struct XBeeTxn
+{
+    const uint8_t * tx_frame;               // Wire-format frame to be transmitted, or NULL
+    XBeeTxProducer_t tx_producer;           // Source of streamed frame data, if <tx_frame> is NULL
+    uint8_t         tx_len;                 // Length of the wire-format frame
+    uint8_t         tx_cksum;               // Running checksum of streamed frame data
+    uint8_t         txcount;                // Number of frame bytes transmitted
+    XBeeCmdState_t  rxstate;                // State of the command-receive state machine
+    XBeePacketBuf_t *rxslot;                // RX queue slot receiving the current frame
+    uint8_t         rxerr;                  // Non-zero if the current frame is to be discarded
+    const XBeeRxStreamHandler_t *rxstream;  // Handler receiving the current frame, if streamed
+    uint8_t         rxcksum;                // Running checksum of the received frame
+    uint16_t        packet_len;             // Received frame bytes still to come
+    int8_t          retries;                // Remaining attempts to receive a frame delimiter
+    XBeeTxnStatus_t ret;                    // Status flags to be returned
+} txn;
+
+
+// Queue of received frames.  Frames are appended by the receive state machine, in the SPI ISR, and
+// removed by xbee_rx_pop() or xbee_rx_dispatch().
+//
+static XBeePacketBuf_t rxq_slot[XBEE_RX_QUEUE_LEN];
+static volatile uint8_t rxq_head;           // Index of the oldest frame
+static volatile uint8_t rxq_count;          // Number of frames in the queue
+
+// Handlers for received frames, by frame type
+static struct XBeeRxHandlerEntry
+{
+    XBeeFrameType_t type;
+    XBeeRxHandler_t handler;
+} rx_handlers[XBEE_RX_HANDLERS_MAX];
+
+// Handlers for frames too long for the RX queue, by frame type
+static struct XBeeRxStreamHandlerEntry
+{
+    XBeeFrameType_t type;
+    const XBeeRxStreamHandler_t *handler;
+} rx_stream_handlers[XBEE_RX_STREAM_HANDLERS_MAX];
+
+// Transmissions awaiting a transmit-status frame.  A <frame_id> of zero marks a free entry.
+static struct XBeeTxTrack
+{
+    XBeeFrameID_t   frame_id;               // ID of the transmitted frame
+    uint8_t         status;                 // Delivery status, or XBEE_TX_STATUS_PENDING
+} tx_track[XBEE_TX_TRACK_LEN];
+
+static XBeeFrameID_t last_frame_id;         // Most recently allocated frame ID
+static XBeeATBatch_t *at_batch;             // AT command batch awaiting responses, if any
+
+
+// XBeeSetting_t - an AT parameter setting, applied by xbee_configure().
+//
+typedef struct XBeeSetting
+{
+    XBeeATCmd_t     cmd;                    // AT command which sets the parameter
+    uint8_t         value;                  // Required (single-byte) parameter value
+} XBeeSetting_t;
+
+// Settings required in the XBee module.  Changing this table changes its digest, which causes the
+// settings to be checked and, where necessary, rewritten at the next boot.  The last entry serves
+// as a sentinel (see xbee_configure()), so its value must differ from the factory default.
+static const XBeeSetting_t xbee_settings[] PROGMEM =
+{
+    {XBeeATCmdATD9, XBeePinCfgAlternateFunction},   // DIO9 = ON/nSLEEP
+    {XBeeATCmdATD8, XBeePinCfgAlternateFunction},   // DIO8 = DTR/SLEEP_RQ
+    {XBeeATCmdATSM, XBeeSleepModePinSleep}          // Sleep mode = pin sleep
+};
+
+// Digest of the settings table as last successfully applied to, and saved in, the XBee module
+static uint16_t EEMEM ee_settings_digest;
+
+
 // xbee_init() - configure the sleep/wake and SPI_nATTN lines as inputs/outputs as appropriate, and
-// set the XBee module SLEEP_RQ line low (requesting "awake" mode).  Also reset the length fields
-// in the command-transmit/-receive buffer objects to indicate that no command is pending
-// transmission or processing.
+// set the XBee module SLEEP_RQ line low (requesting "awake" mode).  Also empty the RX frame queue,
+// and register the handler which matches transmit-status frames to tracked transmissions.
 //
 void xbee_init()
 {
@@ -44,8 +135,9 @@ void xbee_init()
     gpio_clear(PIN_XBEE_SLEEP_RQ);          // } Wake the XBee by setting the XBEE_SLEEP_RQ pin to
     gpio_make_output(PIN_XBEE_SLEEP_RQ);    // } 0 and making the pin an output.
 
-    xbee_tx.len = 0;                        // Indicates that there is nothing to transmit
-    xbee_rx.len = 0;                        // Indicates that no packet has been received
+    rxq_head = rxq_count = 0;               // No frames have been received
+
+    xbee_set_rx_handler(XBeeFrameZigbeeTransmitStatus, xbee_handle_tx_status);
 }
 
 
@@ -75,205 +167,647 @@ void xbee_set_power_state(const XBeePowerState_t state)
 }
 
 
-void xbee_wait_power_state(const XBeePowerState_t state)
+// xbee_wait_power_state() - wait for the XBee's ON/nSLEEP output to indicate that the module has
+// entered the power state <state>.  The core sleeps while waiting.  Returns XBEE_TXRX_TIMEOUT if
+// the module does not reach the requested state within XBEE_WAKE_TIMEOUT_MS; zero otherwise.
+//
+XBeeTxnStatus_t xbee_wait_power_state(const XBeePowerState_t state)
 {
-    if(state == XBeePowerStateWake)
-        gpio_wait_high(PIN_XBEE_ON_nSLEEP);
-    else if(state == XBeePowerStateSleep)
-        gpio_wait_low(PIN_XBEE_ON_nSLEEP);
+    if(!gpio_wait_level_timeout(PIN_XBEE_ON_nSLEEP, state == XBeePowerStateWake,
+                                RTC_MS_TO_TICKS(XBEE_WAKE_TIMEOUT_MS)))
+        return XBEE_TXRX_TIMEOUT;
+
+    return 0;
+}
+
+
+// xbee_txn_tx() - SPI transfer callback which returns the next byte of the wire-format frame being
+// transmitted.  If the frame is streamed, the start delimiter, length and checksum are generated
+// here, around the frame data supplied by the producer callback.  Once the frame has been sent,
+// it returns 0x00 bytes, which serve only to clock in data from the XBee.  Called from the SPI ISR.
+//
+static uint8_t xbee_txn_tx()
+{
+    const uint8_t pos = txn.txcount;
+    uint8_t data;
+
+    if(pos >= txn.tx_len)
+        return 0x00;
+
+    ++txn.txcount;
+
+    if(txn.tx_frame)
+        return txn.tx_frame[pos];
+
+    switch(pos)
+    {
+        case 0:
+            return XBEE_FRAME_DELIMITER;
+
+        case 1:
+            return 0;                       // Length MSB; streamed frames are < 256 bytes long
+
+        case 2:
+            return txn.tx_len - XBEE_FRAME_OVERHEAD;
+
+        default:
+            if(pos == txn.tx_len - 1)
+                return 0xff - txn.tx_cksum;
+
+            data = txn.tx_producer();
+            txn.tx_cksum += data;
+            return data;
+    }
+}
+
+
+// xbee_txn_rx() - SPI transfer callback which runs the command-receive state machine on the byte
+// in <data>, appending each frame received to the RX queue (except responses to an outstanding AT
+// command batch, which are matched to the batch immediately).  Returns the number of further bytes
+// the state machine requires (see SPIXferNeed_t).  While no frame is in progress, a further byte
+// is requested only if receive retries remain.  After each frame, reception continues for as long
+// as the XBee holds SPI_nATTN asserted and a free queue slot remains, so that every pending frame
+// is drained in a single SPI session.  Called from the SPI ISR.
+//
+static SPIXferNeed_t xbee_txn_rx(const uint8_t data)
+{
+    switch(txn.rxstate)
+    {
+        case XBeeCmdStateIdle:
+            if(data == XBEE_FRAME_DELIMITER)
+            {
+                // A frame which arrives while the queue is full must still be read, but it is
+                // discarded
+                if(rxq_count < XBEE_RX_QUEUE_LEN)
+                {
+                    txn.rxslot = rxq_slot + ((rxq_head + rxq_count) & (XBEE_RX_QUEUE_LEN - 1));
+                    txn.rxslot->len = 0;
+                    txn.rxerr = 0;
+                }
+                else
+                {
+                    txn.rxslot = NULL;
+                    txn.rxerr = 1;
+                    txn.ret |= XBEE_RX_QUEUE_FULL;
+                }
+                txn.rxstream = NULL;
+                txn.rxcksum = 0;
+                txn.retries = 0;            // Found a frame - no need for any more retries
+                txn.rxstate = XBeeCmdStateLen1;
+            }
+            break;
+
+        case XBeeCmdStateHeader:
+            // This state is not used in the "receive" state machine, and is unreachable.
+            // This case is present in order to suppress a compiler warning.
+            break;
+
+        case XBeeCmdStateLen1:
+            txn.packet_len = data;
+            txn.packet_len <<= 8;
+            txn.rxstate = XBeeCmdStateLen2;
+            break;
+
+        case XBeeCmdStateLen2:
+            txn.packet_len |= data;
+            txn.rxstate = XBeeCmdStateFrameType;
+
+            // A frame must hold at least a frame type, and no API frame is longer than
+            // XBEE_RX_FRAME_LEN_MAX.  Any other length means that the "delimiter" was not one (or
+            // that bytes were lost), so discard the frame and hunt for the next delimiter.
+            if(!txn.packet_len || (txn.packet_len > XBEE_RX_FRAME_LEN_MAX))
+            {
+                txn.ret |= XBEE_RX_BAD_LENGTH;
+                txn.rxstate = XBeeCmdStateIdle;
+                if(xbee_attn())
+                    txn.retries = XBEE_RX_ONLY_RETRIES;
+            }
+            break;
+
+        case XBeeCmdStateFrameType:
+            txn.rxcksum += data;
+            --txn.packet_len;
+            txn.rxstate = txn.packet_len ? XBeeCmdStateData : XBeeCmdStateCksum;
+
+            if(!txn.rxslot)
+                break;                      // The frame is being discarded
+
+            txn.rxslot->frame_type = data;
+
+            // A frame too long for the queue is passed, piece by piece, to the streaming handler
+            // for its type, if there is one and it accepts the frame; otherwise it is discarded.
+            // The queue slot serves as the chunk buffer.
+            if(txn.packet_len > XBEE_BUF_LEN)
+            {
+                txn.rxstream = xbee_rx_stream_find(data);
+                if(!txn.rxstream || !txn.rxstream->begin(data, txn.packet_len))
+                {
+                    txn.rxstream = NULL;
+                    txn.ret |= XBEE_RX_FRAME_TOO_LONG;
+                    txn.rxerr = 1;
+                }
+            }
+            break;
+
+        case XBeeCmdStateData:
+            txn.rxcksum += data;
+            if(!--txn.packet_len)
+                txn.rxstate = XBeeCmdStateCksum;
+
+            if(txn.rxstream && (txn.rxslot->len == XBEE_BUF_LEN))
+            {
+                txn.rxstream->data((const uint8_t *) txn.rxslot->raw, XBEE_BUF_LEN);
+                txn.rxslot->len = 0;
+            }
+
+            if(txn.rxslot && (txn.rxslot->len < XBEE_BUF_LEN))
+                txn.rxslot->raw[txn.rxslot->len++] = data;
+            break;
+
+        case XBeeCmdStateCksum:
+            if((0xff - txn.rxcksum) != data)
+                txn.ret |= XBEE_RX_BAD_CHECKSUM;
+            else if(!txn.rxerr)
+            {
+                // Commit the frame to the queue, unless it is consumed here
+                if(!txn.rxstream && !xbee_at_batch_match(txn.rxslot))
+                    ++rxq_count;
+                txn.ret |= XBEE_RX_SUCCESS;
+            }
+
+            if(txn.rxstream)
+            {
+                if(txn.rxslot->len)
+                    txn.rxstream->data((const uint8_t *) txn.rxslot->raw, txn.rxslot->len);
+                txn.rxstream->end((0xff - txn.rxcksum) == data);
+                txn.rxstream = NULL;
+            }
+            txn.rxstate = XBeeCmdStateIdle;
+
+            // If the XBee has more to send, and there is room for it, hunt for another delimiter
+            if(xbee_attn() && (rxq_count < XBEE_RX_QUEUE_LEN))
+                txn.retries = XBEE_RX_ONLY_RETRIES;
+            break;
+    }
+
+    switch(txn.rxstate)
+    {
+        case XBeeCmdStateIdle:
+            return (txn.retries-- > 0) ? SPIXferNext : SPIXferDone;
+
+        case XBeeCmdStateCksum:
+            return SPIXferNext;
+
+        default:
+            return SPIXferStream;           // Frame header or data outstanding, plus checksum
+    }
+}
+
+
+// xbee_spi_session() - run an SPI session in which the <tx_len>-byte wire-format frame held in
+// <frame>, or streamed from <producer> if <frame> is NULL, is transmitted.  If <tx_len> is zero,
+// nothing is transmitted and the session serves only to receive frames.  <responses> is the
+// number of response frames which the transmitted frames may trigger, and which must be queued;
+// queued frames are dispatched until there is room for them, or for one frame if <responses> is
+// zero.  Returns XBEE_RX_QUEUE_FULL, without starting the session, if <responses> exceeds the
+// length of the queue.  See xbee_spi_transaction() for details.
+//
+static XBeeTxnStatus_t xbee_spi_session(const uint8_t * const frame,
+                                        const XBeeTxProducer_t producer, const uint8_t tx_len,
+                                        const uint8_t responses)
+{
+    const uint8_t slots = responses ? responses : 1;
+
+    if(slots > XBEE_RX_QUEUE_LEN)
+        return XBEE_RX_QUEUE_FULL;
+
+    while(XBEE_RX_QUEUE_LEN - rxq_count < slots)
+        xbee_rx_dispatch_one();             // Make room for the frames which may be received
+
+    txn.packet_len = txn.txcount = txn.rxcksum = txn.tx_cksum = txn.ret = 0;
+
+    // If no frame is supplied, nothing will be transmitted but a frame may still be received.  In
+    // this case, the transfer starts with a transmit length of zero, which results in a stream of
+    // 0x00-value bytes being sent while packet reception is in progress.  If a frame delimiter is
+    // not immediately received at the SPI port, the transfer will end once the retries have been
+    // used up.  If a frame is to be transmitted, no retries are made - don't hang around waiting
+    // for a frame.
+    txn.retries = tx_len ? 0 : XBEE_RX_ONLY_RETRIES;
+    txn.tx_frame = frame;
+    txn.tx_producer = producer;
+    txn.tx_len = tx_len;
+    txn.rxstate = XBeeCmdStateIdle;
+
+    spi0_slave_select(1);                   // Assert the SPI slave-select output
+
+    spi0_xfer_start(xbee_txn_tx, xbee_txn_rx, txn.tx_len);
+    spi0_xfer_wait();
+
+    spi0_slave_select(0);                   // Negate the SPI slave-select output
+
+    if(!tx_len)
+    {
+        // No frame transmission was requested, and the retry counter has expired.  Conclude that
+        // we were expecting to receive a packet but didn't; set the appropriate error code.
+        if(txn.retries < 0)
+            txn.ret |= XBEE_RX_NO_DATA;
+    }
+    else
+    {
+        // In this case a frame transmission was requested.  If this point has been reached, the
+        // transmission was successful.
+        txn.ret |= XBEE_TX_SUCCESS;
+    }
+
+    return txn.ret;
 }
 
 
 // xbee_spi_transaction() - attempt to receive a data frame via the SPI bus, and optionally
-// simultaneously transmit a frame.  This function reads data from the buffer object in the global
-// variable <xbee_tx>. If <frame_type> != XBeeFrameNone, then the transmit buffer  is assumed to
-// contain data for an API frame of type <type> with ID <frame_id>.  In this case, the frame is
-// transmitted.  During transmission, the XBee module may send data to us;  in this case, the data
-// will be received in full (buffer space permitting) and written to the global <xbee_rx> buffer.
-// If the XBee module attempts to send a frame longer than <xbee_rx.len>, the frame will be
-// discarded.  If no frame transmission is requested (i.e. the function is called solely in order
-// to attempt to receive data) then it will retry attempts to receive a start-of-frame delimiter.
-// XBEE_RX_ONLY_RETRIES attempts will be made.  In cases where frame transmission is requested, no
-// receive retries will be made.
-//
-// The function returns a bit-field in a uint8_t.  Zero or more of the following bits will be set:
+// simultaneously transmit a frame.  If <frame> is non-NULL, it must point to <frame_len> bytes
+// holding one or more complete wire-format frames (as produced by xbee_frame_end()), which are
+// transmitted back-to-back.  During transmission, the XBee module may send data to us;  in this
+// case, the data will be received in full and appended to the RX queue, as will any further
+// frames which the XBee has pending.  Frames longer than XBEE_BUF_LEN are passed, as they arrive,
+// to the streaming handler registered for their type (see xbee_set_rx_stream_handler()), or are
+// otherwise discarded.  Each frame transmitted with a non-zero frame ID will trigger a response
+// frame; before the session starts, the oldest queued frames are dispatched until there is a free
+// slot for each response (or, if none are expected, for one frame).  A frame which arrives while
+// the queue is nevertheless full is discarded.  If no frame transmission is requested (i.e. the
+// function is called solely in order to attempt to receive data) then it will retry attempts to
+// receive a start-of-frame delimiter.  XBEE_RX_ONLY_RETRIES attempts will be made.  In cases
+// where frame transmission is requested, no receive retries will be made.
+//
+// The bytes are exchanged by the interrupt-driven SPI transfer engine; the receive state machine
+// runs in the SPI ISR, and the core sleeps until the transfer completes.
+//
+// The function returns a bit-field in a uint16_t.  Zero or more of the following bits will be set:
 //      XBEE_TX_SUCCESS         - a frame was successfully transmitted
-//      XBEE_TX_FRAME_TOO_LONG  - the supplied frame exceeds the length of the transmit buffer;
-//                                neither transmission or reception occur in this case
-//      XBEE_TX_FRAME_EMPTY     - a frame of type other than XBEE_FRAME_NONE was specified, but its
-//                                length equals zero
-//      XBEE_RX_SUCCESS         - a frame was successfully received
-//      XBEE_RX_FRAME_TOO_LONG  - a frame longer than the xbee_rx buffer was received and discarded
+//      XBEE_TX_BAD_FRAME_SIZE  - a frame was supplied, but is too short; neither
+//                                transmission nor reception occur in this case
+//      XBEE_RX_SUCCESS         - at least one frame was successfully received
+//      XBEE_RX_FRAME_TOO_LONG  - a frame longer than XBEE_BUF_LEN, with no streaming handler,
+//                                was received and discarded
 //      XBEE_RX_BAD_CHECKSUM    - the received packet checksum is invalid; the packet was discarded
+//      XBEE_RX_QUEUE_FULL      - a frame was received while the RX queue was full, and was
+//                                discarded; or the frames supplied would trigger more responses
+//                                than the queue can hold, and nothing was transmitted
+//
+XBeeTxnStatus_t xbee_spi_transaction(const uint8_t * const frame, const uint8_t frame_len)
+{
+    if(!frame)
+        return xbee_spi_session(NULL, NULL, 0, 0);
+
+    // Size-validate the frame: it must carry at least a frame type.  Longer frames are rejected by
+    // xbee_frame_end(); several frames may be sent in one transaction.
+    if(frame_len <= XBEE_FRAME_OVERHEAD)
+        return XBEE_TX_BAD_FRAME_SIZE;
+
+    return xbee_spi_session(frame, NULL, frame_len, xbee_frame_responses(frame, frame_len));
+}
+
+
+// xbee_frame_responses() - return the number of response frames which will be triggered by the
+// <frame_len> bytes of wire-format frames held in <frame>, i.e. the number of frames which carry a
+// non-zero frame ID.  The frame ID, where present, follows the frame type.
+//
+static uint8_t xbee_frame_responses(const uint8_t * const frame, const uint8_t frame_len)
+{
+    uint16_t pos;
+    uint8_t responses = 0;
+
+    // The length MSB of each frame is zero, as the frames are less than 256 bytes long
+    for(pos = 0; pos + XBEE_FRAME_OVERHEAD + 1 < frame_len;
+        pos += XBEE_FRAME_OVERHEAD + frame[pos + 2])
+        if(frame[pos + 4])
+            ++responses;
+
+    return responses;
+}
+
+
+// xbee_send_stream() - transmit a frame whose <data_len> bytes of frame data (i.e. the frame type
+// and the frame-specific data which follows it) are obtained one at a time from <producer> as
+// they are clocked out, so that the frame need not be assembled in RAM.  The start delimiter,
+// length and checksum are generated automatically.  <producer> is called exactly <data_len>
+// times, from the SPI ISR.  Frames may be received during transmission, as for
+// xbee_spi_transaction(), which describes the return value.
+//
+XBeeTxnStatus_t xbee_send_stream(const XBeeTxProducer_t producer, const uint8_t data_len)
+{
+    if(!data_len || (data_len > 0xff - XBEE_FRAME_OVERHEAD))
+        return XBEE_TX_BAD_FRAME_SIZE;
+
+    return xbee_spi_session(NULL, producer, data_len + XBEE_FRAME_OVERHEAD, 1);
+}
+
+
+// xbee_send_frame() - complete the frame under construction in <b> and transmit it.
+//
+XBeeTxnStatus_t xbee_send_frame(XBeeFrameBuilder_t * const b)
+{
+    const uint8_t len = xbee_frame_end(b);
+
+    if(!len)
+        return XBEE_TX_BAD_FRAME_SIZE;
+
+    return xbee_spi_transaction(b->buf, len);
+}
+
+
+// xbee_alloc_frame_id() - return the next frame ID in the sequence 1, 2, ... 255, 1, ...  Frame
+// ID 0 is never returned, as it tells the XBee not to send a response frame.
 //
-XBeeTxnStatus_t xbee_spi_transaction()
+XBeeFrameID_t xbee_alloc_frame_id()
 {
-    uint8_t txcount, rxcksum, txcksum, data, ret;
-    int8_t retries;
-    uint16_t packet_len;
-    XBeeCmdState_t rxstate, txstate;
+    if(!++last_frame_id)
+        last_frame_id = 1;
+
+    return last_frame_id;
+}
 
-    packet_len = txcount = rxcksum = txcksum = data = ret = 0;
 
-    // If the requested frame type is XBeeFrameNone, no frame will be transmitted but a frame may
-    // still be received.  In this case, we enter the main loop with <txstate> equal to
-    // XBEE_TX_DONE, which results in a stream of 0x00-value bytes being sent while packet
-    // reception is in progress.  If a frame delimiter is not immediately received at the SPI port,
-    // the loop will exit.
-    if(xbee_tx.frame_type == XBeeFrameNone)
+// xbee_tx_track_begin() - allocate a frame ID for a transmission whose delivery status is to be
+// tracked, and record it in the table of outstanding transmissions.  The frame ID must be placed in
+// the transmitted frame.  Returns the frame ID, or zero if the table is full (in which case the
+// frame should be sent with frame ID 0, i.e. without requesting a transmit-status frame).
+//
+XBeeFrameID_t xbee_tx_track_begin()
+{
+    uint8_t i;
+
+    for(i = 0; i < XBEE_TX_TRACK_LEN; ++i)
     {
-        // We will only try to receive a frame - nothing will be transmitted.
-        txstate = XBeeCmdStateIdle;         // No frame to transmit
-        retries = XBEE_RX_ONLY_RETRIES;     // Number of times to wait for a frame delimiter
+        if(!tx_track[i].frame_id)
+        {
+            tx_track[i].frame_id = xbee_alloc_frame_id();
+            tx_track[i].status = XBEE_TX_STATUS_PENDING;
+            return tx_track[i].frame_id;
+        }
     }
-    else
+
+    return 0;
+}
+
+
+// xbee_tx_track_wait() - wait, for up to XBEE_TX_STATUS_TIMEOUT_MS, for the transmit-status frame
+// corresponding to the tracked transmission with ID <frame_id>, dispatching any frames received in
+// the meantime.  Releases the table entry and returns the delivery status (a value from the
+// XBeeTXDeliveryStatus_t enumeration), or XBEE_TX_STATUS_PENDING if no status frame was received.
+//
+uint8_t xbee_tx_track_wait(const XBeeFrameID_t frame_id)
+{
+    const uint16_t ticks = RTC_MS_TO_TICKS(XBEE_TX_STATUS_TIMEOUT_MS), start = rtc_get_count();
+    struct XBeeTxTrack *t = NULL;
+    uint8_t i, status;
+
+    for(i = 0; i < XBEE_TX_TRACK_LEN; ++i)
+        if(frame_id && (tx_track[i].frame_id == frame_id))
+            t = tx_track + i;
+
+    if(!t)
+        return XBEE_TX_STATUS_PENDING;
+
+    xbee_rx_dispatch();                     // The status may already have been received
+
+    while(t->status == XBEE_TX_STATUS_PENDING)
     {
-        // We will be transmitting a frame, and possibly also receiving one.
-        txstate = XBeeCmdStateHeader;       // Start by transmitting a frame header
-        retries = 0;                        // No retries - don't hang around waiting for a frame
+        const uint16_t elapsed = rtc_get_count() - start;
 
-        // Size-validate the frame
-        if(!xbee_tx.len || (xbee_tx.len >= XBEE_BUF_LEN))
-            return XBEE_TX_BAD_FRAME_SIZE;
+        if((elapsed >= ticks) ||
+           !gpio_wait_level_timeout(PIN_XBEE_SPI_nATTN, 0, ticks - elapsed))
+            break;                          // Timed out
+
+        xbee_receive_packet_no_wait();
+        xbee_rx_dispatch();
     }
-    rxstate = XBeeCmdStateIdle;
 
-    spi0_slave_select(1);                   // Assert the SPI slave-select output
+    status = t->status;
+    t->frame_id = 0;                        // Release the table entry
 
-    do
+    return status;
+}
+
+
+// xbee_handle_tx_status() - handler for transmit-status frames.  Records the delivery status in
+// the table entry of the matching tracked transmission, if any.
+//
+static void xbee_handle_tx_status(const XBeePacketBuf_t * const pkt)
+{
+    const XBeeTXStatusView_t * const txs = xbee_view_tx_status(pkt);
+    uint8_t i;
+
+    if(!txs || !txs->frame_id)
+        return;
+
+    for(i = 0; i < XBEE_TX_TRACK_LEN; ++i)
     {
-        // Command-transmit state machine
-        switch(txstate)
+        if(tx_track[i].frame_id == txs->frame_id)
         {
-            case XBeeCmdStateHeader:
-                data = XBEE_FRAME_DELIMITER;
-                txstate = XBeeCmdStateLen1;
-                break;
-
-            case XBeeCmdStateLen1:
-                data = (xbee_tx.len + 1) >> 8;
-                txstate = XBeeCmdStateLen2;
-                break;
-
-            case XBeeCmdStateLen2:
-                data = (xbee_tx.len + 1) & 0xff;
-                txstate = XBeeCmdStateFrameType;
-                break;
-
-            case XBeeCmdStateFrameType:
-                data = xbee_tx.frame_type;
-                txcksum += data;
-                txstate = XBeeCmdStateData;
-                break;
-
-            case XBeeCmdStateData:
-                data = xbee_tx.raw[txcount++];
-                txcksum += data;
-                if(txcount == xbee_tx.len)
-                    txstate = XBeeCmdStateCksum;
-                break;
-
-            case XBeeCmdStateCksum:
-                data = 0xff - txcksum;
-                txstate = XBeeCmdStateIdle;
-                break;
-
-            case XBeeCmdStateIdle:
-                data = 0x00;
-                break;
+            tx_track[i].status = txs->status;
+            return;
         }
+    }
+}
+
+
+// xbee_rx_head() - return the oldest frame in the RX queue, or NULL if the queue is empty.  The
+// frame remains in the queue until it is released by xbee_rx_pop().
+//
+const XBeePacketBuf_t *xbee_rx_head()
+{
+    return rxq_count ? rxq_slot + rxq_head : NULL;
+}
+
+
+// xbee_rx_pop() - release the oldest frame in the RX queue.
+//
+void xbee_rx_pop()
+{
+    if(rxq_count)
+    {
+        rxq_head = (rxq_head + 1) & (XBEE_RX_QUEUE_LEN - 1);
+        --rxq_count;
+    }
+}
 
-        spi0_tx(data);
-        spi0_wait_tx();
-        data = spi0_read();
 
-        // Command-receive state machine
-        switch(rxstate)
+// xbee_set_rx_handler() - register <handler> to be called by xbee_rx_dispatch() for each received
+// frame of type <type>, replacing any handler already registered for that type.  Passing a NULL
+// <handler> removes the registration.  Returns non-zero on success, or zero if the handler table
+// is full.
+//
+uint8_t xbee_set_rx_handler(const XBeeFrameType_t type, const XBeeRxHandler_t handler)
+{
+    struct XBeeRxHandlerEntry *free_entry = NULL;
+    uint8_t i;
+
+    for(i = 0; i < XBEE_RX_HANDLERS_MAX; ++i)
+    {
+        if(rx_handlers[i].handler && (rx_handlers[i].type == type))
         {
-            case XBeeCmdStateIdle:
-                if(data == XBEE_FRAME_DELIMITER)
-                {
-                    xbee_rx.len = 0;
-                    retries = 0;            // Found a frame - no need for any more retries
-                    rxstate = XBeeCmdStateLen1;
-                }
-                break;
-
-            case XBeeCmdStateHeader:
-                // This state is not used in the "receive" state machine, and is unreachable.
-                // This case is present in order to suppress a compiler warning.
-                break;
-
-            case XBeeCmdStateLen1:
-                packet_len = data;
-                packet_len <<= 8;
-                rxstate = XBeeCmdStateLen2;
-                break;
-
-            case XBeeCmdStateLen2:
-                packet_len |= data;
-                rxstate = XBeeCmdStateFrameType;
-                if(packet_len >= XBEE_BUF_LEN)
-                    ret |= XBEE_RX_FRAME_TOO_LONG;
-                break;
-
-            case XBeeCmdStateFrameType:
-                xbee_rx.frame_type = data;
-                rxcksum += data;
-                --packet_len;
-                rxstate = XBeeCmdStateData;
-                break;
-
-            case XBeeCmdStateData:
-                rxcksum += data;
-                if(!--packet_len)
-                    rxstate = XBeeCmdStateCksum;
-                if(xbee_rx.len < XBEE_BUF_LEN)
-                    xbee_rx.raw[xbee_rx.len++] = data;
-                break;
-
-            case XBeeCmdStateCksum:
-                if((0xff - rxcksum) != data)
-                    ret |= XBEE_RX_BAD_CHECKSUM;
-                else if(!ret)
-                    ret |= XBEE_RX_SUCCESS;
-                rxstate = XBeeCmdStateIdle;
-                break;
+            rx_handlers[i].handler = handler;
+            return 1;
         }
-    } while((txstate != XBeeCmdStateIdle) || (rxstate != XBeeCmdStateIdle) || (retries-- > 0));
+        else if(!rx_handlers[i].handler && !free_entry)
+            free_entry = rx_handlers + i;
+    }
 
-    spi0_slave_select(0);                   // Negate the SPI slave-select output
+    if(!handler)
+        return 1;
+
+    if(!free_entry)
+        return 0;
+
+    free_entry->type = type;
+    free_entry->handler = handler;
+    return 1;
+}
+
+
+// xbee_set_rx_stream_handler() - register <handler> to receive frames of type <type> which are
+// too long to fit in the RX queue, replacing any handler already registered for that type.
+// Shorter frames of the same type are queued and dispatched as usual.  Passing a NULL <handler>
+// removes the registration.  Returns non-zero on success, or zero if the handler table is full.
+// Must not be called while an SPI transaction is in progress.
+//
+uint8_t xbee_set_rx_stream_handler(const XBeeFrameType_t type,
+                                   const XBeeRxStreamHandler_t * const handler)
+{
+    struct XBeeRxStreamHandlerEntry *free_entry = NULL;
+    uint8_t i;
 
-    if(xbee_tx.frame_type == XBeeFrameNone)
+    for(i = 0; i < XBEE_RX_STREAM_HANDLERS_MAX; ++i)
     {
-        // No frame transmission was requested, and the retry counter has expired.  Conclude that
-        // we were expecting to receive a packet but didn't; set the appropriate error code.
-        if(retries < 0)
-            ret |= XBEE_RX_NO_DATA;
+        if(rx_stream_handlers[i].handler && (rx_stream_handlers[i].type == type))
+        {
+            rx_stream_handlers[i].handler = handler;
+            return 1;
+        }
+        else if(!rx_stream_handlers[i].handler && !free_entry)
+            free_entry = rx_stream_handlers + i;
     }
-    else
+
+    if(!handler)
+        return 1;
+
+    if(!free_entry)
+        return 0;
+
+    free_entry->type = type;
+    free_entry->handler = handler;
+    return 1;
+}
+
+
+// xbee_rx_stream_find() - return the streaming handler registered for frames of type <type>, or
+// NULL if there is none.  Called from the SPI ISR.
+//
+static const XBeeRxStreamHandler_t *xbee_rx_stream_find(const XBeeFrameType_t type)
+{
+    uint8_t i;
+
+    for(i = 0; i < XBEE_RX_STREAM_HANDLERS_MAX; ++i)
+        if(rx_stream_handlers[i].handler && (rx_stream_handlers[i].type == type))
+            return rx_stream_handlers[i].handler;
+
+    return NULL;
+}
+
+
+// xbee_rx_dispatch_one() - pass the oldest frame in the RX queue to the handler registered for its
+// frame type, if any, then release it.
+//
+static void xbee_rx_dispatch_one()
+{
+    const XBeePacketBuf_t * const pkt = xbee_rx_head();
+    uint8_t i;
+
+    if(!pkt)
+        return;
+
+    for(i = 0; i < XBEE_RX_HANDLERS_MAX; ++i)
     {
-        // In this case a frame transmission was requested.  If this point has been reached, the
-        // transmission was successful.
-        ret |= XBEE_TX_SUCCESS;
+        if(rx_handlers[i].handler && (rx_handlers[i].type == pkt->frame_type))
+        {
+            rx_handlers[i].handler(pkt);
+            break;
+        }
     }
 
-    return ret;
+    if(i == XBEE_RX_HANDLERS_MAX)
+        debug_log("I: XBee frame %02x not handled\n", pkt->frame_type);
+
+    xbee_rx_pop();
+}
+
+
+// xbee_rx_dispatch() - dispatch, and release, every frame in the RX queue.
+//
+void xbee_rx_dispatch()
+{
+    while(rxq_count)
+        xbee_rx_dispatch_one();
+}
+
+
+// xbee_rx_wait() - wait for a frame of type <type> to arrive.  Frames of other types which precede
+// it are dispatched.  Up to XBEE_RX_WAIT_SESSIONS receive sessions are run.  On success, returns
+// XBEE_RX_SUCCESS, with the frame held at the head of the RX queue until the caller releases it
+// using xbee_rx_pop(); otherwise returns the status of the last receive session.
+//
+static XBeeTxnStatus_t xbee_rx_wait(const XBeeFrameType_t type)
+{
+    const XBeePacketBuf_t *pkt;
+    XBeeTxnStatus_t ret = XBEE_RX_NO_DATA;
+    uint8_t sessions = XBEE_RX_WAIT_SESSIONS;
+
+    while(1)
+    {
+        while((pkt = xbee_rx_head()) != NULL)
+        {
+            if(pkt->frame_type == type)
+                return XBEE_RX_SUCCESS;
+
+            xbee_rx_dispatch_one();
+        }
+
+        if(!sessions--)
+            return ret;
+
+        ret = xbee_receive_packet();
+        if(!(ret & XBEE_RX_SUCCESS))
+            return ret;
+    }
 }
 
 
-// xbee_send_at_command() - send the AT command <command> to the XBee module.  Any command
-// parameters must be populated into <xbee_tx.at.parameter_value[]> by the caller before calling
-// this function.
+// xbee_poll() - if the XBee is requesting attention, receive all of the frames it has pending;
+// then dispatch every frame in the RX queue.
 //
-XBeeTxnStatus_t xbee_send_at_command(const XBeeATCmd_t command, const uint8_t param_len)
+void xbee_poll()
 {
-    xbee_tx.frame_type = XBeeFrameATCommand;
-    xbee_tx.at.cmd = command;
-    xbee_tx.at.frame_id = 0x55;         // FIXME - move constant
-    xbee_tx.len = param_len + sizeof(xbee_tx.at.cmd) + sizeof(xbee_tx.at.frame_id);
+    if(xbee_attn())
+        xbee_receive_packet_no_wait();
 
-    return xbee_spi_transaction();
+    xbee_rx_dispatch();
+}
+
+
+// xbee_send_at_command() - send the AT command <command>, in a frame with ID <frame_id>, with the
+// <param_len>-byte parameter value in <param> (which may be NULL if <param_len> is zero), to the
+// XBee module.
+//
+XBeeTxnStatus_t xbee_send_at_command(const XBeeFrameID_t frame_id, const XBeeATCmd_t command,
+                                     const uint8_t * const param, const uint8_t param_len)
+{
+    uint8_t frame[XBEE_FRAME_OVERHEAD + 4 + XBEE_AT_PARAM_MAX];
+    XBeeFrameBuilder_t b;
+
+    xbee_frame_at(&b, frame, sizeof(frame), XBeeFrameATCommand, frame_id, command);
+    xbee_frame_put_bytes(&b, param, param_len);
+
+    return xbee_send_frame(&b);
 }
 
 
@@ -282,118 +816,402 @@ XBeeTxnStatus_t xbee_send_at_command(const XBeeATCmd_t command, const uint8_t pa
 //
 XBeeTxnStatus_t xbee_receive_packet_no_wait()
 {
-    xbee_tx.frame_type = XBeeFrameNone;   // Set up a receive-only SPI transaction
-    xbee_tx.len = 0;
-
-    return xbee_spi_transaction();          // Attempt to receive the command response
+    return xbee_spi_transaction(NULL, 0);   // Attempt to receive the command response
 }
 
 
 // xbee_receive_packet() - wait for the XBee to assert the SPI nATTN (attention) line, then
-// transmit dummy data in order to receive a packet from the XBee.
+// transmit dummy data in order to receive a packet from the XBee.  The core sleeps while waiting.
+// Returns XBEE_TXRX_TIMEOUT if nATTN is not asserted within XBEE_ATTN_TIMEOUT_MS.
 //
 XBeeTxnStatus_t xbee_receive_packet()
 {
-    while(!xbee_attn())                     // Wait for the device to respond
-        ;                                   // FIXME - implement a timeout
+    // Wait for the device to respond
+    if(!gpio_wait_level_timeout(PIN_XBEE_SPI_nATTN, 0, RTC_MS_TO_TICKS(XBEE_ATTN_TIMEOUT_MS)))
+        return XBEE_TXRX_TIMEOUT;
 
     return xbee_receive_packet_no_wait();
 }
 
 
-// xbee_do_at_command() - helper function that sends the AT command specified by <command>, waits
-// for and then reads the response packet.  Command parameters must have been placed in the
-// <xbee_tx> buffer by the caller.  The length of the parameter data must be passed in <param_len>.
+// xbee_do_at_command() - helper function that sends the AT command specified by <command>, with
+// the <param_len>-byte parameter value in <param>, then waits for the response frame.  If
+// XBEE_RX_SUCCESS is returned, the response is held at the head of the RX queue, where it may be
+// inspected using xbee_view_at_resp(xbee_rx_head()); the caller must then release it using
+// xbee_rx_pop().  Any other frames received in the meantime are dispatched.
 //
-XBeeTxnStatus_t xbee_do_at_command(const XBeeATCmd_t command, const uint8_t param_len)
+XBeeTxnStatus_t xbee_do_at_command(const XBeeATCmd_t command, const uint8_t * const param,
+                                   const uint8_t param_len)
 {
+    const XBeeFrameID_t frame_id = xbee_alloc_frame_id();
+    const XBeeATRespView_t *resp;
     XBeeTxnStatus_t ret;
 
-    ret = xbee_send_at_command(command, param_len);
+    ret = xbee_send_at_command(frame_id, command, param, param_len);
     if(!(ret & XBEE_TX_SUCCESS))
         return ret;
 
-    ret = xbee_receive_packet();
+    ret = xbee_rx_wait(XBeeFrameATCommandResponse);
     if(ret & XBEE_RX_SUCCESS)
     {
-        // Ensure that the received frame is an AT command response
-        if(xbee_rx.frame_type != XBeeFrameATCommandResponse)
+        resp = xbee_view_at_resp(xbee_rx_head());
+        if(!resp || (resp->frame_id != frame_id))
         {
-            debug_printf("E: AT%c%c: unexpected response frame type %02x\n",
-                            command, command >> 8, xbee_rx.frame_type);
+            xbee_rx_pop();                  // Invalid, or a response to some other command
             return XBEE_RX_WRONG_FRAME;
         }
-        else if(xbee_rx.at_resp.status != XBeeATCmdOK)
-            debug_printf("E: AT%c%c: cmd failed: %02x\n", command, command >> 8,
-                            xbee_rx.at_resp.status);
+        else if(resp->status != XBeeATCmdOK)
+            debug_log("E: AT%c%c: cmd failed: %02x\n", command, command >> 8, resp->status);
         else
-            debug_printf("I: AT%c%c: OK\n", command, command >> 8);
+            debug_log("I: AT%c%c: OK\n", command, command >> 8);
     }
     else
-        debug_printf("E: AT%c%c: send failed: %02x\n", command, command >> 8, ret);
+        debug_log("E: AT%c%c: send failed: %04x\n", command, command >> 8, ret);
 
     return ret;
 }
 
 
-// xbee_configure() - send initial configuration commands to the XBee module.
+// xbee_at_batch_begin() - start a new AT command batch in <batch>, whose frames will be built in
+// the <cap>-byte buffer <buf>.
+//
+void xbee_at_batch_begin(XBeeATBatch_t * const batch, uint8_t * const buf, const uint8_t cap)
+{
+    batch->buf = buf;
+    batch->cap = cap;
+    batch->len = batch->count = batch->overflow = batch->pending = batch->failed = 0;
+    batch->query = 0;
+}
+
+
+// xbee_at_batch_frame() - append to <batch> an AT command frame of type <type> for the command
+// <command>, with the <param_len>-byte parameter value <param>.  Returns non-zero on success, or
+// zero (and marks the batch as overflowed) if the frame does not fit.
 //
-void xbee_configure()
+static uint8_t xbee_at_batch_frame(XBeeATBatch_t * const batch, const XBeeFrameType_t type,
+                                   const XBeeATCmd_t command, const uint8_t * const param,
+                                   const uint8_t param_len)
 {
-    uint8_t ret;
+    const XBeeFrameID_t frame_id = xbee_alloc_frame_id();
+    XBeeFrameBuilder_t b;
+    uint8_t len;
 
-    while(1)
+    xbee_frame_at(&b, batch->buf + batch->len, batch->cap - batch->len, type, frame_id, command);
+    xbee_frame_put_bytes(&b, param, param_len);
+
+    len = xbee_frame_end(&b);
+    if(!len)
     {
-        debug_putstr_p("Config start: XBee reset\n");
-        xbee_reset();                       // Perform a hardware reset
+        batch->overflow = 1;
+        return 0;
+    }
 
-        xbee_receive_packet_no_wait();      // Cause some SPI activity to provoke nATT assertion
-        ret = xbee_receive_packet();
-        if(!(ret & XBEE_RX_SUCCESS))
-            continue;                       // Try again
+    batch->len += len;
+    batch->query &= ~(1 << batch->count);
+    batch->frame_id[batch->count++] = frame_id;
+    return 1;
+}
 
-        // The first received frame should be a modem status frame with its status byte set to
-        // 0x00, indicating a hardware reset.
-        if(!(ret & XBEE_RX_SUCCESS) || (xbee_rx.frame_type != XBeeFrameModemStatus) ||
-           (xbee_rx.ms.status != XBeeModemStatusHardwareReset))
-            continue;                       // Try again
 
-        // Send an ATD9 command to configure pin DIO9 as ON/nSLEEP
-        xbee_tx.at.parameter_value[0] = XBeePinCfgAlternateFunction;
+// xbee_at_batch_query() - append to <batch> a query of the parameter read by <command>.  The
+// parameter must have a single-byte value, which is recorded in the <value> field of <batch> when
+// the response is received.  Returns non-zero on success, or zero if the batch is full.
+//
+static uint8_t xbee_at_batch_query(XBeeATBatch_t * const batch, const XBeeATCmd_t command)
+{
+    if((batch->count > XBEE_AT_BATCH_MAX) ||
+       !xbee_at_batch_frame(batch, XBeeFrameATCommand, command, NULL, 0))
+    {
+        batch->overflow = 1;
+        return 0;
+    }
+
+    batch->query |= 1 << (batch->count - 1);
+    return 1;
+}
+
+
+// xbee_at_batch_add() - add to <batch> a change of the parameter set by <command> to the
+// <param_len>-byte value <param>.  Nothing is sent until xbee_at_batch_send() is called.  Returns
+// non-zero on success, or zero if the batch is full.
+//
+uint8_t xbee_at_batch_add(XBeeATBatch_t * const batch, const XBeeATCmd_t command,
+                          const uint8_t * const param, const uint8_t param_len)
+{
+    if(batch->count >= XBEE_AT_BATCH_MAX)
+    {
+        batch->overflow = 1;
+        return 0;
+    }
+
+    return xbee_at_batch_frame(batch, XBeeFrameATCommandQueueParamVal, command, param,
+                               param_len);
+}
+
+
+// xbee_at_batch_send() - complete <batch> with an AT command frame which applies the queued
+// changes - ATWR if <persist> is non-zero, so that the changes are also saved in the XBee's
+// non-volatile memory; otherwise ATAC - and transmit every frame in the batch in a single SPI
+// session.  Responses are collected by xbee_at_batch_wait().  Returns XBEE_TX_BAD_FRAME_SIZE if
+// the frames did not fit in the batch buffer; otherwise returns the status of the transaction.
+//
+XBeeTxnStatus_t xbee_at_batch_send(XBeeATBatch_t * const batch, const uint8_t persist)
+{
+    // Any AT command frame (0x08) applies all queued parameter values before it is executed
+    if(!xbee_at_batch_frame(batch, XBeeFrameATCommand, persist ? XBeeATCmdATWR : XBeeATCmdATAC,
+                            NULL, 0))
+        return XBEE_TX_BAD_FRAME_SIZE;
+
+    return xbee_at_batch_transmit(batch);
+}
+
+
+// xbee_at_batch_transmit() - transmit every frame in <batch> in a single SPI session, as it
+// stands.  Responses are collected by xbee_at_batch_wait().  Returns XBEE_TX_BAD_FRAME_SIZE if the
+// frames did not fit in the batch buffer; otherwise returns the status of the transaction.
+//
+static XBeeTxnStatus_t xbee_at_batch_transmit(XBeeATBatch_t * const batch)
+{
+    if(batch->overflow || !batch->count)
+        return XBEE_TX_BAD_FRAME_SIZE;
+
+    batch->pending = (1 << batch->count) - 1;
+    batch->failed = 0;
+
+    at_batch = batch;
+
+    // The responses are matched to the batch as they arrive, and are not queued
+    return xbee_spi_session(batch->buf, NULL, batch->len, 0);
+}
+
+
+// xbee_at_batch_match() - if <pkt> is an AT command response frame answering a frame in the
+// outstanding batch, mark that frame as answered, record whether it failed and, if it is a query,
+// the value returned, then return non-zero: the frame has been consumed.  Otherwise return zero.
+// Called from the SPI ISR.
+//
+static uint8_t xbee_at_batch_match(const XBeePacketBuf_t * const pkt)
+{
+    const XBeeATRespView_t * const resp = xbee_view_at_resp(pkt);
+    uint8_t i, mask;
+
+    if(!resp || !at_batch)
+        return 0;
+
+    for(i = 0, mask = 1; i < at_batch->count; ++i, mask <<= 1)
+    {
+        if((at_batch->pending & mask) && (at_batch->frame_id[i] == resp->frame_id))
+        {
+            if((resp->status != XBeeATCmdOK) ||
+               ((at_batch->query & mask) && (xbee_view_data_len(pkt, XBeeATRespView_t) != 1)))
+                at_batch->failed |= mask;
+            else if(at_batch->query & mask)
+                at_batch->value[i] = resp->data[0];
+
+            at_batch->pending &= ~mask;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+// xbee_at_batch_wait() - wait, for up to XBEE_AT_BATCH_TIMEOUT_MS, for the responses to the
+// frames sent by xbee_at_batch_send(), dispatching any other frames received in the meantime.
+// Returns non-zero if every response was received and indicated success.  On return, the
+// <pending> and <failed> fields of <batch> identify any frames which were not answered, or which
+// failed.
+//
+uint8_t xbee_at_batch_wait(XBeeATBatch_t * const batch)
+{
+    const uint16_t ticks = RTC_MS_TO_TICKS(XBEE_AT_BATCH_TIMEOUT_MS), start = rtc_get_count();
+
+    xbee_rx_dispatch();                     // Responses may have arrived during transmission
+
+    while(batch->pending)
+    {
+        const uint16_t elapsed = rtc_get_count() - start;
+
+        if((elapsed >= ticks) ||
+           !gpio_wait_level_timeout(PIN_XBEE_SPI_nATTN, 0, ticks - elapsed))
+            break;                          // Timed out
+
+        xbee_receive_packet_no_wait();
+        xbee_rx_dispatch();
+    }
+
+    at_batch = NULL;
+
+    if(batch->pending || batch->failed)
+    {
+        debug_log("E: AT batch: pending %02x failed %02x\n", batch->pending, batch->failed);
+        return 0;
+    }
+
+    return 1;
+}
+
+
+// xbee_settings_digest() - return a CRC-16 digest of the xbee_settings[] table.
+//
+static uint16_t xbee_settings_digest()
+{
+    const uint8_t *p = (const uint8_t *) xbee_settings;
+    uint16_t crc = 0;
+    uint8_t i;
+
+    for(i = 0; i < sizeof(xbee_settings); ++i)
+        crc = _crc16_update(crc, pgm_read_byte(p++));
+
+    return crc;
+}
+
+
+// xbee_apply_settings() - read back every setting in xbee_settings[] from the XBee module, as a
+// single batch of queries, then write those whose values differ as a single AT command batch,
+// which is saved in the module's non-volatile memory with ATWR.  Nothing is written if every
+// setting matches.  Returns non-zero on success.
+//
+static uint8_t xbee_apply_settings()
+{
+    uint8_t buf[(sizeof(xbee_settings) / sizeof(xbee_settings[0]) + 1) *
+                (XBEE_FRAME_OVERHEAD + 4 + 1)];
+    XBeeATBatch_t batch;
+    uint8_t i, differ = 0;
+
+    // Query every current value
+    xbee_at_batch_begin(&batch, buf, sizeof(buf));
+
+    for(i = 0; i < sizeof(xbee_settings) / sizeof(xbee_settings[0]); ++i)
+        xbee_at_batch_query(&batch, pgm_read_word(&xbee_settings[i].cmd));
+
+    if(!(xbee_at_batch_transmit(&batch) & XBEE_TX_SUCCESS))
+        return 0;
+
+    xbee_at_batch_wait(&batch);
+    if(batch.pending)
+        return 0;                           // Not every query was answered
+
+    // A setting whose query failed is rewritten
+    for(i = 0; i < batch.count; ++i)
+        if((batch.failed & (1 << i)) || (batch.value[i] != pgm_read_byte(&xbee_settings[i].value)))
+            differ |= 1 << i;
+
+    // Write the settings which differ
+    xbee_at_batch_begin(&batch, buf, sizeof(buf));
+
+    for(i = 0; i < sizeof(xbee_settings) / sizeof(xbee_settings[0]); ++i)
+    {
+        const uint8_t value = pgm_read_byte(&xbee_settings[i].value);
+
+        if((differ & (1 << i)) &&
+           !xbee_at_batch_add(&batch, pgm_read_word(&xbee_settings[i].cmd), &value, 1))
+            return 0;
+    }
+
+    if(!batch.count)
+        return 1;                           // Nothing to change
+
+    if(!(xbee_at_batch_send(&batch, 1) & XBEE_TX_SUCCESS))
+        return 0;
+
+    return xbee_at_batch_wait(&batch);
+}
+
+
+// xbee_sentinel_ok() - query the XBee module for the value of the last (sentinel) setting in
+// xbee_settings[].  Returns non-zero if the module holds the required value.
+//
+static uint8_t xbee_sentinel_ok()
+{
+    const XBeeSetting_t * const sentinel =
+        xbee_settings + sizeof(xbee_settings) / sizeof(xbee_settings[0]) - 1;
+    const XBeeATRespView_t *resp;
+    uint8_t ok;
+
+    if(!(xbee_do_at_command(pgm_read_word(&sentinel->cmd), NULL, 0) & XBEE_RX_SUCCESS))
+        return 0;
+
+    resp = xbee_view_at_resp(xbee_rx_head());
+    ok = resp && (resp->status == XBeeATCmdOK) &&
+         (xbee_view_data_len(xbee_rx_head(), XBeeATRespView_t) == 1) &&
+         (resp->data[0] == pgm_read_byte(&sentinel->value));
+    xbee_rx_pop();
+
+    return ok;
+}
+
+
+// xbee_configure() - ensure that the XBee module holds the settings in xbee_settings[].  If the
+// digest of the table matches the one stored in EEPROM when the settings were last applied, and
+// the module holds the sentinel setting, the module is assumed to be configured already.  The
+// sentinel check detects a module which has been replaced or restored to its factory settings
+// since the digest was stored.  Otherwise the module is reset and the settings are applied (see
+// xbee_apply_settings()).  Up to XBEE_CONFIG_ATTEMPTS attempts are made.  Returns non-zero on
+// success.
+//
+uint8_t xbee_configure()
+{
+    const uint16_t digest = xbee_settings_digest();
+    const XBeeModemStatusView_t *ms;
+    uint8_t attempt, ret;
+
+    if(eeprom_read_word(&ee_settings_digest) == digest)
+    {
+        if(xbee_sentinel_ok())
+        {
+            debug_log("I: XBee config unchanged\n");
+            return 1;
+        }
+
+        debug_log("W: XBee config lost\n");
+    }
 
-        ret = xbee_do_at_command(XBeeATCmdATD9, 1);
-        if(!(ret & XBEE_RX_SUCCESS) || (xbee_rx.at_resp.status != XBeeATCmdOK))
+    for(attempt = 0; attempt < XBEE_CONFIG_ATTEMPTS; ++attempt)
+    {
+        debug_log("Config start: XBee reset\n");
+        while(xbee_rx_head())
+            xbee_rx_pop();                  // Discard frames received before the reset
+        xbee_reset();                       // Perform a hardware reset
+
+        xbee_receive_packet_no_wait();      // Cause some SPI activity to provoke nATT assertion
+
+        // Expect a modem status frame with its status byte set to 0x00, indicating a hardware
+        // reset.
+        ret = xbee_rx_wait(XBeeFrameModemStatus);
+        if(!(ret & XBEE_RX_SUCCESS))
             continue;                       // Try again
 
-        // Send an ATD8 command to configure pin DIO8 as DTR/SLEEP_RQ
-        xbee_tx.at.parameter_value[0] = XBeePinCfgAlternateFunction;
-        ret = xbee_do_at_command(XBeeATCmdATD8, 1);
-        if(!(ret & XBEE_RX_SUCCESS) || (xbee_rx.at_resp.status != XBeeATCmdOK))
+        ms = xbee_view_modem_status(xbee_rx_head());
+        ret = ms && (ms->status == XBeeModemStatusHardwareReset);
+        xbee_rx_pop();
+        if(!ret)
             continue;                       // Try again
 
-        // TODO: set sleep mode (SM) = pin sleep
-        xbee_tx.at.parameter_value[0] = XBeeSleepModePinSleep;
-        ret = xbee_do_at_command(XBeeATCmdATSM, 1);
-        if(!(ret & XBEE_RX_SUCCESS) || (xbee_rx.at_resp.status != XBeeATCmdOK))
+        if(!xbee_apply_settings())
             continue;                       // Try again
 
-        break;
+        eeprom_update_word(&ee_settings_digest, digest);
+        return 1;
     }
+
+    return 0;
 }
 
 
 #if 0
-void xbee_dump_packet()
+void xbee_dump_packet(const XBeePacketBuf_t * const pkt)
 {
     uint8_t i;
 
     usart0_puts_p(PSTR("Pkt: ("));
-    usart0_puthex_byte(xbee_rx.frame_type);
+    usart0_puthex_byte(pkt->frame_type);
     usart0_tx(')');
-    for(i = 0; i < xbee_rx.len; ++i)
+    for(i = 0; i < pkt->len; ++i)
     {
         usart0_tx(' ');
-        usart0_puthex_byte(xbee_rx.raw[i]);
+        usart0_puthex_byte(pkt->raw[i]);
     }
     usart0_tx('\n');
 }
@@ -9,15 +9,38 @@
 #include <stdint.h>
 #include "atcommands.h"
 #include "xbeeapi.h"
+#include "xbeeframe.h"
 
 
 #define XBEE_RX_ONLY_RETRIES    (10)    // In receive-only mode: # times to wait for a delimiter
 #define XBEE_NRESET_ASSERT_MS   (10)    // Length of time to assert XBee's nRESET pin, in ms
 #define XBEE_NRESET_WAIT_MS     (50)    // Time to wait after negating XBee's nRESET pin, in ms
-
-
-// Global transmit and receive packet buffers
-XBeePacketBuf_t xbee_rx, xbee_tx;
+#define XBEE_ATTN_TIMEOUT_MS    (1000)  // Max time to wait for the XBee to assert SPI_nATTN, in ms
+#define XBEE_WAKE_TIMEOUT_MS    (100)   // Max time to wait for the XBee to wake/sleep, in ms
+#define XBEE_SPI_CLK_FREQ_MAX   (2000000UL) // Max SPI clock frequency, in Hz
+
+#define XBEE_AT_PARAM_MAX       (20)    // Max length of an AT command parameter value
+#define XBEE_RX_FRAME_LEN_MAX   (300)   // Max length (frame type + data) of a received API frame
+#define XBEE_RX_QUEUE_LEN       (2)     // Number of frame slots in the RX queue; a power of two
+#define XBEE_RX_HANDLERS_MAX    (4)     // Max number of registered received-frame handlers
+#define XBEE_RX_STREAM_HANDLERS_MAX (2) // Max number of registered streaming frame handlers
+#define XBEE_RX_WAIT_SESSIONS   (4)     // Max receive sessions while waiting for a given frame
+#define XBEE_AT_BATCH_MAX       (7)     // Max parameter changes in an AT command batch
+#define XBEE_AT_BATCH_TIMEOUT_MS (1000) // Max time to wait for AT command batch responses, in ms
+#define XBEE_CONFIG_ATTEMPTS    (3)     // Max attempts to configure the XBee module at boot
+#define XBEE_TX_TRACK_LEN       (4)     // Max number of transmissions awaiting a status frame
+#define XBEE_TX_STATUS_TIMEOUT_MS (3000)    // Max time to wait for a transmit-status frame, in ms
+
+// Pseudo-delivery status returned by xbee_tx_track_wait() if no transmit-status frame arrived
+#define XBEE_TX_STATUS_PENDING  (0xff)
+#define XBEE_TXRQ_HDR_LEN       (13)    // Length of transmit-request fields preceding the data
+#define XBEE_TXRQ_DATA_MAX      (XBEE_BUF_LEN - XBEE_TXRQ_HDR_LEN - 1)  // Max transmit data len
+
+// Macro giving the wire-format length of a transmit-request frame carrying <data_len> bytes
+#define XBEE_TXRQ_FRAME_LEN(data_len)   (XBEE_FRAME_OVERHEAD + 1 + XBEE_TXRQ_HDR_LEN + (data_len))
+
+#define XBEE_ADDR_COORDINATOR   (0x0000000000000000ULL) // 64-bit address of network coordinator
+#define XBEE_NET_ADDR_UNKNOWN   (0xfffe)    // 16-bit net address to use if the address is unknown
 
 
 // XBeePowerState_t - enumeration representing available XBee power states
@@ -28,8 +51,65 @@ typedef enum XBeePowerState
 } XBeePowerState_t;
 
 
+// XBeeRxHandler_t - function called by xbee_rx_dispatch() for each received frame of the type with
+// which it was registered.  The frame is released when the handler returns.
+//
+typedef void (*XBeeRxHandler_t)(const XBeePacketBuf_t * const pkt);
+
+
+// XBeeATBatch_t - a batch of AT parameter changes.  Each change is queued in the XBee module with
+// an "AT command - queue parameter value" frame; the changes are applied together by a final AC
+// (or WR) command.  A batch may instead hold parameter queries, whose single-byte results are
+// recorded in <value>.  All of the frames are transmitted in a single SPI session, and the
+// response to each frame is matched to it by frame ID as it is received, in the SPI ISR, so that
+// responses do not occupy the RX queue.  Bit <n> of <pending>, <failed> and <query> refers to the
+// <n>th frame in the batch.
+//
+typedef struct XBeeATBatch
+{
+    uint8_t *       buf;                    // Buffer holding the wire-format frames
+    uint8_t         cap;                    // Capacity of <buf>
+    uint8_t         len;                    // Length of the frames in <buf>
+    uint8_t         count;                  // Number of frames in <buf>
+    uint8_t         overflow;               // Non-zero if a frame did not fit in <buf>
+    volatile uint8_t pending;               // Frames whose responses have not yet been received
+    volatile uint8_t failed;                // Frames whose responses indicated an error
+    uint8_t         query;                  // Frames which query a parameter value
+    XBeeFrameID_t   frame_id[XBEE_AT_BATCH_MAX + 1];
+    volatile uint8_t value[XBEE_AT_BATCH_MAX + 1];  // Values returned by queries
+} XBeeATBatch_t;
+
+
+// XBeeRxStreamHandler_t - callbacks which receive frames of a particular type which are too long
+// to fit in the RX queue, piece by piece as they arrive.  All are called from the SPI ISR, and
+// should return quickly.
+//
+typedef struct XBeeRxStreamHandler
+{
+    // Called once the frame type and length are known.  <data_len> is the length of the frame data
+    // which follows the frame type.  Return non-zero to accept the frame; otherwise it is
+    // discarded, and no further callbacks are made.
+    uint8_t (*begin)(const XBeeFrameType_t type, const uint16_t data_len);
+
+    // Called with each successive chunk of the frame data (up to XBEE_BUF_LEN bytes).  The first
+    // chunk starts with the frame-specific header fields, and may be inspected using the
+    // xbee_view_*() structs.
+    void    (*data)(const uint8_t * const chunk, const uint8_t len);
+
+    // Called once the frame has been received.  <commit> is non-zero if the frame's checksum is
+    // valid; otherwise the data passed to data() must be discarded.
+    void    (*end)(const uint8_t commit);
+} XBeeRxStreamHandler_t;
+
+
+// XBeeTxProducer_t - function called by xbee_send_stream() to obtain each successive byte of the
+// frame data being transmitted, starting with the frame type.  Called from the SPI ISR.
+//
+typedef uint8_t (*XBeeTxProducer_t)();
+
+
 // XBeeTxnStatus_t - return type used by xbee_spi_transaction(), xbee_send_at_command(), etc.
-typedef uint8_t XBeeTxnStatus_t;
+typedef uint16_t XBeeTxnStatus_t;
 
 // Flags used in the return value from xbee_spi_transaction(), xbee_send_at_command(), etc.
 //
@@ -38,9 +118,14 @@ typedef uint8_t XBeeTxnStatus_t;
 #define XBEE_TX_BAD_FRAME_SIZE          (0x04)      // Transmit frame too long, or zero-length
 #define XBEE_RX_NO_DATA                 (0x08)      // Expected to receive a packet, but didn't
 #define XBEE_RX_FRAME_TOO_LONG          (0x10)      // RX packet discarded - too long for buffer
+                                                    // and no streaming handler accepted it
 #define XBEE_RX_BAD_CHECKSUM            (0x20)      // RX packet discarded - bad checksum
 #define XBEE_RX_WRONG_FRAME             (0x40)      // RX packet contained unexpected frame
 #define XBEE_TXRX_TIMEOUT               (0x80)      // Timeout occurred during command TX/RX
+#define XBEE_RX_QUEUE_FULL              (0x100)     // RX packet discarded - RX queue full, or
+                                                    // too many responses requested
+#define XBEE_RX_BAD_LENGTH              (0x200)     // RX packet discarded - length field zero
+                                                    // or greater than XBEE_RX_FRAME_LEN_MAX
 
 
 // xbee_attn() - macro expanding to a GPIO-reading function call which returns non-zero if the
@@ -51,14 +136,33 @@ typedef uint8_t XBeeTxnStatus_t;
 void xbee_init();
 void xbee_reset();
 void xbee_set_power_state(const XBeePowerState_t state);
-void xbee_wait_power_state(const XBeePowerState_t state);
-XBeeTxnStatus_t xbee_spi_transaction();
-void xbee_configure();
+XBeeTxnStatus_t xbee_wait_power_state(const XBeePowerState_t state);
+XBeeTxnStatus_t xbee_spi_transaction(const uint8_t * const frame, const uint8_t frame_len);
+XBeeTxnStatus_t xbee_send_frame(XBeeFrameBuilder_t * const b);
+XBeeTxnStatus_t xbee_send_stream(const XBeeTxProducer_t producer, const uint8_t data_len);
+XBeeTxnStatus_t xbee_do_at_command(const XBeeATCmd_t command, const uint8_t * const param,
+                                   const uint8_t param_len);
+void xbee_at_batch_begin(XBeeATBatch_t * const batch, uint8_t * const buf, const uint8_t cap);
+uint8_t xbee_at_batch_add(XBeeATBatch_t * const batch, const XBeeATCmd_t command,
+                          const uint8_t * const param, const uint8_t param_len);
+XBeeTxnStatus_t xbee_at_batch_send(XBeeATBatch_t * const batch, const uint8_t persist);
+uint8_t xbee_at_batch_wait(XBeeATBatch_t * const batch);
+XBeeFrameID_t xbee_alloc_frame_id();
+XBeeFrameID_t xbee_tx_track_begin();
+uint8_t xbee_tx_track_wait(const XBeeFrameID_t frame_id);
+const XBeePacketBuf_t *xbee_rx_head();
+void xbee_rx_pop();
+uint8_t xbee_set_rx_handler(const XBeeFrameType_t type, const XBeeRxHandler_t handler);
+uint8_t xbee_set_rx_stream_handler(const XBeeFrameType_t type,
+                                   const XBeeRxStreamHandler_t * const handler);
+void xbee_rx_dispatch();
+void xbee_poll();
+uint8_t xbee_configure();
 
 #ifdef _DEBUG
-void xbee_dump_packet();
+void xbee_dump_packet(const XBeePacketBuf_t * const pkt);
 #else
-#define xbee_dump_packet()
+#define xbee_dump_packet(pkt)
 #endif
 
 #endif
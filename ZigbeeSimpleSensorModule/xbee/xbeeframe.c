@@ -0,0 +1,230 @@
+/*
+    xbeeframe.c - definitions relating to the XBee API frame builder and received-frame views
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "xbeeframe.h"
+#include <stddef.h>
+
+
+// xbee_frame_begin() - start building a frame of type <type> in the <cap>-byte buffer <buf>.  The
+// start delimiter and frame type are written, and space is reserved for the length field.
+//
+void xbee_frame_begin(XBeeFrameBuilder_t * const b, uint8_t * const buf, const uint8_t cap,
+                      const XBeeFrameType_t type)
+{
+    b->buf = buf;
+    b->cap = cap;
+    b->cksum = 0;
+
+    if(cap < XBEE_FRAME_OVERHEAD + 1)
+    {
+        b->len = 0;
+        b->overflow = 1;
+        return;
+    }
+
+    buf[0] = XBEE_FRAME_DELIMITER;
+    b->len = 3;                             // Length field is filled in by xbee_frame_end()
+    b->overflow = 0;
+
+    xbee_frame_put_u8(b, type);
+}
+
+
+// xbee_frame_begin_data() - start building a fragment of frame data in the <cap>-byte buffer
+// <buf>.  No start delimiter, length field or frame type is written, and the fragment must not be
+// completed with xbee_frame_end(); on completion, its length is held in <b->len>.  As with whole
+// frames, one byte of <buf> is held in reserve.  Fragments are used to supply frame data to
+// xbee_send_stream() piecemeal.
+//
+void xbee_frame_begin_data(XBeeFrameBuilder_t * const b, uint8_t * const buf, const uint8_t cap)
+{
+    b->buf = buf;
+    b->cap = cap;
+    b->len = 0;
+    b->cksum = 0;
+    b->overflow = !cap;
+}
+
+
+// xbee_frame_put_u8() - append the byte <val> to the frame, updating the checksum.  One byte is
+// always kept in reserve for the checksum.
+//
+void xbee_frame_put_u8(XBeeFrameBuilder_t * const b, const uint8_t val)
+{
+    if(b->len >= b->cap - 1)
+    {
+        b->overflow = 1;
+        return;
+    }
+
+    b->buf[b->len++] = val;
+    b->cksum += val;
+}
+
+
+// xbee_frame_put_u16_be() - append the 16-bit value <val> to the frame, MSB first.
+//
+void xbee_frame_put_u16_be(XBeeFrameBuilder_t * const b, const uint16_t val)
+{
+    xbee_frame_put_u8(b, val >> 8);
+    xbee_frame_put_u8(b, val & 0xff);
+}
+
+
+// xbee_frame_put_u16_le() - append the 16-bit value <val> to the frame, LSB first.
+//
+void xbee_frame_put_u16_le(XBeeFrameBuilder_t * const b, const uint16_t val)
+{
+    xbee_frame_put_u8(b, val & 0xff);
+    xbee_frame_put_u8(b, val >> 8);
+}
+
+
+// xbee_frame_put_u64_be() - append the 64-bit value <val> to the frame, MSB first.
+//
+void xbee_frame_put_u64_be(XBeeFrameBuilder_t * const b, const uint64_t val)
+{
+    int8_t shift;
+
+    for(shift = 56; shift >= 0; shift -= 8)
+        xbee_frame_put_u8(b, (uint8_t) (val >> shift));
+}
+
+
+// xbee_frame_put_bytes() - append <len> bytes from <src> to the frame.
+//
+void xbee_frame_put_bytes(XBeeFrameBuilder_t * const b, const uint8_t *src, uint8_t len)
+{
+    while(len--)
+        xbee_frame_put_u8(b, *src++);
+}
+
+
+// xbee_frame_space() - return the number of bytes which may still be appended to the frame.
+//
+uint8_t xbee_frame_space(const XBeeFrameBuilder_t * const b)
+{
+    return b->overflow ? 0 : b->cap - 1 - b->len;
+}
+
+
+// xbee_frame_end() - complete the frame by filling in its length field and appending its
+// checksum.  Returns the length of the finished frame, in bytes, or zero if the frame overflowed
+// its buffer.
+//
+uint8_t xbee_frame_end(XBeeFrameBuilder_t * const b)
+{
+    const uint8_t data_len = b->len - 3;    // Frame type + frame data
+
+    if(b->overflow)
+        return 0;
+
+    b->buf[1] = 0;
+    b->buf[2] = data_len;
+    b->buf[b->len++] = 0xff - b->cksum;
+
+    return b->len;
+}
+
+
+// xbee_frame_at() - start building an AT command frame of type <type> (XBeeFrameATCommand or
+// XBeeFrameATCommandQueueParamVal) with ID <frame_id>, for the command <cmd>.  Any parameter value
+// should then be appended by the caller.
+//
+void xbee_frame_at(XBeeFrameBuilder_t * const b, uint8_t * const buf, const uint8_t cap,
+                   const XBeeFrameType_t type, const XBeeFrameID_t frame_id,
+                   const XBeeATCmd_t cmd)
+{
+    xbee_frame_begin(b, buf, cap, type);
+    xbee_frame_put_u8(b, frame_id);
+    xbee_frame_put_u16_le(b, cmd);          // XBeeATCmd_t values hold the first char in the LSB
+}
+
+
+// xbee_frame_txrq() - start building a Zigbee transmit-request frame with ID <frame_id>, addressed
+// to the device with 64-bit address <dest_addr> and 16-bit network address <dest_net_addr>.  The
+// RF data should then be appended by the caller.
+//
+void xbee_frame_txrq(XBeeFrameBuilder_t * const b, uint8_t * const buf, const uint8_t cap,
+                     const XBeeFrameID_t frame_id, const uint64_t dest_addr,
+                     const uint16_t dest_net_addr, const uint8_t radius, const uint8_t options)
+{
+    xbee_frame_begin(b, buf, cap, XBeeFrameZigbeeTXRequest);
+    xbee_frame_put_txrq_fields(b, frame_id, dest_addr, dest_net_addr, radius, options);
+}
+
+
+// xbee_frame_put_txrq_fields() - append the fields of a Zigbee transmit-request frame which follow
+// its frame type.  Used by xbee_frame_txrq(), and to build the header of a streamed frame.
+//
+void xbee_frame_put_txrq_fields(XBeeFrameBuilder_t * const b, const XBeeFrameID_t frame_id,
+                                const uint64_t dest_addr, const uint16_t dest_net_addr,
+                                const uint8_t radius, const uint8_t options)
+{
+    xbee_frame_put_u8(b, frame_id);
+    xbee_frame_put_u64_be(b, dest_addr);
+    xbee_frame_put_u16_be(b, dest_net_addr);
+    xbee_frame_put_u8(b, radius);
+    xbee_frame_put_u8(b, options);
+}
+
+
+// xbee_frame_explicit() - start building an explicit-addressing Zigbee command frame.  The
+// arguments correspond to the frame's fields; the RF data should then be appended by the caller.
+//
+void xbee_frame_explicit(XBeeFrameBuilder_t * const b, uint8_t * const buf, const uint8_t cap,
+                         const XBeeFrameID_t frame_id, const uint64_t dest_addr,
+                         const uint16_t dest_net_addr, const uint8_t src_endpoint,
+                         const uint8_t dest_endpoint, const uint16_t cluster_id,
+                         const uint16_t profile_id, const uint8_t radius, const uint8_t options)
+{
+    xbee_frame_begin(b, buf, cap, XBeeFrameExplicitAddrZigbeeCmd);
+    xbee_frame_put_u8(b, frame_id);
+    xbee_frame_put_u64_be(b, dest_addr);
+    xbee_frame_put_u16_be(b, dest_net_addr);
+    xbee_frame_put_u8(b, src_endpoint);
+    xbee_frame_put_u8(b, dest_endpoint);
+    xbee_frame_put_u16_be(b, cluster_id);
+    xbee_frame_put_u16_be(b, profile_id);
+    xbee_frame_put_u8(b, radius);
+    xbee_frame_put_u8(b, options);
+}
+
+
+// xbee_frame_view() - return a pointer to the frame-specific data of the received frame in <pkt>,
+// provided that the frame is of type <type> and carries at least <min_len> bytes of data;
+// otherwise return NULL.  Normally called through the xbee_view_*() macros.
+//
+const void *xbee_frame_view(const XBeePacketBuf_t * const pkt, const XBeeFrameType_t type,
+                            const uint8_t min_len)
+{
+    if((pkt->frame_type != type) || (pkt->len < min_len))
+        return NULL;
+
+    return pkt->raw;
+}
+
+
+// xbee_get_u16_be() - return the 16-bit value stored MSB-first at <p>.
+//
+uint16_t xbee_get_u16_be(const uint8_t * const p)
+{
+    return ((uint16_t) p[0] << 8) | p[1];
+}
+
+
+// xbee_get_u64_be() - return the 64-bit value stored MSB-first at <p>.
+//
+uint64_t xbee_get_u64_be(const uint8_t * const p)
+{
+    uint64_t val = 0;
+    uint8_t i;
+
+    for(i = 0; i < 8; ++i)
+        val = (val << 8) | p[i];
+
+    return val;
+}
@@ -0,0 +1,136 @@
+#ifndef XBEEFRAME_H_INC
+#define XBEEFRAME_H_INC
+/*
+    xbeeframe.h - declarations relating to the XBee API frame builder and received-frame views
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include <stdint.h>
+#include "atcommands.h"
+#include "xbeeapi.h"
+
+
+#define XBEE_FRAME_OVERHEAD     (4)     // Delimiter, two length bytes and checksum
+#define XBEE_FRAME_BUF_LEN      (XBEE_BUF_LEN + XBEE_FRAME_OVERHEAD)    // Max wire-format length
+
+
+// XBeeFrameBuilder_t - state of a frame under construction.  The frame is built, in wire format
+// (i.e. including the start delimiter, length and checksum), in a buffer supplied by the caller.
+// The checksum is accumulated as each field is appended, and the length field is filled in by
+// xbee_frame_end().  If the buffer overflows, further fields are discarded and xbee_frame_end()
+// fails.
+//
+typedef struct XBeeFrameBuilder
+{
+    uint8_t *   buf;                    // Frame buffer
+    uint8_t     cap;                    // Size of <buf>, in bytes
+    uint8_t     len;                    // Number of bytes written to <buf>
+    uint8_t     cksum;                  // Running sum of the frame type and frame data
+    uint8_t     overflow;               // Non-zero if a field did not fit in <buf>
+} XBeeFrameBuilder_t;
+
+
+//
+// Read-only views of the frame-specific data in received frames.  Multi-byte addresses are held
+// MSB-first ("network order"); use xbee_get_u16_be() and xbee_get_u64_be() to read them.
+//
+
+// AT command response frame (0x88)
+typedef struct __attribute__((packed)) XBeeATRespView
+{
+    XBeeFrameID_t           frame_id;
+    XBeeATCmd_t             cmd;
+    XBeeATCmdStatus_t       status;
+    uint8_t                 data[];
+} XBeeATRespView_t;
+
+// Modem status frame (0x8a)
+typedef struct __attribute__((packed)) XBeeModemStatusView
+{
+    XBeeModemStatus_t       status;
+} XBeeModemStatusView_t;
+
+// Transmit status frame (0x8b)
+typedef struct __attribute__((packed)) XBeeTXStatusView
+{
+    XBeeFrameID_t           frame_id;
+    uint8_t                 dest_net_addr[2];
+    uint8_t                 retry_count;
+    XBeeTXDeliveryStatus_t  status;
+    XBeeTXDiscoveryStatus_t discovery_status;
+} XBeeTXStatusView_t;
+
+// Receive packet frame (0x90)
+typedef struct __attribute__((packed)) XBeeRXPacketView
+{
+    uint8_t                 src_addr[8];
+    uint8_t                 src_net_addr[2];
+    uint8_t                 options;
+    uint8_t                 data[];
+} XBeeRXPacketView_t;
+
+// Explicit receive indicator frame (0x91)
+typedef struct __attribute__((packed)) XBeeExplicitRXView
+{
+    uint8_t                 src_addr[8];
+    uint8_t                 src_net_addr[2];
+    uint8_t                 src_endpoint;
+    uint8_t                 dest_endpoint;
+    uint8_t                 cluster_id[2];
+    uint8_t                 profile_id[2];
+    uint8_t                 options;
+    uint8_t                 data[];
+} XBeeExplicitRXView_t;
+
+
+// Macros returning a typed view of the received frame in <pkt> (an XBeePacketBuf_t *), or NULL if
+// the frame is of a different type or is too short to hold the view's fixed fields.
+#define xbee_view_at_resp(pkt)      ((const XBeeATRespView_t *) \
+    xbee_frame_view((pkt), XBeeFrameATCommandResponse, sizeof(XBeeATRespView_t)))
+#define xbee_view_modem_status(pkt) ((const XBeeModemStatusView_t *) \
+    xbee_frame_view((pkt), XBeeFrameModemStatus, sizeof(XBeeModemStatusView_t)))
+#define xbee_view_tx_status(pkt)    ((const XBeeTXStatusView_t *) \
+    xbee_frame_view((pkt), XBeeFrameZigbeeTransmitStatus, sizeof(XBeeTXStatusView_t)))
+#define xbee_view_rx_packet(pkt)    ((const XBeeRXPacketView_t *) \
+    xbee_frame_view((pkt), XBeeFrameZigbeeReceivePacket, sizeof(XBeeRXPacketView_t)))
+#define xbee_view_explicit_rx(pkt)  ((const XBeeExplicitRXView_t *) \
+    xbee_frame_view((pkt), XBeeFrameZigbeeExplicitRXIndicator, sizeof(XBeeExplicitRXView_t)))
+
+// Macro returning the length of the variable-length data which follows a view of type <view_type>
+// in the received frame <pkt>.  Only valid once the view has been obtained successfully.
+#define xbee_view_data_len(pkt, view_type)  ((uint8_t) ((pkt)->len - sizeof(view_type)))
+
+
+void xbee_frame_begin(XBeeFrameBuilder_t * const b, uint8_t * const buf, const uint8_t cap,
+                      const XBeeFrameType_t type);
+void xbee_frame_begin_data(XBeeFrameBuilder_t * const b, uint8_t * const buf, const uint8_t cap);
+void xbee_frame_put_u8(XBeeFrameBuilder_t * const b, const uint8_t val);
+void xbee_frame_put_u16_be(XBeeFrameBuilder_t * const b, const uint16_t val);
+void xbee_frame_put_u16_le(XBeeFrameBuilder_t * const b, const uint16_t val);
+void xbee_frame_put_u64_be(XBeeFrameBuilder_t * const b, const uint64_t val);
+void xbee_frame_put_bytes(XBeeFrameBuilder_t * const b, const uint8_t *src, uint8_t len);
+uint8_t xbee_frame_space(const XBeeFrameBuilder_t * const b);
+uint8_t xbee_frame_end(XBeeFrameBuilder_t * const b);
+
+void xbee_frame_at(XBeeFrameBuilder_t * const b, uint8_t * const buf, const uint8_t cap,
+                   const XBeeFrameType_t type, const XBeeFrameID_t frame_id,
+                   const XBeeATCmd_t cmd);
+void xbee_frame_txrq(XBeeFrameBuilder_t * const b, uint8_t * const buf, const uint8_t cap,
+                     const XBeeFrameID_t frame_id, const uint64_t dest_addr,
+                     const uint16_t dest_net_addr, const uint8_t radius, const uint8_t options);
+void xbee_frame_put_txrq_fields(XBeeFrameBuilder_t * const b, const XBeeFrameID_t frame_id,
+                                const uint64_t dest_addr, const uint16_t dest_net_addr,
+                                const uint8_t radius, const uint8_t options);
+void xbee_frame_explicit(XBeeFrameBuilder_t * const b, uint8_t * const buf, const uint8_t cap,
+                         const XBeeFrameID_t frame_id, const uint64_t dest_addr,
+                         const uint16_t dest_net_addr, const uint8_t src_endpoint,
+                         const uint8_t dest_endpoint, const uint16_t cluster_id,
+                         const uint16_t profile_id, const uint8_t radius, const uint8_t options);
+
+const void *xbee_frame_view(const XBeePacketBuf_t * const pkt, const XBeeFrameType_t type,
+                            const uint8_t min_len);
+uint16_t xbee_get_u16_be(const uint8_t * const p);
+uint64_t xbee_get_u64_be(const uint8_t * const p);
+
+#endif
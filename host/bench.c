@@ -0,0 +1,126 @@
+/*
+    bench.c - runs the complete firmware in the simulator, with an XBee module attached and
+    varying signals at the sensor inputs, and reports the register accesses made, and the bytes
+    moved, in each wake cycle.  Usage: bench [cycles]
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "sim.h"
+#include "xbeepeer.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+
+#define BENCH_CYCLES_DEFAULT    (20)    // Number of wake cycles run, unless given on the cmd line
+#define BENCH_PIT_VECTOR        (7)     // RTC_PIT_vect
+
+int firmware_main(void);                // The firmware's main(), renamed by the Makefile
+
+static unsigned cycles;                 // Number of wake cycles to run
+static unsigned cycle;                  // Number of wake cycles started
+static SimStats_t last;                 // Counters at the start of the current cycle
+static uint64_t last_t;                 // Time at the start of the current cycle
+
+// Signals at the ADC inputs: a steady battery, a slowly varying light level and a noisy
+// thermistor
+static const SimWave_t vbatt = {.type = SimWaveConst, .level = 1500};
+static const SimWave_t light = {.type = SimWaveSine, .level = 1000, .amplitude = 600,
+                                .period = SIM_MS(120000), .gated = 1};
+static const SimWave_t temp = {.type = SimWaveNoise, .level = 750, .amplitude = 5, .gated = 1};
+
+
+// accesses() - return the total number of register accesses, and write the bytes moved by them to
+// <*bytes>, in the counters <st>.
+//
+static uint32_t accesses(const SimStats_t * const st, uint32_t * const bytes)
+{
+    uint32_t n = 0;
+    unsigned b;
+
+    *bytes = 0;
+    for(b = 0; b < SimBlock_end; ++b)
+    {
+        n += st->block[b].reads + st->block[b].writes;
+        *bytes += st->block[b].bytes;
+    }
+
+    return n;
+}
+
+
+// report_cycle() - print a row describing the wake cycle which has just ended.
+//
+static void report_cycle()
+{
+    const SimStats_t * const st = sim_stats();
+    uint32_t bytes, last_bytes;
+    const uint32_t n = accesses(st, &bytes), last_n = accesses(&last, &last_bytes);
+
+    printf("%5u %9.3f %8u %8u %6u %6u %5u %9.3f\n", cycle, last_t / 1e12, n - last_n,
+           bytes - last_bytes, st->spi_bytes - last.spi_bytes,
+           st->adc_conversions - last.adc_conversions, st->irqs - last.irqs,
+           (st->sleep_ps - last.sleep_ps) / 1e12);
+}
+
+
+// pit_hook() - IRQ hook which marks the start of each wake cycle, reporting the previous one.
+//
+static void pit_hook(const uint8_t vector)
+{
+    if(vector != BENCH_PIT_VECTOR)
+        return;
+
+    report_cycle();
+
+    if(++cycle > cycles)
+        sim_stop();
+
+    last = *sim_stats();
+    last_t = sim_now();
+}
+
+
+static void run_firmware()
+{
+    firmware_main();
+}
+
+
+int main(int argc, char **argv)
+{
+    const SimStats_t * const st = sim_stats();
+    uint32_t n, bytes;
+    unsigned b;
+
+    cycles = (argc > 1) ? atoi(argv[1]) : BENCH_CYCLES_DEFAULT;
+
+    sim_init();
+    sim_pin_pull(0, 4, 1);              // External pull-up on SENSOR_nENABLE (PA4)
+    sim_adc_set_gate(0, 4);
+    sim_adc_set_wave(1, &vbatt);
+    sim_adc_set_wave(2, &temp);
+    sim_adc_set_wave(3, &light);
+    xbee_peer_init();
+    xbee_peer_set_tx_status(20, 0);
+
+    sim_set_irq_hook(pit_hook);
+
+    printf("cycle   start/s accesses    bytes    spi    adc  irqs  asleep/s\n");
+    sim_run(run_firmware);
+
+    // Cycle 0 is the boot, up to the first PIT interrupt
+    printf("\n%u wake cycles in %.3fs; register accesses by block:\n", cycles, sim_now() / 1e12);
+    printf("block       reads   writes    bytes  bytes/cycle\n");
+    for(b = 0; b < SimBlock_end; ++b)
+        if(st->block[b].reads || st->block[b].writes)
+            printf("%-8s %8u %8u %8u %12.1f\n", sim_block_name(b), st->block[b].reads,
+                   st->block[b].writes, st->block[b].bytes, (double) st->block[b].bytes / cycles);
+
+    n = accesses(st, &bytes);
+    printf("total %20u %8u %12.1f\n", n, bytes, (double) bytes / cycles);
+    printf("spi %u bytes, adc %u conversions, xbee %u frames in, %u out\n", st->spi_bytes,
+           st->adc_conversions, xbee_peer_stats()->frames_rx, xbee_peer_stats()->frames_tx);
+
+    return 0;
+}
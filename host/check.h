@@ -0,0 +1,51 @@
+#ifndef HOST_CHECK_H_INC
+#define HOST_CHECK_H_INC
+/*
+    check.h - minimal assertion macros used by the host-built checks.  Each failed check prints its
+    location and is counted; check_exit() returns a non-zero exit status if any check failed.
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include <stdio.h>
+
+
+static unsigned check_failures;
+
+// CHECK() - macro which records a failure if <cond> is false.
+//
+#define CHECK(cond)                                                                         \
+            do {                                                                            \
+                if(!(cond))                                                                 \
+                {                                                                           \
+                    fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+                    ++check_failures;                                                       \
+                }                                                                           \
+            } while(0)
+
+// CHECK_EQ() - macro which records a failure, showing both values, if <a> != <b>.
+//
+#define CHECK_EQ(a, b)                                                                      \
+            do {                                                                            \
+                const long long a_ = (a), b_ = (b);                                         \
+                if(a_ != b_)                                                                \
+                {                                                                           \
+                    fprintf(stderr, "%s:%d: check failed: %s == %s (%lld != %lld)\n",       \
+                            __FILE__, __LINE__, #a, #b, a_, b_);                            \
+                    ++check_failures;                                                       \
+                }                                                                           \
+            } while(0)
+
+// check_exit() - report the result of the checks in the program <name>; return an exit status.
+//
+static inline int check_exit(const char * const name)
+{
+    if(check_failures)
+        fprintf(stderr, "%s: %u check(s) failed\n", name, check_failures);
+    else
+        printf("%s: ok\n", name);
+
+    return check_failures ? 1 : 0;
+}
+
+#endif
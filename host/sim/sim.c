@@ -0,0 +1,1024 @@
+#define _GNU_SOURCE
+/*
+    sim.c - core of the host simulator of the ATtiny816: the trapped register file, simulated time,
+    interrupt dispatch, sleep, delays and EEPROM, together with models of the register blocks which
+    need little or no behaviour of their own (CPU, SLPCTRL, CLKCTRL, VREF, CPUINT, EVSYS, PORTMUX,
+    TCB0, FUSE).  See sim.h for an overview.
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "simdev.h"
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/delay_basic.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+
+#define SIM_SPIN_READS          (16)    // Consecutive re-reads of recent registers deemed a spin
+#define SIM_SPIN_ADDRS          (4)     // Number of recently-read registers remembered
+#define SIM_STORM_MAX           (10000) // Consecutive re-triggers of one vector deemed a storm
+#define SIM_WALL_CLOCK_S        (60)    // Limit on the real time taken by a simulation
+#define SIM_EFLAGS_TF           (0x100) // x86 trap flag: single-step the next instruction
+#define SIM_PF_WRITE            (0x02)  // x86 page-fault error code bit: the access was a write
+#define SIM_TIMERS              (16)    // Max number of timers pending at once; see sim_at()
+
+
+uint8_t *sim_io = NULL;                 // Untrapped view of the simulated data space
+uint64_t sim_t = 0;                     // Current time, in ps
+SimStats_t sim_st;                      // Counters
+
+void sim_irq_dispatch_trampoline();     // Interrupt entry and exit; see below
+void sim_irq_dispatch_trampoline_end();
+void sim_irq_dispatch_from_trampoline();
+
+static const SimDev_t sim_dev_cpu, sim_dev_slpctrl, sim_dev_clkctrl, sim_dev_vref,
+                      sim_dev_cpuint, sim_dev_evsys, sim_dev_portmux, sim_dev_tcb, sim_dev_fuse,
+                      sim_dev_other, sim_dev_timer;
+
+// Register blocks, in order of address, followed by the timers, which have no registers
+static const SimDev_t * const sim_devs[] =
+{
+    &sim_dev_vport, &sim_dev_cpu, &sim_dev_other, &sim_dev_slpctrl, &sim_dev_clkctrl,
+    &sim_dev_vref, &sim_dev_cpuint, &sim_dev_rtc, &sim_dev_evsys, &sim_dev_portmux, &sim_dev_port,
+    &sim_dev_adc, &sim_dev_usart, &sim_dev_twi, &sim_dev_spi, &sim_dev_tcb, &sim_dev_fuse,
+    &sim_dev_timer
+};
+
+#define SIM_NUM_DEVS            (sizeof(sim_devs) / sizeof(sim_devs[0]))
+
+static const char * const sim_block_names[SimBlock_end] =
+{
+    "VPORT", "CPU", "SLPCTRL", "CLKCTRL", "VREF", "CPUINT", "RTC", "EVSYS", "PORTMUX", "PORT",
+    "ADC0", "USART0", "TWI0", "SPI0", "TCB0", "FUSE", "other"
+};
+
+// Interrupt vectors.  ISR() defines the handlers used by the firmware; the remainder are NULL.
+#define SIM_VECTOR_DECL(n)      void __vector_##n(void) __attribute__((weak));
+#define SIM_VECTOR_LIST(X) \
+    X(0) X(1) X(2) X(3) X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15) X(16) \
+    X(17) X(18) X(19) X(20) X(21) X(22) X(23) X(24) X(25)
+
+SIM_VECTOR_LIST(SIM_VECTOR_DECL)
+
+#define SIM_VECTOR_ENTRY(n)     __vector_##n,
+
+static void (* const sim_vectors[SIM_VECTORS])(void) = { SIM_VECTOR_LIST(SIM_VECTOR_ENTRY) };
+
+// The section holding EEMEM variables; absent if the firmware linked has none
+extern uint8_t __start_host_eeprom[] __attribute__((weak));
+extern uint8_t __stop_host_eeprom[] __attribute__((weak));
+
+static struct
+{
+    const SimDev_t *dev;                // Block accessed
+    uint16_t    addr;                   // Address accessed
+    uint8_t     width;                  // Width of the register, in bytes
+    uint8_t     write;                  // Non-zero if the access is a write
+    uint16_t    old;                    // Value of the register before a write
+    uint8_t     ccp;                    // Non-zero if the access follows a CCP unlock
+} sim_trap;
+
+static struct
+{
+    uint16_t    addr[SIM_SPIN_ADDRS];   // Registers most recently read
+    uint8_t     next;                   // Index at which the next new address is recorded
+    uint16_t    streak;                 // Consecutive reads of those registers
+} sim_spin;
+
+static gregset_t sim_irq_gregs;         // Firmware context interrupted by the trampoline
+static struct _libc_fpstate sim_irq_fpregs;
+static uint8_t sim_in_dispatch = 0;     // Non-zero while ISRs are being run
+static uint8_t sim_ccp_armed = 0;       // Non-zero if the last write unlocked CCP
+static uint8_t sim_storm_vector = 0;    // Vector which re-triggered after its last ISR
+static uint32_t sim_storm_count = 0;    // ... number of consecutive re-triggers
+static SimIrqHook_t sim_irq_hook = NULL;
+static jmp_buf sim_run_env;             // Context to which sim_stop() returns
+static uint8_t sim_running = 0;         // Non-zero during sim_run()
+
+static uint64_t sim_tcb_t0;             // Time at which TCB0 held <sim_tcb_cnt0>
+static uint16_t sim_tcb_cnt0;
+
+static struct
+{
+    uint64_t    t;                      // Time at which the timer expires
+    SimTimerFn_t fn;                    // Function to call then, or NULL if the entry is free
+} sim_timers[SIM_TIMERS];
+
+static uint64_t sim_irq_dispatch();
+static void sim_clk_change(const uint16_t addr, const uint8_t old, const uint8_t val);
+
+
+// sim_fail() - report a failure of the firmware, or of a test script, to observe the hardware's
+// rules, and exit.
+//
+void sim_fail(const char *fmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "sim: FAIL at t=%.6fs: ", (double) sim_t / SIM_PS_PER_S);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+    exit(1);
+}
+
+
+// sim_io_get() - return the value of the <width>-byte register at <addr>.
+//
+static uint16_t sim_io_get(const uint16_t addr, const uint8_t width)
+{
+    return (width == 2) ? *(uint16_t *) (sim_io + addr) : sim_io[addr];
+}
+
+
+// sim_reg_width() - return the width, in bytes, of the register at <addr>.
+//
+static uint8_t sim_reg_width(const uint16_t addr)
+{
+    if((addr == SIM_ADDR(RTC_CNT)) || (addr == SIM_ADDR(RTC_PER)) || (addr == SIM_ADDR(RTC_CMP)) ||
+       (addr == SIM_ADDR(ADC0_RES)) || (addr == SIM_ADDR(USART0_BAUD)) ||
+       (addr == SIM_ADDR(TCB0_CNT)) || (addr == SIM_ADDR(TCB0_CCMP)))
+        return 2;
+
+    return 1;
+}
+
+
+// sim_dev_at() - return the register block containing <addr>.
+//
+static const SimDev_t *sim_dev_at(const uint16_t addr)
+{
+    unsigned i;
+
+    for(i = 0; i < SIM_NUM_DEVS; ++i)
+        if((addr >= sim_devs[i]->base) && (addr < sim_devs[i]->base + sim_devs[i]->len))
+            return sim_devs[i];
+
+    sim_fail("access to unimplemented register 0x%04x", addr);
+}
+
+
+// sim_cycles_ps() - return the duration, in ps, of <cycles> cycles of a clock of frequency <freq>.
+//
+uint64_t sim_cycles_ps(const uint64_t cycles, const uint32_t freq)
+{
+    return ((unsigned __int128) cycles * SIM_PS_PER_S + freq - 1) / freq;
+}
+
+
+// sim_main_freq() - return the frequency of the main clock, in Hz.
+//
+static uint32_t sim_main_freq()
+{
+    switch(SIM_REG(CLKCTRL_MCLKCTRLA) & CLKCTRL_CLKSEL_gm)
+    {
+        case CLKCTRL_CLKSEL_OSC20M_gc:
+            return ((SIM_REG(FUSE_OSCCFG) & FUSE_FREQSEL_gm) == FREQSEL_20MHZ_gc) ? 20000000
+                                                                                 : 16000000;
+
+        case CLKCTRL_CLKSEL_OSCULP32K_gc:
+            return 32000;
+
+        case CLKCTRL_CLKSEL_XOSC32K_gc:
+            return 32768;
+
+        default:
+            sim_fail("main clock set to EXTCLK, which is not connected");
+    }
+}
+
+
+// sim_cpu_freq() - return the frequency of the CPU clock, which is also the peripheral clock, in
+// Hz.
+//
+uint32_t sim_cpu_freq()
+{
+    static const uint8_t pdiv[16] = {2, 4, 8, 16, 32, 64, 0, 0, 6, 10, 12, 24, 48, 0, 0, 0};
+    const uint8_t mclkctrlb = SIM_REG(CLKCTRL_MCLKCTRLB);
+    uint8_t div;
+
+    if(!(mclkctrlb & CLKCTRL_PEN_bm))
+        return sim_main_freq();
+
+    div = pdiv[(mclkctrlb & CLKCTRL_PDIV_gm) >> CLKCTRL_PDIV_gp];
+    if(!div)
+        sim_fail("reserved PDIV value in MCLKCTRLB (0x%02x)", mclkctrlb);
+
+    return sim_main_freq() / div;
+}
+
+
+// sim_next_event() - return the time of the earliest event scheduled by any peripheral model.
+//
+static uint64_t sim_next_event()
+{
+    uint64_t next = SIM_NEVER;
+    unsigned i;
+
+    for(i = 0; i < SIM_NUM_DEVS; ++i)
+        if(sim_devs[i]->next)
+        {
+            const uint64_t t = sim_devs[i]->next();
+            if(t < next)
+                next = t;
+        }
+
+    return next;
+}
+
+
+// sim_advance_to() - advance time to <t>, processing each model event which falls due on the way.
+//
+static void sim_advance_to(const uint64_t t)
+{
+    uint64_t next;
+
+    while((next = sim_next_event()) <= t)
+    {
+        unsigned i;
+
+        if(next > sim_t)
+            sim_t = next;
+
+        for(i = 0; i < SIM_NUM_DEVS; ++i)
+            if(sim_devs[i]->next && (sim_devs[i]->next() <= sim_t))
+                sim_devs[i]->tick();
+    }
+
+    if(t > sim_t)
+        sim_t = t;
+}
+
+
+// sim_busy() - return non-zero if any peripheral is mid-operation.
+//
+static uint8_t sim_busy()
+{
+    unsigned i;
+
+    for(i = 0; i < SIM_NUM_DEVS; ++i)
+        if(sim_devs[i]->busy && sim_devs[i]->busy())
+            return 1;
+
+    return 0;
+}
+
+
+// sim_irq_pending() - return the mask of interrupt vectors requesting service.
+//
+static uint32_t sim_irq_pending()
+{
+    uint32_t mask = 0;
+    unsigned i;
+
+    for(i = 0; i < SIM_NUM_DEVS; ++i)
+        if(sim_devs[i]->irq)
+            mask |= sim_devs[i]->irq();
+
+    return mask;
+}
+
+
+// sim_irq_ready() - return non-zero if an interrupt can be taken now.  As on the uC, the I flag is
+// not cleared on entry to an ISR; rather, LVL0EX prevents the ISR being preempted.
+//
+static uint8_t sim_irq_ready()
+{
+    return !sim_in_dispatch && (SIM_REG(CPU_SREG) & CPU_I_bm) &&
+           !(SIM_REG(CPUINT_STATUS) & CPUINT_LVL0EX_bm) && sim_irq_pending();
+}
+
+
+// sim_irq_take() - run the ISR for vector <vect>.
+//
+static void sim_irq_take(const uint8_t vect)
+{
+    if(!sim_vectors[vect])
+        sim_fail("interrupt vector %u is pending, but has no ISR", vect);
+
+    ++sim_st.irqs;
+    ++sim_st.vector_irqs[vect];
+    sim_advance_to(sim_t + sim_cycles_ps(SIM_ISR_CYCLES, sim_cpu_freq()));
+
+    SIM_REG(CPUINT_STATUS) |= CPUINT_LVL0EX_bm;
+    if(sim_irq_hook)
+        sim_irq_hook(vect);
+    sim_vectors[vect]();
+    SIM_REG(CPUINT_STATUS) &= ~CPUINT_LVL0EX_bm;
+
+    // An ISR which fails to clear its interrupt flag is re-entered indefinitely
+    if(sim_irq_pending() & SIM_VECTOR_BIT(vect))
+    {
+        if((vect == sim_storm_vector) && (++sim_storm_count > SIM_STORM_MAX))
+            sim_fail("interrupt storm: vector %u is still pending after its ISR", vect);
+        else if(vect != sim_storm_vector)
+        {
+            sim_storm_vector = vect;
+            sim_storm_count = 1;
+        }
+    }
+    else
+        sim_storm_count = 0;
+}
+
+
+// sim_irq_dispatch() - take each interrupt which is pending, lowest vector first, for as long as
+// interrupts can be taken.  Returns the time spent.
+//
+static uint64_t sim_irq_dispatch()
+{
+    const uint64_t start = sim_t;
+
+    while(sim_irq_ready())
+    {
+        const uint32_t pending = sim_irq_pending();
+
+        sim_in_dispatch = 1;
+        sim_irq_take(__builtin_ctz(pending));
+        sim_in_dispatch = 0;
+    }
+
+    return sim_t - start;
+}
+
+
+// sim_irq_dispatch_from_trampoline() - called by the trampoline to which an interrupted firmware
+// context is diverted.
+//
+void sim_irq_dispatch_from_trampoline()
+{
+    sim_irq_dispatch();
+}
+
+
+// The trampoline.  The SIGTRAP handler diverts the firmware here, on a stack frame below the one
+// it interrupted; once the ISRs have run, INT3 returns control to the handler, which restores the
+// interrupted context.
+__asm__(".text\n"
+        ".globl sim_irq_dispatch_trampoline\n"
+        "sim_irq_dispatch_trampoline:\n"
+        "    call sim_irq_dispatch_from_trampoline\n"
+        "    int3\n"
+        ".globl sim_irq_dispatch_trampoline_end\n"
+        "sim_irq_dispatch_trampoline_end:\n");
+
+
+// sim_spin_check() - note a read of <addr>.  If the firmware is spinning, reading the same few
+// registers over and over, skip to the next event which could change what it reads.
+//
+static void sim_spin_check(const uint16_t addr)
+{
+    uint64_t next;
+    unsigned i;
+
+    for(i = 0; i < SIM_SPIN_ADDRS; ++i)
+        if(sim_spin.addr[i] == addr)
+            break;
+
+    if(i == SIM_SPIN_ADDRS)
+    {
+        sim_spin.addr[sim_spin.next] = addr;
+        sim_spin.next = (sim_spin.next + 1) % SIM_SPIN_ADDRS;
+        sim_spin.streak = 0;
+        return;
+    }
+
+    if(++sim_spin.streak < SIM_SPIN_READS)
+        return;
+
+    sim_spin.streak = 0;
+
+    next = sim_next_event();
+    if(sim_rtc_next_count() < next)
+        next = sim_rtc_next_count();
+    if(next == SIM_NEVER)
+        sim_fail("spinning on register 0x%04x, with nothing scheduled to change it", addr);
+
+    sim_advance_to(next);
+}
+
+
+// sim_segv() - SIGSEGV handler.  Faults within the register file are firmware accesses: the access
+// is counted and charged for, the register is brought up to date for a read, or its old value
+// recorded for a write, and the access is then allowed to complete, single-stepped, with the
+// register file unprotected.
+//
+static void sim_segv(int sig, siginfo_t *info, void *ctx)
+{
+    ucontext_t * const uc = ctx;
+    const uintptr_t addr = (uintptr_t) info->si_addr;
+    const SimDev_t *dev;
+
+    if((addr < HOST_IO_BASE) || (addr >= HOST_IO_BASE + HOST_IO_LEN))
+    {
+        signal(SIGSEGV, SIG_DFL);           // A genuine fault; let it happen again, fatally
+        return;
+    }
+
+    dev = sim_dev_at(addr - HOST_IO_BASE);
+    sim_trap.dev = dev;
+    sim_trap.addr = addr - HOST_IO_BASE;
+    sim_trap.width = sim_reg_width(sim_trap.addr);
+    sim_trap.write = !!(uc->uc_mcontext.gregs[REG_ERR] & SIM_PF_WRITE);
+    sim_trap.ccp = sim_ccp_armed;
+    sim_ccp_armed = 0;
+
+    if(sim_trap.write)
+        ++sim_st.block[dev->block].writes;
+    else
+        ++sim_st.block[dev->block].reads;
+    sim_st.block[dev->block].bytes += sim_trap.width;
+
+    sim_advance_to(sim_t + sim_cycles_ps(SIM_ACCESS_CYCLES, sim_cpu_freq()));
+
+    if(sim_trap.write)
+    {
+        sim_spin.streak = 0;
+        sim_trap.old = sim_io_get(sim_trap.addr, sim_trap.width);
+    }
+    else
+    {
+        sim_spin_check(sim_trap.addr);
+        if(dev->read)
+            dev->read(sim_trap.addr - dev->base);
+    }
+
+    mprotect((void *) HOST_IO_BASE, HOST_IO_LEN, PROT_READ | PROT_WRITE);
+    uc->uc_mcontext.gregs[REG_EFL] |= SIM_EFLAGS_TF;
+}
+
+
+// sim_trap_step() - SIGTRAP handler.  Follows the single-stepped completion of an access: the
+// register file is protected again, a write is applied to the peripheral model, and, if an
+// interrupt can now be taken, the firmware is diverted to the ISR trampoline.  Also handles the
+// trampoline's INT3, restoring the context interrupted.
+//
+static void sim_trap_step(int sig, siginfo_t *info, void *ctx)
+{
+    ucontext_t * const uc = ctx;
+    greg_t * const gregs = uc->uc_mcontext.gregs;
+
+    if(gregs[REG_RIP] == (greg_t) sim_irq_dispatch_trampoline_end)
+    {
+        memcpy(gregs, sim_irq_gregs, sizeof(sim_irq_gregs));
+        memcpy(uc->uc_mcontext.fpregs, &sim_irq_fpregs, sizeof(sim_irq_fpregs));
+        return;
+    }
+
+    gregs[REG_EFL] &= ~SIM_EFLAGS_TF;
+    mprotect((void *) HOST_IO_BASE, HOST_IO_LEN, PROT_NONE);
+
+    if(sim_trap.write && sim_trap.dev->write)
+        sim_trap.dev->write(sim_trap.addr - sim_trap.dev->base, sim_trap.old,
+                            sim_io_get(sim_trap.addr, sim_trap.width));
+
+    if(sim_irq_ready())
+    {
+        memcpy(sim_irq_gregs, gregs, sizeof(sim_irq_gregs));
+        memcpy(&sim_irq_fpregs, uc->uc_mcontext.fpregs, sizeof(sim_irq_fpregs));
+        gregs[REG_RSP] = (gregs[REG_RSP] - 128) & ~15;      // Skip the red zone; align
+        gregs[REG_RIP] = (greg_t) sim_irq_dispatch_trampoline;
+    }
+}
+
+
+// sim_wall_clock() - SIGALRM handler, called if a simulation takes too long in real time: usually
+// because the firmware is spinning on a RAM variable which only an ISR can change.
+//
+static void sim_wall_clock(int sig)
+{
+    sim_fail("no progress after %us of real time", SIM_WALL_CLOCK_S);
+}
+
+
+// sim_init() - initialise the simulator, bringing every register to its reset state, and erase
+// the EEPROM.  Must be called before the firmware runs.
+//
+void sim_init()
+{
+    struct sigaction sa;
+    unsigned i;
+
+    if(!sim_io)
+    {
+        const int fd = memfd_create("sim_io", 0);
+
+        if((fd < 0) || ftruncate(fd, HOST_IO_LEN) ||
+           (mmap((void *) HOST_IO_BASE, HOST_IO_LEN, PROT_NONE,
+                 MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0) != (void *) HOST_IO_BASE) ||
+           ((sim_io = mmap(NULL, HOST_IO_LEN, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0))
+                == MAP_FAILED))
+            sim_fail("cannot map the register file at 0x%08lx", HOST_IO_BASE);
+
+        close(fd);
+
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+        sa.sa_sigaction = sim_segv;
+        sigaction(SIGSEGV, &sa, NULL);
+        sa.sa_sigaction = sim_trap_step;
+        sigaction(SIGTRAP, &sa, NULL);
+        signal(SIGALRM, sim_wall_clock);
+    }
+
+    alarm(SIM_WALL_CLOCK_S);
+
+    memset(sim_io, 0, HOST_IO_LEN);
+    memset(&sim_st, 0, sizeof(sim_st));
+    memset(&sim_spin, 0, sizeof(sim_spin));
+    sim_st.adc_settle_min_ps = SIM_NEVER;
+    sim_t = 0;
+    sim_in_dispatch = 0;
+    sim_ccp_armed = 0;
+    sim_storm_count = 0;
+    sim_irq_hook = NULL;
+    memset(sim_timers, 0, sizeof(sim_timers));
+
+    for(i = 0; i < SIM_NUM_DEVS; ++i)
+        if(sim_devs[i]->reset)
+            sim_devs[i]->reset();
+
+    if(__start_host_eeprom)
+        memset(__start_host_eeprom, 0xff, __stop_host_eeprom - __start_host_eeprom);
+}
+
+
+// sim_now() - return the current simulated time, in ps.
+//
+uint64_t sim_now()
+{
+    return sim_t;
+}
+
+
+// sim_stats() - return the simulator's counters.
+//
+const SimStats_t *sim_stats()
+{
+    return &sim_st;
+}
+
+
+// sim_block_name() - return the name of register block <block>.
+//
+const char *sim_block_name(const SimBlock_t block)
+{
+    return (block < SimBlock_end) ? sim_block_names[block] : "?";
+}
+
+
+// sim_advance() - let <ps> of simulated time pass, outside the firmware, taking any interrupts
+// which become pending on the way.
+//
+void sim_advance(const uint64_t ps)
+{
+    const uint64_t end = sim_t + ps;
+    uint64_t next;
+
+    sim_irq_dispatch();
+    while((next = sim_next_event()) <= end)
+    {
+        sim_advance_to(next);
+        sim_irq_dispatch();
+    }
+
+    sim_advance_to(end);
+}
+
+
+// sim_set_irq_hook() - arrange for <hook> to be called on entry to each ISR.
+//
+void sim_set_irq_hook(const SimIrqHook_t hook)
+{
+    sim_irq_hook = hook;
+}
+
+
+// sim_at() - arrange for <fn> to be called at time <t>, or as soon as possible if <t> has passed.
+// Used by models of devices outside the uC, e.g. to delay a response.
+//
+void sim_at(const uint64_t t, const SimTimerFn_t fn)
+{
+    unsigned i;
+
+    for(i = 0; i < SIM_TIMERS; ++i)
+        if(!sim_timers[i].fn)
+        {
+            sim_timers[i].t = (t > sim_t) ? t : sim_t;
+            sim_timers[i].fn = fn;
+            return;
+        }
+
+    sim_fail("too many timers pending");
+}
+
+
+// sim_set_fuse_freqsel() - set the FREQSEL fuse, which selects a 16MHz or 20MHz OSC20M.
+//
+void sim_set_fuse_freqsel(const uint8_t freqsel)
+{
+    sim_clk_change(SIM_ADDR(FUSE_OSCCFG), SIM_REG(FUSE_OSCCFG),
+                   (SIM_REG(FUSE_OSCCFG) & ~FUSE_FREQSEL_gm) | freqsel);
+}
+
+
+// sim_run() - call <fn>, which will normally not return, until sim_stop() is called.
+//
+void sim_run(void (*fn)())
+{
+    if(!setjmp(sim_run_env))
+    {
+        sim_running = 1;
+        fn();
+    }
+
+    // sim_stop() may have been called from an ISR, or with the register file unprotected
+    sim_running = 0;
+    sim_in_dispatch = 0;
+    SIM_REG(CPUINT_STATUS) &= ~CPUINT_LVL0EX_bm;
+    mprotect((void *) HOST_IO_BASE, HOST_IO_LEN, PROT_NONE);
+}
+
+
+// sim_stop() - return from sim_run().  May be called from an IRQ hook, or any other code running
+// in the firmware's context (but not from a peripheral model's callbacks).
+//
+void sim_stop()
+{
+    if(!sim_running)
+        sim_fail("sim_stop() called outside sim_run()");
+
+    longjmp(sim_run_env, 1);
+}
+
+
+//
+// Functions called by the firmware through the stub headers
+//
+
+// host_set_i() - set (if <enable> is non-zero) or clear the I flag in SREG.  Any interrupt pending
+// is taken at the next register access, sleep or delay.
+//
+void host_set_i(const uint8_t enable)
+{
+    if(enable)
+        SIM_REG(CPU_SREG) |= CPU_I_bm;
+    else
+        SIM_REG(CPU_SREG) &= ~CPU_I_bm;
+}
+
+
+// host_sleep() - execute a SLEEP instruction: if sleep is enabled, advance time until an interrupt
+// is pending, and take it if interrupts are enabled.
+//
+void host_sleep()
+{
+    const uint8_t ctrla = SIM_REG(SLPCTRL_CTRLA);
+    const uint64_t start = sim_t;
+
+    if(!(ctrla & SLPCTRL_SEN_bm))
+        return;
+
+    ++sim_st.sleeps;
+    if(((ctrla & SLPCTRL_SMODE_gm) != SLPCTRL_SMODE_IDLE_gc) && sim_busy())
+        ++sim_st.sleep_busy;
+
+    while(!sim_irq_pending())
+    {
+        const uint64_t next = sim_next_event();
+
+        if(next == SIM_NEVER)
+            sim_fail("sleeping, with nothing scheduled to wake the core");
+
+        sim_advance_to(next);
+    }
+
+    sim_st.sleep_ps += sim_t - start;
+    sim_irq_dispatch();
+}
+
+
+// host_delay_cycles() - busy-wait for <cycles> cycles of the CPU clock.  Interrupts taken during
+// the wait lengthen it, as they would on the uC.
+//
+void host_delay_cycles(const uint32_t cycles)
+{
+    const uint64_t start = sim_t;
+    uint64_t end = sim_t + sim_cycles_ps(cycles, sim_cpu_freq()), next;
+
+    end += sim_irq_dispatch();
+    while((next = sim_next_event()) <= end)
+    {
+        sim_advance_to(next);
+        end += sim_irq_dispatch();
+    }
+
+    sim_advance_to(end);
+    sim_st.delay_ps += sim_t - start;
+}
+
+
+// sim_ee_check() - check that the <n> bytes at <addr> lie within the EEPROM.
+//
+static void sim_ee_check(const void *addr, const size_t n)
+{
+    if(((const uint8_t *) addr < __start_host_eeprom) ||
+       ((const uint8_t *) addr + n > __stop_host_eeprom))
+        sim_fail("EEPROM access outside EEMEM: %p+%zu", addr, n);
+}
+
+
+uint8_t eeprom_read_byte(const uint8_t *addr)
+{
+    sim_ee_check(addr, 1);
+    ++sim_st.ee_read_bytes;
+    return *addr;
+}
+
+
+uint16_t eeprom_read_word(const uint16_t *addr)
+{
+    sim_ee_check(addr, 2);
+    sim_st.ee_read_bytes += 2;
+    return *addr;
+}
+
+
+void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+    sim_ee_check(src, n);
+    sim_st.ee_read_bytes += n;
+    memcpy(dst, src, n);
+}
+
+
+void eeprom_update_block(const void *src, void *dst, size_t n)
+{
+    const uint8_t *s = src;
+    uint8_t *d = dst;
+
+    sim_ee_check(dst, n);
+    for(; n--; ++s, ++d)
+    {
+        ++sim_st.ee_read_bytes;
+        if(*d != *s)
+        {
+            *d = *s;
+            ++sim_st.ee_write_bytes;
+        }
+    }
+}
+
+
+void eeprom_update_byte(uint8_t *addr, uint8_t value)
+{
+    eeprom_update_block(&value, addr, 1);
+}
+
+
+void eeprom_update_word(uint16_t *addr, uint16_t value)
+{
+    eeprom_update_block(&value, addr, 2);
+}
+
+
+//
+// CPU, CLKCTRL, FUSE
+//
+
+static void sim_cpu_write(const uint16_t off, const uint16_t old, const uint16_t val)
+{
+    if((sim_dev_cpu.base + off == SIM_ADDR(CPU_CCP)) && (val == CCP_IOREG_gc))
+        sim_ccp_armed = 1;
+}
+
+
+// sim_clk_change() - write <val> to the clock-configuration register at <addr>, which currently
+// holds <old>.  The models are notified before the new value takes effect, so that they can
+// account for the time elapsed at the old frequency.
+//
+static void sim_clk_change(const uint16_t addr, const uint8_t old, const uint8_t val)
+{
+    unsigned i;
+
+    sim_io[addr] = old;
+
+    ++sim_st.clk_changes;
+    if(sim_busy())
+        ++sim_st.clk_change_busy;
+
+    for(i = 0; i < SIM_NUM_DEVS; ++i)
+        if(sim_devs[i]->clk_changing)
+            sim_devs[i]->clk_changing();
+
+    sim_io[addr] = val;
+}
+
+
+static void sim_clkctrl_reset()
+{
+    SIM_REG(CLKCTRL_MCLKCTRLB) = CLKCTRL_PDIV_6X_gc | CLKCTRL_PEN_bm;
+}
+
+
+// Writes to MCLKCTRLA, MCLKCTRLB and MCLKLOCK are ignored unless the CCP register was unlocked by
+// the previous access.
+static void sim_clkctrl_write(const uint16_t off, const uint16_t old, const uint16_t val)
+{
+    const uint16_t addr = sim_dev_clkctrl.base + off;
+
+    if(addr > SIM_ADDR(CLKCTRL_MCLKLOCK))
+        return;
+
+    if(!sim_trap.ccp)
+    {
+        ++sim_st.ccp_violations;
+        sim_io[addr] = old;
+    }
+    else if((val != old) && (addr != SIM_ADDR(CLKCTRL_MCLKLOCK)))
+    {
+        if(SIM_REG(CLKCTRL_MCLKLOCK) & 0x01)
+            sim_io[addr] = old;             // Locked
+        else
+            sim_clk_change(addr, old, val);
+    }
+}
+
+
+static void sim_fuse_reset()
+{
+    SIM_REG(FUSE_OSCCFG) = FREQSEL_16MHZ_gc;
+}
+
+
+static void sim_fuse_write(const uint16_t off, const uint16_t old, const uint16_t val)
+{
+    sim_io[sim_dev_fuse.base + off] = old;      // Fuses can't be written at run time
+}
+
+
+//
+// TCB0.  Only the counter is modelled: it counts up at the peripheral clock frequency (or half of
+// it), wrapping after reaching CCMP.  No interrupts or events are generated.
+//
+
+static uint32_t sim_tcb_freq()
+{
+    return sim_cpu_freq() /
+           (((SIM_REG(TCB0_CTRLA) & TCB_CLKSEL_gm) == TCB_CLKSEL_CLKDIV2_gc) ? 2 : 1);
+}
+
+
+// sim_tcb_count() - return the current value of TCB0_CNT.
+//
+static uint16_t sim_tcb_count()
+{
+    const uint32_t top = SIM_REG(TCB0_CCMP) + 1UL;
+
+    if(!(SIM_REG(TCB0_CTRLA) & TCB_ENABLE_bm))
+        return sim_tcb_cnt0;
+
+    return (sim_tcb_cnt0 + (uint64_t) ((unsigned __int128) (sim_t - sim_tcb_t0) * sim_tcb_freq()
+                                       / SIM_PS_PER_S)) % top;
+}
+
+
+// sim_tcb_rebase() - record the current count, so that later counts can be derived from it.
+//
+static void sim_tcb_rebase()
+{
+    sim_tcb_cnt0 = sim_tcb_count();
+    sim_tcb_t0 = sim_t;
+}
+
+
+static void sim_tcb_reset()
+{
+    SIM_REG(TCB0_CCMP) = 0;
+    sim_tcb_cnt0 = 0;
+    sim_tcb_t0 = 0;
+}
+
+
+static void sim_tcb_read(const uint16_t off)
+{
+    if(sim_dev_tcb.base + off == SIM_ADDR(TCB0_CNT))
+        SIM_REG(TCB0_CNT) = sim_tcb_count();
+}
+
+
+static void sim_tcb_write(const uint16_t off, const uint16_t old, const uint16_t val)
+{
+    const uint16_t addr = sim_dev_tcb.base + off;
+
+    if(addr == SIM_ADDR(TCB0_CNT))
+    {
+        sim_tcb_cnt0 = val;
+        sim_tcb_t0 = sim_t;
+    }
+    else if(addr == SIM_ADDR(TCB0_CTRLA))
+    {
+        const uint8_t now = SIM_REG(TCB0_CTRLA);
+
+        SIM_REG(TCB0_CTRLA) = old;
+        sim_tcb_rebase();
+        SIM_REG(TCB0_CTRLA) = now;
+    }
+    else if(addr == SIM_ADDR(TCB0_INTFLAGS))
+        SIM_REG(TCB0_INTFLAGS) = old & ~val;
+}
+
+
+//
+// Timers set by sim_at()
+//
+
+static uint64_t sim_timer_next()
+{
+    uint64_t next = SIM_NEVER;
+    unsigned i;
+
+    for(i = 0; i < SIM_TIMERS; ++i)
+        if(sim_timers[i].fn && (sim_timers[i].t < next))
+            next = sim_timers[i].t;
+
+    return next;
+}
+
+
+// sim_timer_tick() - call the function of each timer which has expired.  Each entry is freed
+// before its function is called, which may therefore set a timer of its own.
+//
+static void sim_timer_tick()
+{
+    unsigned i;
+
+    for(i = 0; i < SIM_TIMERS; ++i)
+        if(sim_timers[i].fn && (sim_timers[i].t <= sim_t))
+        {
+            const SimTimerFn_t fn = sim_timers[i].fn;
+
+            sim_timers[i].fn = NULL;
+            fn();
+        }
+}
+
+
+// Register blocks which are plain memory, or nearly so
+static const SimDev_t sim_dev_cpu = {
+    .block = SimBlockCPU, .base = 0x30, .len = 0x10, .write = sim_cpu_write
+};
+
+static const SimDev_t sim_dev_other = {
+    .block = SimBlockOther, .base = 0x40, .len = 0x10           // RSTCTRL
+};
+
+static const SimDev_t sim_dev_slpctrl = {
+    .block = SimBlockSLPCTRL, .base = 0x50, .len = 0x10
+};
+
+static const SimDev_t sim_dev_clkctrl = {
+    .block = SimBlockCLKCTRL, .base = 0x60, .len = 0x20, .reset = sim_clkctrl_reset,
+    .write = sim_clkctrl_write
+};
+
+static const SimDev_t sim_dev_vref = {
+    .block = SimBlockVREF, .base = 0xa0, .len = 0x10
+};
+
+static const SimDev_t sim_dev_cpuint = {
+    .block = SimBlockCPUINT, .base = 0x110, .len = 0x10
+};
+
+static const SimDev_t sim_dev_evsys = {
+    .block = SimBlockEVSYS, .base = 0x180, .len = 0x40
+};
+
+static const SimDev_t sim_dev_portmux = {
+    .block = SimBlockPORTMUX, .base = 0x200, .len = 0x10
+};
+
+static const SimDev_t sim_dev_tcb = {
+    .block = SimBlockTCB, .base = 0xa40, .len = 0x10, .reset = sim_tcb_reset,
+    .read = sim_tcb_read, .write = sim_tcb_write, .clk_changing = sim_tcb_rebase
+};
+
+static const SimDev_t sim_dev_fuse = {
+    .block = SimBlockFUSE, .base = 0x1280, .len = 0x20, .reset = sim_fuse_reset,
+    .write = sim_fuse_write
+};
+
+static const SimDev_t sim_dev_timer = {
+    .block = SimBlockOther, .next = sim_timer_next, .tick = sim_timer_tick
+};
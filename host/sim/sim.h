@@ -0,0 +1,178 @@
+#ifndef HOST_SIM_SIM_H_INC
+#define HOST_SIM_SIM_H_INC
+/*
+    sim.h - declarations relating to the host simulator of the ATtiny816, against which the
+    firmware's hardware-dependent modules are built and checked.
+
+    The register file declared by stub/avr/io.h occupies a block of host memory which is kept
+    inaccessible.  Each access made by the firmware therefore faults; the simulator counts the
+    access, brings the peripheral models up to date, applies the register's hardware semantics
+    (e.g. write-one-to-clear flags, strobe registers, read-to-clear data registers), lets the
+    access complete, and then takes any interrupt which has become pending, by diverting the
+    firmware to the vector's ISR.  Simulated time advances by a fixed cost per access, during
+    delays, and while the core sleeps, when it skips directly to the next model event.
+
+    Peripheral models (PORT, RTC, ADC, SPI, USART, TWI) are driven from test scripts through the
+    functions declared here; see also xbeepeer.h, which models an XBee module on the SPI bus.
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include <avr/io.h>
+#include <stdint.h>
+
+
+#define SIM_PS_PER_S            (1000000000000ULL)
+#define SIM_US(us)              ((uint64_t) (us) * 1000000ULL)     // Microseconds, in ps
+#define SIM_MS(ms)              ((uint64_t) (ms) * 1000000000ULL)  // Milliseconds, in ps
+
+#define SIM_ACCESS_CYCLES       (3)     // CPU cycles charged for each register access
+#define SIM_ISR_CYCLES          (20)    // CPU cycles charged for interrupt entry and exit
+#define SIM_VECTORS             (_VECTORS_SIZE_COUNT)
+
+#define SIM_PIN_Z               (-1)    // Level of an undriven pin; see sim_pin_drive()
+
+
+// SimBlock_t - enumeration of the register blocks whose accesses are counted separately.
+//
+typedef enum SimBlock
+{
+    SimBlockVPORT,
+    SimBlockCPU,
+    SimBlockSLPCTRL,
+    SimBlockCLKCTRL,
+    SimBlockVREF,
+    SimBlockCPUINT,
+    SimBlockRTC,
+    SimBlockEVSYS,
+    SimBlockPORTMUX,
+    SimBlockPORT,
+    SimBlockADC,
+    SimBlockUSART,
+    SimBlockTWI,
+    SimBlockSPI,
+    SimBlockTCB,
+    SimBlockFUSE,
+    SimBlockOther,
+    SimBlock_end                        // Placeholder value
+} SimBlock_t;
+
+
+// SimAccessStats_t - counts of the register accesses made to one block.
+//
+typedef struct SimAccessStats
+{
+    uint32_t    reads;                  // Read accesses
+    uint32_t    writes;                 // Write accesses
+    uint32_t    bytes;                  // Bytes moved by those accesses (16-bit registers move 2)
+} SimAccessStats_t;
+
+
+// SimStats_t - counters maintained by the simulator.  They are never reset; callers take the
+// difference between two snapshots.
+//
+typedef struct SimStats
+{
+    SimAccessStats_t block[SimBlock_end];   // Register accesses, by block
+    uint32_t    irqs;                   // Interrupts taken
+    uint32_t    vector_irqs[SIM_VECTORS];   // Interrupts taken, by vector
+    uint32_t    sleeps;                 // Calls to sleep_cpu() with sleep enabled
+    uint32_t    sleep_busy;             // ... in a mode which stops a peripheral in use
+    uint64_t    sleep_ps;               // Time spent asleep
+    uint64_t    delay_ps;               // Time spent in _delay_*() calls
+    uint32_t    spi_bytes;              // Bytes exchanged by the SPI master
+    uint32_t    spi_bytes_unselected;   // ... of which were clocked with the peer deselected
+    uint32_t    adc_conversions;        // Conversions (not results: an accumulated result counts
+                                        // each conversion)
+    uint32_t    adc_ungated;            // Conversions of a gated input whose gate was off
+    uint64_t    adc_settle_min_ps;      // Least time from gate-on to a gated conversion
+    uint32_t    adc_clk_max;            // Highest ADC clock frequency used, in Hz
+    uint32_t    usart_tx_bytes;         // Bytes transmitted by USART0
+    uint32_t    twi_bytes;              // Bytes (including addresses) moved on the TWI bus
+    uint32_t    twi_scl_max;            // Highest TWI SCL frequency used, in Hz
+    uint32_t    ee_read_bytes;          // EEPROM bytes read
+    uint32_t    ee_write_bytes;         // EEPROM bytes written (i.e. changed)
+    uint32_t    ccp_violations;         // Writes to protected registers without a CCP unlock
+    uint32_t    clk_changes;            // Changes of CPU/peripheral clock frequency
+    uint32_t    clk_change_busy;        // ... made while a peripheral was mid-operation
+} SimStats_t;
+
+
+// SimWaveType_t - enumeration of the waveforms which may be applied to an analogue input.
+//
+typedef enum SimWaveType
+{
+    SimWaveConst,                       // <level>
+    SimWaveRamp,                        // <level> + <amplitude> * (t mod <period>) / <period>
+    SimWaveSine,                        // <level> + <amplitude> * sin(2 * pi * t / <period>)
+    SimWaveNoise,                       // <level> + uniform noise in [-<amplitude>, <amplitude>]
+    SimWaveTable                        // <table>[(t / <period>) mod <table_len>]
+} SimWaveType_t;
+
+
+// SimWave_t - an analogue waveform, in mV.  Times are in ps.
+//
+typedef struct SimWave
+{
+    SimWaveType_t   type;
+    double          level;
+    double          amplitude;
+    uint64_t        period;
+    const double *  table;
+    unsigned        table_len;
+    uint8_t         gated;              // Non-zero if the source is powered by the gate pin
+} SimWave_t;
+
+
+// SimTWIDevice_t - a TWI slave holding a bank of 8-bit registers.  The first byte written after
+// the address selects the register; further bytes written or read access successive registers.
+//
+typedef struct SimTWIDevice
+{
+    uint8_t     addr;                   // 7-bit device address
+    uint8_t     regs[256];
+    uint8_t     reg_ptr;
+} SimTWIDevice_t;
+
+typedef void (*SimPinWatch_t)(const uint8_t level);
+typedef uint8_t (*SimSPIPeer_t)(const uint8_t mosi);
+typedef void (*SimIrqHook_t)(const uint8_t vector);
+typedef void (*SimTimerFn_t)();
+
+
+// Core
+void sim_init();
+uint64_t sim_now();
+uint32_t sim_cpu_freq();
+const SimStats_t *sim_stats();
+const char *sim_block_name(const SimBlock_t block);
+void sim_advance(const uint64_t ps);
+void sim_set_irq_hook(const SimIrqHook_t hook);
+void sim_at(const uint64_t t, const SimTimerFn_t fn);
+void sim_set_fuse_freqsel(const uint8_t freqsel);
+void sim_run(void (*fn)());
+void sim_stop();
+void sim_fail(const char *fmt, ...) __attribute__((noreturn, format(printf, 1, 2)));
+
+// PORT
+void sim_pin_drive(const uint8_t port, const uint8_t pin, const int8_t level);
+void sim_pin_pull(const uint8_t port, const uint8_t pin, const int8_t level);
+uint8_t sim_pin_level(const uint8_t port, const uint8_t pin);
+void sim_pin_watch(const uint8_t port, const uint8_t pin, const SimPinWatch_t fn);
+
+// ADC
+void sim_adc_set_wave(const uint8_t channel, const SimWave_t * const wave);
+void sim_adc_set_gate(const uint8_t port, const uint8_t pin);
+void sim_adc_set_vdd(const uint16_t mv);
+
+// SPI
+void sim_spi_set_peer(const SimSPIPeer_t peer);
+
+// USART
+const uint8_t *sim_usart_tx_data(unsigned * const len);
+void sim_usart_rx_inject(const uint8_t data);
+
+// TWI
+void sim_twi_add_device(SimTWIDevice_t * const dev);
+
+#endif
@@ -0,0 +1,302 @@
+/*
+    simadc.c - host simulator model of the ATtiny816's ADC, and of the analogue signals at its
+    inputs.
+
+    The signal at each input is described by a SimWave_t (see sim.h), in millivolts.  A waveform
+    may be "gated": i.e. produced by a sensor powered through the gate pin (see sim_adc_set_gate()),
+    which is active low.  A gated input reads 0mV while the gate is off.
+
+    Each conversion lasts (13 + SAMPLEN + SAMPDLY) ADC clock cycles; the first conversion after the
+    ADC is enabled is preceded by the initialisation delay selected by INITDLY.  The input is
+    sampled at the start of each conversion.  Window comparison is not modelled.
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "simdev.h"
+#include <math.h>
+#include <string.h>
+
+
+#define SIM_ADC_CHANNELS        (12)
+#define SIM_ADC_CONV_CYCLES     (13)        // ADC clock cycles per conversion, excluding SAMPLEN
+#define SIM_ADC_VDD_DEFAULT     (3300)      // Default supply voltage, in mV
+
+static struct
+{
+    SimWave_t   wave[SIM_ADC_CHANNELS];     // Signal at each input
+    uint8_t     wave_set[SIM_ADC_CHANNELS]; // Non-zero if <wave[]> has been set for the input
+    uint32_t    noise[SIM_ADC_CHANNELS];    // Noise generator state, by input
+    uint16_t    vdd_mv;                     // Supply voltage
+
+    uint8_t     gate_set;                   // Non-zero if a gate pin has been set
+    uint8_t     gate_on;                    // Non-zero while the gate is on
+    uint64_t    gate_on_t;                  // Time at which the gate was last switched on
+
+    uint8_t     busy;                       // Non-zero while a conversion is in progress
+    uint8_t     initdly;                    // Non-zero if the next conversion needs an init delay
+    uint64_t    start_t;                    // Start time of the conversion in progress
+    uint64_t    end_t;                      // End time of the conversion in progress
+    uint64_t    conv_ps;                    // Duration of each conversion accumulated
+} sim_adc;
+
+
+// sim_adc_wave_mv() - return the voltage, in mV, of waveform <w> at time <t>.  <noise> points to
+// the input's noise generator state.
+//
+static double sim_adc_wave_mv(const SimWave_t * const w, const uint64_t t, uint32_t * const noise)
+{
+    const uint64_t period = w->period ? w->period : 1;
+
+    switch(w->type)
+    {
+        case SimWaveConst:
+            return w->level;
+
+        case SimWaveRamp:
+            return w->level + w->amplitude * (double) (t % period) / period;
+
+        case SimWaveSine:
+            return w->level + w->amplitude * sin(2 * M_PI * (double) (t % period) / period);
+
+        case SimWaveNoise:
+            *noise = *noise * 1103515245UL + 12345;
+            return w->level + w->amplitude * (((*noise >> 8) & 0xffff) / 32767.5 - 1);
+
+        case SimWaveTable:
+            if(!w->table || !w->table_len)
+                sim_fail("ADC waveform table is empty");
+            return w->table[(t / period) % w->table_len];
+    }
+
+    return 0;
+}
+
+
+// sim_adc_ref_mv() - return the ADC reference voltage, in mV.
+//
+static uint16_t sim_adc_ref_mv()
+{
+    static const uint16_t intref[8] = {550, 1100, 2500, 4300, 1500, 0, 0, 0};
+    uint16_t mv;
+
+    if((SIM_REG(ADC0_CTRLC) & ADC_REFSEL_gm) == ADC_REFSEL_VDDREF_gc)
+        return sim_adc.vdd_mv;
+
+    mv = intref[(SIM_REG(VREF_CTRLA) & VREF_ADC0REFSEL_gm) >> VREF_ADC0REFSEL_gp];
+    if(!mv)
+        sim_fail("reserved ADC0REFSEL value in VREF_CTRLA (0x%02x)", SIM_REG(VREF_CTRLA));
+
+    return mv;
+}
+
+
+// sim_adc_sample() - return the 10-bit result of a conversion, sampled at time <t>, of the input
+// selected by MUXPOS.
+//
+static uint16_t sim_adc_sample(const uint64_t t)
+{
+    const uint8_t ch = SIM_REG(ADC0_MUXPOS) & ADC_MUXPOS_gm;
+    double mv, code;
+
+    if(ch == ADC_MUXPOS_GND_gc)
+        return 0;
+    if((ch >= SIM_ADC_CHANNELS) || !sim_adc.wave_set[ch])
+        sim_fail("conversion of ADC input %u, which has no waveform", ch);
+
+    mv = sim_adc_wave_mv(sim_adc.wave + ch, t, sim_adc.noise + ch);
+
+    if(sim_adc.wave[ch].gated)
+    {
+        if(!sim_adc.gate_set)
+            sim_fail("ADC input %u is gated, but no gate pin has been set", ch);
+
+        if(!sim_adc.gate_on)
+        {
+            ++sim_st.adc_ungated;
+            mv = 0;
+        }
+        else if(t - sim_adc.gate_on_t < sim_st.adc_settle_min_ps)
+            sim_st.adc_settle_min_ps = t - sim_adc.gate_on_t;
+    }
+
+    code = round(mv * 1024 / sim_adc_ref_mv());
+    return (code < 0) ? 0 : (code > 1023) ? 1023 : code;
+}
+
+
+// sim_adc_start() - start a conversion, accumulating the number of samples selected by SAMPNUM.
+//
+static void sim_adc_start()
+{
+    static const uint16_t initdly[8] = {0, 16, 32, 64, 128, 256, 256, 256};
+    const uint32_t adc_clk = sim_cpu_freq() / (2UL << (SIM_REG(ADC0_CTRLC) & ADC_PRESC_gm));
+    const uint32_t cycles = SIM_ADC_CONV_CYCLES + (SIM_REG(ADC0_SAMPCTRL) & ADC_SAMPLEN_gm) +
+                            (SIM_REG(ADC0_CTRLD) & ADC_SAMPDLY_gm);
+    const uint8_t samples = 1 << (SIM_REG(ADC0_CTRLB) & ADC_SAMPNUM_gm);
+
+    if(adc_clk > sim_st.adc_clk_max)
+        sim_st.adc_clk_max = adc_clk;
+
+    sim_adc.start_t = sim_t;
+    if(sim_adc.initdly)
+    {
+        sim_adc.start_t += sim_cycles_ps(initdly[(SIM_REG(ADC0_CTRLD) & ADC_INITDLY_gm) >>
+                                                 ADC_INITDLY_gp], adc_clk);
+        sim_adc.initdly = 0;
+    }
+
+    sim_adc.conv_ps = sim_cycles_ps(cycles, adc_clk);
+    sim_adc.end_t = sim_adc.start_t + samples * sim_adc.conv_ps;
+    sim_adc.busy = 1;
+    SIM_REG(ADC0_COMMAND) = ADC_STCONV_bm;
+}
+
+
+// sim_adc_event() - handle an event at the ADC's event input.
+//
+void sim_adc_event()
+{
+    if((SIM_REG(ADC0_CTRLA) & ADC_ENABLE_bm) && (SIM_REG(ADC0_EVCTRL) & ADC_STARTEI_bm) &&
+       !sim_adc.busy)
+        sim_adc_start();
+}
+
+
+static uint64_t sim_adc_next()
+{
+    return sim_adc.busy ? sim_adc.end_t : SIM_NEVER;
+}
+
+
+// sim_adc_tick() - complete the conversion in progress.
+//
+static void sim_adc_tick()
+{
+    const uint8_t samples = 1 << (SIM_REG(ADC0_CTRLB) & ADC_SAMPNUM_gm);
+    uint16_t res = 0;
+    uint8_t i;
+
+    for(i = 0; i < samples; ++i)
+    {
+        const uint16_t code = sim_adc_sample(sim_adc.start_t + i * sim_adc.conv_ps);
+        res += (SIM_REG(ADC0_CTRLA) & ADC_RESSEL_bm) ? (code >> 2) : code;
+    }
+
+    sim_st.adc_conversions += samples;
+    SIM_REG(ADC0_RES) = res;
+    SIM_REG(ADC0_INTFLAGS) |= ADC_RESRDY_bm;
+    SIM_REG(ADC0_COMMAND) = 0;
+    sim_adc.busy = 0;
+
+    if(SIM_REG(ADC0_CTRLA) & ADC_FREERUN_bm)
+        sim_adc_start();
+}
+
+
+static void sim_adc_reset()
+{
+    uint8_t ch;
+
+    memset(&sim_adc, 0, sizeof(sim_adc));
+    sim_adc.vdd_mv = SIM_ADC_VDD_DEFAULT;
+    for(ch = 0; ch < SIM_ADC_CHANNELS; ++ch)
+        sim_adc.noise[ch] = 1 + ch;         // Each input has its own, repeatable, noise
+}
+
+
+// Reading RES clears RESRDY
+static void sim_adc_read(const uint16_t off)
+{
+    if(sim_dev_adc.base + off == SIM_ADDR(ADC0_RES))
+        SIM_REG(ADC0_INTFLAGS) &= ~ADC_RESRDY_bm;
+}
+
+
+static void sim_adc_write(const uint16_t off, const uint16_t old, const uint16_t val)
+{
+    const uint16_t addr = sim_dev_adc.base + off;
+
+    if(addr == SIM_ADDR(ADC0_CTRLA))
+    {
+        if((val & ADC_ENABLE_bm) && !(old & ADC_ENABLE_bm))
+            sim_adc.initdly = 1;
+        else if(!(val & ADC_ENABLE_bm))
+        {
+            sim_adc.busy = 0;               // Any conversion in progress is abandoned
+            SIM_REG(ADC0_COMMAND) = 0;
+        }
+    }
+    else if(addr == SIM_ADDR(ADC0_COMMAND))
+    {
+        SIM_REG(ADC0_COMMAND) = sim_adc.busy ? ADC_STCONV_bm : 0;
+        if((val & ADC_STCONV_bm) && !sim_adc.busy && (SIM_REG(ADC0_CTRLA) & ADC_ENABLE_bm))
+            sim_adc_start();
+    }
+    else if(addr == SIM_ADDR(ADC0_INTFLAGS))
+        SIM_REG(ADC0_INTFLAGS) = old & ~val;
+    else if(addr == SIM_ADDR(ADC0_RES))
+        SIM_REG(ADC0_RES) = old;            // Read-only
+}
+
+
+static uint32_t sim_adc_irq()
+{
+    return (SIM_REG(ADC0_INTFLAGS) & SIM_REG(ADC0_INTCTRL) & (ADC_RESRDY_bm | ADC_WCMP_bm))
+                ? SIM_VECTOR_BIT(17) : 0;
+}
+
+
+static uint8_t sim_adc_busy()
+{
+    return sim_adc.busy;
+}
+
+
+const SimDev_t sim_dev_adc = {
+    .block = SimBlockADC, .base = 0x600, .len = 0x20, .reset = sim_adc_reset,
+    .read = sim_adc_read, .write = sim_adc_write, .irq = sim_adc_irq, .busy = sim_adc_busy,
+    .next = sim_adc_next, .tick = sim_adc_tick
+};
+
+
+// sim_adc_gate_changed() - pin watch function for the gate pin.
+//
+static void sim_adc_gate_changed(const uint8_t level)
+{
+    sim_adc.gate_on = !level;
+    if(!level)
+        sim_adc.gate_on_t = sim_t;
+}
+
+
+// sim_adc_set_wave() - set the signal at ADC input <channel> to the waveform <wave>.
+//
+void sim_adc_set_wave(const uint8_t channel, const SimWave_t * const wave)
+{
+    if(channel >= SIM_ADC_CHANNELS)
+        sim_fail("no such ADC input: %u", channel);
+
+    sim_adc.wave[channel] = *wave;
+    sim_adc.wave_set[channel] = 1;
+}
+
+
+// sim_adc_set_gate() - set the pin which powers the sources of gated waveforms.  The gate is on
+// while the pin is low.
+//
+void sim_adc_set_gate(const uint8_t port, const uint8_t pin)
+{
+    sim_adc.gate_set = 1;
+    sim_adc.gate_on = !sim_pin_level(port, pin);
+    sim_adc.gate_on_t = sim_t;
+    sim_pin_watch(port, pin, sim_adc_gate_changed);
+}
+
+
+// sim_adc_set_vdd() - set the supply voltage, which is the ADC reference when VDDREF is selected.
+//
+void sim_adc_set_vdd(const uint16_t mv)
+{
+    sim_adc.vdd_mv = mv;
+}
@@ -0,0 +1,61 @@
+#ifndef HOST_SIM_SIMDEV_H_INC
+#define HOST_SIM_SIMDEV_H_INC
+/*
+    simdev.h - declarations shared by the simulator core (sim.c) and its peripheral models.  Not
+    for use by tests, which should use sim.h.
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "sim.h"
+#include <avr/io.h>
+#include <stdint.h>
+
+
+#define SIM_NEVER               (UINT64_MAX)    // Event time meaning "no event scheduled"
+
+// SIM_ADDR() - macro giving the offset of register <reg> within the simulated data space
+#define SIM_ADDR(reg)           ((uint16_t) _SFR_IO_ADDR(reg))
+
+// SIM_REG() - macro giving an lvalue which accesses the simulator's (untrapped) view of register
+// <reg>.  Models use this in place of the register itself, whose accesses would trap.
+#define SIM_REG(reg)            (*(__typeof__(&(reg))) (sim_io + SIM_ADDR(reg)))
+
+// SIM_VECTOR_BIT() - macro giving the bit representing interrupt vector <vect> in a vector mask
+#define SIM_VECTOR_BIT(vect)    (1UL << (vect))
+
+
+// SimDev_t - a register block, and the peripheral model behind it.  Any function pointer may be
+// NULL.  Offsets are relative to <base>.
+//
+typedef struct SimDev
+{
+    SimBlock_t  block;                      // Block to which accesses are attributed
+    uint16_t    base;                       // Address of the first register in the block
+    uint16_t    len;                        // Extent of the block, in bytes
+    void        (*reset)();                 // Restore the reset state
+    void        (*read)(const uint16_t off);    // Bring the register at <off> up to date
+    void        (*write)(const uint16_t off, const uint16_t old, const uint16_t val);
+                                            // Apply the write of <val> over <old> at <off>
+    uint32_t    (*irq)();                   // Return the mask of vectors requesting service
+    uint8_t     (*busy)();                  // Return non-zero if the peripheral is mid-operation
+    uint64_t    (*next)();                  // Return the time of the next event, or SIM_NEVER
+    void        (*tick)();                  // Process the events due at the current time
+    void        (*clk_changing)();          // The peripheral clock frequency is about to change
+} SimDev_t;
+
+
+extern uint8_t *sim_io;                     // Untrapped view of the simulated data space
+extern uint64_t sim_t;                      // Current time, in ps
+extern SimStats_t sim_st;                   // Counters
+
+// Register blocks, defined by the model files
+extern const SimDev_t sim_dev_vport, sim_dev_port, sim_dev_rtc, sim_dev_adc, sim_dev_spi,
+                      sim_dev_usart, sim_dev_twi;
+
+uint64_t sim_cycles_ps(const uint64_t cycles, const uint32_t freq);
+uint64_t sim_rtc_next_count();
+void sim_adc_event();
+void sim_port_update(const uint8_t port);
+
+#endif
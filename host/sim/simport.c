@@ -0,0 +1,334 @@
+/*
+    simport.c - host simulator model of the ATtiny816's I/O ports (PORTx and VPORTx), and of the
+    circuits attached to their pins.
+
+    Each pin's level is that driven by the port, if the pin is an output; otherwise that driven
+    by an external device (see sim_pin_drive()), or failing that the level set by the pin's pull-up
+    resistor or an external pull resistor (see sim_pin_pull()).  An undriven, unpulled pin reads 0.
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "simdev.h"
+#include <string.h>
+
+
+#define SIM_PORTS               (3)
+#define SIM_PORT_PINS           (8)
+#define SIM_PORT_WATCHES        (4)     // Max number of watch functions per pin
+
+// Offsets of the registers within each PORTx block
+#define SIM_PORT_DIR            (0x00)
+#define SIM_PORT_DIRSET         (0x01)
+#define SIM_PORT_DIRCLR         (0x02)
+#define SIM_PORT_DIRTGL         (0x03)
+#define SIM_PORT_OUT            (0x04)
+#define SIM_PORT_OUTSET         (0x05)
+#define SIM_PORT_OUTCLR         (0x06)
+#define SIM_PORT_OUTTGL         (0x07)
+#define SIM_PORT_IN             (0x08)
+#define SIM_PORT_INTFLAGS       (0x09)
+#define SIM_PORT_PIN0CTRL       (0x10)
+#define SIM_PORT_STRIDE         (0x20)
+
+// Offsets of the registers within each VPORTx block
+#define SIM_VPORT_DIR           (0x00)
+#define SIM_VPORT_OUT           (0x01)
+#define SIM_VPORT_IN            (0x02)
+#define SIM_VPORT_INTFLAGS      (0x03)
+#define SIM_VPORT_STRIDE        (0x04)
+
+// SIM_PORT_REG() - macro giving the untrapped view of the register at offset <off> in PORTx <port>
+#define SIM_PORT_REG(port, off) \
+    (sim_io[SIM_ADDR(PORTA_DIR) + ((port) * SIM_PORT_STRIDE) + (off)])
+
+// SIM_VPORT_REG() - macro giving the untrapped view of the register at offset <off> in VPORTx
+// <port>
+#define SIM_VPORT_REG(port, off) \
+    (sim_io[SIM_ADDR(VPORTA_DIR) + ((port) * SIM_VPORT_STRIDE) + (off)])
+
+static int8_t sim_port_drive[SIM_PORTS][SIM_PORT_PINS];     // External drivers; SIM_PIN_Z if none
+static int8_t sim_port_pull[SIM_PORTS][SIM_PORT_PINS];      // External pulls; SIM_PIN_Z if none
+static uint8_t sim_port_level[SIM_PORTS];                   // Last pin levels
+static uint8_t sim_port_sense[SIM_PORTS];                   // Last inputs to the sense logic
+static SimPinWatch_t sim_port_watch[SIM_PORTS][SIM_PORT_PINS][SIM_PORT_WATCHES];
+
+
+// sim_port_check() - fail unless <port> and <pin> identify a pin.
+//
+static void sim_port_check(const uint8_t port, const uint8_t pin)
+{
+    if((port >= SIM_PORTS) || (pin >= SIM_PORT_PINS))
+        sim_fail("no such pin: port %u, pin %u", port, pin);
+}
+
+
+// sim_port_pin_level() - return the level of pin <pin> in port <port>.
+//
+static uint8_t sim_port_pin_level(const uint8_t port, const uint8_t pin)
+{
+    const uint8_t bit = 1 << pin, ctrl = SIM_PORT_REG(port, SIM_PORT_PIN0CTRL + pin);
+
+    if(SIM_PORT_REG(port, SIM_PORT_DIR) & bit)
+        return !(SIM_PORT_REG(port, SIM_PORT_OUT) & bit) != !(ctrl & PORT_INVEN_bm);
+
+    if(sim_port_drive[port][pin] != SIM_PIN_Z)
+        return sim_port_drive[port][pin];
+
+    if(ctrl & PORT_PULLUPEN_bm)
+        return 1;
+
+    return (sim_port_pull[port][pin] == SIM_PIN_Z) ? 0 : sim_port_pull[port][pin];
+}
+
+
+// sim_port_update() - recalculate the levels of the pins of port <port>, following a change to its
+// registers or to the circuits attached to it.  Sets interrupt flags according to each pin's
+// input/sense configuration, brings the IN, strobe and VPORT registers up to date, and calls the
+// watch functions of the pins whose levels have changed.
+//
+void sim_port_update(const uint8_t port)
+{
+    uint8_t level = 0, sense = 0, in = 0, flags = SIM_PORT_REG(port, SIM_PORT_INTFLAGS), changed,
+            pin;
+
+    for(pin = 0; pin < SIM_PORT_PINS; ++pin)
+    {
+        const uint8_t bit = 1 << pin, ctrl = SIM_PORT_REG(port, SIM_PORT_PIN0CTRL + pin),
+                      l = sim_port_pin_level(port, pin), s = !l != !(ctrl & PORT_INVEN_bm);
+
+        if(l)
+            level |= bit;
+        if(s)
+            sense |= bit;
+
+        switch(ctrl & PORT_ISC_gm)
+        {
+            case PORT_ISC_BOTHEDGES_gc:
+                if((sim_port_sense[port] ^ sense) & bit)
+                    flags |= bit;
+                break;
+
+            case PORT_ISC_RISING_gc:
+                if(s && !(sim_port_sense[port] & bit))
+                    flags |= bit;
+                break;
+
+            case PORT_ISC_FALLING_gc:
+                if(!s && (sim_port_sense[port] & bit))
+                    flags |= bit;
+                break;
+
+            case PORT_ISC_LEVEL_gc:
+                if(!s)
+                    flags |= bit;
+                break;
+
+            default:
+                break;
+        }
+
+        if((ctrl & PORT_ISC_gm) != PORT_ISC_INPUT_DISABLE_gc)
+            in |= sense & bit;
+    }
+
+    changed = level ^ sim_port_level[port];
+    sim_port_level[port] = level;
+    sim_port_sense[port] = sense;
+
+    SIM_PORT_REG(port, SIM_PORT_IN) = in;
+    SIM_PORT_REG(port, SIM_PORT_INTFLAGS) = flags;
+    SIM_PORT_REG(port, SIM_PORT_DIRSET) = SIM_PORT_REG(port, SIM_PORT_DIRCLR) =
+        SIM_PORT_REG(port, SIM_PORT_DIRTGL) = SIM_PORT_REG(port, SIM_PORT_DIR);
+    SIM_PORT_REG(port, SIM_PORT_OUTSET) = SIM_PORT_REG(port, SIM_PORT_OUTCLR) =
+        SIM_PORT_REG(port, SIM_PORT_OUTTGL) = SIM_PORT_REG(port, SIM_PORT_OUT);
+
+    SIM_VPORT_REG(port, SIM_VPORT_DIR) = SIM_PORT_REG(port, SIM_PORT_DIR);
+    SIM_VPORT_REG(port, SIM_VPORT_OUT) = SIM_PORT_REG(port, SIM_PORT_OUT);
+    SIM_VPORT_REG(port, SIM_VPORT_IN) = in;
+    SIM_VPORT_REG(port, SIM_VPORT_INTFLAGS) = flags;
+
+    // The levels are recorded before any watch function is called, as a watch function may itself
+    // change the level of a pin
+    for(pin = 0; pin < SIM_PORT_PINS; ++pin)
+        if(changed & (1 << pin))
+        {
+            unsigned i;
+
+            for(i = 0; i < SIM_PORT_WATCHES; ++i)
+                if(sim_port_watch[port][pin][i])
+                    sim_port_watch[port][pin][i](!!(level & (1 << pin)));
+        }
+}
+
+
+static void sim_port_reset()
+{
+    uint8_t port;
+
+    memset(sim_port_watch, 0, sizeof(sim_port_watch));
+    memset(sim_port_drive, SIM_PIN_Z, sizeof(sim_port_drive));
+    memset(sim_port_pull, SIM_PIN_Z, sizeof(sim_port_pull));
+    memset(sim_port_level, 0, sizeof(sim_port_level));
+    memset(sim_port_sense, 0, sizeof(sim_port_sense));
+
+    for(port = 0; port < SIM_PORTS; ++port)
+        sim_port_update(port);
+}
+
+
+// sim_port_write_reg() - apply the write of <val>, over <old>, to the register at offset <off> in
+// PORTx <port>.  Strobe registers read back as the register they modify.
+//
+static void sim_port_write_reg(const uint8_t port, const uint8_t off, const uint8_t old,
+                               const uint8_t val)
+{
+    switch(off)
+    {
+        case SIM_PORT_DIRSET:
+            SIM_PORT_REG(port, SIM_PORT_DIR) |= val;
+            break;
+
+        case SIM_PORT_DIRCLR:
+            SIM_PORT_REG(port, SIM_PORT_DIR) &= ~val;
+            break;
+
+        case SIM_PORT_DIRTGL:
+            SIM_PORT_REG(port, SIM_PORT_DIR) ^= val;
+            break;
+
+        case SIM_PORT_OUTSET:
+            SIM_PORT_REG(port, SIM_PORT_OUT) |= val;
+            break;
+
+        case SIM_PORT_OUTCLR:
+            SIM_PORT_REG(port, SIM_PORT_OUT) &= ~val;
+            break;
+
+        case SIM_PORT_OUTTGL:
+        case SIM_PORT_IN:                   // Writing a one to a bit of IN toggles OUT
+            SIM_PORT_REG(port, SIM_PORT_OUT) ^= val;
+            break;
+
+        case SIM_PORT_INTFLAGS:             // Flags are cleared by writing one to them
+            SIM_PORT_REG(port, SIM_PORT_INTFLAGS) = old & ~val;
+            break;
+
+        default:
+            break;
+    }
+
+    sim_port_update(port);
+}
+
+
+static void sim_port_write(const uint16_t off, const uint16_t old, const uint16_t val)
+{
+    sim_port_write_reg(off / SIM_PORT_STRIDE, off % SIM_PORT_STRIDE, old, val);
+}
+
+
+static uint32_t sim_port_irq()
+{
+    uint32_t mask = 0;
+
+    if(SIM_REG(PORTA_INTFLAGS))
+        mask |= SIM_VECTOR_BIT(3);
+    if(SIM_REG(PORTB_INTFLAGS))
+        mask |= SIM_VECTOR_BIT(4);
+    if(SIM_REG(PORTC_INTFLAGS))
+        mask |= SIM_VECTOR_BIT(5);
+
+    return mask;
+}
+
+
+// VPORTx registers are aliases of the corresponding PORTx registers
+static void sim_vport_write(const uint16_t off, const uint16_t old, const uint16_t val)
+{
+    const uint8_t port = off / SIM_VPORT_STRIDE;
+
+    if(port >= SIM_PORTS)
+        return;                             // General-purpose I/O registers
+
+    switch(off % SIM_VPORT_STRIDE)
+    {
+        case SIM_VPORT_DIR:
+            SIM_PORT_REG(port, SIM_PORT_DIR) = val;
+            sim_port_update(port);
+            break;
+
+        case SIM_VPORT_OUT:
+            SIM_PORT_REG(port, SIM_PORT_OUT) = val;
+            sim_port_update(port);
+            break;
+
+        case SIM_VPORT_IN:
+            sim_port_write_reg(port, SIM_PORT_IN, 0, val);
+            break;
+
+        case SIM_VPORT_INTFLAGS:
+            sim_port_write_reg(port, SIM_PORT_INTFLAGS, old, val);
+            break;
+    }
+}
+
+
+const SimDev_t sim_dev_vport = {
+    .block = SimBlockVPORT, .base = 0x00, .len = 0x20, .write = sim_vport_write
+};
+
+const SimDev_t sim_dev_port = {
+    .block = SimBlockPORT, .base = 0x400, .len = SIM_PORTS * SIM_PORT_STRIDE,
+    .reset = sim_port_reset, .write = sim_port_write, .irq = sim_port_irq
+};
+
+
+// sim_pin_drive() - drive pin <pin> of port <port> to <level> from outside the uC, or stop driving
+// it if <level> is SIM_PIN_Z.  The pin's level is unaffected while it is an output.
+//
+void sim_pin_drive(const uint8_t port, const uint8_t pin, const int8_t level)
+{
+    sim_port_check(port, pin);
+    sim_port_drive[port][pin] = (level == SIM_PIN_Z) ? SIM_PIN_Z : !!level;
+    sim_port_update(port);
+}
+
+
+// sim_pin_pull() - attach a resistor pulling pin <pin> of port <port> to <level>, or remove it if
+// <level> is SIM_PIN_Z.  The resistor is weaker than any driver, and than the pin's pull-up.
+//
+void sim_pin_pull(const uint8_t port, const uint8_t pin, const int8_t level)
+{
+    sim_port_check(port, pin);
+    sim_port_pull[port][pin] = (level == SIM_PIN_Z) ? SIM_PIN_Z : !!level;
+    sim_port_update(port);
+}
+
+
+// sim_pin_level() - return the level of pin <pin> of port <port>.
+//
+uint8_t sim_pin_level(const uint8_t port, const uint8_t pin)
+{
+    sim_port_check(port, pin);
+    return sim_port_pin_level(port, pin);
+}
+
+
+// sim_pin_watch() - arrange for <fn> to be called whenever the level of pin <pin> of port <port>
+// changes.
+//
+void sim_pin_watch(const uint8_t port, const uint8_t pin, const SimPinWatch_t fn)
+{
+    unsigned i;
+
+    sim_port_check(port, pin);
+    for(i = 0; i < SIM_PORT_WATCHES; ++i)
+        if(!sim_port_watch[port][pin][i])
+        {
+            sim_port_watch[port][pin][i] = fn;
+            return;
+        }
+
+    sim_fail("too many watches on port %u, pin %u", port, pin);
+}
@@ -0,0 +1,312 @@
+/*
+    simrtc.c - host simulator model of the ATtiny816's real-time counter (RTC), including its
+    periodic interrupt timer (PIT) and the events it sends through the event system.
+
+    The counter's value is derived from simulated time, rather than being incremented, so that the
+    model costs nothing while the core sleeps.  Synchronisation between the RTC and CPU clock
+    domains is not modelled: the busy flags in STATUS and PITSTATUS always read as zero.
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "simdev.h"
+
+
+static struct
+{
+    uint64_t    t0;                     // Time at which the counter held <cnt0>
+    uint16_t    cnt0;
+    uint64_t    k_done;                 // Ticks since <t0> whose events have been processed
+    uint64_t    pit_t0;                 // Time at which the PIT was started
+    uint64_t    pit_n_done;             // RTC clocks since <pit_t0> whose events are processed
+} sim_rtc;
+
+
+// sim_rtc_clk_freq() - return the frequency of the RTC clock, in Hz.
+//
+static uint32_t sim_rtc_clk_freq()
+{
+    switch(SIM_REG(RTC_CLKSEL) & RTC_CLKSEL_gm)
+    {
+        case RTC_CLKSEL_INT32K_gc:
+        case RTC_CLKSEL_TOSC32K_gc:
+            return 32768;
+
+        case RTC_CLKSEL_INT1K_gc:
+            return 1024;
+
+        default:
+            sim_fail("RTC clock set to EXTCLK, which is not connected");
+    }
+}
+
+
+// sim_rtc_prescale() - return the division ratio of the RTC prescaler.
+//
+static uint32_t sim_rtc_prescale()
+{
+    return 1UL << ((SIM_REG(RTC_CTRLA) & RTC_PRESCALER_gm) >> 3);
+}
+
+
+// sim_rtc_ticks() - return the number of counter ticks between <t0> and time <t>.
+//
+static uint64_t sim_rtc_ticks(const uint64_t t)
+{
+    return (unsigned __int128) (t - sim_rtc.t0) * sim_rtc_clk_freq() /
+           ((unsigned __int128) sim_rtc_prescale() * SIM_PS_PER_S);
+}
+
+
+// sim_rtc_tick_time() - return the time at which the counter makes its <k>th tick after <t0>.
+//
+static uint64_t sim_rtc_tick_time(const uint64_t k)
+{
+    const uint32_t f = sim_rtc_clk_freq();
+
+    return sim_rtc.t0 + ((unsigned __int128) k * sim_rtc_prescale() * SIM_PS_PER_S + f - 1) / f;
+}
+
+
+// sim_rtc_count_after() - return the counter value after <k> ticks from <t0>.
+//
+static uint16_t sim_rtc_count_after(const uint64_t k)
+{
+    return (sim_rtc.cnt0 + k) % (SIM_REG(RTC_PER) + 1UL);
+}
+
+
+// sim_rtc_enabled() - return non-zero if the counter is running.
+//
+static uint8_t sim_rtc_enabled()
+{
+    return SIM_REG(RTC_CTRLA) & RTC_RTCEN_bm;
+}
+
+
+// sim_rtc_count() - return the counter value at the current time.
+//
+static uint16_t sim_rtc_count()
+{
+    return sim_rtc_enabled() ? sim_rtc_count_after(sim_rtc_ticks(sim_t)) : sim_rtc.cnt0;
+}
+
+
+// sim_rtc_rebase() - restart the derivation of the counter value from the current time, e.g.
+// before its clock or period is changed.
+//
+static void sim_rtc_rebase()
+{
+    sim_rtc.cnt0 = sim_rtc_count();
+    sim_rtc.t0 = sim_t;
+    sim_rtc.k_done = 0;
+}
+
+
+// sim_rtc_next_match() - return the number of ticks after <t0> at which the counter next reaches
+// <val>, after the ticks already processed.
+//
+static uint64_t sim_rtc_next_match(const uint16_t val)
+{
+    const uint32_t n = SIM_REG(RTC_PER) + 1UL;
+    const uint32_t delta = (val + n - sim_rtc_count_after(sim_rtc.k_done) % n) % n;
+
+    return sim_rtc.k_done + (delta ? delta : n);
+}
+
+
+// sim_rtc_pit_period() - return the PIT period, in RTC clock cycles, or zero if it is off.
+//
+static uint32_t sim_rtc_pit_period()
+{
+    const uint8_t period = (SIM_REG(RTC_PITCTRLA) & RTC_PERIOD_gm) >> 3;
+
+    if(!(SIM_REG(RTC_PITCTRLA) & RTC_PITEN_bm) || !period || (period > 0x0e))
+        return 0;
+
+    return 2UL << period;
+}
+
+
+// sim_rtc_pit_next() - return the number of RTC clocks after <pit_t0> at which the PIT next fires.
+//
+static uint64_t sim_rtc_pit_next()
+{
+    const uint32_t period = sim_rtc_pit_period();
+
+    return (sim_rtc.pit_n_done / period + 1) * period;
+}
+
+
+static uint64_t sim_rtc_pit_time(const uint64_t n)
+{
+    const uint32_t f = sim_rtc_clk_freq();
+
+    return sim_rtc.pit_t0 + ((unsigned __int128) n * SIM_PS_PER_S + f - 1) / f;
+}
+
+
+// sim_rtc_next_count() - return the time at which the counter value next changes.
+//
+uint64_t sim_rtc_next_count()
+{
+    if(!sim_rtc_enabled())
+        return SIM_NEVER;
+
+    return sim_rtc_tick_time(sim_rtc_ticks(sim_t) + 1);
+}
+
+
+static uint64_t sim_rtc_next()
+{
+    uint64_t next = SIM_NEVER;
+
+    if(sim_rtc_enabled())
+    {
+        const uint64_t cmp = sim_rtc_tick_time(sim_rtc_next_match(SIM_REG(RTC_CMP))),
+                       ovf = sim_rtc_tick_time(sim_rtc_next_match(0));
+
+        next = (cmp < ovf) ? cmp : ovf;
+    }
+
+    if(sim_rtc_pit_period())
+    {
+        const uint64_t pit = sim_rtc_pit_time(sim_rtc_pit_next());
+
+        if(pit < next)
+            next = pit;
+    }
+
+    return next;
+}
+
+
+// sim_rtc_event() - route RTC event <gen> (an EVSYS_ASYNCCH0 generator value) through the event
+// system.  Only asynchronous channel 0 and the ADC0 user are modelled.
+//
+static void sim_rtc_event(const uint8_t gen)
+{
+    if((SIM_REG(EVSYS_ASYNCCH0) == gen) &&
+       (SIM_REG(EVSYS_ASYNCUSER1) == EVSYS_ASYNCUSER1_ASYNCCH0_gc))
+        sim_adc_event();
+}
+
+
+static void sim_rtc_tick()
+{
+    if(sim_rtc_enabled())
+    {
+        const uint64_t k = sim_rtc_ticks(sim_t),
+                       cmp = sim_rtc_next_match(SIM_REG(RTC_CMP)), ovf = sim_rtc_next_match(0);
+
+        sim_rtc.k_done = k;
+
+        if(cmp <= k)
+        {
+            SIM_REG(RTC_INTFLAGS) |= RTC_CMP_bm;
+            sim_rtc_event(EVSYS_ASYNCCH0_RTC_CMP_gc);
+        }
+
+        if(ovf <= k)
+        {
+            SIM_REG(RTC_INTFLAGS) |= RTC_OVF_bm;
+            sim_rtc_event(EVSYS_ASYNCCH0_RTC_OVF_gc);
+        }
+    }
+
+    if(sim_rtc_pit_period())
+    {
+        const uint32_t f = sim_rtc_clk_freq();
+        const uint64_t n = (unsigned __int128) (sim_t - sim_rtc.pit_t0) * f / SIM_PS_PER_S;
+
+        if(sim_rtc_pit_next() <= n)
+            SIM_REG(RTC_PITINTFLAGS) |= RTC_PI_bm;
+
+        sim_rtc.pit_n_done = n;
+    }
+}
+
+
+static void sim_rtc_reset()
+{
+    sim_rtc.t0 = sim_rtc.pit_t0 = 0;
+    sim_rtc.cnt0 = 0;
+    sim_rtc.k_done = sim_rtc.pit_n_done = 0;
+    SIM_REG(RTC_PER) = 0xffff;
+}
+
+
+static void sim_rtc_read(const uint16_t off)
+{
+    if(sim_dev_rtc.base + off == SIM_ADDR(RTC_CNT))
+        SIM_REG(RTC_CNT) = sim_rtc_count();
+}
+
+
+static void sim_rtc_write(const uint16_t off, const uint16_t old, const uint16_t val)
+{
+    const uint16_t addr = sim_dev_rtc.base + off;
+
+    if((addr == SIM_ADDR(RTC_CTRLA)) || (addr == SIM_ADDR(RTC_CLKSEL)) ||
+       (addr == SIM_ADDR(RTC_PER)))
+    {
+        // Derive the count so far using the old configuration
+        if(addr == SIM_ADDR(RTC_PER))
+            SIM_REG(RTC_PER) = old;
+        else
+            sim_io[addr] = old;
+
+        sim_rtc_rebase();
+
+        if(addr == SIM_ADDR(RTC_PER))
+            SIM_REG(RTC_PER) = val;
+        else
+            sim_io[addr] = val;
+
+        if((addr == SIM_ADDR(RTC_CLKSEL)) && sim_rtc_pit_period())
+        {
+            sim_rtc.pit_t0 = sim_t;
+            sim_rtc.pit_n_done = 0;
+        }
+    }
+    else if(addr == SIM_ADDR(RTC_CNT))
+    {
+        sim_rtc.cnt0 = val;
+        sim_rtc.t0 = sim_t;
+        sim_rtc.k_done = 0;
+    }
+    else if(addr == SIM_ADDR(RTC_PITCTRLA))
+    {
+        if((val & RTC_PITEN_bm) && !(old & RTC_PITEN_bm))
+        {
+            sim_rtc.pit_t0 = sim_t;
+            sim_rtc.pit_n_done = 0;
+        }
+    }
+    else if(addr == SIM_ADDR(RTC_INTFLAGS))
+        SIM_REG(RTC_INTFLAGS) = old & ~val;
+    else if(addr == SIM_ADDR(RTC_PITINTFLAGS))
+        SIM_REG(RTC_PITINTFLAGS) = old & ~val;
+    else if((addr == SIM_ADDR(RTC_STATUS)) || (addr == SIM_ADDR(RTC_PITSTATUS)))
+        sim_io[addr] = old;
+}
+
+
+static uint32_t sim_rtc_irq()
+{
+    uint32_t mask = 0;
+
+    if(SIM_REG(RTC_INTFLAGS) & SIM_REG(RTC_INTCTRL) & (RTC_OVF_bm | RTC_CMP_bm))
+        mask |= SIM_VECTOR_BIT(6);
+    if(SIM_REG(RTC_PITINTFLAGS) & SIM_REG(RTC_PITINTCTRL) & RTC_PI_bm)
+        mask |= SIM_VECTOR_BIT(7);
+
+    return mask;
+}
+
+
+const SimDev_t sim_dev_rtc = {
+    .block = SimBlockRTC, .base = 0x140, .len = 0x20, .reset = sim_rtc_reset,
+    .read = sim_rtc_read, .write = sim_rtc_write, .irq = sim_rtc_irq, .next = sim_rtc_next,
+    .tick = sim_rtc_tick
+};
@@ -0,0 +1,209 @@
+/*
+    simspi.c - host simulator model of the ATtiny816's SPI peripheral, operating as a master in
+    buffered mode, and of the slave device on the bus.
+
+    Each byte is exchanged with the slave (see sim_spi_set_peer()) as it finishes shifting, if the
+    slave's nSS pin is low at that point; otherwise 0xff is received.  The firmware drives nSS
+    itself, so the peripheral's own slave-select handling (SSD) is not modelled.
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "simdev.h"
+#include <string.h>
+
+
+#define SIM_SPI_RX_FIFO_LEN     (2)     // Depth of the receive buffer in buffered mode
+
+static struct
+{
+    SimSPIPeer_t peer;                  // Slave device
+    uint8_t     shifting;               // Non-zero while a byte is being shifted
+    uint8_t     shift;                  // Byte being shifted out
+    uint8_t     ss_port;                // nSS pin, sampled at the start of the byte
+    uint8_t     ss_pin;
+    uint64_t    end_t;                  // Time at which the byte being shifted is complete
+    uint8_t     tx_full;                // Non-zero if the transmit buffer holds a byte
+    uint8_t     tx;                     // ... that byte
+    uint8_t     rx[SIM_SPI_RX_FIFO_LEN];    // Receive buffer
+    uint8_t     rx_count;               // Number of bytes in <rx>
+} sim_spi;
+
+
+// sim_spi_sync() - bring the DATA and INTFLAGS registers up to date with the model's state.  The
+// write-one-to-clear flags (TXCIF, BUFOVF, SSIF) are preserved.
+//
+static void sim_spi_sync()
+{
+    uint8_t flags = SIM_REG(SPI0_INTFLAGS) & (SPI_TXCIF_bm | SPI_BUFOVF_bm | SPI_SSIF_bm);
+
+    if(sim_spi.rx_count)
+        flags |= SPI_RXCIF_bm;
+    if(!sim_spi.tx_full)
+        flags |= SPI_DREIF_bm;
+
+    SIM_REG(SPI0_INTFLAGS) = flags;
+    SIM_REG(SPI0_DATA) = sim_spi.rx_count ? sim_spi.rx[0] : 0;
+}
+
+
+// sim_spi_byte_ps() - return the time taken to shift one byte.
+//
+static uint64_t sim_spi_byte_ps()
+{
+    static const uint8_t div[4] = {4, 16, 64, 128};
+    const uint8_t ctrla = SIM_REG(SPI0_CTRLA);
+
+    return sim_cycles_ps(8 * div[(ctrla & SPI_PRESC_gm) >> 1] / ((ctrla & SPI_CLK2X_bm) ? 2 : 1),
+                         sim_cpu_freq());
+}
+
+
+// sim_spi_shift() - start shifting <data>.
+//
+static void sim_spi_shift(const uint8_t data)
+{
+    sim_spi.shifting = 1;
+    sim_spi.shift = data;
+    sim_spi.end_t = sim_t + sim_spi_byte_ps();
+
+    // The slave is the one selected by the pin-set in use
+    if(SIM_REG(PORTMUX_CTRLB) & PORTMUX_SPI0_ALTERNATE_gc)
+    {
+        sim_spi.ss_port = 2;                // PC3
+        sim_spi.ss_pin = 3;
+    }
+    else
+    {
+        sim_spi.ss_port = 0;                // PA4
+        sim_spi.ss_pin = 4;
+    }
+}
+
+
+static uint64_t sim_spi_next()
+{
+    return sim_spi.shifting ? sim_spi.end_t : SIM_NEVER;
+}
+
+
+// sim_spi_tick() - complete the byte being shifted, exchanging it with the slave, and start
+// shifting the next byte, if one is buffered.
+//
+static void sim_spi_tick()
+{
+    uint8_t miso = 0xff;
+
+    ++sim_st.spi_bytes;
+    if(sim_pin_level(sim_spi.ss_port, sim_spi.ss_pin) || !sim_spi.peer)
+        ++sim_st.spi_bytes_unselected;
+    else
+        miso = sim_spi.peer(sim_spi.shift);
+
+    if(sim_spi.rx_count < SIM_SPI_RX_FIFO_LEN)
+        sim_spi.rx[sim_spi.rx_count++] = miso;
+    else
+        SIM_REG(SPI0_INTFLAGS) |= SPI_BUFOVF_bm;    // The byte is lost
+
+    sim_spi.shifting = 0;
+    if(sim_spi.tx_full)
+    {
+        sim_spi.tx_full = 0;
+        sim_spi_shift(sim_spi.tx);
+    }
+    else
+        SIM_REG(SPI0_INTFLAGS) |= SPI_TXCIF_bm;
+
+    sim_spi_sync();
+}
+
+
+// sim_spi_flush() - abandon any transfer in progress, and empty the buffers.
+//
+static void sim_spi_flush()
+{
+    sim_spi.shifting = 0;
+    sim_spi.tx_full = 0;
+    sim_spi.rx_count = 0;
+}
+
+
+static void sim_spi_reset()
+{
+    memset(&sim_spi, 0, sizeof(sim_spi));
+    sim_spi_sync();
+}
+
+
+// Reading DATA removes the oldest byte from the receive buffer
+static void sim_spi_read(const uint16_t off)
+{
+    if((sim_dev_spi.base + off == SIM_ADDR(SPI0_DATA)) && sim_spi.rx_count)
+    {
+        SIM_REG(SPI0_DATA) = sim_spi.rx[0];
+        memmove(sim_spi.rx, sim_spi.rx + 1, --sim_spi.rx_count);
+        SIM_REG(SPI0_INTFLAGS) &= ~SPI_RXCIF_bm;
+        if(sim_spi.rx_count)
+            SIM_REG(SPI0_INTFLAGS) |= SPI_RXCIF_bm;
+    }
+}
+
+
+static void sim_spi_write(const uint16_t off, const uint16_t old, const uint16_t val)
+{
+    const uint16_t addr = sim_dev_spi.base + off;
+
+    if(addr == SIM_ADDR(SPI0_DATA))
+    {
+        const uint8_t ctrla = SIM_REG(SPI0_CTRLA);
+
+        if(!(ctrla & SPI_ENABLE_bm) || !(ctrla & SPI_MASTER_bm) ||
+           !(SIM_REG(SPI0_CTRLB) & SPI_BUFEN_bm))
+            sim_fail("SPI0 DATA written, but SPI0 is not an enabled master in buffered mode");
+
+        if(!sim_spi.shifting)
+            sim_spi_shift(val);
+        else if(!sim_spi.tx_full)
+        {
+            sim_spi.tx = val;
+            sim_spi.tx_full = 1;
+        }
+        else
+            sim_fail("SPI0 DATA written while the transmit buffer is full");
+    }
+    else if(addr == SIM_ADDR(SPI0_INTFLAGS))
+        SIM_REG(SPI0_INTFLAGS) = old & ~(val & (SPI_TXCIF_bm | SPI_BUFOVF_bm | SPI_SSIF_bm));
+    else if((addr == SIM_ADDR(SPI0_CTRLA)) && !(val & SPI_ENABLE_bm))
+        sim_spi_flush();
+
+    sim_spi_sync();
+}
+
+
+// In buffered mode, each interrupt flag has its own enable bit
+static uint32_t sim_spi_irq()
+{
+    return (SIM_REG(SPI0_INTFLAGS) & SIM_REG(SPI0_INTCTRL) & 0xf0) ? SIM_VECTOR_BIT(21) : 0;
+}
+
+
+static uint8_t sim_spi_busy()
+{
+    return sim_spi.shifting;
+}
+
+
+const SimDev_t sim_dev_spi = {
+    .block = SimBlockSPI, .base = 0x820, .len = 0x10, .reset = sim_spi_reset,
+    .read = sim_spi_read, .write = sim_spi_write, .irq = sim_spi_irq, .busy = sim_spi_busy,
+    .next = sim_spi_next, .tick = sim_spi_tick
+};
+
+
+// sim_spi_set_peer() - connect the slave device <peer> to the SPI bus.  <peer> is called with each
+// byte sent by the master while the slave is selected, and returns the byte sent in reply.
+//
+void sim_spi_set_peer(const SimSPIPeer_t peer)
+{
+    sim_spi.peer = peer;
+}
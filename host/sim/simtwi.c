@@ -0,0 +1,259 @@
+/*
+    simtwi.c - host simulator model of the ATtiny816's TWI peripheral, operating as a master, and
+    of the slave devices on the bus (see sim_twi_add_device()).
+
+    Each bus operation (START and address, data byte) takes the number of SCL periods it would on
+    the wire, at the SCL frequency given by MBAUD; a STOP completes at once.  Rise times, clock
+    stretching by the slave, and other masters are not modelled, so ARBLOST and BUSERR are never
+    set.
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "simdev.h"
+#include <stddef.h>
+#include <string.h>
+
+
+#define SIM_TWI_DEVICES         (4)     // Max number of slave devices on the bus
+
+// SimTWIOp_t - enumeration of bus operations.
+//
+typedef enum SimTWIOp
+{
+    SimTWIOpNone = 0,
+    SimTWIOpAddrWrite,                  // START, address, write bit; ACK
+    SimTWIOpAddrRead,                   // START, address, read bit; ACK; first byte
+    SimTWIOpWrite,                      // Data byte; ACK
+    SimTWIOpRead                        // ACK of the previous byte; data byte
+} SimTWIOp_t;
+
+static struct
+{
+    SimTWIDevice_t *devs[SIM_TWI_DEVICES];
+    SimTWIDevice_t *dev;                // Device addressed, or NULL
+    uint8_t     first;                  // Non-zero if the next byte written is the register index
+    SimTWIOp_t  op;                     // Operation in progress
+    uint64_t    end_t;                  // ... time at which it is complete
+} sim_twi;
+
+
+// sim_twi_op() - start bus operation <op>, lasting <bits> SCL periods.
+//
+static void sim_twi_op(const SimTWIOp_t op, const uint8_t bits)
+{
+    const uint32_t scl = sim_cpu_freq() / (10 + 2 * SIM_REG(TWI0_MBAUD));
+
+    if(!(SIM_REG(TWI0_MCTRLA) & TWI_ENABLE_bm))
+        sim_fail("TWI0 bus operation started with the master disabled");
+    if(sim_twi.op != SimTWIOpNone)
+        sim_fail("TWI0 bus operation started while another is in progress");
+
+    if(scl > sim_st.twi_scl_max)
+        sim_st.twi_scl_max = scl;
+
+    SIM_REG(TWI0_MSTATUS) &= ~(TWI_RIF_bm | TWI_WIF_bm | TWI_CLKHOLD_bm);
+    sim_twi.op = op;
+    sim_twi.end_t = sim_t + sim_cycles_ps(bits * (10 + 2 * SIM_REG(TWI0_MBAUD)), sim_cpu_freq());
+}
+
+
+// sim_twi_start() - start a START (or repeated START) condition, and the address in MADDR.
+//
+static void sim_twi_start()
+{
+    const uint8_t maddr = SIM_REG(TWI0_MADDR);
+    unsigned i;
+
+    sim_twi.dev = NULL;
+    for(i = 0; i < SIM_TWI_DEVICES; ++i)
+        if(sim_twi.devs[i] && (sim_twi.devs[i]->addr == maddr >> 1))
+            sim_twi.dev = sim_twi.devs[i];
+
+    SIM_REG(TWI0_MSTATUS) = (SIM_REG(TWI0_MSTATUS) & ~TWI_BUSSTATE_gm) | TWI_BUSSTATE_OWNER_gc;
+
+    if((maddr & 1) && sim_twi.dev)
+        sim_twi_op(SimTWIOpAddrRead, 19);   // START, address, ACK, data byte
+    else
+        sim_twi_op((maddr & 1) ? SimTWIOpAddrRead : SimTWIOpAddrWrite, 10);
+}
+
+
+// sim_twi_read_byte() - place the next byte from the addressed device in MDATA.
+//
+static void sim_twi_read_byte()
+{
+    SIM_REG(TWI0_MDATA) = sim_twi.dev->regs[sim_twi.dev->reg_ptr++];
+    SIM_REG(TWI0_MSTATUS) |= TWI_RIF_bm | TWI_CLKHOLD_bm;
+    ++sim_st.twi_bytes;
+}
+
+
+static uint64_t sim_twi_next()
+{
+    return (sim_twi.op != SimTWIOpNone) ? sim_twi.end_t : SIM_NEVER;
+}
+
+
+// sim_twi_tick() - complete the bus operation in progress.
+//
+static void sim_twi_tick()
+{
+    const SimTWIOp_t op = sim_twi.op;
+
+    sim_twi.op = SimTWIOpNone;
+    SIM_REG(TWI0_MSTATUS) &= ~TWI_RXACK_bm;
+
+    switch(op)
+    {
+        case SimTWIOpAddrWrite:
+        case SimTWIOpAddrRead:
+            ++sim_st.twi_bytes;
+            sim_twi.first = 1;
+            if(!sim_twi.dev)
+                SIM_REG(TWI0_MSTATUS) |= TWI_RXACK_bm | TWI_WIF_bm | TWI_CLKHOLD_bm;
+            else if(op == SimTWIOpAddrWrite)
+                SIM_REG(TWI0_MSTATUS) |= TWI_WIF_bm | TWI_CLKHOLD_bm;
+            else
+                sim_twi_read_byte();
+            break;
+
+        case SimTWIOpWrite:
+            ++sim_st.twi_bytes;
+            if(!sim_twi.dev)
+                SIM_REG(TWI0_MSTATUS) |= TWI_RXACK_bm;
+            else if(sim_twi.first)
+            {
+                sim_twi.dev->reg_ptr = SIM_REG(TWI0_MDATA);
+                sim_twi.first = 0;
+            }
+            else
+                sim_twi.dev->regs[sim_twi.dev->reg_ptr++] = SIM_REG(TWI0_MDATA);
+            SIM_REG(TWI0_MSTATUS) |= TWI_WIF_bm | TWI_CLKHOLD_bm;
+            break;
+
+        case SimTWIOpRead:
+            sim_twi_read_byte();
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+// sim_twi_recv() - acknowledge the byte just received and receive the next, if a device is being
+// read and the master is holding the clock.
+//
+static void sim_twi_recv()
+{
+    if(sim_twi.dev && (SIM_REG(TWI0_MADDR) & 1) && (SIM_REG(TWI0_MSTATUS) & TWI_CLKHOLD_bm))
+        sim_twi_op(SimTWIOpRead, 9);
+}
+
+
+static void sim_twi_reset()
+{
+    memset(&sim_twi, 0, sizeof(sim_twi));
+}
+
+
+// In smart mode, reading MDATA while ACKACT is zero acknowledges the byte and receives the next
+static void sim_twi_read(const uint16_t off)
+{
+    if(sim_dev_twi.base + off != SIM_ADDR(TWI0_MDATA))
+        return;
+
+    if(SIM_REG(TWI0_MSTATUS) & TWI_RIF_bm)
+    {
+        SIM_REG(TWI0_MSTATUS) &= ~TWI_RIF_bm;
+        if((SIM_REG(TWI0_MCTRLA) & TWI_SMEN_bm) && !(SIM_REG(TWI0_MCTRLB) & TWI_ACKACT_bm) &&
+           ((SIM_REG(TWI0_MSTATUS) & TWI_BUSSTATE_gm) == TWI_BUSSTATE_OWNER_gc))
+            sim_twi_recv();
+    }
+}
+
+
+static void sim_twi_write(const uint16_t off, const uint16_t old, const uint16_t val)
+{
+    const uint16_t addr = sim_dev_twi.base + off;
+
+    if(addr == SIM_ADDR(TWI0_MADDR))
+        sim_twi_start();
+    else if(addr == SIM_ADDR(TWI0_MDATA))
+    {
+        if((SIM_REG(TWI0_MSTATUS) & TWI_BUSSTATE_gm) != TWI_BUSSTATE_OWNER_gc)
+            sim_fail("TWI0 MDATA written without owning the bus");
+        sim_twi_op(SimTWIOpWrite, 9);
+    }
+    else if(addr == SIM_ADDR(TWI0_MCTRLB))
+    {
+        SIM_REG(TWI0_MCTRLB) = val & TWI_ACKACT_bm;     // MCMD and FLUSH read as zero
+
+        switch(val & TWI_MCMD_gm)
+        {
+            case TWI_MCMD_REPSTART_gc:
+                sim_twi_start();
+                break;
+
+            case TWI_MCMD_RECVTRANS_gc:
+                sim_twi_recv();
+                break;
+
+            case TWI_MCMD_STOP_gc:
+                if(sim_twi.op != SimTWIOpNone)
+                    sim_fail("TWI0 STOP issued during a bus operation");
+                SIM_REG(TWI0_MSTATUS) = (SIM_REG(TWI0_MSTATUS) &
+                                         ~(TWI_BUSSTATE_gm | TWI_CLKHOLD_bm)) |
+                                        TWI_BUSSTATE_IDLE_gc;
+                break;
+        }
+    }
+    else if(addr == SIM_ADDR(TWI0_MSTATUS))
+    {
+        const uint8_t w1c = TWI_RIF_bm | TWI_WIF_bm | TWI_CLKHOLD_bm | TWI_ARBLOST_bm |
+                            TWI_BUSERR_bm;
+
+        SIM_REG(TWI0_MSTATUS) = ((old & ~(val & w1c)) & ~TWI_BUSSTATE_gm) |
+                                (val & TWI_BUSSTATE_gm);
+    }
+}
+
+
+static uint32_t sim_twi_irq()
+{
+    const uint8_t status = SIM_REG(TWI0_MSTATUS), ctrla = SIM_REG(TWI0_MCTRLA);
+
+    return (((status & TWI_RIF_bm) && (ctrla & TWI_RIEN_bm)) ||
+            ((status & TWI_WIF_bm) && (ctrla & TWI_WIEN_bm))) ? SIM_VECTOR_BIT(20) : 0;
+}
+
+
+static uint8_t sim_twi_busy()
+{
+    return sim_twi.op != SimTWIOpNone;
+}
+
+
+const SimDev_t sim_dev_twi = {
+    .block = SimBlockTWI, .base = 0x810, .len = 0x10, .reset = sim_twi_reset,
+    .read = sim_twi_read, .write = sim_twi_write, .irq = sim_twi_irq, .busy = sim_twi_busy,
+    .next = sim_twi_next, .tick = sim_twi_tick
+};
+
+
+// sim_twi_add_device() - attach the slave device <dev> to the TWI bus.
+//
+void sim_twi_add_device(SimTWIDevice_t * const dev)
+{
+    unsigned i;
+
+    for(i = 0; i < SIM_TWI_DEVICES; ++i)
+        if(!sim_twi.devs[i])
+        {
+            sim_twi.devs[i] = dev;
+            return;
+        }
+
+    sim_fail("too many TWI devices");
+}
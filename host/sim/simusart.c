@@ -0,0 +1,198 @@
+/*
+    simusart.c - host simulator model of the ATtiny816's USART0, in asynchronous mode.
+
+    Frames are assumed to be 10 bits long (8N1).  Transmitted bytes are captured, and may be
+    retrieved using sim_usart_tx_data(); bytes may be injected into the receiver using
+    sim_usart_rx_inject().
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "simdev.h"
+#include <string.h>
+
+
+#define SIM_USART_FRAME_BITS    (10)
+#define SIM_USART_RX_FIFO_LEN   (2)
+#define SIM_USART_TX_CAPTURE    (4096)  // Max number of transmitted bytes captured
+
+static struct
+{
+    uint8_t     shifting;               // Non-zero while a byte is being transmitted
+    uint8_t     shift;                  // ... that byte
+    uint64_t    end_t;                  // Time at which its transmission is complete
+    uint8_t     tx_full;                // Non-zero if the transmit buffer holds a byte
+    uint8_t     tx;                     // ... that byte
+    uint8_t     rx[SIM_USART_RX_FIFO_LEN];  // Receive buffer
+    uint8_t     rx_count;               // Number of bytes in <rx>
+    uint8_t     captured[SIM_USART_TX_CAPTURE];
+    unsigned    captured_len;
+} sim_usart;
+
+
+// sim_usart_sync() - bring the RXDATAL and STATUS registers up to date with the model's state.
+// TXCIF, which is cleared by writing one to it, is preserved.
+//
+static void sim_usart_sync()
+{
+    uint8_t status = SIM_REG(USART0_STATUS) & USART_TXCIF_bm;
+
+    if(sim_usart.rx_count)
+        status |= USART_RXCIF_bm;
+    if(!sim_usart.tx_full)
+        status |= USART_DREIF_bm;
+
+    SIM_REG(USART0_STATUS) = status;
+    SIM_REG(USART0_RXDATAL) = sim_usart.rx_count ? sim_usart.rx[0] : 0;
+}
+
+
+// sim_usart_shift() - start transmitting <data>.
+//
+static void sim_usart_shift(const uint8_t data)
+{
+    const uint8_t samples =
+        ((SIM_REG(USART0_CTRLB) & USART_RXMODE_gm) == USART_RXMODE_CLK2X_gc) ? 8 : 16;
+    const uint16_t baud = SIM_REG(USART0_BAUD);
+
+    if(baud < 64)
+        sim_fail("USART0 transmitting with BAUD = %u", baud);
+
+    sim_usart.shifting = 1;
+    sim_usart.shift = data;
+    sim_usart.end_t = sim_t + sim_cycles_ps((uint64_t) SIM_USART_FRAME_BITS * samples * baud / 64,
+                                            sim_cpu_freq());
+}
+
+
+static uint64_t sim_usart_next()
+{
+    return sim_usart.shifting ? sim_usart.end_t : SIM_NEVER;
+}
+
+
+// sim_usart_tick() - complete the transmission of a byte, and start the next, if one is buffered.
+//
+static void sim_usart_tick()
+{
+    ++sim_st.usart_tx_bytes;
+    if(sim_usart.captured_len < SIM_USART_TX_CAPTURE)
+        sim_usart.captured[sim_usart.captured_len++] = sim_usart.shift;
+
+    sim_usart.shifting = 0;
+    if(sim_usart.tx_full)
+    {
+        sim_usart.tx_full = 0;
+        sim_usart_shift(sim_usart.tx);
+    }
+    else
+        SIM_REG(USART0_STATUS) |= USART_TXCIF_bm;
+
+    sim_usart_sync();
+}
+
+
+static void sim_usart_reset()
+{
+    memset(&sim_usart, 0, sizeof(sim_usart));
+    sim_usart_sync();
+}
+
+
+// Reading RXDATAL removes the oldest byte from the receive buffer
+static void sim_usart_read(const uint16_t off)
+{
+    if((sim_dev_usart.base + off == SIM_ADDR(USART0_RXDATAL)) && sim_usart.rx_count)
+    {
+        SIM_REG(USART0_RXDATAL) = sim_usart.rx[0];
+        memmove(sim_usart.rx, sim_usart.rx + 1, --sim_usart.rx_count);
+        if(!sim_usart.rx_count)
+            SIM_REG(USART0_STATUS) &= ~USART_RXCIF_bm;
+    }
+}
+
+
+static void sim_usart_write(const uint16_t off, const uint16_t old, const uint16_t val)
+{
+    const uint16_t addr = sim_dev_usart.base + off;
+
+    if(addr == SIM_ADDR(USART0_TXDATAL))
+    {
+        if(!(SIM_REG(USART0_CTRLB) & USART_TXEN_bm))
+            sim_fail("USART0 TXDATAL written with the transmitter disabled");
+
+        if(!sim_usart.shifting)
+            sim_usart_shift(val);
+        else if(!sim_usart.tx_full)
+        {
+            sim_usart.tx = val;
+            sim_usart.tx_full = 1;
+        }
+        else
+            sim_fail("USART0 TXDATAL written while the transmit buffer is full");
+    }
+    else if(addr == SIM_ADDR(USART0_STATUS))
+        SIM_REG(USART0_STATUS) = old & ~(val & USART_TXCIF_bm);
+    else if((addr == SIM_ADDR(USART0_CTRLB)) && !(val & USART_TXEN_bm))
+    {
+        sim_usart.shifting = 0;
+        sim_usart.tx_full = 0;
+    }
+
+    sim_usart_sync();
+}
+
+
+static uint32_t sim_usart_irq()
+{
+    const uint8_t pending = SIM_REG(USART0_STATUS) & SIM_REG(USART0_CTRLA);
+    uint32_t mask = 0;
+
+    if(pending & USART_RXCIF_bm)
+        mask |= SIM_VECTOR_BIT(22);
+    if(pending & USART_DREIF_bm)
+        mask |= SIM_VECTOR_BIT(23);
+    if(pending & USART_TXCIF_bm)
+        mask |= SIM_VECTOR_BIT(24);
+
+    return mask;
+}
+
+
+static uint8_t sim_usart_busy()
+{
+    return sim_usart.shifting;
+}
+
+
+const SimDev_t sim_dev_usart = {
+    .block = SimBlockUSART, .base = 0x800, .len = 0x10, .reset = sim_usart_reset,
+    .read = sim_usart_read, .write = sim_usart_write, .irq = sim_usart_irq,
+    .busy = sim_usart_busy, .next = sim_usart_next, .tick = sim_usart_tick
+};
+
+
+// sim_usart_tx_data() - return the bytes transmitted so far, writing their number to <*len>.
+//
+const uint8_t *sim_usart_tx_data(unsigned * const len)
+{
+    *len = sim_usart.captured_len;
+    return sim_usart.captured;
+}
+
+
+// sim_usart_rx_inject() - deliver <data> to the receiver, as if it had just been received.  The
+// byte is lost if the receiver is disabled; if the receive buffer is full, it overwrites the
+// newest byte.
+//
+void sim_usart_rx_inject(const uint8_t data)
+{
+    if(!(SIM_REG(USART0_CTRLB) & USART_RXEN_bm))
+        return;
+
+    if(sim_usart.rx_count < SIM_USART_RX_FIFO_LEN)
+        ++sim_usart.rx_count;
+    sim_usart.rx[sim_usart.rx_count - 1] = data;
+
+    sim_usart_sync();
+}
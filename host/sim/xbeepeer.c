@@ -0,0 +1,565 @@
+/*
+    xbeepeer.c - host simulator model of an XBee Zigbee module attached to the SPI bus.  See
+    xbeepeer.h for an overview.
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "xbeepeer.h"
+#include "sim.h"
+#include "xbee/atcommands.h"
+#include "xbee/xbeeapi.h"
+#include "xbee/xbeeframe.h"
+#include <string.h>
+
+
+// Connections to the uC; see platform.h
+#define XBEE_PEER_PORTB         (1)
+#define XBEE_PEER_SLEEP_RQ      (0)     // PB0: SLEEP_RQ (input)
+#define XBEE_PEER_ON_nSLEEP     (1)     // PB1: ON/nSLEEP (output, when D9 = 1)
+#define XBEE_PEER_nRESET        (4)     // PB4: nRESET (input, pulled up)
+#define XBEE_PEER_SPI_nATTN     (5)     // PB5: SPI_nATTN (output)
+#define XBEE_PEER_PORTC         (2)
+#define XBEE_PEER_SPI_nSS       (3)     // PC3: SPI_nSSEL (input); the uC uses the alternate pins
+
+#define XBEE_PEER_DATA_MAX      (300)   // Max length of the data (type onwards) in a frame
+#define XBEE_PEER_WIRE_MAX      (XBEE_PEER_DATA_MAX + XBEE_FRAME_OVERHEAD)
+#define XBEE_PEER_OUT_LEN       (2048)  // Capacity of the output queue, in bytes
+#define XBEE_PEER_DELAYED       (8)     // Max number of frames awaiting their response delay
+#define XBEE_PEER_TXRQ_HDR      (14)    // Transmit request: frame type to end of the header
+
+// XBeePeerRxState_t - enumeration of the states of the frame receiver
+//
+typedef enum XBeePeerRxState
+{
+    XBeePeerRxIdle,
+    XBeePeerRxLen1,
+    XBeePeerRxLen2,
+    XBeePeerRxData,
+    XBeePeerRxCksum
+} XBeePeerRxState_t;
+
+// Parameters modelled, with their factory settings
+static const struct XBeePeerParam
+{
+    uint16_t    cmd;
+    uint8_t     factory;
+} xbee_peer_params[] =
+{
+    {XBeeATCmdATD8, XBeePinCfgAlternateFunction},
+    {XBeeATCmdATD9, XBeePinCfgAlternateFunction},
+    {XBeeATCmdATSM, XBeeSleepModeDisabled}
+};
+
+#define XBEE_PEER_PARAMS        (sizeof(xbee_peer_params) / sizeof(xbee_peer_params[0]))
+#define XBEE_PEER_D8            (0)     // Indices into xbee_peer_params[]
+#define XBEE_PEER_D9            (1)
+#define XBEE_PEER_SM            (2)
+
+static struct
+{
+    uint8_t     nv[XBEE_PEER_PARAMS];       // Parameter values in non-volatile memory
+    uint8_t     active[XBEE_PEER_PARAMS];   // ... in effect
+    uint8_t     queued[XBEE_PEER_PARAMS];   // ... queued by 0x09 frames
+    uint8_t     queued_mask;                // Parameters with a queued value
+
+    uint8_t     in_reset;                   // Non-zero while nRESET is low
+    uint8_t     booted;                     // Non-zero once the module has booted
+    uint64_t    boot_t;                     // Time at which the module boots
+    uint8_t     awake;                      // Non-zero while the module is awake
+    uint8_t     spi_mode;                   // Non-zero once the uC has selected the module
+
+    uint8_t     out[XBEE_PEER_OUT_LEN];     // Output queue: bytes for the uC
+    uint16_t    out_head;
+    uint16_t    out_len;
+
+    struct XBeePeerDelayed
+    {
+        uint8_t     used;
+        uint64_t    t;                      // Time at which the frame joins the output queue
+        uint16_t    len;
+        uint8_t     wire[XBEE_PEER_WIRE_MAX];
+    } delayed[XBEE_PEER_DELAYED];
+
+    XBeePeerRxState_t rx_state;             // Frame being received from the uC
+    uint16_t    rx_len;
+    uint16_t    rx_pos;
+    uint8_t     rx_cksum;
+    uint8_t     rx[XBEE_PEER_DATA_MAX];
+
+    int32_t     tx_status_ms;               // Delay of transmit-status frames; -1 for none
+    uint8_t     tx_delivery;                // Delivery status which they report
+    uint8_t     last_tx[XBEE_PEER_DATA_MAX];    // Data carried by the last transmit request
+    uint16_t    last_tx_len;
+
+    XBeePeerStats_t st;
+} xbee_peer;
+
+
+// xbee_peer_param_index() - return the index in xbee_peer_params[] of the parameter set by AT
+// command <cmd>, or -1 if it is not modelled.
+//
+static int8_t xbee_peer_param_index(const uint16_t cmd)
+{
+    uint8_t i;
+
+    for(i = 0; i < XBEE_PEER_PARAMS; ++i)
+        if(xbee_peer_params[i].cmd == cmd)
+            return i;
+
+    return -1;
+}
+
+
+// xbee_peer_pin_sleep() - return non-zero if pin sleep is configured: SLEEP_RQ then requests sleep.
+//
+static uint8_t xbee_peer_pin_sleep()
+{
+    return (xbee_peer.active[XBEE_PEER_SM] == XBeeSleepModePinSleep) &&
+           (xbee_peer.active[XBEE_PEER_D8] == XBeePinCfgAlternateFunction);
+}
+
+
+// xbee_peer_pins() - drive the module's output pins according to its state.  SPI_nATTN is asserted
+// while the output queue holds data, once the uC has selected the module; ON/nSLEEP is driven only
+// if configured by D9.
+//
+static void xbee_peer_pins()
+{
+    const uint8_t attn = xbee_peer.booted && xbee_peer.awake && xbee_peer.spi_mode &&
+                         xbee_peer.out_len;
+
+    sim_pin_drive(XBEE_PEER_PORTB, XBEE_PEER_SPI_nATTN, !attn);
+
+    if(xbee_peer.in_reset || (xbee_peer.active[XBEE_PEER_D9] == XBeePinCfgAlternateFunction))
+        sim_pin_drive(XBEE_PEER_PORTB, XBEE_PEER_ON_nSLEEP, xbee_peer.booted && xbee_peer.awake);
+    else
+        sim_pin_drive(XBEE_PEER_PORTB, XBEE_PEER_ON_nSLEEP, SIM_PIN_Z);
+}
+
+
+// xbee_peer_queue() - append the <len> bytes at <data> to the output queue.
+//
+static void xbee_peer_queue(const uint8_t * const data, const uint16_t len)
+{
+    uint16_t i;
+
+    if(xbee_peer.out_len + len > XBEE_PEER_OUT_LEN)
+        sim_fail("XBee output queue overflow");
+
+    for(i = 0; i < len; ++i)
+        xbee_peer.out[(xbee_peer.out_head + xbee_peer.out_len++) % XBEE_PEER_OUT_LEN] = data[i];
+
+    xbee_peer_pins();
+}
+
+
+// xbee_peer_release() - timer function which moves each delayed frame whose time has come to the
+// output queue.
+//
+static void xbee_peer_release()
+{
+    unsigned i;
+
+    for(i = 0; i < XBEE_PEER_DELAYED; ++i)
+        if(xbee_peer.delayed[i].used && (xbee_peer.delayed[i].t <= sim_now()))
+        {
+            xbee_peer.delayed[i].used = 0;
+            xbee_peer_queue(xbee_peer.delayed[i].wire, xbee_peer.delayed[i].len);
+        }
+}
+
+
+// xbee_peer_send() - send the uC a frame of type <type> carrying the <len> bytes at <data>, after
+// a delay of <delay> ps.
+//
+static void xbee_peer_send(const uint8_t type, const uint8_t * const data, const uint16_t len,
+                           const uint64_t delay)
+{
+    uint8_t wire[XBEE_PEER_WIRE_MAX], cksum = type;
+    uint16_t i;
+    unsigned slot;
+
+    if(len + 1 > XBEE_PEER_DATA_MAX)
+        sim_fail("XBee frame too long: %u bytes", len + 1);
+
+    wire[0] = XBEE_FRAME_DELIMITER;
+    wire[1] = (len + 1) >> 8;
+    wire[2] = (len + 1) & 0xff;
+    wire[3] = type;
+    for(i = 0; i < len; ++i)
+        cksum += wire[4 + i] = data[i];
+    wire[4 + len] = 0xff - cksum;
+
+    ++xbee_peer.st.frames_tx;
+
+    if(!delay)
+    {
+        xbee_peer_queue(wire, len + XBEE_FRAME_OVERHEAD + 1);
+        return;
+    }
+
+    for(slot = 0; slot < XBEE_PEER_DELAYED; ++slot)
+        if(!xbee_peer.delayed[slot].used)
+            break;
+
+    if(slot == XBEE_PEER_DELAYED)
+        sim_fail("too many XBee frames awaiting their response delay");
+
+    xbee_peer.delayed[slot].used = 1;
+    xbee_peer.delayed[slot].t = sim_now() + delay;
+    xbee_peer.delayed[slot].len = len + XBEE_FRAME_OVERHEAD + 1;
+    memcpy(xbee_peer.delayed[slot].wire, wire, xbee_peer.delayed[slot].len);
+    sim_at(xbee_peer.delayed[slot].t, xbee_peer_release);
+}
+
+
+// xbee_peer_power() - timer function which brings the module's power state into line with
+// SLEEP_RQ, following a change of the pin or of the sleep configuration.
+//
+static void xbee_peer_power()
+{
+    const uint8_t awake = xbee_peer.booted &&
+        !(xbee_peer_pin_sleep() && sim_pin_level(XBEE_PEER_PORTB, XBEE_PEER_SLEEP_RQ));
+
+    if(awake != xbee_peer.awake)
+    {
+        xbee_peer.awake = awake;
+        xbee_peer_pins();
+    }
+}
+
+
+// xbee_peer_boot() - timer function which completes the boot following power-on or the release of
+// nRESET: the parameters are loaded from non-volatile memory, and a modem-status frame reports
+// the reset.
+//
+static void xbee_peer_boot()
+{
+    const uint8_t status = XBeeModemStatusHardwareReset;
+
+    if(xbee_peer.in_reset || xbee_peer.booted || (sim_now() < xbee_peer.boot_t))
+        return;                             // Superseded by a later reset
+
+    memcpy(xbee_peer.active, xbee_peer.nv, sizeof(xbee_peer.active));
+    xbee_peer.queued_mask = 0;
+    xbee_peer.booted = 1;
+    xbee_peer.awake = 0;
+    ++xbee_peer.st.resets;
+
+    xbee_peer_power();
+    xbee_peer_send(XBeeFrameModemStatus, &status, 1, 0);
+}
+
+
+// xbee_peer_nreset_changed() - pin watch function for nRESET.
+//
+static void xbee_peer_nreset_changed(const uint8_t level)
+{
+    if(!level)
+    {
+        xbee_peer.in_reset = 1;
+        xbee_peer.booted = xbee_peer.awake = xbee_peer.spi_mode = 0;
+        xbee_peer.out_len = 0;
+        xbee_peer.rx_state = XBeePeerRxIdle;
+        memset(xbee_peer.delayed, 0, sizeof(xbee_peer.delayed));
+        xbee_peer_pins();
+    }
+    else if(xbee_peer.in_reset)
+    {
+        xbee_peer.in_reset = 0;
+        xbee_peer.boot_t = sim_now() + SIM_MS(XBEE_PEER_BOOT_MS);
+        sim_at(xbee_peer.boot_t, xbee_peer_boot);
+    }
+}
+
+
+// xbee_peer_sleep_rq_changed() - pin watch function for SLEEP_RQ.
+//
+static void xbee_peer_sleep_rq_changed(const uint8_t level)
+{
+    sim_at(sim_now() + SIM_US(XBEE_PEER_WAKE_US), xbee_peer_power);
+}
+
+
+// xbee_peer_nss_changed() - pin watch function for SPI_nSSEL.  The module switches its API
+// interface to SPI when first selected.
+//
+static void xbee_peer_nss_changed(const uint8_t level)
+{
+    if(!level && xbee_peer.booted && xbee_peer.awake && !xbee_peer.spi_mode)
+    {
+        xbee_peer.spi_mode = 1;
+        xbee_peer_pins();
+    }
+}
+
+
+// xbee_peer_apply() - apply the queued parameter values.
+//
+static void xbee_peer_apply()
+{
+    uint8_t i;
+
+    for(i = 0; i < XBEE_PEER_PARAMS; ++i)
+        if(xbee_peer.queued_mask & (1 << i))
+            xbee_peer.active[i] = xbee_peer.queued[i];
+
+    xbee_peer.queued_mask = 0;
+    xbee_peer_pins();
+    sim_at(sim_now() + SIM_US(XBEE_PEER_WAKE_US), xbee_peer_power);
+}
+
+
+// xbee_peer_at() - execute the AT command frame (type 0x08) or queued-parameter frame (type 0x09)
+// held in <rx>.  A command frame first applies any queued values.
+//
+static void xbee_peer_at()
+{
+    const uint8_t queue = xbee_peer.rx[0] == XBeeFrameATCommandQueueParamVal,
+                  param_len = xbee_peer.rx_len - 4, * const param = xbee_peer.rx + 4;
+    const uint16_t cmd = xbee_peer.rx[2] | (xbee_peer.rx[3] << 8);
+    const int8_t i = xbee_peer_param_index(cmd);
+    uint8_t resp[5] = {xbee_peer.rx[1], xbee_peer.rx[2], xbee_peer.rx[3], XBeeATCmdOK, 0},
+            resp_len = 4;
+
+    ++xbee_peer.st.at_cmds;
+
+    if(!queue)
+        xbee_peer_apply();
+
+    if(i >= 0)
+    {
+        if(!param_len)
+        {
+            resp[4] = xbee_peer.active[i];
+            resp_len = 5;
+        }
+        else if(param_len != 1)
+            resp[3] = XBeeATCmdInvalidParam;
+        else if(queue)
+        {
+            xbee_peer.queued[i] = param[0];
+            xbee_peer.queued_mask |= 1 << i;
+        }
+        else
+        {
+            xbee_peer.queued[i] = param[0];
+            xbee_peer.queued_mask = 1 << i;
+            xbee_peer_apply();
+        }
+    }
+    else if((cmd == XBeeATCmdATWR) && !queue)
+    {
+        memcpy(xbee_peer.nv, xbee_peer.active, sizeof(xbee_peer.nv));
+        ++xbee_peer.st.nv_writes;
+    }
+    else if(cmd != XBeeATCmdATAC)
+        resp[3] = XBeeATCmdInvalidCmd;
+
+    if(resp[0])
+        xbee_peer_send(XBeeFrameATCommandResponse, resp, resp_len, SIM_US(XBEE_PEER_AT_US));
+}
+
+
+// xbee_peer_tx_request() - handle the transmit request frame (type 0x10) held in <rx>: record its
+// data and, if it has a frame ID, answer with a transmit-status frame as scripted.
+//
+static void xbee_peer_tx_request()
+{
+    const uint8_t hdr = XBEE_PEER_TXRQ_HDR;
+    uint8_t status[6] = {xbee_peer.rx[1], 0x00, 0x00, 0, xbee_peer.tx_delivery, 0};
+
+    ++xbee_peer.st.tx_requests;
+    xbee_peer.last_tx_len = xbee_peer.rx_len - hdr;
+    memcpy(xbee_peer.last_tx, xbee_peer.rx + hdr, xbee_peer.last_tx_len);
+
+    if(status[0] && (xbee_peer.tx_status_ms >= 0))
+        xbee_peer_send(XBeeFrameZigbeeTransmitStatus, status, sizeof(status),
+                       SIM_MS(xbee_peer.tx_status_ms));
+}
+
+
+// xbee_peer_rx() - run the frame receiver on <data>, a byte received from the uC.
+//
+static void xbee_peer_rx(const uint8_t data)
+{
+    switch(xbee_peer.rx_state)
+    {
+        case XBeePeerRxIdle:
+            if(data == XBEE_FRAME_DELIMITER)
+                xbee_peer.rx_state = XBeePeerRxLen1;
+            break;
+
+        case XBeePeerRxLen1:
+            xbee_peer.rx_len = data << 8;
+            xbee_peer.rx_state = XBeePeerRxLen2;
+            break;
+
+        case XBeePeerRxLen2:
+            xbee_peer.rx_len |= data;
+            xbee_peer.rx_pos = xbee_peer.rx_cksum = 0;
+            xbee_peer.rx_state = XBeePeerRxData;
+            if(!xbee_peer.rx_len || (xbee_peer.rx_len > XBEE_PEER_DATA_MAX))
+            {
+                ++xbee_peer.st.bad_frames;
+                xbee_peer.rx_state = XBeePeerRxIdle;
+            }
+            break;
+
+        case XBeePeerRxData:
+            xbee_peer.rx[xbee_peer.rx_pos++] = data;
+            xbee_peer.rx_cksum += data;
+            if(xbee_peer.rx_pos == xbee_peer.rx_len)
+                xbee_peer.rx_state = XBeePeerRxCksum;
+            break;
+
+        case XBeePeerRxCksum:
+            xbee_peer.rx_state = XBeePeerRxIdle;
+            if((uint8_t) (0xff - xbee_peer.rx_cksum) != data)
+            {
+                ++xbee_peer.st.bad_frames;
+                break;
+            }
+
+            ++xbee_peer.st.frames_rx;
+            if(((xbee_peer.rx[0] == XBeeFrameATCommand) ||
+                (xbee_peer.rx[0] == XBeeFrameATCommandQueueParamVal)) && (xbee_peer.rx_len >= 4))
+                xbee_peer_at();
+            else if((xbee_peer.rx[0] == XBeeFrameZigbeeTXRequest) &&
+                    (xbee_peer.rx_len >= XBEE_PEER_TXRQ_HDR))
+                xbee_peer_tx_request();
+            break;
+    }
+}
+
+
+// xbee_peer_spi() - SPI peer function: exchange <mosi> for the next byte in the output queue, or
+// 0xff if the queue is empty.  A module which is asleep, or in reset, neither sends nor receives.
+//
+static uint8_t xbee_peer_spi(const uint8_t mosi)
+{
+    uint8_t miso = 0xff;
+
+    if(!xbee_peer.booted || !xbee_peer.awake)
+    {
+        ++xbee_peer.st.bytes_asleep;
+        return 0xff;
+    }
+
+    if(xbee_peer.out_len)
+    {
+        miso = xbee_peer.out[xbee_peer.out_head];
+        xbee_peer.out_head = (xbee_peer.out_head + 1) % XBEE_PEER_OUT_LEN;
+        --xbee_peer.out_len;
+    }
+
+    xbee_peer_rx(mosi);
+    xbee_peer_pins();
+
+    return miso;
+}
+
+
+// xbee_peer_init() - attach the module, with factory settings, to the simulated uC, and power it
+// on.  Must be called after sim_init().
+//
+void xbee_peer_init()
+{
+    uint8_t i;
+
+    memset(&xbee_peer, 0, sizeof(xbee_peer));
+    for(i = 0; i < XBEE_PEER_PARAMS; ++i)
+        xbee_peer.nv[i] = xbee_peer_params[i].factory;
+
+    sim_spi_set_peer(xbee_peer_spi);
+    sim_pin_pull(XBEE_PEER_PORTB, XBEE_PEER_nRESET, 1);
+    sim_pin_watch(XBEE_PEER_PORTB, XBEE_PEER_nRESET, xbee_peer_nreset_changed);
+    sim_pin_watch(XBEE_PEER_PORTB, XBEE_PEER_SLEEP_RQ, xbee_peer_sleep_rq_changed);
+    sim_pin_watch(XBEE_PEER_PORTC, XBEE_PEER_SPI_nSS, xbee_peer_nss_changed);
+
+    // Power-on behaves as the release of nRESET
+    xbee_peer.in_reset = 1;
+    xbee_peer_pins();
+    xbee_peer_nreset_changed(1);
+}
+
+
+// xbee_peer_factory_reset() - restore the factory settings to non-volatile memory.  They take
+// effect at the next reset.
+//
+void xbee_peer_factory_reset()
+{
+    uint8_t i;
+
+    for(i = 0; i < XBEE_PEER_PARAMS; ++i)
+        xbee_peer.nv[i] = xbee_peer_params[i].factory;
+}
+
+
+// xbee_peer_set_tx_status() - set the delay, in ms, after which transmit requests are answered,
+// and the delivery status reported.  A negative <delay_ms> suppresses the answers.
+//
+void xbee_peer_set_tx_status(const int32_t delay_ms, const uint8_t delivery_status)
+{
+    xbee_peer.tx_status_ms = delay_ms;
+    xbee_peer.tx_delivery = delivery_status;
+}
+
+
+// xbee_peer_inject_frame() - send the uC a frame of type <frame_type>, carrying the <len> bytes at
+// <data>, as if it had arrived over the air.
+//
+void xbee_peer_inject_frame(const uint8_t frame_type, const uint8_t * const data,
+                            const uint16_t len)
+{
+    xbee_peer_send(frame_type, data, len, 0);
+}
+
+
+// xbee_peer_inject_raw() - append the <len> bytes at <data> to the output queue, e.g. to send the
+// uC a malformed frame.
+//
+void xbee_peer_inject_raw(const uint8_t * const data, const uint16_t len)
+{
+    xbee_peer_queue(data, len);
+}
+
+
+// xbee_peer_param() - return the value in effect of the parameter set by AT command <cmd>.
+//
+uint8_t xbee_peer_param(const uint16_t cmd)
+{
+    const int8_t i = xbee_peer_param_index(cmd);
+
+    if(i < 0)
+        sim_fail("XBee parameter %c%c is not modelled", cmd & 0xff, cmd >> 8);
+
+    return xbee_peer.active[i];
+}
+
+
+// xbee_peer_awake() - return non-zero if the module is awake.
+//
+uint8_t xbee_peer_awake()
+{
+    return xbee_peer.booted && xbee_peer.awake;
+}
+
+
+// xbee_peer_last_tx() - return the data carried by the last transmit request, writing its length
+// to <*len>.
+//
+const uint8_t *xbee_peer_last_tx(uint16_t * const len)
+{
+    *len = xbee_peer.last_tx_len;
+    return xbee_peer.last_tx;
+}
+
+
+// xbee_peer_stats() - return the model's counters.
+//
+const XBeePeerStats_t *xbee_peer_stats()
+{
+    return &xbee_peer.st;
+}
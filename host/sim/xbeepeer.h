@@ -0,0 +1,52 @@
+#ifndef HOST_SIM_XBEEPEER_H_INC
+#define HOST_SIM_XBEEPEER_H_INC
+/*
+    xbeepeer.h - declarations relating to the host simulator's model of an XBee Zigbee module,
+    attached to the simulated uC's SPI bus and XBee control pins as described in platform.h.
+
+    The model speaks the API-mode frame protocol.  It answers AT command frames (0x08) and queued
+    parameter frames (0x09) for the parameters the firmware configures (D8, D9, SM), plus AC and
+    WR; other AT commands are answered with "invalid command".  Transmit requests (0x10) are
+    answered with a transmit-status frame after a scriptable delay.  Frames for the uC are held in
+    an output queue, which the module announces by asserting SPI_nATTN once the uC has selected it
+    on the SPI bus; a test script may append frames, or raw bytes, to the queue.  The module
+    honours nRESET, and pin sleep (SM = 1) through SLEEP_RQ and ON/nSLEEP.
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include <stdint.h>
+
+
+#define XBEE_PEER_BOOT_MS       (20)    // Time from release of nRESET to the modem-status frame
+#define XBEE_PEER_AT_US         (1000)  // Time taken to answer an AT command frame
+#define XBEE_PEER_WAKE_US       (2000)  // Time taken to wake, or to fall asleep, on request
+
+
+// XBeePeerStats_t - counters maintained by the model.  They are reset by xbee_peer_init().
+//
+typedef struct XBeePeerStats
+{
+    uint32_t    frames_rx;              // Valid frames received from the uC
+    uint32_t    frames_tx;              // Frames queued for the uC (including injected frames)
+    uint32_t    bad_frames;             // Frames received with a bad length or checksum
+    uint32_t    at_cmds;                // AT command and queued-parameter frames received
+    uint32_t    nv_writes;              // WR commands executed
+    uint32_t    resets;                 // Boots following power-on or nRESET
+    uint32_t    tx_requests;            // Transmit-request frames received
+    uint32_t    bytes_asleep;           // SPI bytes clocked while the module was asleep
+} XBeePeerStats_t;
+
+
+void xbee_peer_init();
+void xbee_peer_factory_reset();
+void xbee_peer_set_tx_status(const int32_t delay_ms, const uint8_t delivery_status);
+void xbee_peer_inject_frame(const uint8_t frame_type, const uint8_t * const data,
+                            const uint16_t len);
+void xbee_peer_inject_raw(const uint8_t * const data, const uint16_t len);
+uint8_t xbee_peer_param(const uint16_t cmd);
+uint8_t xbee_peer_awake();
+const uint8_t *xbee_peer_last_tx(uint16_t * const len);
+const XBeePeerStats_t *xbee_peer_stats();
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef HOST_STUB_AVR_EEPROM_H_INC
+#define HOST_STUB_AVR_EEPROM_H_INC
+/*
+    eeprom.h - host build stand-in for avr-libc's <avr/eeprom.h>.  EEMEM variables are placed in
+    their own section, which the host simulator (see ../sim/sim.h) erases to 0xff at start-up, as
+    on a new uC, and which it reads and writes on behalf of the access functions.  A test which
+    does not link the simulator may instead supply the functions itself, so that it can observe and
+    corrupt the EEPROM contents.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define EEMEM                   __attribute__((section("host_eeprom")))
+
+uint8_t eeprom_read_byte(const uint8_t *addr);
+uint16_t eeprom_read_word(const uint16_t *addr);
+void eeprom_read_block(void *dst, const void *src, size_t n);
+void eeprom_update_byte(uint8_t *addr, uint8_t value);
+void eeprom_update_word(uint16_t *addr, uint16_t value);
+void eeprom_update_block(const void *src, void *dst, size_t n);
+
+#endif
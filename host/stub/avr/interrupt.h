@@ -0,0 +1,20 @@
+#ifndef HOST_STUB_AVR_INTERRUPT_H_INC
+#define HOST_STUB_AVR_INTERRUPT_H_INC
+/*
+    interrupt.h - host build stand-in for avr-libc's <avr/interrupt.h>.  ISR() defines an ordinary
+    function named after the vector, which the host simulator (see ../sim/sim.h) calls when the
+    interrupt is taken.  cli() and sei() clear and set the I flag in the simulated SREG; as on the
+    uC, a pending interrupt is not taken until after the instruction following sei().
+*/
+
+#include <avr/io.h>
+
+
+#define ISR(vector, ...)        void vector(void); void vector(void)
+
+#define cli()                   host_set_i(0)
+#define sei()                   host_set_i(1)
+
+void host_set_i(const uint8_t enable);
+
+#endif
@@ -0,0 +1,609 @@
+#ifndef HOST_STUB_AVR_IO_H_INC
+#define HOST_STUB_AVR_IO_H_INC
+/*
+    io.h - host build stand-in for avr-libc's <avr/io.h>.  Declares the ATtiny816 registers, bit
+    masks, group-configuration values and interrupt vectors used by the firmware; the addresses
+    and values are those of iotn816.h.
+
+    Each register is an lvalue in a block of host memory at HOST_IO_BASE, laid out exactly as the
+    uC's data space.  The host simulator (see ../sim/sim.h) keeps that block inaccessible, so that
+    every access made by the firmware traps into the simulator, which counts it and applies the
+    register's hardware semantics.  The firmware is therefore compiled unmodified.
+*/
+
+#include <stdint.h>
+
+
+// Base address, in the host's address space, of the simulated uC data space
+#define HOST_IO_BASE            (0x20000000UL)
+#define HOST_IO_LEN             (0x2000)        // Extent of the simulated I/O space, in bytes
+
+#define _SFR_MEM8(addr)         (*(volatile uint8_t *) (HOST_IO_BASE + (addr)))
+#define _SFR_MEM16(addr)        (*(volatile uint16_t *) (HOST_IO_BASE + (addr)))
+#define _SFR_IO_ADDR(sfr)       ((uintptr_t) &(sfr) - HOST_IO_BASE)
+#define _BV(bit)                (1 << (bit))
+
+
+//
+// Interrupt vectors.  ISR() (see <avr/interrupt.h>) defines each handler as an ordinary function
+// named after its vector, which the simulator calls when the interrupt is taken.
+//
+#define PORTA_PORT_vect         __vector_3
+#define PORTB_PORT_vect         __vector_4
+#define PORTC_PORT_vect         __vector_5
+#define RTC_CNT_vect            __vector_6
+#define RTC_PIT_vect            __vector_7
+#define TCB0_INT_vect           __vector_13
+#define ADC0_RESRDY_vect        __vector_17
+#define TWI0_TWIM_vect          __vector_20
+#define SPI0_INT_vect           __vector_21
+#define USART0_RXC_vect         __vector_22
+#define USART0_DRE_vect         __vector_23
+#define USART0_TXC_vect         __vector_24
+
+#define _VECTORS_SIZE_COUNT     (26)
+
+
+//
+// Registers
+//
+
+// VPORTA, VPORTB, VPORTC - virtual ports
+#define VPORTA_DIR              _SFR_MEM8(0x0000)
+#define VPORTA_OUT              _SFR_MEM8(0x0001)
+#define VPORTA_IN               _SFR_MEM8(0x0002)
+#define VPORTA_INTFLAGS         _SFR_MEM8(0x0003)
+#define VPORTB_DIR              _SFR_MEM8(0x0004)
+#define VPORTB_OUT              _SFR_MEM8(0x0005)
+#define VPORTB_IN               _SFR_MEM8(0x0006)
+#define VPORTB_INTFLAGS         _SFR_MEM8(0x0007)
+#define VPORTC_DIR              _SFR_MEM8(0x0008)
+#define VPORTC_OUT              _SFR_MEM8(0x0009)
+#define VPORTC_IN               _SFR_MEM8(0x000A)
+#define VPORTC_INTFLAGS         _SFR_MEM8(0x000B)
+
+// CPU
+#define CPU_CCP                 _SFR_MEM8(0x0034)
+#define CPU_SPL                 _SFR_MEM8(0x003D)
+#define CPU_SPH                 _SFR_MEM8(0x003E)
+#define CPU_SREG                _SFR_MEM8(0x003F)
+#define SREG                    CPU_SREG
+
+// RSTCTRL, SLPCTRL
+#define RSTCTRL_RSTFR           _SFR_MEM8(0x0040)
+#define SLPCTRL_CTRLA           _SFR_MEM8(0x0050)
+
+// CLKCTRL
+#define CLKCTRL_MCLKCTRLA       _SFR_MEM8(0x0060)
+#define CLKCTRL_MCLKCTRLB       _SFR_MEM8(0x0061)
+#define CLKCTRL_MCLKLOCK        _SFR_MEM8(0x0062)
+#define CLKCTRL_MCLKSTATUS      _SFR_MEM8(0x0063)
+
+// VREF
+#define VREF_CTRLA              _SFR_MEM8(0x00A0)
+#define VREF_CTRLB              _SFR_MEM8(0x00A1)
+
+// CPUINT
+#define CPUINT_CTRLA            _SFR_MEM8(0x0110)
+#define CPUINT_STATUS           _SFR_MEM8(0x0111)
+#define CPUINT_LVL0PRI          _SFR_MEM8(0x0112)
+#define CPUINT_LVL1VEC          _SFR_MEM8(0x0113)
+
+// RTC
+#define RTC_CTRLA               _SFR_MEM8(0x0140)
+#define RTC_STATUS              _SFR_MEM8(0x0141)
+#define RTC_INTCTRL             _SFR_MEM8(0x0142)
+#define RTC_INTFLAGS            _SFR_MEM8(0x0143)
+#define RTC_TEMP                _SFR_MEM8(0x0144)
+#define RTC_DBGCTRL             _SFR_MEM8(0x0145)
+#define RTC_CLKSEL              _SFR_MEM8(0x0147)
+#define RTC_CNT                 _SFR_MEM16(0x0148)
+#define RTC_PER                 _SFR_MEM16(0x014A)
+#define RTC_CMP                 _SFR_MEM16(0x014C)
+#define RTC_PITCTRLA            _SFR_MEM8(0x0150)
+#define RTC_PITSTATUS           _SFR_MEM8(0x0151)
+#define RTC_PITINTCTRL          _SFR_MEM8(0x0152)
+#define RTC_PITINTFLAGS         _SFR_MEM8(0x0153)
+
+// EVSYS
+#define EVSYS_ASYNCSTROBE       _SFR_MEM8(0x0180)
+#define EVSYS_SYNCSTROBE        _SFR_MEM8(0x0181)
+#define EVSYS_ASYNCCH0          _SFR_MEM8(0x0182)
+#define EVSYS_ASYNCCH1          _SFR_MEM8(0x0183)
+#define EVSYS_ASYNCCH2          _SFR_MEM8(0x0184)
+#define EVSYS_ASYNCCH3          _SFR_MEM8(0x0185)
+#define EVSYS_ASYNCUSER0        _SFR_MEM8(0x0192)
+#define EVSYS_ASYNCUSER1        _SFR_MEM8(0x0193)
+
+// PORTMUX
+#define PORTMUX_CTRLA           _SFR_MEM8(0x0200)
+#define PORTMUX_CTRLB           _SFR_MEM8(0x0201)
+#define PORTMUX_CTRLC           _SFR_MEM8(0x0202)
+#define PORTMUX_CTRLD           _SFR_MEM8(0x0203)
+
+// PORTA, PORTB, PORTC - I/O ports
+#define PORTA_DIR               _SFR_MEM8(0x0400)
+#define PORTA_DIRSET            _SFR_MEM8(0x0401)
+#define PORTA_DIRCLR            _SFR_MEM8(0x0402)
+#define PORTA_DIRTGL            _SFR_MEM8(0x0403)
+#define PORTA_OUT               _SFR_MEM8(0x0404)
+#define PORTA_OUTSET            _SFR_MEM8(0x0405)
+#define PORTA_OUTCLR            _SFR_MEM8(0x0406)
+#define PORTA_OUTTGL            _SFR_MEM8(0x0407)
+#define PORTA_IN                _SFR_MEM8(0x0408)
+#define PORTA_INTFLAGS          _SFR_MEM8(0x0409)
+#define PORTA_PIN0CTRL          _SFR_MEM8(0x0410)
+
+#define PORTB_DIR               _SFR_MEM8(0x0420)
+#define PORTB_DIRSET            _SFR_MEM8(0x0421)
+#define PORTB_DIRCLR            _SFR_MEM8(0x0422)
+#define PORTB_DIRTGL            _SFR_MEM8(0x0423)
+#define PORTB_OUT               _SFR_MEM8(0x0424)
+#define PORTB_OUTSET            _SFR_MEM8(0x0425)
+#define PORTB_OUTCLR            _SFR_MEM8(0x0426)
+#define PORTB_OUTTGL            _SFR_MEM8(0x0427)
+#define PORTB_IN                _SFR_MEM8(0x0428)
+#define PORTB_INTFLAGS          _SFR_MEM8(0x0429)
+#define PORTB_PIN0CTRL          _SFR_MEM8(0x0430)
+
+#define PORTC_DIR               _SFR_MEM8(0x0440)
+#define PORTC_DIRSET            _SFR_MEM8(0x0441)
+#define PORTC_DIRCLR            _SFR_MEM8(0x0442)
+#define PORTC_DIRTGL            _SFR_MEM8(0x0443)
+#define PORTC_OUT               _SFR_MEM8(0x0444)
+#define PORTC_OUTSET            _SFR_MEM8(0x0445)
+#define PORTC_OUTCLR            _SFR_MEM8(0x0446)
+#define PORTC_OUTTGL            _SFR_MEM8(0x0447)
+#define PORTC_IN                _SFR_MEM8(0x0448)
+#define PORTC_INTFLAGS          _SFR_MEM8(0x0449)
+#define PORTC_PIN0CTRL          _SFR_MEM8(0x0450)
+
+// ADC0
+#define ADC0_CTRLA              _SFR_MEM8(0x0600)
+#define ADC0_CTRLB              _SFR_MEM8(0x0601)
+#define ADC0_CTRLC              _SFR_MEM8(0x0602)
+#define ADC0_CTRLD              _SFR_MEM8(0x0603)
+#define ADC0_CTRLE              _SFR_MEM8(0x0604)
+#define ADC0_SAMPCTRL           _SFR_MEM8(0x0605)
+#define ADC0_MUXPOS             _SFR_MEM8(0x0606)
+#define ADC0_COMMAND            _SFR_MEM8(0x0608)
+#define ADC0_EVCTRL             _SFR_MEM8(0x0609)
+#define ADC0_INTCTRL            _SFR_MEM8(0x060A)
+#define ADC0_INTFLAGS           _SFR_MEM8(0x060B)
+#define ADC0_RES                _SFR_MEM16(0x0610)
+
+// USART0
+#define USART0_RXDATAL          _SFR_MEM8(0x0800)
+#define USART0_RXDATAH          _SFR_MEM8(0x0801)
+#define USART0_TXDATAL          _SFR_MEM8(0x0802)
+#define USART0_TXDATAH          _SFR_MEM8(0x0803)
+#define USART0_STATUS           _SFR_MEM8(0x0804)
+#define USART0_CTRLA            _SFR_MEM8(0x0805)
+#define USART0_CTRLB            _SFR_MEM8(0x0806)
+#define USART0_CTRLC            _SFR_MEM8(0x0807)
+#define USART0_BAUD             _SFR_MEM16(0x0808)
+
+// TWI0
+#define TWI0_CTRLA              _SFR_MEM8(0x0810)
+#define TWI0_MCTRLA             _SFR_MEM8(0x0813)
+#define TWI0_MCTRLB             _SFR_MEM8(0x0814)
+#define TWI0_MSTATUS            _SFR_MEM8(0x0815)
+#define TWI0_MBAUD              _SFR_MEM8(0x0816)
+#define TWI0_MADDR              _SFR_MEM8(0x0817)
+#define TWI0_MDATA              _SFR_MEM8(0x0818)
+
+// SPI0
+#define SPI0_CTRLA              _SFR_MEM8(0x0820)
+#define SPI0_CTRLB              _SFR_MEM8(0x0821)
+#define SPI0_INTCTRL            _SFR_MEM8(0x0822)
+#define SPI0_INTFLAGS           _SFR_MEM8(0x0823)
+#define SPI0_DATA               _SFR_MEM8(0x0824)
+
+// TCB0
+#define TCB0_CTRLA              _SFR_MEM8(0x0A40)
+#define TCB0_CTRLB              _SFR_MEM8(0x0A41)
+#define TCB0_EVCTRL             _SFR_MEM8(0x0A44)
+#define TCB0_INTCTRL            _SFR_MEM8(0x0A45)
+#define TCB0_INTFLAGS           _SFR_MEM8(0x0A46)
+#define TCB0_STATUS             _SFR_MEM8(0x0A47)
+#define TCB0_CNT                _SFR_MEM16(0x0A4A)
+#define TCB0_CCMP               _SFR_MEM16(0x0A4C)
+
+// FUSE
+#define FUSE_WDTCFG             _SFR_MEM8(0x1280)
+#define FUSE_BODCFG             _SFR_MEM8(0x1281)
+#define FUSE_OSCCFG             _SFR_MEM8(0x1282)
+#define FUSE_SYSCFG0            _SFR_MEM8(0x1285)
+#define FUSE_SYSCFG1            _SFR_MEM8(0x1286)
+
+
+//
+// Bit masks, bit positions and group configurations
+//
+
+// CPU, CPUINT
+#define CPU_I_bm                (0x80)
+#define CPUINT_LVL0EX_bm        (0x01)
+#define CPUINT_LVL1EX_bm        (0x02)
+
+// CCP - configuration change protection signatures
+typedef enum CCP_enum
+{
+    CCP_SPM_gc = (0x9D << 0),
+    CCP_IOREG_gc = (0xD8 << 0)
+} CCP_t;
+
+// SLPCTRL
+#define SLPCTRL_SEN_bm          (0x01)
+#define SLPCTRL_SMODE_gm        (0x06)
+
+typedef enum SLPCTRL_SMODE_enum
+{
+    SLPCTRL_SMODE_IDLE_gc = (0x00 << 1),
+    SLPCTRL_SMODE_STDBY_gc = (0x01 << 1),
+    SLPCTRL_SMODE_PDOWN_gc = (0x02 << 1)
+} SLPCTRL_SMODE_t;
+
+// CLKCTRL
+#define CLKCTRL_CLKSEL_gm       (0x03)
+#define CLKCTRL_CLKOUT_bm       (0x80)
+#define CLKCTRL_PEN_bm          (0x01)
+#define CLKCTRL_PDIV_gm         (0x1E)
+#define CLKCTRL_PDIV_gp         (1)
+#define CLKCTRL_PDIV0_bm        (0x02)
+#define CLKCTRL_PDIV0_bp        (1)
+
+// CLKCTRL_CLKSEL - clock select
+typedef enum CLKCTRL_CLKSEL_enum
+{
+    CLKCTRL_CLKSEL_OSC20M_gc = (0x00 << 0),
+    CLKCTRL_CLKSEL_OSCULP32K_gc = (0x01 << 0),
+    CLKCTRL_CLKSEL_XOSC32K_gc = (0x02 << 0),
+    CLKCTRL_CLKSEL_EXTCLK_gc = (0x03 << 0)
+} CLKCTRL_CLKSEL_t;
+
+// CLKCTRL_PDIV - peripheral clock prescaler division select
+typedef enum CLKCTRL_PDIV_enum
+{
+    CLKCTRL_PDIV_2X_gc = (0x00 << 1),
+    CLKCTRL_PDIV_4X_gc = (0x01 << 1),
+    CLKCTRL_PDIV_8X_gc = (0x02 << 1),
+    CLKCTRL_PDIV_16X_gc = (0x03 << 1),
+    CLKCTRL_PDIV_32X_gc = (0x04 << 1),
+    CLKCTRL_PDIV_64X_gc = (0x05 << 1),
+    CLKCTRL_PDIV_6X_gc = (0x08 << 1),
+    CLKCTRL_PDIV_10X_gc = (0x09 << 1),
+    CLKCTRL_PDIV_12X_gc = (0x0A << 1),
+    CLKCTRL_PDIV_24X_gc = (0x0B << 1),
+    CLKCTRL_PDIV_48X_gc = (0x0C << 1)
+} CLKCTRL_PDIV_t;
+
+// FUSE
+#define FUSE_FREQSEL_gm         (0x03)
+
+// FREQSEL - frequency select
+typedef enum FREQSEL_enum
+{
+    FREQSEL_16MHZ_gc = (0x01 << 0),
+    FREQSEL_20MHZ_gc = (0x02 << 0)
+} FREQSEL_t;
+
+// VREF
+#define VREF_DAC0REFSEL_gm      (0x07)
+#define VREF_DAC0REFSEL_gp      (0)
+#define VREF_ADC0REFSEL_gm      (0x70)
+#define VREF_ADC0REFSEL_gp      (4)
+#define VREF_DAC0REFEN_bm       (0x01)
+#define VREF_ADC0REFEN_bm       (0x02)
+
+// RTC
+#define RTC_RTCEN_bm            (0x01)
+#define RTC_PRESCALER_gm        (0x78)
+#define RTC_RUNSTDBY_bm         (0x80)
+#define RTC_CTRLABUSY_bm        (0x01)
+#define RTC_CNTBUSY_bm          (0x02)
+#define RTC_PERBUSY_bm          (0x04)
+#define RTC_CMPBUSY_bm          (0x08)
+#define RTC_OVF_bm              (0x01)
+#define RTC_CMP_bm              (0x02)
+#define RTC_CLKSEL_gm           (0x03)
+#define RTC_PITEN_bm            (0x01)
+#define RTC_PERIOD_gm           (0x78)
+#define RTC_CTRLBUSY_bm         (0x01)
+#define RTC_PI_bm               (0x01)
+
+// RTC_PRESCALER - RTC prescaling factor select
+typedef enum RTC_PRESCALER_enum
+{
+    RTC_PRESCALER_DIV1_gc = (0x00 << 3),
+    RTC_PRESCALER_DIV2_gc = (0x01 << 3),
+    RTC_PRESCALER_DIV4_gc = (0x02 << 3),
+    RTC_PRESCALER_DIV8_gc = (0x03 << 3),
+    RTC_PRESCALER_DIV16_gc = (0x04 << 3),
+    RTC_PRESCALER_DIV32_gc = (0x05 << 3),
+    RTC_PRESCALER_DIV64_gc = (0x06 << 3),
+    RTC_PRESCALER_DIV128_gc = (0x07 << 3),
+    RTC_PRESCALER_DIV256_gc = (0x08 << 3),
+    RTC_PRESCALER_DIV512_gc = (0x09 << 3),
+    RTC_PRESCALER_DIV1024_gc = (0x0A << 3),
+    RTC_PRESCALER_DIV2048_gc = (0x0B << 3),
+    RTC_PRESCALER_DIV4096_gc = (0x0C << 3),
+    RTC_PRESCALER_DIV8192_gc = (0x0D << 3),
+    RTC_PRESCALER_DIV16384_gc = (0x0E << 3),
+    RTC_PRESCALER_DIV32768_gc = (0x0F << 3)
+} RTC_PRESCALER_t;
+
+// RTC_PERIOD - RTC periodic interrupt timer period select
+typedef enum RTC_PERIOD_enum
+{
+    RTC_PERIOD_OFF_gc = (0x00 << 3),
+    RTC_PERIOD_CYC4_gc = (0x01 << 3),
+    RTC_PERIOD_CYC8_gc = (0x02 << 3),
+    RTC_PERIOD_CYC16_gc = (0x03 << 3),
+    RTC_PERIOD_CYC32_gc = (0x04 << 3),
+    RTC_PERIOD_CYC64_gc = (0x05 << 3),
+    RTC_PERIOD_CYC128_gc = (0x06 << 3),
+    RTC_PERIOD_CYC256_gc = (0x07 << 3),
+    RTC_PERIOD_CYC512_gc = (0x08 << 3),
+    RTC_PERIOD_CYC1024_gc = (0x09 << 3),
+    RTC_PERIOD_CYC2048_gc = (0x0A << 3),
+    RTC_PERIOD_CYC4096_gc = (0x0B << 3),
+    RTC_PERIOD_CYC8192_gc = (0x0C << 3),
+    RTC_PERIOD_CYC16384_gc = (0x0D << 3),
+    RTC_PERIOD_CYC32768_gc = (0x0E << 3)
+} RTC_PERIOD_t;
+
+// RTC_CLKSEL - RTC clock source select
+typedef enum RTC_CLKSEL_enum
+{
+    RTC_CLKSEL_INT32K_gc = (0x00 << 0),
+    RTC_CLKSEL_INT1K_gc = (0x01 << 0),
+    RTC_CLKSEL_TOSC32K_gc = (0x02 << 0),
+    RTC_CLKSEL_EXTCLK_gc = (0x03 << 0)
+} RTC_CLKSEL_t;
+
+// EVSYS_ASYNCCH0 - asynchronous channel 0 generator select (subset)
+typedef enum EVSYS_ASYNCCH0_enum
+{
+    EVSYS_ASYNCCH0_OFF_gc = (0x00 << 0),
+    EVSYS_ASYNCCH0_RTC_OVF_gc = (0x08 << 0),
+    EVSYS_ASYNCCH0_RTC_CMP_gc = (0x09 << 0)
+} EVSYS_ASYNCCH0_t;
+
+// EVSYS_ASYNCUSER1 - asynchronous user 1 (ADC0) channel select (subset)
+typedef enum EVSYS_ASYNCUSER1_enum
+{
+    EVSYS_ASYNCUSER1_OFF_gc = (0x00 << 0),
+    EVSYS_ASYNCUSER1_ASYNCCH0_gc = (0x03 << 0)
+} EVSYS_ASYNCUSER1_t;
+
+// PORTMUX_CTRLB - alternate pin-set selects
+typedef enum PORTMUX_USART0_enum
+{
+    PORTMUX_USART0_DEFAULT_gc = (0x00 << 0),
+    PORTMUX_USART0_ALTERNATE_gc = (0x01 << 0)
+} PORTMUX_USART0_t;
+
+typedef enum PORTMUX_SPI0_enum
+{
+    PORTMUX_SPI0_DEFAULT_gc = (0x00 << 2),
+    PORTMUX_SPI0_ALTERNATE_gc = (0x01 << 2)
+} PORTMUX_SPI0_t;
+
+typedef enum PORTMUX_TWI0_enum
+{
+    PORTMUX_TWI0_DEFAULT_gc = (0x00 << 4),
+    PORTMUX_TWI0_ALTERNATE_gc = (0x01 << 4)
+} PORTMUX_TWI0_t;
+
+// PORT
+#define PORT_ISC_gm             (0x07)
+#define PORT_PULLUPEN_bm        (0x08)
+#define PORT_INVEN_bm           (0x80)
+
+// PORT_ISC - input/sense configuration
+typedef enum PORT_ISC_enum
+{
+    PORT_ISC_INTDISABLE_gc = (0x00 << 0),
+    PORT_ISC_BOTHEDGES_gc = (0x01 << 0),
+    PORT_ISC_RISING_gc = (0x02 << 0),
+    PORT_ISC_FALLING_gc = (0x03 << 0),
+    PORT_ISC_INPUT_DISABLE_gc = (0x04 << 0),
+    PORT_ISC_LEVEL_gc = (0x05 << 0)
+} PORT_ISC_t;
+
+// ADC
+#define ADC_ENABLE_bm           (0x01)
+#define ADC_ENABLE_bp           (0)
+#define ADC_FREERUN_bm          (0x02)
+#define ADC_RESSEL_bm           (0x04)
+#define ADC_RUNSTBY_bm          (0x80)
+#define ADC_SAMPNUM_gm          (0x07)
+#define ADC_PRESC_gm            (0x07)
+#define ADC_PRESC_gp            (0)
+#define ADC_REFSEL_gm           (0x30)
+#define ADC_REFSEL_gp           (4)
+#define ADC_SAMPCAP_bm          (0x40)
+#define ADC_SAMPDLY_gm          (0x0F)
+#define ADC_ASDV_bm             (0x10)
+#define ADC_INITDLY_gm          (0xE0)
+#define ADC_INITDLY_gp          (5)
+#define ADC_SAMPLEN_gm          (0x1F)
+#define ADC_MUXPOS_gm           (0x1F)
+#define ADC_STCONV_bm           (0x01)
+#define ADC_STARTEI_bm          (0x01)
+#define ADC_RESRDY_bm           (0x01)
+#define ADC_WCMP_bm             (0x02)
+
+// ADC_SAMPNUM - accumulation samples select
+typedef enum ADC_SAMPNUM_enum
+{
+    ADC_SAMPNUM_ACC1_gc = (0x00 << 0),
+    ADC_SAMPNUM_ACC2_gc = (0x01 << 0),
+    ADC_SAMPNUM_ACC4_gc = (0x02 << 0),
+    ADC_SAMPNUM_ACC8_gc = (0x03 << 0),
+    ADC_SAMPNUM_ACC16_gc = (0x04 << 0),
+    ADC_SAMPNUM_ACC32_gc = (0x05 << 0),
+    ADC_SAMPNUM_ACC64_gc = (0x06 << 0)
+} ADC_SAMPNUM_t;
+
+// ADC_PRESC - clock prescaler
+typedef enum ADC_PRESC_enum
+{
+    ADC_PRESC_DIV2_gc = (0x00 << 0),
+    ADC_PRESC_DIV4_gc = (0x01 << 0),
+    ADC_PRESC_DIV8_gc = (0x02 << 0),
+    ADC_PRESC_DIV16_gc = (0x03 << 0),
+    ADC_PRESC_DIV32_gc = (0x04 << 0),
+    ADC_PRESC_DIV64_gc = (0x05 << 0),
+    ADC_PRESC_DIV128_gc = (0x06 << 0),
+    ADC_PRESC_DIV256_gc = (0x07 << 0)
+} ADC_PRESC_t;
+
+// ADC_REFSEL - reference selection
+typedef enum ADC_REFSEL_enum
+{
+    ADC_REFSEL_INTREF_gc = (0x00 << 4),
+    ADC_REFSEL_VDDREF_gc = (0x01 << 4)
+} ADC_REFSEL_t;
+
+// ADC_INITDLY - initial delay selection
+typedef enum ADC_INITDLY_enum
+{
+    ADC_INITDLY_DLY0_gc = (0x00 << 5),
+    ADC_INITDLY_DLY16_gc = (0x01 << 5),
+    ADC_INITDLY_DLY32_gc = (0x02 << 5),
+    ADC_INITDLY_DLY64_gc = (0x03 << 5),
+    ADC_INITDLY_DLY128_gc = (0x04 << 5),
+    ADC_INITDLY_DLY256_gc = (0x05 << 5)
+} ADC_INITDLY_t;
+
+// ADC_MUXPOS - analog channel selection
+typedef enum ADC_MUXPOS_enum
+{
+    ADC_MUXPOS_AIN0_gc = (0x00 << 0),
+    ADC_MUXPOS_AIN1_gc = (0x01 << 0),
+    ADC_MUXPOS_AIN2_gc = (0x02 << 0),
+    ADC_MUXPOS_AIN3_gc = (0x03 << 0),
+    ADC_MUXPOS_AIN4_gc = (0x04 << 0),
+    ADC_MUXPOS_AIN5_gc = (0x05 << 0),
+    ADC_MUXPOS_AIN6_gc = (0x06 << 0),
+    ADC_MUXPOS_AIN7_gc = (0x07 << 0),
+    ADC_MUXPOS_AIN8_gc = (0x08 << 0),
+    ADC_MUXPOS_AIN9_gc = (0x09 << 0),
+    ADC_MUXPOS_AIN10_gc = (0x0A << 0),
+    ADC_MUXPOS_AIN11_gc = (0x0B << 0),
+    ADC_MUXPOS_DAC0_gc = (0x1C << 0),
+    ADC_MUXPOS_INTREF_gc = (0x1D << 0),
+    ADC_MUXPOS_TEMPSENSE_gc = (0x1E << 0),
+    ADC_MUXPOS_GND_gc = (0x1F << 0)
+} ADC_MUXPOS_t;
+
+// USART
+#define USART_RXCIE_bm          (0x80)
+#define USART_TXCIE_bm          (0x40)
+#define USART_DREIE_bm          (0x20)
+#define USART_RXCIF_bm          (0x80)
+#define USART_TXCIF_bm          (0x40)
+#define USART_DREIF_bm          (0x20)
+#define USART_RXEN_bm           (0x80)
+#define USART_TXEN_bm           (0x40)
+#define USART_RXMODE_gm         (0x06)
+
+// USART_RXMODE - receiver mode
+typedef enum USART_RXMODE_enum
+{
+    USART_RXMODE_NORMAL_gc = (0x00 << 1),
+    USART_RXMODE_CLK2X_gc = (0x01 << 1),
+    USART_RXMODE_GENAUTO_gc = (0x02 << 1),
+    USART_RXMODE_LINAUTO_gc = (0x03 << 1)
+} USART_RXMODE_t;
+
+// TWI
+#define TWI_ENABLE_bm           (0x01)
+#define TWI_SMEN_bm             (0x02)
+#define TWI_QCEN_bm             (0x10)
+#define TWI_WIEN_bm             (0x40)
+#define TWI_RIEN_bm             (0x80)
+#define TWI_MCMD_gm             (0x03)
+#define TWI_ACKACT_bm           (0x04)
+#define TWI_FLUSH_bm            (0x08)
+#define TWI_BUSSTATE_gm         (0x03)
+#define TWI_BUSERR_bm           (0x04)
+#define TWI_ARBLOST_bm          (0x08)
+#define TWI_RXACK_bm            (0x10)
+#define TWI_CLKHOLD_bm          (0x20)
+#define TWI_WIF_bm              (0x40)
+#define TWI_RIF_bm              (0x80)
+
+// TWI_MCMD - command
+typedef enum TWI_MCMD_enum
+{
+    TWI_MCMD_NOACT_gc = (0x00 << 0),
+    TWI_MCMD_REPSTART_gc = (0x01 << 0),
+    TWI_MCMD_RECVTRANS_gc = (0x02 << 0),
+    TWI_MCMD_STOP_gc = (0x03 << 0)
+} TWI_MCMD_t;
+
+// TWI_BUSSTATE - bus state
+typedef enum TWI_BUSSTATE_enum
+{
+    TWI_BUSSTATE_UNKNOWN_gc = (0x00 << 0),
+    TWI_BUSSTATE_IDLE_gc = (0x01 << 0),
+    TWI_BUSSTATE_OWNER_gc = (0x02 << 0),
+    TWI_BUSSTATE_BUSY_gc = (0x03 << 0)
+} TWI_BUSSTATE_t;
+
+// SPI
+#define SPI_ENABLE_bm           (0x01)
+#define SPI_PRESC_gm            (0x06)
+#define SPI_CLK2X_bm            (0x10)
+#define SPI_MASTER_bm           (0x20)
+#define SPI_DORD_bm             (0x40)
+#define SPI_MODE_gm             (0x03)
+#define SPI_SSD_bm              (0x04)
+#define SPI_BUFWR_bm            (0x40)
+#define SPI_BUFEN_bm            (0x80)
+#define SPI_IE_bm               (0x01)
+#define SPI_SSIE_bm             (0x10)
+#define SPI_DREIE_bm            (0x20)
+#define SPI_TXCIE_bm            (0x40)
+#define SPI_RXCIE_bm            (0x80)
+#define SPI_BUFOVF_bm           (0x01)
+#define SPI_SSIF_bm             (0x10)
+#define SPI_DREIF_bm            (0x20)
+#define SPI_TXCIF_bm            (0x40)
+#define SPI_RXCIF_bm            (0x80)
+
+// SPI_PRESC - prescaler
+typedef enum SPI_PRESC_enum
+{
+    SPI_PRESC_DIV4_gc = (0x00 << 1),
+    SPI_PRESC_DIV16_gc = (0x01 << 1),
+    SPI_PRESC_DIV64_gc = (0x02 << 1),
+    SPI_PRESC_DIV128_gc = (0x03 << 1)
+} SPI_PRESC_t;
+
+// TCB
+#define TCB_ENABLE_bm           (0x01)
+#define TCB_CLKSEL_gm           (0x06)
+#define TCB_CNTMODE_gm          (0x07)
+#define TCB_CAPT_bm             (0x01)
+
+// TCB_CLKSEL - clock select
+typedef enum TCB_CLKSEL_enum
+{
+    TCB_CLKSEL_CLKDIV1_gc = (0x00 << 1),
+    TCB_CLKSEL_CLKDIV2_gc = (0x01 << 1),
+    TCB_CLKSEL_CLKTCA_gc = (0x02 << 1)
+} TCB_CLKSEL_t;
+
+// TCB_CNTMODE - timer mode (subset)
+typedef enum TCB_CNTMODE_enum
+{
+    TCB_CNTMODE_INT_gc = (0x00 << 0),
+    TCB_CNTMODE_TIMEOUT_gc = (0x01 << 0),
+    TCB_CNTMODE_CAPT_gc = (0x02 << 0)
+} TCB_CNTMODE_t;
+
+#endif
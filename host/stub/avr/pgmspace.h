@@ -0,0 +1,22 @@
+#ifndef HOST_STUB_AVR_PGMSPACE_H_INC
+#define HOST_STUB_AVR_PGMSPACE_H_INC
+/*
+    pgmspace.h - host build stand-in for avr-libc's <avr/pgmspace.h>.  There is a single address
+    space on the host, so PROGMEM is empty and the pgm_read_*() macros are ordinary reads.
+    pgm_read_word() is used by the firmware to read tables of (16-bit, on the uC) pointers, so it
+    reads a whole host pointer when applied to one.
+*/
+
+#include <stdint.h>
+
+
+#define PROGMEM
+#define PSTR(s)                 (s)
+#define pgm_read_byte(addr)     (*(const uint8_t *) (addr))
+#define pgm_read_word(addr)     __builtin_choose_expr(sizeof(*(addr)) == sizeof(void *),       \
+                                                      (uintptr_t) *(addr),                     \
+                                                      *(const uint16_t *) (addr))
+#define pgm_read_dword(addr)    (*(const uint32_t *) (addr))
+#define pgm_read_ptr(addr)      (*(void * const *) (addr))
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef HOST_STUB_AVR_SLEEP_H_INC
+#define HOST_STUB_AVR_SLEEP_H_INC
+/*
+    sleep.h - host build stand-in for avr-libc's <avr/sleep.h>.  The sleep mode and sleep-enable
+    bits live in the simulated SLPCTRL_CTRLA register, as on the uC; sleep_cpu() passes control to
+    the host simulator, which advances simulated time until an interrupt wakes the core.
+*/
+
+#include <avr/io.h>
+
+
+#define SLEEP_MODE_IDLE         SLPCTRL_SMODE_IDLE_gc
+#define SLEEP_MODE_STANDBY      SLPCTRL_SMODE_STDBY_gc
+#define SLEEP_MODE_PWR_DOWN     SLPCTRL_SMODE_PDOWN_gc
+
+#define set_sleep_mode(mode)    (SLPCTRL_CTRLA = (SLPCTRL_CTRLA & ~SLPCTRL_SMODE_gm) | (mode))
+#define sleep_enable()          (SLPCTRL_CTRLA |= SLPCTRL_SEN_bm)
+#define sleep_disable()         (SLPCTRL_CTRLA &= ~SLPCTRL_SEN_bm)
+#define sleep_cpu()             host_sleep()
+
+void host_sleep();
+
+#endif
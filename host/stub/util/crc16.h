@@ -0,0 +1,38 @@
+#ifndef HOST_STUB_UTIL_CRC16_H_INC
+#define HOST_STUB_UTIL_CRC16_H_INC
+/*
+    crc16.h - host build stand-in for avr-libc's <util/crc16.h>.  Provides the CRC routines used
+    by the firmware, in the portable C forms given in the avr-libc documentation.
+*/
+
+#include <stdint.h>
+
+
+// _crc8_ccitt_update() - CRC-8-CCITT (polynomial 0x07) of <data>, continuing from <crc>.
+//
+static inline uint8_t _crc8_ccitt_update(uint8_t crc, const uint8_t data)
+{
+    uint8_t i;
+
+    crc ^= data;
+    for(i = 0; i < 8; ++i)
+        crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+
+    return crc;
+}
+
+
+// _crc16_update() - CRC-16 (polynomial 0xa001, reflected) of <data>, continuing from <crc>.
+//
+static inline uint16_t _crc16_update(uint16_t crc, const uint8_t data)
+{
+    uint8_t i;
+
+    crc ^= data;
+    for(i = 0; i < 8; ++i)
+        crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : crc >> 1;
+
+    return crc;
+}
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef HOST_STUB_UTIL_DELAY_H_INC
+#define HOST_STUB_UTIL_DELAY_H_INC
+/*
+    delay.h - host build stand-in for avr-libc's <util/delay.h>.  As with avr-libc, the length of
+    each delay is computed in CPU cycles from F_CPU; the host simulator converts the cycles to
+    simulated time at the CPU clock frequency actually in force, so a delay lasts longer when the
+    clock governor has slowed the core, just as it would on the uC.
+*/
+
+#include <stdint.h>
+
+#ifndef F_CPU
+#error "F_CPU must be defined for <util/delay.h>"
+#endif
+
+
+void host_delay_cycles(const uint32_t cycles);
+
+#define _delay_ms(ms)           host_delay_cycles((uint32_t) ((ms) * (F_CPU / 1e3) + 0.999))
+#define _delay_us(us)           host_delay_cycles((uint32_t) ((us) * (F_CPU / 1e6) + 0.999))
+
+#endif
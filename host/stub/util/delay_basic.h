@@ -0,0 +1,24 @@
+#ifndef HOST_STUB_UTIL_DELAY_BASIC_H_INC
+#define HOST_STUB_UTIL_DELAY_BASIC_H_INC
+/*
+    delay_basic.h - host build stand-in for avr-libc's <util/delay_basic.h>.  Each loop lasts as
+    many CPU cycles as its AVR counterpart: three per iteration of _delay_loop_1() and four per
+    iteration of _delay_loop_2(), with a count of zero giving the maximum number of iterations.
+*/
+
+#include <stdint.h>
+
+
+void host_delay_cycles(const uint32_t cycles);
+
+static inline void _delay_loop_1(const uint8_t count)
+{
+    host_delay_cycles(3 * (count ? count : 0x100UL));
+}
+
+static inline void _delay_loop_2(const uint16_t count)
+{
+    host_delay_cycles(4 * (count ? count : 0x10000UL));
+}
+
+#endif
@@ -0,0 +1,108 @@
+/*
+    test_calib.c - host checks of the fixed-point conversion of sensor readings into engineering
+    units (calib.c), and of the thermistor table in therm_table.h
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "check.h"
+#include "calib.h"
+#include "therm_table.h"
+#include <math.h>
+
+
+// Thermistor and divider parameters given in therm_table.h
+#define THERM_R0                (10000.0)   // Thermistor resistance at 25 degC, in ohms
+#define THERM_BETA              (3950.0)    // Thermistor Beta, in K
+#define THERM_R_FIXED           (10000.0)   // Divider's fixed resistor, in ohms
+#define THERM_V_SUPPLY          (3.0)       // Divider supply voltage, in V
+#define THERM_T_MIN             (-40.0)     // Table limits, in degC
+#define THERM_T_MAX             (125.0)
+
+#define FULL_SCALE              (1 << SENSOR_READING_BITS)
+
+
+// beta_temp() - return the temperature, in degC, at which the thermistor divider gives the ADC
+// reading <counts>, clamped to the range of the table.
+//
+static double beta_temp(const unsigned counts)
+{
+    const double v = counts * (CALIB_VREF_MV / 1000.0) / FULL_SCALE;
+    double r, t;
+
+    if(v <= 0.0)
+        return THERM_T_MAX;
+
+    r = THERM_R_FIXED * v / (THERM_V_SUPPLY - v);
+    t = 1.0 / (1.0 / (25.0 + 273.15) + log(r / THERM_R0) / THERM_BETA) - 273.15;
+
+    return fmin(fmax(t, THERM_T_MIN), THERM_T_MAX);
+}
+
+
+// check_linear() - check the battery voltage and light level conversions.
+//
+static void check_linear()
+{
+    CHECK_EQ(calib_vbatt_mv(0), 0);
+    CHECK_EQ(calib_vbatt_mv(FULL_SCALE / 2), CALIB_VREF_MV * CALIB_VBATT_DIV / 2);
+    CHECK_EQ(calib_vbatt_mv(FULL_SCALE - 1),
+             (CALIB_VREF_MV * CALIB_VBATT_DIV * (FULL_SCALE - 1L)) / FULL_SCALE);
+
+    CHECK_EQ(calib_light_lux(0), 0);
+    CHECK_EQ(calib_light_lux(FULL_SCALE / 4), CALIB_LIGHT_FULL_SCALE / 4);
+    CHECK_EQ(calib_light_lux(FULL_SCALE - 1),
+             (CALIB_LIGHT_FULL_SCALE * (FULL_SCALE - 1L)) / FULL_SCALE);
+}
+
+
+// check_therm_table() - check each entry of the thermistor table against the Beta equation.
+//
+static void check_therm_table()
+{
+    const unsigned step = FULL_SCALE >> THERM_TABLE_BITS;
+    unsigned i;
+
+    CHECK_EQ(sizeof(therm_table) / sizeof(therm_table[0]), (1 << THERM_TABLE_BITS) + 1);
+
+    for(i = 0; i <= (1 << THERM_TABLE_BITS); ++i)
+        CHECK(fabs(therm_table[i] - beta_temp(i * step) * 100) <= 1.0);
+}
+
+
+// check_temp() - check that temperature conversion reproduces the table at its knots, interpolates
+// between them, and is monotonic over the whole input range.
+//
+static void check_temp()
+{
+    const unsigned step = FULL_SCALE >> THERM_TABLE_BITS;
+    int16_t prev = calib_temp_centi(0);
+    unsigned i;
+
+    for(i = 0; i < (1 << THERM_TABLE_BITS); ++i)
+        CHECK_EQ(calib_temp_centi(i * step), therm_table[i]);
+
+    CHECK_EQ(calib_temp_centi(16 * step + step / 2), (therm_table[16] + therm_table[17]) / 2);
+
+    for(i = 1; i < FULL_SCALE; ++i)
+    {
+        const int16_t t = calib_temp_centi(i);
+
+        CHECK(t <= prev);
+        prev = t;
+    }
+
+    // Interpolation error is small in the useful range (-5 to 65 degC)
+    for(i = 4 * step; i < 31 * step; ++i)
+        CHECK(fabs(calib_temp_centi(i) - beta_temp(i) * 100) < 50.0);
+}
+
+
+int main()
+{
+    check_linear();
+    check_therm_table();
+    check_temp();
+
+    return check_exit("test_calib");
+}
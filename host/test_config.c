@@ -0,0 +1,198 @@
+/*
+    test_config.c - host checks of configuration command parsing and persistence (config.c)
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "check.h"
+#include "config.h"
+#include "lib/rtc.h"
+#include "sched.h"
+#include "sensors.h"
+#include "xbee/xbee.h"
+#include <string.h>
+
+
+static uint8_t filter_shift[SensorChannel_end] = {2, 4, 3};   // Sensor filter window shifts
+static XBeeRxHandler_t rx_handler;          // Handler registered for receive-packet frames
+static uint8_t *ee_record;                  // Location of config.c's EEPROM record
+static size_t ee_record_len;
+static unsigned ee_writes;                  // Number of calls to eeprom_update_block()
+
+
+//
+// Fakes of the functions called by config.c and sched.c
+//
+
+void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+    ee_record = (uint8_t *) src;
+    ee_record_len = n;
+    memcpy(dst, src, n);
+}
+
+
+void eeprom_update_block(const void *src, void *dst, size_t n)
+{
+    memcpy(dst, src, n);
+    ++ee_writes;
+}
+
+
+uint8_t sensor_get_filter_shift(const SensorChannel_t channel)
+{
+    return filter_shift[channel];
+}
+
+
+uint8_t sensor_filter_shift_valid(const SensorChannel_t channel, const uint8_t shift)
+{
+    return shift <= SENSOR_EMA_SHIFT_MAX;
+}
+
+
+uint8_t sensor_set_filter_shift(const SensorChannel_t channel, const uint8_t shift)
+{
+    filter_shift[channel] = shift;
+    return 1;
+}
+
+
+uint8_t xbee_set_rx_handler(const XBeeFrameType_t type, const XBeeRxHandler_t handler)
+{
+    CHECK_EQ(type, XBeeFrameZigbeeReceivePacket);
+    rx_handler = handler;
+    return 1;
+}
+
+
+void rtc_pit_set_period(const RTCPITPeriod_t period)
+{
+}
+
+
+void sensor_get_readings(SensorReadings_t * const r)
+{
+    memset(r, 0, sizeof(*r));
+}
+
+
+// receive() - pass to the registered handler a receive-packet frame from the 64-bit address <src>
+// carrying the <len> bytes at <data>.
+//
+static void receive(const uint64_t src, const uint8_t * const data, const uint8_t len)
+{
+    XBeePacketBuf_t pkt;
+    XBeeFrameBuilder_t b;
+
+    memset(&pkt, 0, sizeof(pkt));
+    pkt.frame_type = XBeeFrameZigbeeReceivePacket;
+    pkt.len = sizeof(XBeeRXPacketView_t) + len;
+
+    xbee_frame_begin_data(&b, (uint8_t *) pkt.raw, sizeof(pkt.raw));
+    xbee_frame_put_u64_be(&b, src);
+    xbee_frame_put_u16_be(&b, 0x1234);
+    xbee_frame_put_u8(&b, 0);
+    xbee_frame_put_bytes(&b, data, len);
+
+    CHECK(rx_handler != NULL);
+    if(rx_handler)
+        rx_handler(&pkt);
+}
+
+
+// check_rejected() - check that the command of <len> bytes at <data> is not applied or saved.
+//
+static void check_rejected(const uint64_t src, const uint8_t * const data, const uint8_t len)
+{
+    const SchedConfig_t before = *sched_get_config();
+    uint8_t shift_before[SensorChannel_end];
+    const unsigned writes = ee_writes;
+
+    memcpy(shift_before, filter_shift, sizeof(filter_shift));
+    receive(src, data, len);
+
+    CHECK(!memcmp(&before, sched_get_config(), sizeof(before)));
+    CHECK(!memcmp(shift_before, filter_shift, sizeof(filter_shift)));
+    CHECK_EQ(ee_writes, writes);
+}
+
+
+// check_commands() - check that valid commands are applied and saved, and that invalid commands
+// are rejected as a whole.
+//
+static void check_commands()
+{
+    static const uint8_t cmd[] =
+    {
+        CONFIG_CMD_MARKER,
+        ConfigParamHeartbeat, 0x58, 0x02,           // 600s
+        ConfigParamDeadbandTemp, 0x0a, 0x00,
+        ConfigParamFilterShiftLight, 0x05, 0x00
+    };
+    static const uint8_t unknown_param[] = {CONFIG_CMD_MARKER, ConfigParamHeartbeat, 0x58, 0x02,
+                                            0x7f, 0x00, 0x00},
+                         truncated[] = {CONFIG_CMD_MARKER, ConfigParamHeartbeat, 0x58},
+                         out_of_range[] = {CONFIG_CMD_MARKER, ConfigParamStableWakes, 0x00, 0x01},
+                         bad_shift[] = {CONFIG_CMD_MARKER, ConfigParamFilterShiftTemp,
+                                        SENSOR_EMA_SHIFT_MAX + 1, 0x00},
+                         invalid[] = {CONFIG_CMD_MARKER, ConfigParamHeartbeat, 0x01, 0x00},
+                         not_cmd[] = {0x00, ConfigParamHeartbeat, 0x10, 0x00};
+
+    receive(XBEE_ADDR_COORDINATOR, cmd, sizeof(cmd));
+    CHECK_EQ(sched_get_config()->heartbeat, 600);
+    CHECK_EQ(sched_get_config()->deadband.temp, 10);
+    CHECK_EQ(sched_get_config()->min_interval, SCHED_MIN_INTERVAL_S);
+    CHECK_EQ(filter_shift[SensorChannelLight], 5);
+    CHECK_EQ(ee_writes, 1);
+
+    check_rejected(XBEE_ADDR_COORDINATOR, unknown_param, sizeof(unknown_param));
+    check_rejected(XBEE_ADDR_COORDINATOR, truncated, sizeof(truncated));
+    check_rejected(XBEE_ADDR_COORDINATOR, out_of_range, sizeof(out_of_range));
+    check_rejected(XBEE_ADDR_COORDINATOR, bad_shift, sizeof(bad_shift));
+    check_rejected(XBEE_ADDR_COORDINATOR, invalid, sizeof(invalid));
+    check_rejected(XBEE_ADDR_COORDINATOR, not_cmd, sizeof(not_cmd));
+    check_rejected(XBEE_ADDR_COORDINATOR, cmd, 0);
+    check_rejected(0x0013a20012345678ULL, cmd, sizeof(cmd));
+}
+
+
+// check_restore() - check that the saved configuration is restored at boot, and that a corrupt
+// record is ignored.
+//
+static void check_restore()
+{
+    const SchedConfig_t saved = *sched_get_config();
+    SchedConfig_t c = saved;
+
+    c.heartbeat = SCHED_HEARTBEAT_S;
+    sched_set_config(&c);
+    filter_shift[SensorChannelLight] = 4;
+
+    config_init();
+    CHECK(!memcmp(&saved, sched_get_config(), sizeof(saved)));
+    CHECK_EQ(filter_shift[SensorChannelLight], 5);
+
+    sched_set_config(&c);
+    filter_shift[SensorChannelLight] = 4;
+    CHECK(ee_record != NULL);
+    if(ee_record)
+        ee_record[ee_record_len / 2] ^= 0x01;
+
+    config_init();
+    CHECK_EQ(sched_get_config()->heartbeat, SCHED_HEARTBEAT_S);
+    CHECK_EQ(filter_shift[SensorChannelLight], 4);
+}
+
+
+int main()
+{
+    // The EEPROM is blank (all zero) at first, so nothing is restored
+    config_init();
+    CHECK_EQ(sched_get_config()->heartbeat, SCHED_HEARTBEAT_S);
+
+    check_commands();
+    check_restore();
+
+    return check_exit("test_config");
+}
@@ -0,0 +1,262 @@
+/*
+    test_report.c - host checks of sample buffering and the report payload encoder (report.c).
+    Each streamed frame is captured and decoded as described in report.h, and the decoded samples
+    are compared with those which were buffered.
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "check.h"
+#include "report.h"
+#include <string.h>
+
+
+#define SAMPLES_MAX             (4 * REPORT_RING_LEN)
+
+
+static SensorValues_t values;               // Values returned by sensor_get_values()
+static XBeeFrameID_t next_frame_id;         // Value returned by xbee_tx_track_begin()
+static uint8_t del_status;                  // Value returned by xbee_tx_track_wait()
+static unsigned frames_sent;                // Number of calls to xbee_send_stream()
+
+static SensorSample_t added[SAMPLES_MAX];   // Samples added to the buffer, in order
+static unsigned n_added;
+static SensorSample_t decoded[SAMPLES_MAX]; // Samples decoded from delivered frames, in order
+static unsigned n_decoded;
+
+
+//
+// Fakes of the functions called by report.c
+//
+
+void sensor_get_values(SensorValues_t * const v)
+{
+    *v = values;
+}
+
+
+XBeeFrameID_t xbee_tx_track_begin()
+{
+    return next_frame_id;
+}
+
+
+uint8_t xbee_tx_track_wait(const XBeeFrameID_t frame_id)
+{
+    CHECK_EQ(frame_id, next_frame_id);
+    return del_status;
+}
+
+
+// get_varint() - decode the varint at <*p>, advancing <*p> past it.
+//
+static uint16_t get_varint(const uint8_t **p, const uint8_t * const end)
+{
+    uint16_t val = 0;
+    uint8_t shift = 0;
+
+    do
+    {
+        CHECK(*p < end);
+        if(*p == end)
+            break;
+        val |= (uint16_t) (**p & 0x7f) << shift;
+        shift += 7;
+    } while(*(*p)++ & 0x80);
+
+    return val;
+}
+
+
+// unzigzag() - invert report.c's zigzag().
+//
+static uint16_t unzigzag(const uint16_t val)
+{
+    return (val >> 1) ^ -(val & 1);
+}
+
+
+// xbee_send_stream() - fake which pulls the frame from <producer>, checks its header, and decodes
+// its payload.  The decoded samples are recorded only if the frame will be reported delivered.
+//
+XBeeTxnStatus_t xbee_send_stream(const XBeeTxProducer_t producer, const uint8_t data_len)
+{
+    uint8_t frame[XBEE_BUF_LEN];
+    const uint8_t *p = frame + 1 + XBEE_TXRQ_HDR_LEN, *end = frame + data_len;
+    SensorSample_t s, prev;
+    unsigned i, n;
+
+    ++frames_sent;
+    CHECK(data_len <= sizeof(frame));
+    CHECK(data_len <= 1 + XBEE_TXRQ_HDR_LEN + XBEE_TXRQ_DATA_MAX);
+    for(i = 0; i < data_len; ++i)
+        frame[i] = producer();
+
+    CHECK_EQ(frame[0], XBeeFrameZigbeeTXRequest);
+    CHECK_EQ(frame[1], next_frame_id);
+    CHECK_EQ(xbee_get_u64_be(frame + 2), XBEE_ADDR_COORDINATOR);
+    CHECK_EQ(xbee_get_u16_be(frame + 10), XBEE_NET_ADDR_UNKNOWN);
+
+    CHECK_EQ(p[0], REPORT_FORMAT_VERSION);
+    n = p[1];
+    memset(&prev, 0, sizeof(prev));
+    prev.timestamp = p[2] | (p[3] << 8);
+    p += REPORT_HDR_LEN;
+
+    for(i = 0; i < n; ++i)
+    {
+        s.timestamp = prev.timestamp + get_varint(&p, end);
+        s.values.vbatt = prev.values.vbatt + unzigzag(get_varint(&p, end));
+        s.values.light = prev.values.light + unzigzag(get_varint(&p, end));
+        s.values.temp = prev.values.temp + unzigzag(get_varint(&p, end));
+
+        if((del_status == XBeeTXDelStatusSuccess) && (n_decoded < SAMPLES_MAX))
+            decoded[n_decoded++] = s;
+        prev = s;
+    }
+    CHECK(p == end);
+
+    return XBEE_TX_SUCCESS;
+}
+
+
+// add() - add a sample with the given timestamp and values to the buffer, recording it in
+// <added>.  Returns the value returned by report_add_sample().
+//
+static uint8_t add(const uint16_t timestamp, const uint16_t vbatt, const uint16_t light,
+                   const int16_t temp)
+{
+    values.vbatt = vbatt;
+    values.light = light;
+    values.temp = temp;
+
+    added[n_added].timestamp = timestamp;
+    added[n_added++].values = values;
+
+    return report_add_sample(timestamp);
+}
+
+
+// check_decoded() - check that the decoded samples match the added samples, starting at index
+// <first> of <added>.
+//
+static void check_decoded(const unsigned first)
+{
+    unsigned i;
+
+    CHECK_EQ(n_decoded, n_added - first);
+    for(i = 0; (i < n_decoded) && (first + i < n_added); ++i)
+        CHECK(!memcmp(&decoded[i], &added[first + i], sizeof(SensorSample_t)));
+}
+
+
+// reset() - discard the record of added and decoded samples.
+//
+static void reset()
+{
+    n_added = n_decoded = frames_sent = 0;
+    next_frame_id = 1;
+    del_status = XBeeTXDelStatusSuccess;
+}
+
+
+// check_small_deltas() - check a report of slowly-changing readings, which fits in one frame with
+// one byte per field.
+//
+static void check_small_deltas()
+{
+    reset();
+    add(100, 3000, 250, 2150);
+    add(108, 2998, 251, 2150);
+    add(116, 2998, 249, 2163);
+
+    CHECK_EQ(report_pending(), 3);
+    CHECK(report_send(120) & XBEE_TX_SUCCESS);
+    CHECK_EQ(frames_sent, 1);
+    CHECK_EQ(report_pending(), 0);
+    check_decoded(0);
+}
+
+
+// check_full() - check that report_add_sample() signals a full buffer, and that the oldest sample
+// is dropped when a sample is added to a full buffer.
+//
+static void check_full()
+{
+    unsigned i;
+
+    reset();
+    for(i = 0; i < REPORT_RING_LEN - 1; ++i)
+        CHECK(!add(200 + 8 * i, 3000, 100, -500));
+    CHECK(add(200 + 8 * i, 3000, 100, -500));
+    CHECK(add(200 + 8 * ++i, 3001, 99, -501));
+    CHECK_EQ(report_pending(), REPORT_RING_LEN);
+
+    CHECK(report_send(300) & XBEE_TX_SUCCESS);
+    check_decoded(1);
+}
+
+
+// check_large_deltas() - check a report of wildly-changing readings, whose multi-byte varints
+// spread the samples over several frames and exceed the airtime budget of one call.
+//
+static void check_large_deltas()
+{
+    unsigned i;
+
+    reset();
+    for(i = 0; i < REPORT_RING_LEN; ++i)
+        add(0xffe0 + 300 * i, (i & 1) ? 0 : 0xffff, 0x8000 ^ (i << 13),
+            (i & 1) ? -4000 : 12500);
+
+    report_send(0x1000);
+    CHECK(frames_sent > 1);
+    CHECK(report_pending() < REPORT_RING_LEN);
+    while(report_pending() && (frames_sent < 2 * REPORT_RING_LEN))
+        report_send(0x1000);
+
+    CHECK_EQ(report_pending(), 0);
+    check_decoded(0);
+}
+
+
+// check_failure() - check that an undelivered frame is retried, then left buffered, and that
+// further reports are deferred with an increasing delay until a report succeeds.
+//
+static void check_failure()
+{
+    reset();
+    add(1000, 3000, 100, 2000);
+    add(1008, 3000, 100, 2000);
+
+    del_status = XBeeTXDelStatusNetworkAckFailure;
+    CHECK(!(report_send(1010) & XBEE_TX_SUCCESS));
+    CHECK_EQ(frames_sent, 1 + REPORT_TX_RETRIES);
+    CHECK_EQ(report_pending(), 2);
+    CHECK(report_deferred(1010));
+    CHECK(report_deferred(1010 + REPORT_BACKOFF_BASE_S - 1));
+    CHECK(!report_deferred(1010 + REPORT_BACKOFF_BASE_S));
+
+    CHECK(!(report_send(1100) & XBEE_TX_SUCCESS));
+    CHECK(report_deferred(1100 + 2 * REPORT_BACKOFF_BASE_S - 1));
+    CHECK(!report_deferred(1100 + 2 * REPORT_BACKOFF_BASE_S));
+
+    // With no tracking slot available, a frame is assumed to have been delivered
+    del_status = XBeeTXDelStatusSuccess;
+    next_frame_id = 0;
+    CHECK(report_send(1200) & XBEE_TX_SUCCESS);
+    CHECK_EQ(report_pending(), 0);
+    CHECK(!report_deferred(1200));
+    check_decoded(0);
+}
+
+
+int main()
+{
+    check_small_deltas();
+    check_full();
+    check_large_deltas();
+    check_failure();
+
+    return check_exit("test_report");
+}
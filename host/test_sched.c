@@ -0,0 +1,174 @@
+/*
+    test_sched.c - host checks of the reporting scheduler (sched.c)
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "check.h"
+#include "sched.h"
+#include "lib/rtc.h"
+
+
+static RTCPITPeriod_t pit_period;           // Period last passed to rtc_pit_set_period()
+static unsigned pit_writes;                 // Number of calls to rtc_pit_set_period()
+static SensorReadings_t readings;           // Readings returned by sensor_get_readings()
+
+
+//
+// Fakes of the functions called by sched.c
+//
+
+void rtc_pit_set_period(const RTCPITPeriod_t period)
+{
+    pit_period = period;
+    ++pit_writes;
+}
+
+
+void sensor_get_readings(SensorReadings_t * const r)
+{
+    *r = readings;
+}
+
+
+// stable_ticks() - call sched_tick() <n> times, at <now> and successive 8s intervals, with the
+// readings unchanged.  Returns the number of calls which requested a report.
+//
+static unsigned stable_ticks(uint16_t now, const unsigned n)
+{
+    unsigned i, reports = 0;
+
+    for(i = 0; i < n; ++i, now += 8)
+        reports += sched_tick(now) ? 1 : 0;
+
+    return reports;
+}
+
+
+// check_first_report() - check that a report is requested on the first wake after boot.
+//
+static void check_first_report()
+{
+    sched_init();
+    CHECK_EQ(pit_period, RTCPITPeriod8192);
+
+    CHECK(sched_tick(0));
+    CHECK(sched_tick(8));                   // Still no report transmitted
+    sched_reported(8);
+    CHECK(!sched_tick(16));
+}
+
+
+// check_period() - check that the wake period doubles after <stable_wakes> stable wakes, up to the
+// configured maximum, and returns to its shortest value when a reading changes.
+//
+static void check_period()
+{
+    const SchedConfig_t * const c = sched_get_config();
+
+    sched_init();
+    sched_reported(0);
+
+    CHECK_EQ(stable_ticks(8, c->stable_wakes - 1), 0);
+    CHECK_EQ(pit_period, RTCPITPeriod8192);
+    stable_ticks(100, 1);
+    CHECK_EQ(pit_period, RTCPITPeriod16384);
+    stable_ticks(200, c->stable_wakes);
+    CHECK_EQ(pit_period, RTCPITPeriod32768);
+
+    pit_writes = 0;
+    stable_ticks(300, 3 * c->stable_wakes);
+    CHECK_EQ(pit_period, RTCPITPeriod32768);
+    CHECK_EQ(pit_writes, 0);
+
+    readings.light += c->deadband.light + 1;
+    CHECK(sched_tick(400));
+    CHECK_EQ(pit_period, RTCPITPeriod8192);
+    sched_reported(400);
+}
+
+
+// check_triggers() - check the deadbands, the minimum interval and the heartbeat.
+//
+static void check_triggers()
+{
+    const SchedConfig_t * const c = sched_get_config();
+
+    sched_init();
+    sched_reported(1000);
+
+    // Changes within the deadband do not trigger a report
+    readings.vbatt += c->deadband.vbatt;
+    readings.temp -= c->deadband.temp;
+    CHECK(!sched_tick(1000 + c->min_interval));
+
+    // A change outside the deadband triggers a report, but not before the minimum interval
+    readings.temp -= 1;
+    CHECK(!sched_tick(1000 + c->min_interval - 1));
+    CHECK(sched_tick(1000 + c->min_interval));
+    sched_reported(1000 + c->min_interval);
+
+    // The heartbeat triggers a report with the readings unchanged
+    CHECK(!sched_tick(1000 + c->min_interval + c->heartbeat - 1));
+    CHECK(sched_tick(1000 + c->min_interval + c->heartbeat));
+
+    // Time is measured modulo 2^16
+    sched_reported(0xfff0);
+    readings.light += c->deadband.light + 1;
+    CHECK(!sched_tick(0xfff0 + c->min_interval - 1));
+    CHECK(sched_tick(0xfff0 + c->min_interval));
+}
+
+
+// check_config() - check configuration validation, and that a new configuration with a shorter
+// maximum wake period takes effect at once.
+//
+static void check_config()
+{
+    const SchedConfig_t saved = *sched_get_config();
+    SchedConfig_t c = saved;
+
+    CHECK(sched_config_valid(&c));
+    c.stable_wakes = 0;
+    CHECK(!sched_config_valid(&c));
+    c = saved;
+    c.max_period_shift = SCHED_MAX_PERIOD_SHIFT + 1;
+    CHECK(!sched_config_valid(&c));
+    c = saved;
+    c.heartbeat = c.min_interval - 1;
+    CHECK(!sched_config_valid(&c));
+
+    sched_init();
+    sched_reported(0);
+    stable_ticks(8, 2 * saved.stable_wakes);
+    CHECK_EQ(pit_period, RTCPITPeriod32768);
+
+    c = saved;
+    c.max_period_shift = 1;
+    sched_set_config(&c);
+    CHECK_EQ(pit_period, RTCPITPeriod16384);
+    stable_ticks(200, 2 * saved.stable_wakes);
+    CHECK_EQ(pit_period, RTCPITPeriod16384);
+
+    // Raising the maximum does not lengthen the period until the readings have been stable
+    pit_writes = 0;
+    sched_set_config(&saved);
+    CHECK_EQ(pit_writes, 0);
+    stable_ticks(400, saved.stable_wakes);
+    CHECK_EQ(pit_period, RTCPITPeriod32768);
+}
+
+
+int main()
+{
+    readings.vbatt = 800;
+    readings.light = 300;
+    readings.temp = 500;
+
+    check_first_report();
+    check_period();
+    check_triggers();
+    check_config();
+
+    return check_exit("test_sched");
+}
@@ -0,0 +1,150 @@
+/*
+    test_sensors.c - host checks of the sensor module (sensors.c), and the ADC and VREF drivers
+    beneath it, against the simulator
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "check.h"
+#include "sim.h"
+#include "sensors.h"
+#include "lib/clk.h"
+#include "lib/debug.h"
+#include <avr/interrupt.h>
+#include <stdlib.h>
+
+
+#define PORTA           (0)                 // Port index passed to sim_pin_*()
+#define REF_MV          (2500)              // ADC reference voltage selected by sensor_init()
+
+// COUNTS() - macro giving the ADC reading of an input at <mv>
+#define COUNTS(mv)      ((uint16_t) ((mv) * 1024L / REF_MV))
+
+// Signals at the ADC inputs.  The battery divider is always connected; the light and temperature
+// sensors are powered through SENSOR_nENABLE.
+static SimWave_t vbatt = {.type = SimWaveConst, .level = 1500};
+static SimWave_t light = {.type = SimWaveConst, .level = 1000, .gated = 1};
+static SimWave_t temp = {.type = SimWaveConst, .level = 750, .gated = 1};
+
+
+// near() - return non-zero if <a> and <b> differ by no more than <tol>.
+//
+static uint8_t near(const int32_t a, const int32_t b, const int32_t tol)
+{
+    return abs(a - b) <= tol;
+}
+
+
+// set_waves() - apply the signals to the ADC inputs.
+//
+static void set_waves()
+{
+    sim_adc_set_wave(1, &vbatt);                // AIN1: battery voltage
+    sim_adc_set_wave(2, &temp);                 // AIN2: thermistor
+    sim_adc_set_wave(3, &light);                // AIN3: light sensor
+}
+
+
+// check_init() - check sensor_init(): the first readings, the settling of the gated sensors, the
+// ADC clock, and the raising of the clock frequency once the battery voltage is known.
+//
+static void check_init()
+{
+    SensorReadings_t r;
+
+    sim_init();
+    sim_pin_pull(PORTA, 4, 1);                  // External pull-up on SENSOR_nENABLE
+    sim_adc_set_gate(PORTA, 4);
+    set_waves();
+
+    pclk_enable();
+    clk_gov_set_speed(ClkSpeedFast);
+    CHECK(sim_cpu_freq() <= 5000000UL);         // Battery voltage unknown
+
+    sensor_init();
+    debug_init();                               // NOP unless debugging
+    sensor_get_readings(&r);
+
+    CHECK(near(r.vbatt, COUNTS(1500), 1));
+    CHECK(near(r.light, COUNTS(1000), 1));
+    CHECK(near(r.temp, COUNTS(750), 1));
+
+    CHECK_EQ(sim_stats()->adc_conversions, 3);
+    CHECK_EQ(sim_stats()->adc_ungated, 0);
+    CHECK(sim_stats()->adc_settle_min_ps >= SIM_US(50));
+    CHECK(sim_stats()->adc_clk_max <= 125000);
+    CHECK(sim_pin_level(PORTA, 4));             // Sensors powered down again
+
+    // Vbatt = 3.0V: the 10MHz speed grade applies, giving 8MHz from the 16MHz oscillator
+    CHECK_EQ(sim_cpu_freq(), 8000000UL);
+}
+
+
+// check_read() - check that sensor_read() filters new readings, sleeping (rather than polling)
+// while the conversions run, and settles the sensors for long enough at the slow clock speed.
+//
+static void check_read()
+{
+    const uint64_t settle_fast = sim_stats()->adc_settle_min_ps;
+    SensorReadings_t r;
+    unsigned i;
+
+    light.level = 2000;
+    set_waves();
+
+    clk_gov_set_speed(ClkSpeedSlow);
+    sei();
+
+    sensor_read();
+    sensor_get_readings(&r);
+    CHECK(r.light > COUNTS(1000) + 10);         // The filter has moved towards the new level...
+    CHECK(r.light < COUNTS(2000) - 10);         // ... but not reached it
+
+    for(i = 0; i < 200; ++i)
+        sensor_read();
+    sensor_get_readings(&r);
+    CHECK(near(r.light, COUNTS(2000), 2));
+    CHECK(near(r.temp, COUNTS(750), 1));
+
+    CHECK_EQ(sim_stats()->adc_ungated, 0);
+    CHECK(sim_stats()->adc_settle_min_ps >= SIM_US(50));
+    CHECK(sim_stats()->adc_settle_min_ps <= settle_fast + SIM_US(10));
+    CHECK(sim_stats()->adc_clk_max <= 125000);
+    CHECK(sim_stats()->sleeps > 0);
+    CHECK_EQ(sim_stats()->sleep_busy, 0);
+    CHECK(sim_cpu_freq() <= CLK_GOV_SLOW_FREQ);
+
+    cli();
+    clk_gov_set_speed(ClkSpeedFast);
+}
+
+
+// check_low_battery() - check that the clock frequency is reduced once the filtered battery
+// voltage falls below the minimum of the 10MHz speed grade.
+//
+static void check_low_battery()
+{
+    SensorValues_t v;
+    unsigned i;
+
+    vbatt.level = 1200;                         // Vbatt = 2.4V
+    set_waves();
+
+    for(i = 0; i < 20; ++i)
+        sensor_read();
+
+    sensor_get_values(&v);
+    CHECK(near(v.vbatt, 2400, 10));
+    CHECK(sim_cpu_freq() <= 5000000UL);
+    CHECK(sim_stats()->adc_clk_max <= 125000);
+}
+
+
+int main()
+{
+    check_init();
+    check_read();
+    check_low_battery();
+
+    return check_exit("test_sensors");
+}
@@ -0,0 +1,179 @@
+/*
+    test_twi.c - host checks of the TWI master driver (lib/twi.c), against the simulator
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "check.h"
+#include "sim.h"
+#include "lib/clk.h"
+#include "lib/twi.h"
+#include <avr/interrupt.h>
+#include <string.h>
+
+
+#define DEV_ADDR        (0x44)              // Address of the simulated slave
+#define DEV_ADDR_NONE   (0x45)              // Address at which nothing responds
+
+
+static SimTWIDevice_t dev;                  // Simulated slave
+static unsigned callbacks;                  // Number of calls to txn_done()
+
+
+// txn_done() - transaction completion callback.
+//
+static void txn_done(TWITxn_t * const txn)
+{
+    ++callbacks;
+}
+
+
+// setup() - reset the simulator, attach the slave and bring the TWI master up at <speed>.
+//
+static void setup(const TWISpeed_t speed)
+{
+    sim_init();
+    memset(&dev, 0, sizeof(dev));
+    dev.addr = DEV_ADDR;
+    sim_twi_add_device(&dev);
+
+    // The clock governor's hooks persist across sim_init(); twi_set_clock() registers its hook on
+    // the first call only
+    pclk_enable();
+    clk_gov_set_speed(ClkSpeedFast);
+    twi_configure_master(PinsetDefault);
+    CHECK(twi_set_clock(speed));
+    twi_master_enable(1);
+}
+
+
+// check_sync_register_access() - check synchronous register writes and reads, with interrupts
+// disabled (so that the driver polls) and enabled (so that it sleeps until the ISR completes the
+// transaction).
+//
+static void check_sync_register_access()
+{
+    uint8_t i, data;
+
+    for(i = 0; i < 2; ++i)
+    {
+        setup(TWISpeed_100kHz);
+        if(i)
+            sei();
+
+        dev.regs[0x10] = 0x5a;
+        CHECK_EQ(twi_sync_register_write(DEV_ADDR, 0x20, 0xa5), TWICmdSuccess);
+        CHECK_EQ(dev.regs[0x20], 0xa5);
+
+        data = 0;
+        CHECK_EQ(twi_sync_register_read(DEV_ADDR, 0x10, &data), TWICmdSuccess);
+        CHECK_EQ(data, 0x5a);
+
+        // Write: address, register, data.  Read: address, register, address, data.
+        CHECK_EQ(sim_stats()->twi_bytes, 7);
+        CHECK(sim_stats()->twi_scl_max <= 100000);
+        CHECK_EQ(sim_stats()->sleep_busy, 0);
+        CHECK_EQ(sim_stats()->vector_irqs[20] > 0, i);     // TWI0_TWIM_vect
+
+        cli();
+    }
+}
+
+
+// check_nack() - check that a transaction addressed to a missing device fails with a NACK, and
+// that the bus is usable afterwards.
+//
+static void check_nack()
+{
+    uint8_t data;
+
+    setup(TWISpeed_400kHz);
+
+    CHECK_EQ(twi_sync_register_read(DEV_ADDR_NONE, 0x00, &data), TWICmdNack);
+    CHECK_EQ(twi_sync_register_write(DEV_ADDR_NONE, 0x00, 0x00), TWICmdNack);
+    CHECK_EQ(twi_sync_register_write(DEV_ADDR, 0x01, 0x11), TWICmdSuccess);
+    CHECK_EQ(dev.regs[0x01], 0x11);
+    CHECK(sim_stats()->twi_scl_max <= 400000);
+}
+
+
+// check_txn() - check a multi-byte write-then-read transaction, and a queued transaction behind
+// it.
+//
+static void check_txn()
+{
+    static const uint8_t reg = 0x80;
+    static const uint8_t wr[] = {0x40, 1, 2, 3};
+    uint8_t rx[8], i;
+    TWITxn_t t1 = {.dev_addr = DEV_ADDR, .tx_buf = &reg, .tx_len = 1, .rx_buf = rx,
+                   .rx_len = sizeof(rx), .callback = txn_done},
+             t2 = {.dev_addr = DEV_ADDR, .tx_buf = wr, .tx_len = sizeof(wr),
+                   .callback = txn_done};
+
+    setup(TWISpeed_400kHz);
+    sei();
+    callbacks = 0;
+
+    for(i = 0; i < sizeof(rx); ++i)
+        dev.regs[reg + i] = 0xc0 + i;
+
+    CHECK_EQ(twi_txn_submit(&t1), TWICmdSuccess);
+    CHECK_EQ(twi_txn_submit(&t2), TWICmdSuccess);
+    CHECK(twi_txn_busy());
+    CHECK_EQ(twi_txn_wait(&t2), TWICmdSuccess);
+    CHECK_EQ(t1.status, TWICmdSuccess);
+    CHECK_EQ(callbacks, 2);
+    CHECK(!twi_txn_busy());
+
+    for(i = 0; i < sizeof(rx); ++i)
+        CHECK_EQ(rx[i], 0xc0 + i);
+    CHECK_EQ(dev.regs[0x40], 1);
+    CHECK_EQ(dev.regs[0x42], 3);
+
+    // t1: address, register, address, 8 data; t2: address, 4 bytes
+    CHECK_EQ(sim_stats()->twi_bytes, 16);
+    CHECK_EQ(sim_stats()->sleep_busy, 0);
+
+    cli();
+}
+
+
+// check_clk_change() - check that a change of clock speed waits for a transaction in progress to
+// complete, and that the bus speed is maintained at the new clock frequency.
+//
+static void check_clk_change()
+{
+    static const uint8_t wr[] = {0x00, 0xde, 0xad, 0xbe, 0xef};
+    TWITxn_t t = {.dev_addr = DEV_ADDR, .tx_buf = wr, .tx_len = sizeof(wr)};
+    uint16_t baud_fast;
+
+    setup(TWISpeed_100kHz);
+    baud_fast = TWI0_MBAUD;
+    sei();
+
+    CHECK_EQ(twi_txn_submit(&t), TWICmdSuccess);
+    clk_gov_set_speed(ClkSpeedSlow);
+
+    CHECK_EQ(t.status, TWICmdSuccess);
+    CHECK_EQ(dev.regs[2], 0xbe);
+    CHECK(sim_stats()->clk_changes > 0);
+    CHECK_EQ(sim_stats()->clk_change_busy, 0);
+    CHECK(TWI0_MBAUD < baud_fast);
+
+    CHECK_EQ(twi_sync_register_write(DEV_ADDR, 0x10, 0x77), TWICmdSuccess);
+    CHECK_EQ(dev.regs[0x10], 0x77);
+    CHECK(sim_stats()->twi_scl_max <= 100000);
+
+    cli();
+}
+
+
+int main()
+{
+    check_sync_register_access();
+    check_nack();
+    check_txn();
+    check_clk_change();
+
+    return check_exit("test_twi");
+}
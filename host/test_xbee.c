@@ -0,0 +1,227 @@
+/*
+    test_xbee.c - host checks of the XBee driver (xbee/xbee.c), and the SPI and GPIO drivers
+    beneath it, against the simulator and its model of an XBee module (sim/xbeepeer.c)
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "check.h"
+#include "sim.h"
+#include "xbeepeer.h"
+#include "lib/clk.h"
+#include "lib/debug.h"
+#include "lib/gpio.h"
+#include "lib/rtc.h"
+#include "lib/spi.h"
+#include "xbee/xbee.h"
+#include <avr/interrupt.h>
+#include <string.h>
+
+
+static unsigned rx_packets;                 // Number of calls to rx_packet()
+static uint8_t rx_data[16];                 // Data carried by the last receive-packet frame
+static uint8_t rx_data_len;                 // ... its length
+
+
+// rx_packet() - handler for receive-packet frames.
+//
+static void rx_packet(const XBeePacketBuf_t * const pkt)
+{
+    const XBeeRXPacketView_t * const rx = xbee_view_rx_packet(pkt);
+
+    ++rx_packets;
+    if(!rx)
+        return;
+
+    rx_data_len = xbee_view_data_len(pkt, XBeeRXPacketView_t);
+    if(rx_data_len > sizeof(rx_data))
+        rx_data_len = sizeof(rx_data);
+    memcpy(rx_data, rx->data, rx_data_len);
+}
+
+
+// setup() - bring up the simulated uC as main() does, as far as the XBee interface, with the XBee
+// module attached and powered on.  The firmware's state persists between calls to its functions,
+// so this is called once.
+//
+static void setup()
+{
+    sim_init();
+    xbee_peer_init();
+
+    clk_gov_set_speed(ClkSpeedFast);
+    pclk_enable();
+
+    spi0_configure_master(PinsetAlternative, SPIClkDiv4);
+    spi0_set_clk_freq_max(XBEE_SPI_CLK_FREQ_MAX);
+    clk_gov_add_hook(spi0_clk_changed);
+    spi0_port_activate(1);
+    spi0_enable(1);
+
+    rtc_set_clock(RTCClkInt1K);
+    rtc_set_prescaler(RTCPrescalerDiv1);
+    rtc_enable(1);
+
+    debug_init();                           // NOP unless debugging
+    xbee_init();
+    xbee_set_rx_handler(XBeeFrameZigbeeReceivePacket, rx_packet);
+}
+
+
+// check_configure() - check xbee_configure() on a module with factory settings, which must be
+// reset and configured, and then on the configured module, which must be left alone.
+//
+static void check_configure()
+{
+    XBeePeerStats_t st;
+
+    CHECK(xbee_configure());
+    st = *xbee_peer_stats();
+
+    CHECK_EQ(st.resets, 1);                 // xbee_reset() precedes the power-on boot
+    CHECK_EQ(st.nv_writes, 1);
+    CHECK_EQ(st.bad_frames, 0);
+    CHECK_EQ(xbee_peer_param(XBeeATCmdATSM), XBeeSleepModePinSleep);
+    CHECK_EQ(xbee_peer_param(XBeeATCmdATD8), XBeePinCfgAlternateFunction);
+    CHECK_EQ(xbee_peer_param(XBeeATCmdATD9), XBeePinCfgAlternateFunction);
+    CHECK_EQ(sim_stats()->spi_bytes_unselected, 0);
+
+    // The stored digest and the sentinel setting show that the module is configured already
+    CHECK(xbee_configure());
+    CHECK_EQ(xbee_peer_stats()->resets, st.resets);
+    CHECK_EQ(xbee_peer_stats()->nv_writes, st.nv_writes);
+    CHECK_EQ(xbee_peer_stats()->at_cmds, st.at_cmds + 1);
+
+    // A module restored to its factory settings is detected by the sentinel, and reconfigured
+    xbee_peer_factory_reset();
+    xbee_reset();
+    while(xbee_rx_head())
+        xbee_rx_pop();
+    CHECK_EQ(xbee_peer_param(XBeeATCmdATSM), XBeeSleepModeDisabled);
+
+    CHECK(xbee_configure());
+    CHECK_EQ(xbee_peer_stats()->nv_writes, st.nv_writes + 1);
+    CHECK_EQ(xbee_peer_param(XBeeATCmdATSM), XBeeSleepModePinSleep);
+}
+
+
+// check_power_state() - check that the module sleeps and wakes on request, once configured for
+// pin sleep, and that the core sleeps while waiting.
+//
+static void check_power_state()
+{
+    const uint32_t sleeps = sim_stats()->sleeps;
+
+    sei();
+
+    xbee_set_power_state(XBeePowerStateSleep);
+    CHECK_EQ(xbee_wait_power_state(XBeePowerStateSleep), 0);
+    CHECK(!xbee_peer_awake());
+
+    xbee_set_power_state(XBeePowerStateWake);
+    CHECK_EQ(xbee_wait_power_state(XBeePowerStateWake), 0);
+    CHECK(xbee_peer_awake());
+
+    CHECK(sim_stats()->sleeps > sleeps);
+    CHECK_EQ(sim_stats()->sleep_busy, 0);
+
+    cli();
+}
+
+
+// send_txrq() - transmit a tracked transmit request carrying <data>; return the delivery status.
+//
+static uint8_t send_txrq(const char * const data)
+{
+    uint8_t buf[XBEE_BUF_LEN];
+    XBeeFrameBuilder_t b;
+    const XBeeFrameID_t frame_id = xbee_tx_track_begin();
+
+    CHECK(frame_id);
+    xbee_frame_txrq(&b, buf, sizeof(buf), frame_id, XBEE_ADDR_COORDINATOR, XBEE_NET_ADDR_UNKNOWN,
+                    0, 0);
+    xbee_frame_put_bytes(&b, (const uint8_t *) data, strlen(data));
+    CHECK(xbee_send_frame(&b) & XBEE_TX_SUCCESS);
+
+    return xbee_tx_track_wait(frame_id);
+}
+
+
+// check_tx_status() - check the tracking of transmit-status frames: a delayed status, and a
+// status which never arrives.
+//
+static void check_tx_status()
+{
+    const uint8_t *tx;
+    uint16_t len;
+    uint64_t t;
+
+    sei();
+
+    xbee_peer_set_tx_status(50, XBeeTXDelStatusSuccess);
+    CHECK_EQ(send_txrq("hello"), XBeeTXDelStatusSuccess);
+    tx = xbee_peer_last_tx(&len);
+    CHECK_EQ(len, 5);
+    CHECK(!memcmp(tx, "hello", 5));
+
+    xbee_peer_set_tx_status(10, XBeeTXDelStatusMACAckFailure);
+    CHECK_EQ(send_txrq("nack"), XBeeTXDelStatusMACAckFailure);
+
+    // The wait times out; the core sleeps, rather than polling, in the meantime
+    xbee_peer_set_tx_status(-1, 0);
+    t = sim_now();
+    CHECK_EQ(send_txrq("lost"), XBEE_TX_STATUS_PENDING);
+    CHECK(sim_now() - t >= SIM_MS(XBEE_TX_STATUS_TIMEOUT_MS) * 9 / 10);
+    CHECK(sim_stats()->sleep_ps >= SIM_MS(XBEE_TX_STATUS_TIMEOUT_MS) * 9 / 10);
+    CHECK_EQ(xbee_peer_stats()->tx_requests, 3);
+
+    cli();
+}
+
+
+// check_rx() - check the reception and dispatch of frames sent by the module, and the recovery
+// from a frame with an impossible length.
+//
+static void check_rx()
+{
+    static const uint8_t pkt[] = {0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xfe, 0x01, 'h', 'i'};
+    static const uint8_t bad[] = {XBEE_FRAME_DELIMITER, 0x7f, 0xff, 0x90};
+    XBeeTxnStatus_t ret;
+
+    rx_packets = 0;
+    xbee_peer_inject_frame(XBeeFrameZigbeeReceivePacket, pkt, sizeof(pkt));
+    CHECK(xbee_attn());
+    xbee_poll();
+    CHECK_EQ(rx_packets, 1);
+    CHECK_EQ(rx_data_len, 2);
+    CHECK(!memcmp(rx_data, "hi", 2));
+    CHECK(!xbee_attn());
+
+    // A bad length field is reported, and the receiver resynchronises on the next delimiter
+    xbee_peer_inject_raw(bad, sizeof(bad));
+    xbee_peer_inject_frame(XBeeFrameZigbeeReceivePacket, pkt, sizeof(pkt));
+    ret = xbee_spi_transaction(NULL, 0);
+    CHECK(ret & XBEE_RX_BAD_LENGTH);
+    while(xbee_attn())
+        xbee_spi_transaction(NULL, 0);
+    xbee_rx_dispatch();
+    CHECK_EQ(rx_packets, 2);
+    CHECK(!memcmp(rx_data, "hi", 2));
+}
+
+
+int main()
+{
+    setup();
+
+    check_configure();
+    check_power_state();
+    check_tx_status();
+    check_rx();
+
+    CHECK_EQ(sim_stats()->spi_bytes_unselected, 0);
+    CHECK_EQ(xbee_peer_stats()->bytes_asleep, 0);
+    CHECK_EQ(xbee_peer_stats()->bad_frames, 0);
+
+    return check_exit("test_xbee");
+}
@@ -0,0 +1,130 @@
+/*
+    test_xbeeframe.c - host checks of the XBee API frame builder and received-frame views
+    (xbee/xbeeframe.c)
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+*/
+
+#include "check.h"
+#include "xbee/xbee.h"
+#include <string.h>
+
+
+// check_at_frame() - check the wire format of an AT command frame against a known-good frame.
+//
+static void check_at_frame()
+{
+    // ATNI, frame ID 1, no parameter (Digi XBee documentation example)
+    static const uint8_t expected[] = {0x7e, 0x00, 0x04, 0x08, 0x01, 0x4e, 0x49, 0x5f};
+    uint8_t buf[XBEE_FRAME_BUF_LEN];
+    XBeeFrameBuilder_t b;
+
+    xbee_frame_at(&b, buf, sizeof(buf), XBeeFrameATCommand, 1, XBeeATCmdATNI);
+    CHECK_EQ(xbee_frame_end(&b), sizeof(expected));
+    CHECK(!memcmp(buf, expected, sizeof(expected)));
+}
+
+
+// check_txrq_frame() - check the length, header fields and checksum of a transmit-request frame.
+//
+static void check_txrq_frame()
+{
+    static const uint8_t data[] = {0x01, 0x02, 0x03};
+    uint8_t buf[XBEE_FRAME_BUF_LEN], sum = 0;
+    XBeeFrameBuilder_t b;
+    uint8_t len, i;
+
+    xbee_frame_txrq(&b, buf, sizeof(buf), 0x42, 0x0013a20012345678ULL, XBEE_NET_ADDR_UNKNOWN,
+                    0, 0);
+    xbee_frame_put_bytes(&b, data, sizeof(data));
+    len = xbee_frame_end(&b);
+
+    CHECK_EQ(len, XBEE_TXRQ_FRAME_LEN(sizeof(data)));
+    CHECK_EQ(buf[0], XBEE_FRAME_DELIMITER);
+    CHECK_EQ((buf[1] << 8) | buf[2], len - XBEE_FRAME_OVERHEAD);
+    CHECK_EQ(buf[3], XBeeFrameZigbeeTXRequest);
+    CHECK_EQ(buf[4], 0x42);
+    CHECK_EQ(xbee_get_u64_be(buf + 5), 0x0013a20012345678ULL);
+    CHECK_EQ(xbee_get_u16_be(buf + 13), XBEE_NET_ADDR_UNKNOWN);
+    CHECK(!memcmp(buf + 4 + XBEE_TXRQ_HDR_LEN, data, sizeof(data)));
+
+    // The frame type, frame data and checksum sum to 0xff
+    for(i = 3; i < len; ++i)
+        sum += buf[i];
+    CHECK_EQ(sum, 0xff);
+}
+
+
+// check_overflow() - check that a frame which does not fit in its buffer is rejected, and that
+// the checksum byte is held in reserve.
+//
+static void check_overflow()
+{
+    uint8_t buf[XBEE_FRAME_OVERHEAD + 3];
+    XBeeFrameBuilder_t b;
+
+    xbee_frame_begin(&b, buf, sizeof(buf), XBeeFrameATCommand);
+    CHECK_EQ(xbee_frame_space(&b), 2);
+    xbee_frame_put_u16_le(&b, 0x1234);
+    CHECK_EQ(xbee_frame_space(&b), 0);
+    CHECK_EQ(xbee_frame_end(&b), sizeof(buf));
+
+    xbee_frame_begin(&b, buf, sizeof(buf), XBeeFrameATCommand);
+    xbee_frame_put_u16_le(&b, 0x1234);
+    xbee_frame_put_u8(&b, 0x56);
+    CHECK_EQ(xbee_frame_space(&b), 0);
+    CHECK_EQ(xbee_frame_end(&b), 0);
+
+    xbee_frame_begin(&b, buf, XBEE_FRAME_OVERHEAD, XBeeFrameATCommand);
+    CHECK_EQ(xbee_frame_end(&b), 0);
+
+    // Fragments reserve one byte, and carry no header
+    xbee_frame_begin_data(&b, buf, 3);
+    xbee_frame_put_u16_be(&b, 0xabcd);
+    xbee_frame_put_u8(&b, 0xef);
+    CHECK(b.overflow);
+    CHECK_EQ(b.len, 2);
+    CHECK_EQ(buf[0], 0xab);
+}
+
+
+// check_views() - check that received-frame views are returned only for frames of the right type
+// and of sufficient length.
+//
+static void check_views()
+{
+    XBeePacketBuf_t pkt;
+    const XBeeRXPacketView_t *rx;
+
+    memset(&pkt, 0, sizeof(pkt));
+    pkt.frame_type = XBeeFrameZigbeeReceivePacket;
+    pkt.len = sizeof(XBeeRXPacketView_t) + 2;
+    pkt.raw[0] = 0x00;
+    pkt.raw[7] = 0x01;
+    pkt.raw[sizeof(XBeeRXPacketView_t)] = 0xc1;
+
+    rx = xbee_view_rx_packet(&pkt);
+    CHECK(rx != NULL);
+    if(rx)
+    {
+        CHECK_EQ(xbee_get_u64_be(rx->src_addr), 1);
+        CHECK_EQ(rx->data[0], 0xc1);
+        CHECK_EQ(xbee_view_data_len(&pkt, XBeeRXPacketView_t), 2);
+    }
+
+    CHECK(xbee_view_tx_status(&pkt) == NULL);
+
+    pkt.len = sizeof(XBeeRXPacketView_t) - 1;
+    CHECK(xbee_view_rx_packet(&pkt) == NULL);
+}
+
+
+int main()
+{
+    check_at_frame();
+    check_txrq_frame();
+    check_overflow();
+    check_views();
+
+    return check_exit("test_xbeeframe");
+}
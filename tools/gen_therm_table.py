@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""
+    gen_therm_table.py - generate the thermistor calibration table used by
+    ZigbeeSimpleSensorModule/calib.c.
+
+    The thermistor is assumed to form the lower leg of a voltage divider, with a fixed resistor to
+    the sensor supply; the ADC measures the voltage across the thermistor against the 2.5V internal
+    reference.  The table holds the temperature, in units of 0.01 degC, at 2^TABLE_BITS + 1 equally
+    spaced ADC readings spanning the full (10-bit) range.  calib.c interpolates linearly between
+    entries.  Temperatures are given by the Beta equation, or by the Steinhart-Hart equation if
+    its coefficients are supplied.
+
+    Usage: gen_therm_table.py [options] > ../ZigbeeSimpleSensorModule/therm_table.h
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+"""
+
+import argparse
+import math
+
+TABLE_BITS = 5
+ADC_FULL_SCALE = 1024
+KELVIN = 273.15
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    ap.add_argument("--r0", type=float, default=10000.0, help="thermistor resistance at T0, ohms")
+    ap.add_argument("--t0", type=float, default=25.0, help="T0, degC")
+    ap.add_argument("--beta", type=float, default=3950.0, help="thermistor Beta, K")
+    ap.add_argument("--sh", type=float, nargs=3, metavar=("A", "B", "C"),
+                    help="Steinhart-Hart coefficients (overrides --r0, --t0 and --beta)")
+    ap.add_argument("--r-fixed", type=float, default=10000.0, help="fixed resistor, ohms")
+    ap.add_argument("--v-supply", type=float, default=3.0, help="divider supply voltage, V")
+    ap.add_argument("--v-ref", type=float, default=2.5, help="ADC reference voltage, V")
+    ap.add_argument("--t-min", type=float, default=-40.0, help="lowest table temperature, degC")
+    ap.add_argument("--t-max", type=float, default=125.0, help="highest table temperature, degC")
+    args = ap.parse_args()
+
+    def temperature(counts):
+        v = counts * args.v_ref / ADC_FULL_SCALE
+        if v <= 0.0:
+            return args.t_max                           # Thermistor shorted
+        if v >= args.v_supply:
+            return args.t_min                           # Thermistor open
+        r = args.r_fixed * v / (args.v_supply - v)
+        if args.sh:
+            a, b, c = args.sh
+            inv_t = a + b * math.log(r) + c * math.log(r) ** 3
+        else:
+            inv_t = 1.0 / (args.t0 + KELVIN) + math.log(r / args.r0) / args.beta
+        return min(max(1.0 / inv_t - KELVIN, args.t_min), args.t_max)
+
+    step = ADC_FULL_SCALE >> TABLE_BITS
+    table = [round(temperature(i * step) * 100) for i in range((1 << TABLE_BITS) + 1)]
+
+    if args.sh:
+        curve = "Steinhart-Hart A=%g B=%g C=%g" % tuple(args.sh)
+    else:
+        curve = "R0=%g ohm at %g degC, Beta=%g K" % (args.r0, args.t0, args.beta)
+
+    print("#ifndef THERM_TABLE_H_INC")
+    print("#define THERM_TABLE_H_INC")
+    print("/*")
+    print("    therm_table.h - thermistor calibration table.  Generated by tools/gen_therm_table.py;")
+    print("    do not edit.")
+    print("")
+    print("    Thermistor: %s" % curve)
+    print("    Divider: %g ohm to %gV supply; ADC reference %gV" %
+          (args.r_fixed, args.v_supply, args.v_ref))
+    print("*/")
+    print("")
+    print("#include <stdint.h>")
+    print("#include <avr/pgmspace.h>")
+    print("")
+    print("")
+    print("#define THERM_TABLE_BITS        (%d)     "
+          "// Table has (1 << THERM_TABLE_BITS) + 1 entries" % TABLE_BITS)
+    print("")
+    print("// Temperature, in units of 0.01 degC, at ADC readings of 0, 1/%d, 2/%d ... full scale"
+          % (1 << TABLE_BITS, 1 << TABLE_BITS))
+    print("static const int16_t therm_table[] PROGMEM =")
+    print("{")
+    for i in range(0, len(table), 8):
+        row = ", ".join("%6d" % t for t in table[i:i + 8])
+        print("    %s%s" % (row, "," if i + 8 < len(table) else ""))
+    print("};")
+    print("")
+    print("#endif")
+
+
+if __name__ == "__main__":
+    main()
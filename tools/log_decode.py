@@ -0,0 +1,197 @@
+#!/usr/bin/env python3
+"""
+    log_decode.py - decoder for the binary debug log written by the Zigbee Simple Sensor Module
+    (see ZigbeeSimpleSensorModule/lib/debug.h for the record format).
+
+    Usage: log_decode.py [-p PROJECT] [-t] [CAPTURE]
+
+    The table of format strings is built from the sources compiled by the project file PROJECT
+    (default: ZigbeeSimpleSensorModule/ZigbeeSimpleSensorModule.cproj): each call to debug_log()
+    is identified by the DEBUG_LOG_FILE_ID of its file and its line number.  The sources must
+    therefore match those from which the firmware was built.
+
+    CAPTURE (default: standard input) is raw data captured from the debug channel.  Text is passed
+    through unchanged; each log record is expanded using its format string.  With -t, the string
+    table is printed instead.
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+DEBUG_LOG_MARKER = 0xf0
+DEBUG_LOG_ARGS_MAX = 6
+DEBUG_LOG_LINE_BITS = 12
+DEBUG_LOG_ID_DROPPED = 0x0000
+
+DEFAULT_PROJECT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..",
+                               "ZigbeeSimpleSensorModule", "ZigbeeSimpleSensorModule.cproj")
+
+FILE_ID_RE = re.compile(r"^#define\s+DEBUG_LOG_FILE_ID\s+\(?\s*(\d+)\s*\)?", re.M)
+CALL_RE = re.compile(r"\bdebug_log\s*\(")
+STRING_RE = re.compile(r'\s*"((?:[^"\\]|\\.)*)"')
+SPEC_RE = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)(hh|h|l)?([diouxXc%])")
+
+
+class LogError(Exception):
+    pass
+
+
+def project_sources(project):
+    """Return the paths of the C source files compiled by the project file <project>."""
+    base = os.path.dirname(project)
+    with open(project) as f:
+        names = re.findall(r'<Compile Include="([^"]+\.c)"', f.read())
+    return [os.path.join(base, *name.split("\\")) for name in names]
+
+
+def call_strings(src):
+    """Yield (first line, last line, format string) for each debug_log() call in <src>."""
+    for m in CALL_RE.finditer(src):
+        pos, fmt = m.end(), ""
+        s = STRING_RE.match(src, pos)
+        if not s:
+            continue                        # e.g. the macro definition itself
+        while s:                            # Concatenate adjacent string literals
+            fmt += s.group(1)
+            pos = s.end()
+            s = STRING_RE.match(src, pos)
+
+        depth = 1                           # Find the closing parenthesis of the call
+        while depth and pos < len(src):
+            if src[pos] == '"':
+                pos = STRING_RE.match(src, pos).end()
+                continue
+            depth += {"(": 1, ")": -1}.get(src[pos], 0)
+            pos += 1
+
+        first = src.count("\n", 0, m.start()) + 1
+        yield first, src.count("\n", 0, pos) + 1, fmt.encode().decode("unicode_escape")
+
+
+def build_table(project):
+    """Return a dict mapping record IDs to (source location, format string)."""
+    table, file_ids = {}, {}
+
+    for path in project_sources(project):
+        with open(path) as f:
+            src = f.read()
+        calls = list(call_strings(src))
+        if not calls:
+            continue
+
+        m = FILE_ID_RE.search(src)
+        if not m:
+            raise LogError("%s: debug_log() used, but DEBUG_LOG_FILE_ID not defined" % path)
+        file_id = int(m.group(1))
+        if file_id in file_ids:
+            raise LogError("%s: DEBUG_LOG_FILE_ID %d already used by %s"
+                           % (path, file_id, file_ids[file_id]))
+        file_ids[file_id] = path
+
+        for first, last, fmt in calls:
+            if last >= 1 << DEBUG_LOG_LINE_BITS:
+                print("warning: %s:%d: line number too large for a record ID" % (path, first),
+                      file=sys.stderr)
+            # The line number recorded may be that of any line of the call
+            for line in range(first, last + 1):
+                table[(file_id << DEBUG_LOG_LINE_BITS) | line] = \
+                    ("%s:%d" % (os.path.basename(path), first), fmt)
+
+    return table
+
+
+def format_record(fmt, args):
+    """Expand the printf()-style format string <fmt> using the 16-bit values in <args>.  A
+    conversion with the "l" length modifier takes a 32-bit value from two arguments, low word
+    first."""
+    args = list(args)
+
+    def expand(m):
+        flags, length, conv = m.groups()
+        if conv == "%":
+            return "%"
+        if not args or (length == "l" and len(args) < 2):
+            return "<?>"
+        val = args.pop(0)
+        sign = 0x8000
+        if length == "l":
+            val |= args.pop(0) << 16
+            sign = 0x80000000
+        if conv in "di":
+            val -= (val & sign) << 1
+        elif conv == "c":
+            return chr(val & 0xff)
+        elif conv == "u":
+            conv = "d"
+        return ("%" + flags + conv) % val
+
+    return SPEC_RE.sub(expand, fmt)
+
+
+def decode(data, table, out):
+    """Write to <out> the text and expanded log records in the captured data <data>."""
+    pos = 0
+    while pos < len(data):
+        byte = data[pos]
+        pos += 1
+
+        if byte < 0x80:
+            out.write(chr(byte))
+            continue
+        if (byte & 0xf0) != DEBUG_LOG_MARKER or (byte & 0x0f) > DEBUG_LOG_ARGS_MAX:
+            out.write("<%02x>" % byte)      # Line noise, or a corrupt record
+            continue
+
+        nargs = byte & 0x0f
+        end = pos + 2 + 2 * nargs
+        if end > len(data):
+            out.write("<truncated record>\n")
+            break
+        rec_id, *args = (data[i] | (data[i + 1] << 8) for i in range(pos, end, 2))
+        pos = end
+
+        if rec_id == DEBUG_LOG_ID_DROPPED:
+            out.write("W: %d debug log records dropped\n" % args[0] if args else "<?>\n")
+        elif rec_id in table:
+            out.write(format_record(table[rec_id][1], args))
+        else:
+            out.write("<unknown record %d:%d %s>\n"
+                      % (rec_id >> DEBUG_LOG_LINE_BITS, rec_id & ((1 << DEBUG_LOG_LINE_BITS) - 1),
+                         " ".join("%04x" % a for a in args)))
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description="Decode the sensor module's binary debug log.")
+    parser.add_argument("-p", "--project", default=DEFAULT_PROJECT, help="project file")
+    parser.add_argument("-t", "--table", action="store_true", help="print the string table")
+    parser.add_argument("capture", nargs="?", help="captured debug channel data")
+    args = parser.parse_args(argv)
+
+    try:
+        table = build_table(args.project)
+    except (LogError, OSError) as e:
+        print("error: %s" % e, file=sys.stderr)
+        return 1
+
+    if args.table:
+        for rec_id, (loc, fmt) in sorted(table.items()):
+            if loc.endswith(":%d" % (rec_id & ((1 << DEBUG_LOG_LINE_BITS) - 1))):
+                print("%04x %-16s %r" % (rec_id, loc, fmt))
+        return 0
+
+    if args.capture:
+        with open(args.capture, "rb") as f:
+            data = f.read()
+    else:
+        data = sys.stdin.buffer.read()
+
+    decode(data, table, sys.stdout)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""
+    report_decode.py - reference decoder for the report payloads transmitted by the Zigbee Simple
+    Sensor Module (see ZigbeeSimpleSensorModule/report.h for the format).
+
+    Usage: report_decode.py [HEX_PAYLOAD ...]
+
+    Each argument (or, if there are none, each line of standard input) is the RF data of one
+    received report frame, in hex.  One line is printed per sample:
+
+        <timestamp> vbatt=<mV> light=<lux> temp=<degC>
+
+    Stuart Wallace <stuartw@atom.net>, October 2018.
+"""
+
+import sys
+
+REPORT_FORMAT_VERSION = 3
+
+
+class ReportError(Exception):
+    pass
+
+
+def read_varint(data, pos):
+    """Decode the varint at data[pos]; return (value, position of the following byte)."""
+    val = shift = 0
+    while True:
+        if pos >= len(data):
+            raise ReportError("truncated varint")
+        byte = data[pos]
+        pos += 1
+        val |= (byte & 0x7f) << shift
+        shift += 7
+        if not byte & 0x80:
+            return val, pos
+
+
+def unzigzag(val):
+    """Invert the zigzag mapping: 0 -> 0, 1 -> -1, 2 -> 1, 3 -> -2, etc."""
+    return (val >> 1) ^ -(val & 1)
+
+
+def decode_report(data):
+    """Decode one report payload; return a list of (timestamp, vbatt_mv, light_lux, temp_degc)
+    tuples."""
+    if len(data) < 4:
+        raise ReportError("payload too short")
+    if data[0] != REPORT_FORMAT_VERSION:
+        raise ReportError("unsupported format version %d" % data[0])
+
+    count = data[1]
+    timestamp = data[2] | (data[3] << 8)
+    readings = [0, 0, 0]
+    samples = []
+    pos = 4
+
+    for _ in range(count):
+        delta_t, pos = read_varint(data, pos)
+        timestamp = (timestamp + delta_t) & 0xffff
+        for ch in range(3):
+            delta, pos = read_varint(data, pos)
+            readings[ch] = (readings[ch] + unzigzag(delta)) & 0xffff
+        temp = readings[2] - 0x10000 if readings[2] & 0x8000 else readings[2]
+        samples.append((timestamp, readings[0], readings[1], temp / 100.0))
+
+    if pos != len(data):
+        raise ReportError("%d trailing bytes" % (len(data) - pos))
+
+    return samples
+
+
+def main(args):
+    status = 0
+    for line in args or (l.strip() for l in sys.stdin):
+        if not line:
+            continue
+        try:
+            for timestamp, vbatt, light, temp in decode_report(bytes.fromhex(line)):
+                print("%5d vbatt=%d light=%d temp=%.2f" % (timestamp, vbatt, light, temp))
+        except (ReportError, ValueError) as e:
+            print("error: %s" % e, file=sys.stderr)
+            status = 1
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))